@@ -25,6 +25,7 @@
 #include <libs/config/config-voicestreams.h>
 #include <libs/config/config-aprsobjs.h>
 #include <libs/comm/comm.h>
+#include <libs/comm/replaybench.h>
 #include <libs/remotedb/remotedb.h>
 #include <libs/coding/coding.h>
 #include <libs/voicestreams/voicestreams.h>
@@ -32,34 +33,56 @@
 
 #include <stdio.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <errno.h>
+#include <limits.h>
 
 static char *dmrshark_configfilename = CONFIGFILENAME;
 static flag_t dmrshark_daemonize = 1;
 static flag_t dmrshark_consoleclient = 0;
 static char *dmrshark_directory = NULL;
+static char *dmrshark_replaybench_filename = NULL;
+static unsigned int dmrshark_replaybench_loops = 1;
+static char *dmrshark_replaybench_events_filename = NULL;
+
+static struct option dmrshark_longopts[] = {
+	{ "replay-bench", required_argument, NULL, 'b' },
+	{ "loops", required_argument, NULL, 'l' },
+	{ "replay-events", required_argument, NULL, 'e' },
+	{ NULL, 0, NULL, 0 }
+};
 
 static void dmrshark_printversion(void) {
 	console_log(APPNAME " by ha2non v%u.%u.%u ", VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH);
 	console_log(__TIME__ " " __DATE__ "\n");
 }
 
+static void dmrshark_printusage(void) {
+	dmrshark_printversion();
+	console_log("usage:\n");
+	console_log("       -h         - this help\n");
+	console_log("       -v         - version\n");
+	console_log("       -f         - run in foreground\n");
+	console_log("       -c [file]  - use given config file\n");
+	console_log("       -r         - connect console to background process (implies -f)\n");
+	console_log("       -d [dir]   - change current directory on startup\n");
+	console_log("       --replay-bench [file] - process given pcap file as fast as possible and print statistics\n");
+	console_log("       --loops [n]           - process the replay bench file n times\n");
+	console_log("       --replay-events [file] - write decoded events of the replay bench to given file\n");
+}
+
 static void dmrshark_processcommandline(int argc, char **argv) {
 	int c;
+	long loops;
+	char *endptr;
 
-	while ((c = getopt(argc, argv, "hvfd:s:rc:i")) != -1) {
+	while ((c = getopt_long(argc, argv, "hvfd:s:rc:i", dmrshark_longopts, NULL)) != -1) {
 		switch (c) {
 			case '?': // Unknown option
 			case 'h':
-				dmrshark_printversion();
-				console_log("usage:\n");
-				console_log("       -h         - this help\n");
-				console_log("       -v         - version\n");
-				console_log("       -f         - run in foreground\n");
-				console_log("       -c [file]  - use given config file\n");
-				console_log("       -r         - connect console to background process (implies -f)\n");
-				console_log("       -d [dir]   - change current directory on startup\n");
+				dmrshark_printusage();
 				exit(0);
 			case 'v':
 				dmrshark_printversion();
@@ -77,12 +100,56 @@ static void dmrshark_processcommandline(int argc, char **argv) {
 			case 'd':
 				dmrshark_directory = optarg;
 				break;
+			case 'b':
+				dmrshark_replaybench_filename = optarg;
+				break;
+			case 'l':
+				errno = 0;
+				loops = strtol(optarg, &endptr, 10);
+				if (*optarg == 0 || *endptr != 0 || errno != 0 || loops <= 0 || loops > UINT_MAX) {
+					console_log("invalid loop count: %s\n", optarg);
+					dmrshark_printusage();
+					exit(1);
+				}
+				dmrshark_replaybench_loops = loops;
+				break;
+			case 'e':
+				dmrshark_replaybench_events_filename = optarg;
+				break;
 			default:
 				exit(1);
 		}
 	}
 }
 
+// Runs the replay benchmark in the foreground without the daemon, the capture device,
+// network TX and the remote db connection.
+static int dmrshark_replaybench(void) {
+	loglevel_t loglevel = { .raw = 0 };
+	flag_t result = 0;
+
+	config_init(dmrshark_configfilename);
+	// Only the benchmark results should be printed.
+	console_set_loglevel(&loglevel);
+	config_voicestreams_init();
+	config_aprsobjs_init();
+	base_init();
+	remotedb_init_dryrun();
+	coding_init();
+	voicestreams_init();
+
+	if (replaybench_set_events_file(dmrshark_replaybench_events_filename)) {
+		result = replaybench_run(dmrshark_replaybench_filename, dmrshark_replaybench_loops);
+		replaybench_set_events_file(NULL);
+	}
+
+	voicestreams_deinit();
+	base_deinit();
+	config_deinit();
+
+	return (result ? 0 : 1);
+}
+
 int main(int argc, char *argv[]) {
 	dmrshark_processcommandline(argc, argv);
 
@@ -90,6 +157,9 @@ int main(int argc, char *argv[]) {
 	if (!daemon_changecwd(dmrshark_directory))
 		return 1;
 
+	if (dmrshark_replaybench_filename != NULL)
+		return dmrshark_replaybench();
+
 	config_init(dmrshark_configfilename);
 	switch (daemon_init(dmrshark_daemonize, dmrshark_consoleclient)) {
 		case DAEMON_INIT_RESULT_FORKED_PARENTEXIT:
@@ -122,6 +192,7 @@ int main(int argc, char *argv[]) {
 		if (!daemon_is_consoleclient()) {
 			base_process();
 			comm_process();
+			voicestreams_process();
 		}
 	}
 
@@ -25,6 +25,7 @@
 #include "smsackbuf.h"
 
 #include <libs/daemon/console.h>
+#include <libs/daemon/daemon-latency.h>
 
 #include <stdio.h>
 #include <string.h>
@@ -103,6 +104,7 @@ void base_process(void) {
 	smsrtbuf_process();
 	smstxbuf_process();
 	data_packet_txbuf_process();
+	daemon_latency_mark(DAEMON_LATENCY_STAGE_BASE);
 }
 
 void base_init(void) {
@@ -28,6 +28,8 @@
 #include "data-packet-txbuf.h"
 
 #include <libs/daemon/console.h>
+#include <libs/daemon/daemon-poll.h>
+#include <libs/daemon/daemon-latency.h>
 #include <libs/config/config.h>
 #include <libs/comm/snmp.h>
 #include <libs/comm/repeaters.h>
@@ -36,7 +38,10 @@
 #include <libs/remotedb/callsignbookdb.h>
 #include <libs/comm/comm.h>
 #include <libs/voicestreams/voicestreams.h>
+#include <libs/voicestreams/voicestreams-governor.h>
+#include <libs/voicestreams/voicestreams-mp3.h>
 #include <libs/comm/httpserver.h>
+#include <libs/comm/pcapreplay.h>
 #include <libs/aprs/aprs.h>
 
 #include <string.h>
@@ -77,6 +82,11 @@ void command_process(char *input_buffer) {
 			char *repeater_callsign;
 			dmr_data_gpspos_t gpspos;
 		} aprspos;
+		struct {
+			char *filename;
+			double speed;
+			unsigned int loops;
+		} pcap;
 	} d;
 	char *endptr = NULL;
 	char *tok = strtok(input_buffer, " ");
@@ -96,8 +106,14 @@ void command_process(char *input_buffer) {
 		console_log("  streamlist                                                       - list voice streams\n");
 		console_log("  remotedbmaintain                                                 - start db maintenance\n");
 		console_log("  remotedbreplistmaintain                                          - start repeater list db maintenance\n");
-		console_log("  loadpcap [pcapfile]                                              - reads and processes packets from pcap file\n");
+		console_log("  loadpcap [pcapfile] (speed) (loops)                              - replays packets from pcap file (speed: max, 1x, 10x..., loops: 0 - forever)\n");
+		console_log("  pcapspeed [speed]                                                - set pcap replay speed (max, 1x, 10x...)\n");
+		console_log("  pcaplist                                                         - list replayed pcap files\n");
+		console_log("  pcapstop                                                         - stop replaying pcap files\n");
 		console_log("  httplist                                                         - list http clients\n");
+		console_log("  loopstat                                                         - print main loop cpu usage and wakeups per second\n");
+		console_log("  latency (reset)                                                  - print/reset main loop latency histograms\n");
+		console_log("  loadgovernor                                                     - print load governor state and transitions\n");
 		console_log("  streamenable [name]                                              - enable stream\n");
 		console_log("  streamdisable [name]                                             - disable stream\n");
 		console_log("  streamrecstart [name]                                            - enable saving raw AMBE data to file\n");
@@ -106,6 +122,8 @@ void command_process(char *input_buffer) {
 		console_log("  streamdecrecstop [name]                                          - disable saving raw decoded data to file\n");
 		console_log("  streammp3recstart [name]                                         - enable saving mp3 data to file\n");
 		console_log("  streammp3recstop [name]                                          - disable saving mp3 data to file\n");
+		console_log("  streammp3measurestart [name]                                     - start measuring mp3 encoder cpu usage and latency\n");
+		console_log("  streammp3measurestop [name]                                      - stop measuring and print the results\n");
 		console_log("  play [file] [host/rptr callsign] [ts] [calltype (p/g)] [dstid]   - play raw AMBE file to given repeater host\n");
 		console_log("  smstxlist                                                        - print the contents of the sms tx buffer\n");
 		console_log("  smsrtlist                                                        - print the contents of the sms retransmit buffer\n");
@@ -233,7 +251,51 @@ void command_process(char *input_buffer) {
 			log_cmdmissingparam();
 			return;
 		}
-		comm_pcapfile_open(tok);
+		d.pcap.filename = tok;
+		tok = strtok(NULL, " ");
+		if (tok != NULL) {
+			if (!pcapreplay_parse_speed(tok, &d.pcap.speed)) {
+				console_log("invalid speed: %s\n", tok);
+				return;
+			}
+			pcapreplay_set_speed(d.pcap.speed);
+		}
+		d.pcap.loops = 1;
+		tok = strtok(NULL, " ");
+		if (tok != NULL) {
+			errno = 0;
+			d.pcap.loops = strtol(tok, &endptr, 10);
+			if (*endptr != 0 || errno != 0) {
+				console_log("invalid loop count: %s\n", tok);
+				return;
+			}
+		}
+		pcapreplay_add(d.pcap.filename, d.pcap.loops);
+		return;
+	}
+
+	if (strcmp(tok, "pcapspeed") == 0) {
+		tok = strtok(NULL, " ");
+		if (tok == NULL) {
+			log_cmdmissingparam();
+			return;
+		}
+		if (!pcapreplay_parse_speed(tok, &d.pcap.speed)) {
+			console_log("invalid speed: %s\n", tok);
+			return;
+		}
+		pcapreplay_set_speed(d.pcap.speed);
+		pcapreplay_print();
+		return;
+	}
+
+	if (strcmp(tok, "pcaplist") == 0) {
+		pcapreplay_print();
+		return;
+	}
+
+	if (strcmp(tok, "pcapstop") == 0) {
+		pcapreplay_stop();
 		return;
 	}
 
@@ -242,6 +304,26 @@ void command_process(char *input_buffer) {
 		return;
 	}
 
+	if (strcmp(tok, "loopstat") == 0) {
+		daemon_poll_print_stats();
+		return;
+	}
+
+	if (strcmp(tok, "latency") == 0) {
+		tok = strtok(NULL, " ");
+		if (tok != NULL && strcmp(tok, "reset") == 0) {
+			daemon_latency_reset();
+			console_log("latency histograms reset\n");
+		} else
+			daemon_latency_print();
+		return;
+	}
+
+	if (strcmp(tok, "loadgovernor") == 0) {
+		voicestreams_governor_print();
+		return;
+	}
+
 	if (strcmp(tok, "streamenable") == 0) {
 		tok = strtok(NULL, " ");
 		if (tok == NULL) {
@@ -370,6 +452,41 @@ void command_process(char *input_buffer) {
 		return;
 	}
 
+#ifdef MP3ENCODEVOICE
+	if (strcmp(tok, "streammp3measurestart") == 0) {
+		tok = strtok(NULL, " ");
+		if (tok == NULL) {
+			log_cmdmissingparam();
+			return;
+		}
+		d.stream.voicestream = voicestreams_get_stream_by_name(tok);
+		if (d.stream.voicestream == NULL) {
+			console_log("voicestream %s not found\n", tok);
+			return;
+		}
+		voicestreams_mp3_set_measuring(d.stream.voicestream, 1);
+		console_log("voicestream [%s]: mp3 encoder measurement started\n", tok);
+		return;
+	}
+
+	if (strcmp(tok, "streammp3measurestop") == 0) {
+		tok = strtok(NULL, " ");
+		if (tok == NULL) {
+			log_cmdmissingparam();
+			return;
+		}
+		d.stream.voicestream = voicestreams_get_stream_by_name(tok);
+		if (d.stream.voicestream == NULL) {
+			console_log("voicestream %s not found\n", tok);
+			return;
+		}
+		voicestreams_mp3_set_measuring(d.stream.voicestream, 0);
+		console_log("voicestream [%s]: mp3 encoder measurement stopped\n", tok);
+		voicestreams_mp3_print_measurement(d.stream.voicestream);
+		return;
+	}
+#endif
+
 	if (strcmp(tok, "play") == 0) {
 		d.play.filename = strtok(NULL, " ");
 		if (d.play.filename == NULL) {
@@ -18,6 +18,7 @@
 
 
 #include "data-packet-txbuf.h"
+#include "virtclock.h"
 
 #include <libs/daemon/console.h>
 #include <libs/daemon/daemon-poll.h>
@@ -74,7 +75,7 @@ void data_packet_txbuf_add(flag_t broadcast_to_all_repeaters, repeater_t *repeat
 	}
 
 	memcpy(&new_data_packet_txbuf_entry->data_packet, data_packet, sizeof(dmrpacket_data_packet_t));
-	new_data_packet_txbuf_entry->added_at = time(NULL);
+	new_data_packet_txbuf_entry->added_at = virtclock_time();
 	new_data_packet_txbuf_entry->broadcast_to_all_repeaters = broadcast_to_all_repeaters;
 	new_data_packet_txbuf_entry->repeater = repeater;
 	new_data_packet_txbuf_entry->ts = ts;
@@ -121,7 +122,7 @@ data_packet_txbuf_t *data_packet_txbuf_get_first_entry(void) {
 }
 
 void data_packet_txbuf_reset_last_send_try_time(void) {
-	data_packet_txbuf_last_send_try_at = time(NULL);
+	data_packet_txbuf_last_send_try_at = virtclock_time();
 }
 
 void data_packet_txbuf_process(void) {
@@ -134,8 +135,8 @@ void data_packet_txbuf_process(void) {
 		return;
 
 	timeout = config_get_mindatapacketsendretryintervalinsec()+ceil(dmrpacket_data_get_time_in_ms_needed_to_send(&data_packet_txbuf_first_entry->data_packet)/1000.0);
-	if (time(NULL)-data_packet_txbuf_last_send_try_at < timeout) {
-		daemon_poll_setmaxtimeout(timeout-(time(NULL)-data_packet_txbuf_last_send_try_at));
+	if (virtclock_time()-data_packet_txbuf_last_send_try_at < timeout) {
+		daemon_poll_setmaxtimeout((timeout-(virtclock_time()-data_packet_txbuf_last_send_try_at))*1000);
 		return;
 	}
 
@@ -212,25 +212,34 @@ void dmr_data_send_sms(flag_t broadcast_to_all_repeaters, repeater_t *repeater,
 	data_packet_txbuf_add(broadcast_to_all_repeaters, repeater, ts, &data_packet);
 }
 
-void dmr_data_send_sms_rms_volume_if_needed(repeater_t *repeater, dmr_timeslot_t ts) {
-	char msg[100];
-	int8_t avg_rms_vol = VOICESTREAMS_INVALID_RMS_VALUE;
-	uint8_t delay;
-
+// Returns 1 if the current call on the given timeslot is an echo service request, which is replied with an RMS volume SMS.
+flag_t dmr_data_is_sms_rms_volume_needed(repeater_t *repeater, dmr_timeslot_t ts) {
 	// No RMS volume SMS for echo service replies.
 	if (repeater->slot[ts].src_id == DMRSHARK_DEFAULT_DMR_ID || repeater->slot[ts].src_id == 9990)
-		return;
+		return 0;
 
 	// Only sending RMS volume after echo service requests.
 	if (repeater->slot[ts].dst_id != DMRSHARK_DEFAULT_DMR_ID && repeater->slot[ts].dst_id != 9990)
-		return;
+		return 0;
 
 	// DMRPlus echo service is only active on TS2.
 	if (repeater->slot[ts].dst_id == 9990 && ts != 1)
+		return 0;
+
+	return 1;
+}
+
+void dmr_data_send_sms_rms_volume_if_needed(repeater_t *repeater, dmr_timeslot_t ts) {
+	char msg[100];
+	int8_t rms_vol = VOICESTREAMS_INVALID_RMS_VALUE;
+	int8_t avg_rms_vol = VOICESTREAMS_INVALID_RMS_VALUE;
+	uint8_t delay;
+
+	if (!dmr_data_is_sms_rms_volume_needed(repeater, ts))
 		return;
 
 	if (repeater->slot[ts].voicestream != NULL)
-		avg_rms_vol = repeater->slot[ts].voicestream->avg_rms_vol;
+		voicestreams_get_rms_vol(repeater->slot[ts].voicestream, repeater, &rms_vol, &avg_rms_vol);
 
 	if (repeater->slot[ts].avg_rssi != 0 && avg_rms_vol != VOICESTREAMS_INVALID_RMS_VALUE)
 		snprintf(msg, sizeof(msg), "Avg. RMS vol.: %ddB, avg. RSSI %ddB * dmrshark by HA2NON", avg_rms_vol, repeater->slot[ts].avg_rssi);
@@ -23,6 +23,7 @@
 #include "data-packet-txbuf.h"
 #include "dmr-data.h"
 #include "smsackbuf.h"
+#include "virtclock.h"
 
 #include <libs/daemon/console.h>
 #include <libs/remotedb/remotedb.h>
@@ -38,6 +39,7 @@
 #include <libs/coding/trellis.h>
 #include <libs/base/base.h>
 #include <libs/comm/comm.h>
+#include <libs/comm/replaybench.h>
 #include <libs/aprs/aprs.h>
 
 #include <stdlib.h>
@@ -46,6 +48,15 @@
 #include <errno.h>
 #include <stdio.h>
 
+static void dmr_handle_lc_event(struct ip *ip_packet, ipscpacket_t *ipscpacket, char *lc_name, dmrpacket_lc_t *lc) {
+	if (lc == NULL)
+		replaybench_event("[%s] ts%u %s: decode failed", comm_get_ip_str(&ip_packet->ip_src), ipscpacket->timeslot, lc_name);
+	else {
+		replaybench_event("[%s] ts%u %s: %s call src %u dst %u", comm_get_ip_str(&ip_packet->ip_src), ipscpacket->timeslot, lc_name,
+			dmr_get_readable_call_type(lc->call_type), lc->src_id, lc->dst_id);
+	}
+}
+
 void dmr_handle_voice_call_end(struct ip *ip_packet, ipscpacket_t *ipscpacket, repeater_t *repeater) {
 	if (ip_packet == NULL || ipscpacket == NULL || repeater == NULL)
 		return;
@@ -59,8 +70,10 @@ void dmr_handle_voice_call_end(struct ip *ip_packet, ipscpacket_t *ipscpacket, r
 	console_log(LOGLEVEL_DMR "->%s]: %s call end on ts %u src %u dst %u\n",
 		repeaters_get_display_string_for_ip(&ip_packet->ip_dst), dmr_get_readable_call_type(repeater->slot[ipscpacket->timeslot-1].call_type),
 		ipscpacket->timeslot, repeater->slot[ipscpacket->timeslot-1].src_id, repeater->slot[ipscpacket->timeslot-1].dst_id);
+	replaybench_event("[%s] ts%u %s call end src %u dst %u", comm_get_ip_str(&repeater->ipaddr), ipscpacket->timeslot,
+		dmr_get_readable_call_type(repeater->slot[ipscpacket->timeslot-1].call_type), repeater->slot[ipscpacket->timeslot-1].src_id, repeater->slot[ipscpacket->timeslot-1].dst_id);
 	repeaters_state_change(repeater, ipscpacket->timeslot-1, REPEATER_SLOT_STATE_IDLE);
-	repeater->slot[ipscpacket->timeslot-1].call_ended_at = time(NULL);
+	repeater->slot[ipscpacket->timeslot-1].call_ended_at = virtclock_time();
 
 	remotedb_update(repeater);
 	remotedb_update_stats_callend(repeater, ipscpacket->timeslot-1);
@@ -68,7 +81,9 @@ void dmr_handle_voice_call_end(struct ip *ip_packet, ipscpacket_t *ipscpacket, r
 	if (repeater->slot[ipscpacket->timeslot-1].echo_buf_first_entry != NULL)
 		repeaters_play_and_free_echo_buf(repeater, ipscpacket->timeslot-1);
 
-	dmr_data_send_sms_rms_volume_if_needed(repeater, ipscpacket->timeslot-1);
+	// If the stream's voice worker is still calculating the call's RMS volume, the SMS is sent when it passes back the result.
+	if (!voicestreams_is_rms_vol_pending(repeater->slot[ipscpacket->timeslot-1].voicestream, repeater))
+		dmr_data_send_sms_rms_volume_if_needed(repeater, ipscpacket->timeslot-1);
 }
 
 void dmr_handle_voice_call_start(struct ip *ip_packet, ipscpacket_t *ipscpacket, repeater_t *repeater) {
@@ -81,8 +96,10 @@ void dmr_handle_voice_call_start(struct ip *ip_packet, ipscpacket_t *ipscpacket,
 	console_log(LOGLEVEL_DMR "dmr [%s", repeaters_get_display_string_for_ip(&ip_packet->ip_src));
 	console_log(LOGLEVEL_DMR "->%s]: %s call start on ts %u src %u dst %u\n",
 		repeaters_get_display_string_for_ip(&ip_packet->ip_dst), dmr_get_readable_call_type(ipscpacket->call_type), ipscpacket->timeslot, ipscpacket->src_id, ipscpacket->dst_id);
+	replaybench_event("[%s] ts%u %s call start src %u dst %u", comm_get_ip_str(&repeater->ipaddr), ipscpacket->timeslot,
+		dmr_get_readable_call_type(ipscpacket->call_type), ipscpacket->src_id, ipscpacket->dst_id);
 	repeaters_state_change(repeater, ipscpacket->timeslot-1, REPEATER_SLOT_STATE_VOICE_CALL_RUNNING);
-	repeater->slot[ipscpacket->timeslot-1].call_started_at = time(NULL);
+	repeater->slot[ipscpacket->timeslot-1].call_started_at = virtclock_time();
 	repeater->slot[ipscpacket->timeslot-1].call_ended_at = 0;
 	repeater->slot[ipscpacket->timeslot-1].call_type = ipscpacket->call_type;
 	repeater->slot[ipscpacket->timeslot-1].dst_id = ipscpacket->dst_id;
@@ -92,7 +109,7 @@ void dmr_handle_voice_call_start(struct ip *ip_packet, ipscpacket_t *ipscpacket,
 	if (repeater->auto_rssi_update_enabled_at == 0 && !repeater->snmpignored) {
 		console_log(LOGLEVEL_SNMP "snmp [%s", repeaters_get_display_string_for_ip(&ip_packet->ip_src));
 		console_log(LOGLEVEL_SNMP "->%s]: starting auto repeater status update\n", repeaters_get_display_string_for_ip(&ip_packet->ip_dst));
-		repeater->auto_rssi_update_enabled_at = time(NULL)+1; // +1 - lets add a little delay to let the repeater read the correct RSSI.
+		repeater->auto_rssi_update_enabled_at = virtclock_time()+1; // +1 - lets add a little delay to let the repeater read the correct RSSI.
 	}
 
 	voicestreams_process_call_start(repeater->slot[ipscpacket->timeslot-1].voicestream, repeater);
@@ -109,8 +126,9 @@ void dmr_handle_voice_call_timeout(repeater_t *repeater, dmr_timeslot_t ts) {
 
 	voicestreams_process_call_end(repeater->slot[ts].voicestream, repeater);
 	console_log(LOGLEVEL_DMR "dmr [%s]: call timeout on ts%u\n", repeaters_get_display_string_for_ip(&repeater->ipaddr), ts+1);
+	replaybench_event("[%s] ts%u call timeout", comm_get_ip_str(&repeater->ipaddr), ts+1);
 	repeaters_state_change(repeater, ts, REPEATER_SLOT_STATE_IDLE);
-	repeater->slot[ts].call_ended_at = time(NULL);
+	repeater->slot[ts].call_ended_at = virtclock_time();
 
 	remotedb_update(repeater);
 	remotedb_update_repeater(repeater);
@@ -119,7 +137,9 @@ void dmr_handle_voice_call_timeout(repeater_t *repeater, dmr_timeslot_t ts) {
 	if (repeater->slot[ts].echo_buf_first_entry != NULL)
 		repeaters_play_and_free_echo_buf(repeater, ts);
 
-	dmr_data_send_sms_rms_volume_if_needed(repeater, ts);
+	// See dmr_handle_voice_call_end().
+	if (!voicestreams_is_rms_vol_pending(repeater->slot[ts].voicestream, repeater))
+		dmr_data_send_sms_rms_volume_if_needed(repeater, ts);
 }
 
 void dmr_handle_voice_lc_header(struct ip *ip_packet, ipscpacket_t *ipscpacket, repeater_t *repeater) {
@@ -135,7 +155,7 @@ void dmr_handle_voice_lc_header(struct ip *ip_packet, ipscpacket_t *ipscpacket,
 	dmrpacket_slot_type_decode(dmrpacket_slot_type_extract_bits(&ipscpacket->payload_bits));
 	packet_payload_info_bits = dmrpacket_extract_info_bits(&ipscpacket->payload_bits);
 	packet_payload_info_bits = dmrpacket_data_bptc_deinterleave(packet_payload_info_bits);
-	dmrpacket_lc_decode_voice_lc_header(bptc_196_96_extractdata(packet_payload_info_bits->bits));
+	dmr_handle_lc_event(ip_packet, ipscpacket, "voice lc header", dmrpacket_lc_decode_voice_lc_header(bptc_196_96_extractdata(packet_payload_info_bits->bits)));
 }
 
 void dmr_handle_terminator_with_lc(struct ip *ip_packet, ipscpacket_t *ipscpacket, repeater_t *repeater) {
@@ -151,7 +171,7 @@ void dmr_handle_terminator_with_lc(struct ip *ip_packet, ipscpacket_t *ipscpacke
 	dmrpacket_slot_type_decode(dmrpacket_slot_type_extract_bits(&ipscpacket->payload_bits));
 	packet_payload_info_bits = dmrpacket_extract_info_bits(&ipscpacket->payload_bits);
 	packet_payload_info_bits = dmrpacket_data_bptc_deinterleave(packet_payload_info_bits);
-	dmrpacket_lc_decode_terminator_with_lc(bptc_196_96_extractdata(packet_payload_info_bits->bits));
+	dmr_handle_lc_event(ip_packet, ipscpacket, "terminator with lc", dmrpacket_lc_decode_terminator_with_lc(bptc_196_96_extractdata(packet_payload_info_bits->bits)));
 }
 
 void dmr_handle_csbk(struct ip *ip_packet, ipscpacket_t *ipscpacket, repeater_t *repeater) {
@@ -246,7 +266,7 @@ void dmr_handle_voice_frame(struct ip *ip_packet, ipscpacket_t *ipscpacket, repe
 			vbptc_16_11_get_data_bits(&repeater->slot[ipscpacket->timeslot-1].emb_sig_lc_vbptc_storage, (flag_t *)&emb_signalling_lc_bits, sizeof(dmrpacket_emb_signalling_lc_bits_t));
 
 			console_log(LOGLEVEL_DMRLC "  decoding embedded signalling lc:\n");
-			dmrpacket_lc_decode_emb_signalling_lc(dmrpacket_emb_signalling_lc_deinterleave(&emb_signalling_lc_bits));
+			dmr_handle_lc_event(ip_packet, ipscpacket, "embedded signalling lc", dmrpacket_lc_decode_emb_signalling_lc(dmrpacket_emb_signalling_lc_deinterleave(&emb_signalling_lc_bits)));
 		}
 		vbptc_16_11_clear(&repeater->slot[ipscpacket->timeslot-1].emb_sig_lc_vbptc_storage);
 	}
@@ -265,18 +285,20 @@ static void dmr_handle_data_call_start(struct ip *ip_packet, repeater_t *repeate
 		return;
 
 	repeater->slot[ipscpacket->timeslot-1].data_packet_header_valid = 0;
-	repeater->slot[ipscpacket->timeslot-1].call_started_at = time(NULL);
+	repeater->slot[ipscpacket->timeslot-1].call_started_at = virtclock_time();
 	repeater->slot[ipscpacket->timeslot-1].call_ended_at = 0;
 	repeater->slot[ipscpacket->timeslot-1].call_type = ipscpacket->call_type;
 	repeater->slot[ipscpacket->timeslot-1].dst_id = ipscpacket->dst_id;
 	repeater->slot[ipscpacket->timeslot-1].src_id = ipscpacket->src_id;
 	repeater->slot[ipscpacket->timeslot-1].rssi = repeater->slot[ipscpacket->timeslot-1].avg_rssi = 0;
 	if (repeater->slot[ipscpacket->timeslot-1].voicestream)
-		repeater->slot[ipscpacket->timeslot-1].voicestream->avg_rms_vol = repeater->slot[ipscpacket->timeslot-1].voicestream->rms_vol = VOICESTREAMS_INVALID_RMS_VALUE;
+		voicestreams_reset_rms_vol(repeater->slot[ipscpacket->timeslot-1].voicestream, repeater);
 
 	console_log(LOGLEVEL_DMR "dmr [%s", repeaters_get_display_string_for_ip(&ip_packet->ip_src));
 	console_log(LOGLEVEL_DMR "->%s]: %s data call start on ts %u src %u dst %u\n",
 		repeaters_get_display_string_for_ip(&ip_packet->ip_dst), dmr_get_readable_call_type(ipscpacket->call_type), ipscpacket->timeslot, ipscpacket->src_id, ipscpacket->dst_id);
+	replaybench_event("[%s] ts%u %s data call start src %u dst %u", comm_get_ip_str(&repeater->ipaddr), ipscpacket->timeslot,
+		dmr_get_readable_call_type(ipscpacket->call_type), ipscpacket->src_id, ipscpacket->dst_id);
 	repeaters_state_change(repeater, ipscpacket->timeslot-1, REPEATER_SLOT_STATE_DATA_CALL_RUNNING);
 
 	remotedb_update_repeater(repeater);
@@ -284,7 +306,7 @@ static void dmr_handle_data_call_start(struct ip *ip_packet, repeater_t *repeate
 
 static void dmr_handle_data_call_end_results(repeater_t *repeater, dmr_timeslot_t ts) {
 	repeaters_state_change(repeater, ts, REPEATER_SLOT_STATE_IDLE);
-	repeater->slot[ts].call_ended_at = time(NULL);
+	repeater->slot[ts].call_ended_at = virtclock_time();
 	repeater->slot[ts].data_packet_header_valid = 0;
 
 	smsackbuf_call_ended(repeater, ts);
@@ -300,6 +322,7 @@ void dmr_handle_data_call_end(repeater_t *repeater, dmr_timeslot_t ts) {
 		return;
 
 	console_log(LOGLEVEL_DMR "dmr [%s]: data call ended on ts%u\n", repeaters_get_display_string_for_ip(&repeater->ipaddr), ts+1);
+	replaybench_event("[%s] ts%u data call end", comm_get_ip_str(&repeater->ipaddr), ts+1);
 	dmr_handle_data_call_end_results(repeater, ts);
 }
 
@@ -311,6 +334,7 @@ void dmr_handle_data_call_timeout(repeater_t *repeater, dmr_timeslot_t ts) {
 		return;
 
 	console_log(LOGLEVEL_DMR "dmr [%s]: data call timeout on ts%u\n", repeaters_get_display_string_for_ip(&repeater->ipaddr), ts+1);
+	replaybench_event("[%s] ts%u data call timeout", comm_get_ip_str(&repeater->ipaddr), ts+1);
 	dmr_handle_data_call_end_results(repeater, ts);
 }
 
@@ -856,6 +880,7 @@ static void dmr_handle_received_complete_fragment(ipscpacket_t *ipscpacket, repe
 
 				if (gps_data_found) {
 					console_log(LOGLEVEL_DMR "  found hytera gps data (%u bytes)\n", message_data_length);
+					replaybench_event("[%s] ts%u gps src %u dst %u: %s", comm_get_ip_str(&repeater->ipaddr), ipscpacket->timeslot, srcid, dstid, decoded_message);
 					if (gpspos != NULL) {
 						userdb_entry = userdb_get_entry_for_id(srcid);
 						if (userdb_entry) {
@@ -890,6 +915,8 @@ static void dmr_handle_received_complete_fragment(ipscpacket_t *ipscpacket, repe
 			console_log(LOGLEVEL_DMR "  message is not printable\n");
 		else {
 			console_log(LOGLEVEL_DMR "  decoded %s: %s\n", dmr_get_readable_data_type(received_data_type), decoded_message);
+			replaybench_event("[%s] ts%u %s src %u dst %u: %s", comm_get_ip_str(&repeater->ipaddr), ipscpacket->timeslot,
+				dmr_get_readable_data_type(received_data_type), srcid, dstid, decoded_message);
 
 			smsackbuf_add(dstid, srcid, calltype, received_data_type, decoded_message);
 		}
@@ -1024,7 +1051,7 @@ void dmr_handle_data_34rate(struct ip *ip_packet, ipscpacket_t *ipscpacket, repe
 	packet_payload_dibits = trellis_extract_dibits(packet_payload_info_bits);
 	packet_payload_dibits = trellis_deinterleave_dibits(packet_payload_dibits);
 	packet_payload_constellationpoints = trellis_getconstellationpoints(packet_payload_dibits);
-	packet_payload_tribits = trellis_extract_tribits(packet_payload_constellationpoints);
+	packet_payload_tribits = trellis_extract_tribits(packet_payload_constellationpoints, NULL);
 	data_binary = trellis_extract_binary(packet_payload_tribits);
 	data_block_bytes = dmrpacket_data_convert_binary_to_block_bytes(data_binary);
 	data_block = dmrpacket_data_decode_block(data_block_bytes, DMRPACKET_DATA_TYPE_RATE_34_DATA, repeater->slot[ipscpacket->timeslot-1].data_packet_header.common.response_requested);
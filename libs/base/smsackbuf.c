@@ -24,6 +24,7 @@
 
 #include "smsackbuf.h"
 #include "smsrtbuf.h"
+#include "virtclock.h"
 
 #include <libs/config/config.h>
 #include <libs/daemon/console.h>
@@ -85,7 +86,7 @@ void smsackbuf_add(dmr_id_t dstid, dmr_id_t srcid, dmr_call_type_t calltype, dmr
 	}
 
 	strncpy(new_entry->msg, msg, sizeof(new_entry->msg));
-	new_entry->added_at = time(NULL);
+	new_entry->added_at = virtclock_time();
 	new_entry->dstid = dstid;
 	new_entry->srcid = srcid;
 	new_entry->calltype = calltype;
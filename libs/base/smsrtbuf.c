@@ -21,6 +21,7 @@
 
 #include "smsrtbuf.h"
 #include "smstxbuf.h"
+#include "virtclock.h"
 
 #include <libs/daemon/console.h>
 #include <libs/config/config.h>
@@ -38,7 +39,7 @@ static void smsrtbuf_print_entry(smsrtbuf_t *entry) {
 	if (entry == NULL)
 		return;
 
-	time_left = config_get_smsretransmittimeoutinsec()-(time(NULL)-entry->last_added_at);
+	time_left = config_get_smsretransmittimeoutinsec()-(virtclock_time()-entry->last_added_at);
 	if (time_left < 0)
 		time_left = 0;
 	console_log("  time left: %u orig type: %s dst: %u src: %u msg: %s\n", time_left,
@@ -100,7 +101,7 @@ void smsrtbuf_add_decoded_message(repeater_t *repeater, dmr_timeslot_t ts, dmr_d
 	new_entry = smsrtbuf_find_entry(dstid, msg);
 	if (new_entry != NULL) {
 		// Entry already in the buffer.
-		new_entry->last_added_at = time(NULL);
+		new_entry->last_added_at = virtclock_time();
 		if (loglevel.flags.dataq) {
 			console_log(LOGLEVEL_DATAQ "smsrtbuf: updated entry:\n");
 			smsrtbuf_print_entry(new_entry);
@@ -116,7 +117,7 @@ void smsrtbuf_add_decoded_message(repeater_t *repeater, dmr_timeslot_t ts, dmr_d
 	new_entry->ts = ts;
 	new_entry->repeater = repeater;
 	strncpy(new_entry->orig_msg, msg, sizeof(new_entry->orig_msg)-1);
-	new_entry->last_added_at = time(NULL);
+	new_entry->last_added_at = virtclock_time();
 
 	if (loglevel.flags.dataq) {
 		console_log(LOGLEVEL_DATAQ "smsrtbuf: added entry:\n");
@@ -225,7 +226,7 @@ void smsrtbuf_process(void) {
 	loglevel_t loglevel;
 
 	while (entry) {
-		if (!entry->currently_sending && time(NULL)-entry->last_added_at > config_get_smsretransmittimeoutinsec()) {
+		if (!entry->currently_sending && virtclock_time()-entry->last_added_at > config_get_smsretransmittimeoutinsec()) {
 			loglevel = console_get_loglevel();
 			snprintf(entry->sent_msg, sizeof(entry->sent_msg), "%s: %s", userdb_get_display_str_for_id(entry->srcid), entry->orig_msg);
 
@@ -257,7 +258,7 @@ void smsrtbuf_process(void) {
 			}
 		}
 
-		if (entry->currently_sending && time(NULL)-entry->last_added_at > 600) { // Cleanup
+		if (entry->currently_sending && virtclock_time()-entry->last_added_at > 600) { // Cleanup
 			smsrtbuf_remove_entry(entry);
 			break;
 		}
@@ -25,6 +25,7 @@
 #include "dmr-data.h"
 #include "smsrtbuf.h"
 #include "data-packet-txbuf.h"
+#include "virtclock.h"
 
 #include <libs/daemon/console.h>
 #include <libs/daemon/daemon-poll.h>
@@ -106,7 +107,7 @@ void smstxbuf_add(uint8_t delay_before_send_sec, repeater_t *repeater, dmr_times
 
 	strncpy(new_smstxbuf_entry->msg, msg, DMRPACKET_MAX_FRAGMENTSIZE);
 	new_smstxbuf_entry->delay_before_send_sec = delay_before_send_sec;
-	new_smstxbuf_entry->added_at = time(NULL);
+	new_smstxbuf_entry->added_at = virtclock_time();
 	new_smstxbuf_entry->data_type = data_type;
 	new_smstxbuf_entry->call_type = calltype;
 	new_smstxbuf_entry->dst_id = dstid;
@@ -128,7 +129,8 @@ void smstxbuf_add(uint8_t delay_before_send_sec, repeater_t *repeater, dmr_times
 		smstxbuf_last_entry->next = new_smstxbuf_entry;
 		smstxbuf_last_entry = new_smstxbuf_entry;
 	}
-	daemon_poll_setmaxtimeout(0);
+	// Entries are also added by the remote db and APRS threads.
+	daemon_poll_wakeup();
 	pthread_mutex_unlock(&smstxbuf_mutex);
 }
 
@@ -225,7 +227,7 @@ static void smstxbuf_first_entry_send_unsuccessful(void) {
 
 void smstxbuf_first_entry_waiting_for_tms_ack_started(void) {
 	if (smstxbuf_first_entry)
-		smstxbuf_first_entry->waiting_for_tms_ack_started_at = time(NULL);
+		smstxbuf_first_entry->waiting_for_tms_ack_started_at = virtclock_time();
 }
 
 // The returned buffer entry must be freed after use with smstxbuf_free_entry().
@@ -273,12 +275,12 @@ void smstxbuf_process(void) {
 	}
 
 	// We allow some time for the TMS ack to arrive.
-	if (smstxbuf_first_entry->waiting_for_tms_ack_started_at != 0 && time(NULL)-smstxbuf_first_entry->waiting_for_tms_ack_started_at < 10) {
+	if (smstxbuf_first_entry->waiting_for_tms_ack_started_at != 0 && virtclock_time()-smstxbuf_first_entry->waiting_for_tms_ack_started_at < 10) {
 		pthread_mutex_unlock(&smstxbuf_mutex);
 		return;
 	}
 
-	if (time(NULL) < smstxbuf_first_entry->added_at+smstxbuf_first_entry->delay_before_send_sec) {
+	if (virtclock_time() < smstxbuf_first_entry->added_at+smstxbuf_first_entry->delay_before_send_sec) {
 		pthread_mutex_unlock(&smstxbuf_mutex);
 		return;
 	}
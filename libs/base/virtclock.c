@@ -0,0 +1,70 @@
+/*
+ * This file is part of dmrshark.
+ *
+ * dmrshark is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dmrshark is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dmrshark.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+// The virtual clock is the time source of the call, data and repeater state handling.
+// It follows the real time, except while a pcap file is replayed: then the replay
+// scheduler sets it to the capture timestamps of the replayed packets, so timeouts
+// work the same way as they did when the traffic was captured.
+
+
+
+#include "virtclock.h"
+
+// The clock is read by the voice worker threads too, so its state is accessed with atomic
+// operations, and reading it never blocks. Virtual times are stored in microseconds, so
+// they can be read with a single load.
+static flag_t virtclock_virtual = 0;
+static int64_t virtclock_now_usec = 0;
+
+time_t virtclock_time(void) {
+	if (__atomic_load_n(&virtclock_virtual, __ATOMIC_ACQUIRE))
+		return __atomic_load_n(&virtclock_now_usec, __ATOMIC_RELAXED)/1000000;
+
+	return time(NULL);
+}
+
+void virtclock_gettimeofday(struct timeval *tv) {
+	int64_t now_usec;
+
+	if (tv == NULL)
+		return;
+
+	if (__atomic_load_n(&virtclock_virtual, __ATOMIC_ACQUIRE)) {
+		now_usec = __atomic_load_n(&virtclock_now_usec, __ATOMIC_RELAXED);
+		tv->tv_sec = now_usec/1000000;
+		tv->tv_usec = now_usec%1000000;
+	} else
+		gettimeofday(tv, NULL);
+}
+
+// Switches to virtual time and sets the clock to the given time. Called only by the main thread.
+void virtclock_set(struct timeval *tv) {
+	if (tv == NULL)
+		return;
+
+	__atomic_store_n(&virtclock_now_usec, (int64_t)tv->tv_sec*1000000+tv->tv_usec, __ATOMIC_RELAXED);
+	__atomic_store_n(&virtclock_virtual, 1, __ATOMIC_RELEASE);
+}
+
+// Switches back to real time.
+void virtclock_release(void) {
+	__atomic_store_n(&virtclock_virtual, 0, __ATOMIC_RELEASE);
+}
+
+flag_t virtclock_is_virtual(void) {
+	return __atomic_load_n(&virtclock_virtual, __ATOMIC_ACQUIRE);
+}
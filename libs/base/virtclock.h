@@ -0,0 +1,33 @@
+/*
+ * This file is part of dmrshark.
+ *
+ * dmrshark is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dmrshark is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dmrshark.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+#ifndef VIRTCLOCK_H_
+#define VIRTCLOCK_H_
+
+#include "types.h"
+
+#include <time.h>
+#include <sys/time.h>
+
+time_t virtclock_time(void);
+void virtclock_gettimeofday(struct timeval *tv);
+
+void virtclock_set(struct timeval *tv);
+void virtclock_release(void);
+flag_t virtclock_is_virtual(void);
+
+#endif
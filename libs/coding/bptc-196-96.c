@@ -285,70 +285,79 @@ flag_t bptc_196_96_check_and_repair(flag_t deinterleaved_bits[196]) {
 }
 
 // Extracts the data bits from the given deinterleaved info bits array (discards BPTC bits).
+bptc_196_96_data_bits_t *bptc_196_96_extractdata_r(flag_t deinterleaved_bits[196], bptc_196_96_data_bits_t *data_bits) {
+	if (deinterleaved_bits == NULL || data_bits == NULL)
+		return NULL;
+
+	memcpy(&data_bits->bits[0], &deinterleaved_bits[4], 8);
+	memcpy(&data_bits->bits[8], &deinterleaved_bits[16], 11);
+	memcpy(&data_bits->bits[19], &deinterleaved_bits[31], 11);
+	memcpy(&data_bits->bits[30], &deinterleaved_bits[46], 11);
+	memcpy(&data_bits->bits[41], &deinterleaved_bits[61], 11);
+	memcpy(&data_bits->bits[52], &deinterleaved_bits[76], 11);
+	memcpy(&data_bits->bits[63], &deinterleaved_bits[91], 11);
+	memcpy(&data_bits->bits[74], &deinterleaved_bits[106], 11);
+	memcpy(&data_bits->bits[85], &deinterleaved_bits[121], 11);
+
+	return data_bits;
+}
+
 bptc_196_96_data_bits_t *bptc_196_96_extractdata(flag_t deinterleaved_bits[196]) {
 	static bptc_196_96_data_bits_t data_bits;
 
-	if (deinterleaved_bits == NULL)
-		return NULL;
-
-	memcpy(&data_bits.bits[0], &deinterleaved_bits[4], 8);
-	memcpy(&data_bits.bits[8], &deinterleaved_bits[16], 11);
-	memcpy(&data_bits.bits[19], &deinterleaved_bits[31], 11);
-	memcpy(&data_bits.bits[30], &deinterleaved_bits[46], 11);
-	memcpy(&data_bits.bits[41], &deinterleaved_bits[61], 11);
-	memcpy(&data_bits.bits[52], &deinterleaved_bits[76], 11);
-	memcpy(&data_bits.bits[63], &deinterleaved_bits[91], 11);
-	memcpy(&data_bits.bits[74], &deinterleaved_bits[106], 11);
-	memcpy(&data_bits.bits[85], &deinterleaved_bits[121], 11);
-
-	return &data_bits;
+	return bptc_196_96_extractdata_r(deinterleaved_bits, &data_bits);
 }
 
 // Generates 196 BPTC payload info bits from 96 data bits.
-dmrpacket_payload_info_bits_t *bptc_196_96_generate(bptc_196_96_data_bits_t *data_bits) {
-	static dmrpacket_payload_info_bits_t payload_info_bits;
+dmrpacket_payload_info_bits_t *bptc_196_96_generate_r(bptc_196_96_data_bits_t *data_bits, dmrpacket_payload_info_bits_t *payload_info_bits) {
 	bptc_196_96_error_vector_t error_vector;
 	uint8_t col, row;
 	uint8_t dbp;
 	flag_t column_bits[9] = {0,};
 
-	memset(payload_info_bits.bits, 0, sizeof(dmrpacket_payload_info_bits_t));
+	memset(payload_info_bits->bits, 0, sizeof(dmrpacket_payload_info_bits_t));
 
 	dbp = 0;
 	for (row = 0; row < 9; row++) {
 		if (row == 0) {
 			for (col = 3; col < 11; col++) {
 				// +1 because the first bit is R(3) and it's not used so we can ignore that.
-				payload_info_bits.bits[col+1] = data_bits->bits[dbp++];
+				payload_info_bits->bits[col+1] = data_bits->bits[dbp++];
 			}
 		} else {
 			for (col = 0; col < 11; col++) {
 				// +1 because the first bit is R(3) and it's not used so we can ignore that.
-				payload_info_bits.bits[col+row*15+1] = data_bits->bits[dbp++];
+				payload_info_bits->bits[col+row*15+1] = data_bits->bits[dbp++];
 			}
 		}
 
 		// +1 because the first bit is R(3) and it's not used so we can ignore that.
-		bptc_196_96_hamming_15_11_3_get_parity_bits(&payload_info_bits.bits[row*15+1], &error_vector);
-		payload_info_bits.bits[row*15+11+1] = error_vector.bits[0];
-		payload_info_bits.bits[row*15+12+1] = error_vector.bits[1];
-		payload_info_bits.bits[row*15+13+1] = error_vector.bits[2];
-		payload_info_bits.bits[row*15+14+1] = error_vector.bits[3];
+		bptc_196_96_hamming_15_11_3_get_parity_bits(&payload_info_bits->bits[row*15+1], &error_vector);
+		payload_info_bits->bits[row*15+11+1] = error_vector.bits[0];
+		payload_info_bits->bits[row*15+12+1] = error_vector.bits[1];
+		payload_info_bits->bits[row*15+13+1] = error_vector.bits[2];
+		payload_info_bits->bits[row*15+14+1] = error_vector.bits[3];
 	}
 
 	for (col = 0; col < 15; col++) {
 		for (row = 0; row < 9; row++)
-			column_bits[row] = payload_info_bits.bits[col+row*15+1];
+			column_bits[row] = payload_info_bits->bits[col+row*15+1];
 
 		bptc_196_96_hamming_13_9_3_get_parity_bits(column_bits, &error_vector);
-		payload_info_bits.bits[col+135+1] = error_vector.bits[0];
-		payload_info_bits.bits[col+135+15+1] = error_vector.bits[1];
-		payload_info_bits.bits[col+135+30+1] = error_vector.bits[2];
-		payload_info_bits.bits[col+135+45+1] = error_vector.bits[3];
+		payload_info_bits->bits[col+135+1] = error_vector.bits[0];
+		payload_info_bits->bits[col+135+15+1] = error_vector.bits[1];
+		payload_info_bits->bits[col+135+30+1] = error_vector.bits[2];
+		payload_info_bits->bits[col+135+45+1] = error_vector.bits[3];
 	}
 
 	//console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "bptc (196,96): constructed matrix:\n");
-	//bptc_196_96_display_data_matrix(payload_info_bits.bits);
+	//bptc_196_96_display_data_matrix(payload_info_bits->bits);
+
+	return payload_info_bits;
+}
+
+dmrpacket_payload_info_bits_t *bptc_196_96_generate(bptc_196_96_data_bits_t *data_bits) {
+	static dmrpacket_payload_info_bits_t payload_info_bits;
 
-	return &payload_info_bits;
+	return bptc_196_96_generate_r(data_bits, &payload_info_bits);
 }
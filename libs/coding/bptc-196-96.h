@@ -27,7 +27,9 @@ typedef struct {
 
 flag_t bptc_196_96_check_and_repair(flag_t deinterleaved_bits[196]);
 bptc_196_96_data_bits_t *bptc_196_96_extractdata(flag_t deinterleaved_bits[196]);
+bptc_196_96_data_bits_t *bptc_196_96_extractdata_r(flag_t deinterleaved_bits[196], bptc_196_96_data_bits_t *data_bits);
 
 dmrpacket_payload_info_bits_t *bptc_196_96_generate(bptc_196_96_data_bits_t *data_bits);
+dmrpacket_payload_info_bits_t *bptc_196_96_generate_r(bptc_196_96_data_bits_t *data_bits, dmrpacket_payload_info_bits_t *payload_info_bits);
 
 #endif
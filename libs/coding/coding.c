@@ -17,14 +17,18 @@
 
 
 
+#include "crc.h"
 #include "golay-20-8.h"
 #include "quadres-16-7.h"
+#include "rs-12-9.h"
 
 #include <libs/daemon/console.h>
 
 void coding_init(void) {
 	console_log("coding: init\n");
 
+	crc_init();
 	golay_20_8_init();
 	quadres_16_7_init();
+	rs_12_9_init();
 }
@@ -19,6 +19,29 @@
 
 #include "crc.h"
 
+// crc_*_table[j][t] holds t*x^(W+8*j) mod G(x), where W is the CRC width. Table 0 is used for
+// processing one byte at a time, all the 8 tables are used by the slicing-by-8 bulk functions.
+static uint16_t crc_crc16_ccitt_table[8][256];
+static uint32_t crc_crc32_table[8][256];
+// As crc9 has 9 shift registers, its byte table is indexed by the upper 8 registers and holds
+// t*x^9 mod G(x). Slicing table j holds t*x^(8*(j+1)) mod G(x), and crc_crc9_x72 is x^72 mod G(x)
+// which is used when the 9th register is set.
+static uint16_t crc_crc9_table[256];
+static uint16_t crc_crc9_slicing_table[8][256];
+static uint16_t crc_crc9_x72;
+
+static uint16_t crc_crc16_ccitt_bitwise(uint16_t crc, uint8_t bitscount) {
+	uint8_t i;
+
+	for (i = 0; i < bitscount; i++) {
+		if (crc & 0x8000)
+			crc = (crc << 1) ^ 0x1021;
+		else
+			crc <<= 1;
+	}
+	return crc;
+}
+
 // This algorithm uses the shift register logic to implement CRC calculation.
 // In the example we use the generator polynomial G(x)=x^16+x^12+x^5+1
 // We create 16 shift registers, as this is a 16-bit CRC.
@@ -36,135 +59,149 @@
 // *crc initial value should be 0xffff.
 //
 // For other polynomials see: http://reveng.sourceforge.net/crc-catalogue/all.htm
+//
+// The shift register logic is evaluated 8 bits at a time using crc_crc16_ccitt_table[0]:
+// the 8 bits falling out from the registers select the value to xor the registers with.
 void crc_calc_crc16_ccitt(uint16_t *crc, uint8_t in) {
-	uint8_t v;
-	flag_t xor_flag;
-	uint8_t i;
-
-	v = 0x80;
-	for (i = 0; i < 8; i++) {
-		if ((*crc) & 0x8000)
-			xor_flag = 1;
-		else
-			xor_flag = 0;
-
-		(*crc) <<= 1;
-
-		if (in & v)
-			(*crc)++;
+	*crc = (((*crc) << 8) | in) ^ crc_crc16_ccitt_table[0][(*crc) >> 8];
+}
 
-		if (xor_flag)
-			(*crc) ^= 0x1021;
+// Bulk version of crc_calc_crc16_ccitt(), uses the slicing-by-8 method to process 8 input bytes at once.
+void crc_calc_crc16_ccitt_bytes(uint16_t *crc, uint8_t *in, uint16_t in_length) {
+	uint16_t c = *crc;
 
-		v >>= 1;
+	for (; in_length >= 8; in_length -= 8, in += 8) {
+		c = ((in[6] << 8) | in[7]) ^
+			crc_crc16_ccitt_table[7][c >> 8] ^ crc_crc16_ccitt_table[6][c & 0xff] ^
+			crc_crc16_ccitt_table[5][in[0]] ^ crc_crc16_ccitt_table[4][in[1]] ^
+			crc_crc16_ccitt_table[3][in[2]] ^ crc_crc16_ccitt_table[2][in[3]] ^
+			crc_crc16_ccitt_table[1][in[4]] ^ crc_crc16_ccitt_table[0][in[5]];
 	}
+	for (; in_length > 0; in_length--, in++)
+		c = ((c << 8) | *in) ^ crc_crc16_ccitt_table[0][c >> 8];
+
+	*crc = c;
 }
 
 // Empties out the shift registers for the CRC calculation. Call this function when there's no more data left.
 void crc_calc_crc16_ccitt_finish(uint16_t *crc) {
-	flag_t xor_flag;
+	crc_calc_crc16_ccitt(crc, 0);
+	crc_calc_crc16_ccitt(crc, 0);
+}
+
+static uint16_t crc_crc9_bitwise(uint16_t crc, uint8_t bitscount) {
 	uint8_t i;
 
-	for (i = 0; i < 16; i++) {
-		if ((*crc) & 0x8000)
-			xor_flag = 1;
+	for (i = 0; i < bitscount; i++) {
+		if (crc & 0x0100)
+			crc = ((crc << 1) & 0x01ff) ^ 0x59;
 		else
-			xor_flag = 0;
-
-		(*crc) <<= 1;
-
-		if (xor_flag)
-			(*crc) ^= 0x1021;
+			crc = (crc << 1) & 0x01ff;
 	}
+	return crc;
 }
 
 // G(x) = x^9+x^6+x^4+x^3+1 -> poly = 0b001011001 = 0x59
+// The shift registers hold 9 bits, so the 8 bits falling out from them when shifting
+// in a byte are the upper 8 registers, and the lowest register moves to the 9th position.
+// If in_bitscount is less than 8, the lowest bits of in are shifted in, followed by zero bits.
 void crc_calc_crc9(uint16_t *crc, uint8_t in, uint8_t in_bitscount) {
-	uint8_t v;
-	flag_t xor_flag;
-	uint8_t i;
-
-	v = 0x80;
-	for (i = 0; i < 8-in_bitscount; i++)
-		v >>= 1;
-	for (i = 0; i < 8; i++) {
-		if ((*crc) & 0x0100)
-			xor_flag = 1;
-		else
-			xor_flag = 0;
-
-		(*crc) <<= 1;
-
-		// Limit the number of shift registers to 9.
-		*crc &= 0x01ff;
+	uint8_t b = (in << (8-in_bitscount)) & 0xff;
 
-		if (in & v)
-			(*crc)++;
+	*crc = ((((*crc) & 1) << 8) | b) ^ crc_crc9_table[(*crc) >> 1];
+}
 
-		if (xor_flag)
-			(*crc) ^= 0x59;
+// Bulk version of crc_calc_crc9() for whole bytes, uses the slicing-by-8 method to process 8 input bytes at once.
+void crc_calc_crc9_bytes(uint16_t *crc, uint8_t *in, uint16_t in_length) {
+	uint16_t c = *crc;
 
-		v >>= 1;
+	for (; in_length >= 8; in_length -= 8, in += 8) {
+		c = in[7] ^ (-(c >> 8) & crc_crc9_x72) ^
+			crc_crc9_slicing_table[7][c & 0xff] ^ crc_crc9_slicing_table[6][in[0]] ^
+			crc_crc9_slicing_table[5][in[1]] ^ crc_crc9_slicing_table[4][in[2]] ^
+			crc_crc9_slicing_table[3][in[3]] ^ crc_crc9_slicing_table[2][in[4]] ^
+			crc_crc9_slicing_table[1][in[5]] ^ crc_crc9_slicing_table[0][in[6]];
 	}
+	for (; in_length > 0; in_length--, in++)
+		c = (((c & 1) << 8) | *in) ^ crc_crc9_table[c >> 1];
+
+	*crc = c;
 }
 
 void crc_calc_crc9_finish(uint16_t *crc, uint8_t out_bitscount) {
-	flag_t xor_flag;
+	for (; out_bitscount >= 8; out_bitscount -= 8)
+		crc_calc_crc9(crc, 0, 8);
+	*crc = crc_crc9_bitwise(*crc, out_bitscount);
+}
+
+static uint32_t crc_crc32_bitwise(uint32_t crc, uint8_t bitscount) {
 	uint8_t i;
 
-	for (i = 0; i < out_bitscount; i++) {
-		if ((*crc) & 0x0100)
-			xor_flag = 1;
+	for (i = 0; i < bitscount; i++) {
+		if (crc & 0x80000000)
+			crc = (crc << 1) ^ 0x04c11db7;
 		else
-			xor_flag = 0;
-
-		(*crc) <<= 1;
-
-		// Limit the number of shift registers to 9.
-		*crc &= 0x01ff;
-
-		if (xor_flag)
-			(*crc) ^= 0x59;
+			crc <<= 1;
 	}
+	return crc;
 }
 
 void crc_calc_crc32(uint32_t *crc, uint8_t in) {
-	uint8_t v;
-	flag_t xor_flag;
-	uint8_t i;
-
-	v = 0x80;
-	for (i = 0; i < 8; i++) {
-		if ((*crc) & 0x80000000)
-			xor_flag = 1;
-		else
-			xor_flag = 0;
-
-		(*crc) <<= 1;
-
-		if (in & v)
-			(*crc)++;
+	*crc = (((*crc) << 8) | in) ^ crc_crc32_table[0][(*crc) >> 24];
+}
 
-		if (xor_flag)
-			(*crc) ^= 0x04c11db7;
+// Bulk version of crc_calc_crc32(), uses the slicing-by-8 method to process 8 input bytes at once.
+void crc_calc_crc32_bytes(uint32_t *crc, uint8_t *in, uint16_t in_length) {
+	uint32_t c = *crc;
 
-		v >>= 1;
+	for (; in_length >= 8; in_length -= 8, in += 8) {
+		c = (((uint32_t)in[4] << 24) | (in[5] << 16) | (in[6] << 8) | in[7]) ^
+			crc_crc32_table[7][c >> 24] ^ crc_crc32_table[6][(c >> 16) & 0xff] ^
+			crc_crc32_table[5][(c >> 8) & 0xff] ^ crc_crc32_table[4][c & 0xff] ^
+			crc_crc32_table[3][in[0]] ^ crc_crc32_table[2][in[1]] ^
+			crc_crc32_table[1][in[2]] ^ crc_crc32_table[0][in[3]];
 	}
+	for (; in_length > 0; in_length--, in++)
+		c = ((c << 8) | *in) ^ crc_crc32_table[0][c >> 24];
+
+	*crc = c;
 }
 
 void crc_calc_crc32_finish(uint32_t *crc) {
-	flag_t xor_flag;
 	uint8_t i;
 
-	for (i = 0; i < 32; i++) {
-		if ((*crc) & 0x80000000)
-			xor_flag = 1;
-		else
-			xor_flag = 0;
+	for (i = 0; i < 4; i++)
+		crc_calc_crc32(crc, 0);
+}
 
-		(*crc) <<= 1;
+static void crc_init_crc9(void) {
+	uint16_t t;
+	uint8_t j;
 
-		if (xor_flag)
-			(*crc) ^= 0x04c11db7;
+	for (t = 0; t < 256; t++) {
+		crc_crc9_table[t] = crc_crc9_bitwise(t << 1, 8);
+		crc_crc9_slicing_table[0][t] = crc_crc9_bitwise(t, 8);
+	}
+	for (j = 1; j < 8; j++) {
+		for (t = 0; t < 256; t++)
+			crc_crc9_slicing_table[j][t] = crc_crc9_bitwise(crc_crc9_slicing_table[j-1][t], 8);
+	}
+	crc_crc9_x72 = crc_crc9_bitwise(crc_crc9_slicing_table[7][1], 8);
+}
+
+void crc_init(void) {
+	uint16_t t;
+	uint8_t j;
+
+	for (t = 0; t < 256; t++) {
+		crc_crc16_ccitt_table[0][t] = crc_crc16_ccitt_bitwise(t << 8, 8);
+		crc_crc32_table[0][t] = crc_crc32_bitwise((uint32_t)t << 24, 8);
+	}
+	for (j = 1; j < 8; j++) {
+		for (t = 0; t < 256; t++) {
+			crc_crc16_ccitt_table[j][t] = crc_crc16_ccitt_bitwise(crc_crc16_ccitt_table[j-1][t], 8);
+			crc_crc32_table[j][t] = crc_crc32_bitwise(crc_crc32_table[j-1][t], 8);
+		}
 	}
+	crc_init_crc9();
 }
@@ -21,12 +21,17 @@
 #include <libs/base/types.h>
 
 void crc_calc_crc16_ccitt(uint16_t *crc, uint8_t in);
+void crc_calc_crc16_ccitt_bytes(uint16_t *crc, uint8_t *in, uint16_t in_length);
 void crc_calc_crc16_ccitt_finish(uint16_t *crc);
 
 void crc_calc_crc9(uint16_t *crc, uint8_t in, uint8_t in_bitscount);
+void crc_calc_crc9_bytes(uint16_t *crc, uint8_t *in, uint16_t in_length);
 void crc_calc_crc9_finish(uint16_t *crc, uint8_t out_bitscount);
 
 void crc_calc_crc32(uint32_t *crc, uint8_t in);
+void crc_calc_crc32_bytes(uint32_t *crc, uint8_t *in, uint16_t in_length);
 void crc_calc_crc32_finish(uint32_t *crc);
 
+void crc_init(void);
+
 #endif
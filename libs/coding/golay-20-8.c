@@ -27,25 +27,29 @@
 static golay_20_8_parity_bits_t golay_20_8_data_parity_syndromes[256];
 
 // Returns the Golay(20,8) parity bits for the given byte.
+golay_20_8_parity_bits_t *golay_20_8_get_parity_bits_r(flag_t bits[8], golay_20_8_parity_bits_t *parity) {
+	// Multiplying the generator matrix with the given data bits.
+	// See DMR AI spec. page 134.
+	parity->bits[0] = bits[1] ^ bits[4] ^ bits[5] ^ bits[6] ^ bits[7];
+	parity->bits[1] = bits[1] ^ bits[2] ^ bits[4];
+	parity->bits[2] = bits[0] ^ bits[2] ^ bits[3] ^ bits[5];
+	parity->bits[3] = bits[0] ^ bits[1] ^ bits[3] ^ bits[4] ^ bits[6];
+	parity->bits[4] = bits[0] ^ bits[1] ^ bits[2] ^ bits[4] ^ bits[5] ^ bits[7];
+	parity->bits[5] = bits[0] ^ bits[2] ^ bits[3] ^ bits[4] ^ bits[7];
+	parity->bits[6] = bits[3] ^ bits[6] ^ bits[7];
+	parity->bits[7] = bits[0] ^ bits[1] ^ bits[5] ^ bits[6];
+	parity->bits[8] = bits[0] ^ bits[1] ^ bits[2] ^ bits[6] ^ bits[7];
+	parity->bits[9] = bits[2] ^ bits[3] ^ bits[4] ^ bits[5] ^ bits[6];
+	parity->bits[10] = bits[0] ^ bits[3] ^ bits[4] ^ bits[5] ^ bits[6] ^ bits[7];
+	parity->bits[11] = bits[1] ^ bits[2] ^ bits[3] ^ bits[5] ^ bits[7];
+
+	return parity;
+}
+
 golay_20_8_parity_bits_t *golay_20_8_get_parity_bits(flag_t bits[8]) {
 	static golay_20_8_parity_bits_t parity;
 
-	// Multiplying the generator matrix with the given data bits.
-	// See DMR AI spec. page 134.
-	parity.bits[0] = bits[1] ^ bits[4] ^ bits[5] ^ bits[6] ^ bits[7];
-	parity.bits[1] = bits[1] ^ bits[2] ^ bits[4];
-	parity.bits[2] = bits[0] ^ bits[2] ^ bits[3] ^ bits[5];
-	parity.bits[3] = bits[0] ^ bits[1] ^ bits[3] ^ bits[4] ^ bits[6];
-	parity.bits[4] = bits[0] ^ bits[1] ^ bits[2] ^ bits[4] ^ bits[5] ^ bits[7];
-	parity.bits[5] = bits[0] ^ bits[2] ^ bits[3] ^ bits[4] ^ bits[7];
-	parity.bits[6] = bits[3] ^ bits[6] ^ bits[7];
-	parity.bits[7] = bits[0] ^ bits[1] ^ bits[5] ^ bits[6];
-	parity.bits[8] = bits[0] ^ bits[1] ^ bits[2] ^ bits[6] ^ bits[7];
-	parity.bits[9] = bits[2] ^ bits[3] ^ bits[4] ^ bits[5] ^ bits[6];
-	parity.bits[10] = bits[0] ^ bits[3] ^ bits[4] ^ bits[5] ^ bits[6] ^ bits[7];
-	parity.bits[11] = bits[1] ^ bits[2] ^ bits[3] ^ bits[5] ^ bits[7];
-
-	return &parity;
+	return golay_20_8_get_parity_bits_r(bits, &parity);
 }
 
 // Prefills the static data parity syndrome buffer with precalculated parities for each byte value.
@@ -193,7 +197,7 @@ static void golay_20_8_check_and_repair_parity(flag_t bits[20]) {
 }*/
 
 flag_t golay_20_8_check_and_repair(flag_t bits[20]) {
-	golay_20_8_parity_bits_t *parity_bits = NULL;
+	golay_20_8_parity_bits_t parity_bits;
 
 	if (bits == NULL)
 		return 0;
@@ -201,8 +205,8 @@ flag_t golay_20_8_check_and_repair(flag_t bits[20]) {
 	console_log(LOGLEVEL_DEBUG LOGLEVEL_CODING "    golay:         input bits: ");
 	golay_20_8_print_bits(bits, 20, 1);
 
-	parity_bits = golay_20_8_get_parity_bits(bits);
-	return (memcmp(parity_bits, bits+8, 12) == 0);
+	golay_20_8_get_parity_bits_r(bits, &parity_bits);
+	return (memcmp(parity_bits.bits, bits+8, 12) == 0);
 
 /*	if (!golay_20_8_check_and_repair_data(bits)) {
 		golay_20_8_check_and_repair_parity(bits);
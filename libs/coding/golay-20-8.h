@@ -25,6 +25,7 @@ typedef struct {
 } golay_20_8_parity_bits_t;
 
 golay_20_8_parity_bits_t *golay_20_8_get_parity_bits(flag_t bits[8]);
+golay_20_8_parity_bits_t *golay_20_8_get_parity_bits_r(flag_t bits[8], golay_20_8_parity_bits_t *parity);
 
 flag_t golay_20_8_check_and_repair(flag_t bits[20]);
 void golay_20_8_init(void);
@@ -27,22 +27,26 @@
 static quadres_16_7_parity_bits_t quadres_16_7_valid_data_paritys[128];
 
 // Returns the quadratic residue (16,7,6) parity bits for the given byte.
+quadres_16_7_parity_bits_t *quadres_16_7_get_parity_bits_r(flag_t bits[7], quadres_16_7_parity_bits_t *parity) {
+	// Multiplying the generator matrix with the given data bits.
+	// See DMR AI spec. page 134.
+	parity->bits[0] = bits[1] ^ bits[2] ^ bits[3] ^ bits[4];
+	parity->bits[1] = bits[2] ^ bits[3] ^ bits[4] ^ bits[5];
+	parity->bits[2] = bits[0] ^ bits[3] ^ bits[4] ^ bits[5] ^ bits[6];
+	parity->bits[3] = bits[2] ^ bits[3] ^ bits[5] ^ bits[6];
+	parity->bits[4] = bits[1] ^ bits[2] ^ bits[6];
+ 	parity->bits[5] = bits[0] ^ bits[1] ^ bits[4];
+	parity->bits[6] = bits[0] ^ bits[1] ^ bits[2] ^ bits[5];
+	parity->bits[7] = bits[0] ^ bits[1] ^ bits[2] ^ bits[3] ^ bits[6];
+	parity->bits[8] = bits[0] ^ bits[2] ^ bits[4] ^ bits[5] ^ bits[6];
+
+	return parity;
+}
+
 quadres_16_7_parity_bits_t *quadres_16_7_get_parity_bits(flag_t bits[7]) {
 	static quadres_16_7_parity_bits_t parity;
 
-	// Multiplying the generator matrix with the given data bits.
-	// See DMR AI spec. page 134.
-	parity.bits[0] = bits[1] ^ bits[2] ^ bits[3] ^ bits[4];
-	parity.bits[1] = bits[2] ^ bits[3] ^ bits[4] ^ bits[5];
-	parity.bits[2] = bits[0] ^ bits[3] ^ bits[4] ^ bits[5] ^ bits[6];
-	parity.bits[3] = bits[2] ^ bits[3] ^ bits[5] ^ bits[6];
-	parity.bits[4] = bits[1] ^ bits[2] ^ bits[6];
- 	parity.bits[5] = bits[0] ^ bits[1] ^ bits[4];
-	parity.bits[6] = bits[0] ^ bits[1] ^ bits[2] ^ bits[5];
-	parity.bits[7] = bits[0] ^ bits[1] ^ bits[2] ^ bits[3] ^ bits[6];
-	parity.bits[8] = bits[0] ^ bits[2] ^ bits[4] ^ bits[5] ^ bits[6];
-
-	return &parity;
+	return quadres_16_7_get_parity_bits_r(bits, &parity);
 }
 
 static void quadres_16_7_calculate_valid_data_paritys(void) {
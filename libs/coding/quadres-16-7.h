@@ -30,6 +30,7 @@ typedef struct {
 } quadres_16_7_parity_bits_t;
 
 quadres_16_7_parity_bits_t *quadres_16_7_get_parity_bits(flag_t bits[7]);
+quadres_16_7_parity_bits_t *quadres_16_7_get_parity_bits_r(flag_t bits[7], quadres_16_7_parity_bits_t *parity);
 
 flag_t quadres_16_7_check(quadres_16_7_codeword_t *codeword);
 
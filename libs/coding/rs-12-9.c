@@ -77,15 +77,15 @@ static uint8_t rs_12_9_galois_log_table[256] = {
 	79,		174,	213,	233,	230,	231,	173,	232,	116,	214,	244,	234,	168,	80,		88,		175
 };
 
+// Full GF(256) multiplication table, generated by rs_12_9_init().
+static uint8_t rs_12_9_galois_multiplication_table[256][256];
+
 static uint8_t rs_12_9_galois_exp_table_get(uint8_t pos) {
 	return rs_12_9_galois_exp_table[pos];
 }
 
 static uint8_t rs_12_9_galois_multiplication(uint8_t a, uint8_t b) {
-	if (a == 0 || b == 0)
-		return 0;
-
-	return rs_12_9_galois_exp_table[(rs_12_9_galois_log_table[a] + rs_12_9_galois_log_table[b]) % 255];
+	return rs_12_9_galois_multiplication_table[a][b];
 }
 
 static uint8_t rs_12_9_galois_inv(uint8_t elt) {
@@ -200,13 +200,12 @@ static void rs_12_9_calculate(rs_12_9_poly_t *syndrome, rs_12_9_poly_t *error_lo
 // The error-locator polynomial's roots are found by looking for the values of a^n where
 // evaluating the polynomial yields zero (evaluating rs_12_9_error_locator_poly at
 // successive values of alpha (Chien's search)).
-static rs_12_9_roots_t *rs_12_9_find_roots(rs_12_9_poly_t *error_locator_poly) {
-	static rs_12_9_roots_t roots;
+static void rs_12_9_find_roots(rs_12_9_poly_t *error_locator_poly, rs_12_9_roots_t *roots) {
 	uint8_t sum;
 	uint16_t r;
 	uint8_t k;
 
-	memset(&roots, 0, sizeof(rs_12_9_roots_t));
+	memset(roots, 0, sizeof(rs_12_9_roots_t));
 
 	for (r = 1; r < 256; r++) {
 		sum = 0;
@@ -215,32 +214,34 @@ static rs_12_9_roots_t *rs_12_9_find_roots(rs_12_9_poly_t *error_locator_poly) {
 			sum ^= rs_12_9_galois_multiplication(rs_12_9_galois_exp_table_get((k*r) % 255), error_locator_poly->data[k]);
 
 		if (sum == 0)
-			roots.error_locations[roots.errors_num++] = (255-r);
+			roots->error_locations[roots->errors_num++] = (255-r);
 	}
-	return &roots;
 }
 
+// Evaluates the codeword polynomial at alpha^1, alpha^2 and alpha^3 using Horner's method.
+// The multiplications with the constant alpha powers are simple table lookups.
 void rs_12_9_calc_syndrome(rs_12_9_codeword_t *codeword, rs_12_9_poly_t *syndrome) {
-	uint8_t i, j;
-
-	syndrome->data[0] = syndrome->data[1] = syndrome->data[2] = 0;
+	uint8_t *mul_alpha1 = rs_12_9_galois_multiplication_table[rs_12_9_galois_exp_table_get(1)];
+	uint8_t *mul_alpha2 = rs_12_9_galois_multiplication_table[rs_12_9_galois_exp_table_get(2)];
+	uint8_t *mul_alpha3 = rs_12_9_galois_multiplication_table[rs_12_9_galois_exp_table_get(3)];
+	uint8_t s0 = 0, s1 = 0, s2 = 0;
+	uint8_t i;
 
-	for (j = 0; j < 3;  j++) {
-		for (i = 0; i < sizeof(rs_12_9_codeword_t); i++)
-			syndrome->data[j] = codeword->data[i] ^ rs_12_9_galois_multiplication(rs_12_9_galois_exp_table_get(j+1), syndrome->data[j]);
+	for (i = 0; i < sizeof(rs_12_9_codeword_t); i++) {
+		s0 = codeword->data[i] ^ mul_alpha1[s0];
+		s1 = codeword->data[i] ^ mul_alpha2[s1];
+		s2 = codeword->data[i] ^ mul_alpha3[s2];
 	}
+
+	memset(syndrome, 0, sizeof(rs_12_9_poly_t));
+	syndrome->data[0] = s0;
+	syndrome->data[1] = s1;
+	syndrome->data[2] = s2;
 }
 
 // Returns 1 if syndrome differs from all zeroes.
 flag_t rs_12_9_check_syndrome(rs_12_9_poly_t *syndrome) {
-	uint8_t i;
-
-	for (i = 0; i < 3; i++) {
-		if (syndrome->data[i] != 0)
-			return 1;
-	}
-
-	return 0;
+	return ((syndrome->data[0] | syndrome->data[1] | syndrome->data[2]) != 0);
 }
 // Returns 1 if errors have been found and corrected, returns 0 if
 // no errors found or errors can't be corrected.
@@ -251,28 +252,34 @@ rs_12_9_correct_errors_result_t rs_12_9_correct_errors(rs_12_9_codeword_t *codew
 	uint8_t err;
 	rs_12_9_poly_t error_locator_poly;
 	rs_12_9_poly_t error_evaluator_poly;
-	rs_12_9_roots_t *roots;
+	rs_12_9_roots_t roots;
 	uint8_t num, denom;
 
+	// Zero syndrome means the codeword is error free, which is the most common case.
+	if (!rs_12_9_check_syndrome(syndrome)) {
+		*errors_found = 0;
+		return RS_12_9_CORRECT_ERRORS_RESULT_NO_ERRORS_FOUND;
+	}
+
 	rs_12_9_calculate(syndrome, &error_locator_poly, &error_evaluator_poly);
-	roots = rs_12_9_find_roots(&error_locator_poly);
-	*errors_found = roots->errors_num;
+	rs_12_9_find_roots(&error_locator_poly, &roots);
+	*errors_found = roots.errors_num;
 
-	if (roots->errors_num == 0)
+	if (roots.errors_num == 0)
 		return RS_12_9_CORRECT_ERRORS_RESULT_NO_ERRORS_FOUND;
 
 	// Error correction is done using the error-evaluator equation on pp 207.
-	if (roots->errors_num > 0 && roots->errors_num <= RS_12_9_CHECKSUMSIZE) {
+	if (roots.errors_num > 0 && roots.errors_num <= RS_12_9_CHECKSUMSIZE) {
 		// First check for illegal error locations.
-		for (r = 0; r < roots->errors_num; r++) {
-			if (roots->error_locations[r] >= RS_12_9_DATASIZE+RS_12_9_CHECKSUMSIZE)
+		for (r = 0; r < roots.errors_num; r++) {
+			if (roots.error_locations[r] >= RS_12_9_DATASIZE+RS_12_9_CHECKSUMSIZE)
 				return RS_12_9_CORRECT_ERRORS_RESULT_ERRORS_CANT_BE_CORRECTED;
 		}
 
 		// Evaluates rs_12_9_error_evaluator_poly/rs_12_9_error_locator_poly' at the roots
 		// alpha^(-i) for error locs i.
-		for (r = 0; r < roots->errors_num; r++) {
-			i = roots->error_locations[r];
+		for (r = 0; r < roots.errors_num; r++) {
+			i = roots.error_locations[r];
 
 			// Evaluate rs_12_9_error_evaluator_poly at alpha^(-i)
 			num = 0;
@@ -296,21 +303,42 @@ rs_12_9_correct_errors_result_t rs_12_9_correct_errors(rs_12_9_codeword_t *codew
 }
 
 // Simulates an LFSR with the generator polynomial and calculates checksum bytes for the given data.
-rs_12_9_checksum_t *rs_12_9_calc_checksum(rs_12_9_codeword_t *codeword) {
+rs_12_9_checksum_t *rs_12_9_calc_checksum_r(rs_12_9_codeword_t *codeword, rs_12_9_checksum_t *checksum) {
 	// See DMR AI. spec. page 136 for these coefficients.
 	static uint8_t genpoly[] = { 0x40, 0x38, 0x0e, 0x01 };
-	static rs_12_9_checksum_t rs_12_9_checksum;
 	uint8_t i;
 	uint8_t feedback;
 
-	rs_12_9_checksum.bytes[0] = rs_12_9_checksum.bytes[1] = rs_12_9_checksum.bytes[2] = 0;
+	checksum->bytes[0] = checksum->bytes[1] = checksum->bytes[2] = 0;
 
 	for (i = 0; i < 9; i++) {
-		feedback = codeword->data[i] ^ rs_12_9_checksum.bytes[0];
+		feedback = codeword->data[i] ^ checksum->bytes[0];
+
+		checksum->bytes[0] = checksum->bytes[1] ^ rs_12_9_galois_multiplication(genpoly[2], feedback);
+		checksum->bytes[1] = checksum->bytes[2] ^ rs_12_9_galois_multiplication(genpoly[1], feedback);
+		checksum->bytes[2] = rs_12_9_galois_multiplication(genpoly[0], feedback);
+	}
+	return checksum;
+}
+
+rs_12_9_checksum_t *rs_12_9_calc_checksum(rs_12_9_codeword_t *codeword) {
+	static rs_12_9_checksum_t rs_12_9_checksum;
+
+	return rs_12_9_calc_checksum_r(codeword, &rs_12_9_checksum);
+}
 
-		rs_12_9_checksum.bytes[0] = rs_12_9_checksum.bytes[1] ^ rs_12_9_galois_multiplication(genpoly[2], feedback);
-		rs_12_9_checksum.bytes[1] = rs_12_9_checksum.bytes[2] ^ rs_12_9_galois_multiplication(genpoly[1], feedback);
-		rs_12_9_checksum.bytes[2] = rs_12_9_galois_multiplication(genpoly[0], feedback);
+// Generates the GF(256) multiplication table from the log/antilog tables.
+void rs_12_9_init(void) {
+	uint16_t a, b;
+
+	console_log(LOGLEVEL_DEBUG LOGLEVEL_CODING "rs (12,9): calculating galois multiplication table\n");
+
+	for (a = 0; a < 256; a++) {
+		for (b = 0; b < 256; b++) {
+			if (a == 0 || b == 0)
+				rs_12_9_galois_multiplication_table[a][b] = 0;
+			else
+				rs_12_9_galois_multiplication_table[a][b] = rs_12_9_galois_exp_table[(rs_12_9_galois_log_table[a] + rs_12_9_galois_log_table[b]) % 255];
+		}
 	}
-	return &rs_12_9_checksum;
 }
@@ -22,6 +22,7 @@
 #include <libs/daemon/console.h>
 
 #include <stdlib.h>
+#include <string.h>
 
 static uint8_t trellis_dibit_interleave_matrix[] = { // See DMR AI protocol spec. page 130.
 	0,	1,	8,	9,	16,	17,	24,	25,	32,	33,	40,	41,	48,	49,	56,	57,	64,	65,	72,	73,	80,	81,	88,	89,	96,	97,
@@ -41,12 +42,73 @@ static uint8_t trellis_trellis_encoder_state_transition_table[] = { // See DMR A
 	6,	14,	0,	8,	4,	12,	2,	10
 };
 
-trellis_dibits_t *trellis_extract_dibits(dmrpacket_payload_info_bits_t *info_bits) {
-	static trellis_dibits_t dibits;
+// Inverse of trellis_dibit_interleave_matrix, used for deinterleaving.
+static uint8_t trellis_dibit_deinterleave_matrix[] = {
+	0,	1,	26,	27,	50,	51,	74,	75,
+	2,	3,	28,	29,	52,	53,	76,	77,
+	4,	5,	30,	31,	54,	55,	78,	79,
+	6,	7,	32,	33,	56,	57,	80,	81,
+	8,	9,	34,	35,	58,	59,	82,	83,
+	10,	11,	36,	37,	60,	61,	84,	85,
+	12,	13,	38,	39,	62,	63,	86,	87,
+	14,	15,	40,	41,	64,	65,	88,	89,
+	16,	17,	42,	43,	66,	67,	90,	91,
+	18,	19,	44,	45,	68,	69,	92,	93,
+	20,	21,	46,	47,	70,	71,	94,	95,
+	22,	23,	48,	49,	72,	73,	96,	97,
+	24,	25
+};
+
+// 4FSK symbol mapping, see DMR AI protocol spec. page 111. Indexed by the two bits of the dibit.
+static trellis_dibit_t trellis_bits_to_dibit[4] = { +1, +3, -1, -3 };
+
+// The dibits are indexed in the following tables by TRELLIS_DIBIT_INDEX(): -3, -1, +1, +3.
+#define TRELLIS_DIBIT_INDEX(dibit) ((((dibit)+3) >> 1) & 0x03)
+
+static uint8_t trellis_dibit_to_bits[4] = { 0b11, 0b10, 0b00, 0b01 };
+
+// See DMR AI protocol spec. page 129.
+static uint8_t trellis_dibits_to_constellationpoint[4][4] = {
+	{ 3,	4,	15,	8 },
+	{ 6,	1,	10,	13 },
+	{ 7,	0,	11,	12 },
+	{ 2,	5,	14,	9 }
+};
+
+static trellis_dibit_t trellis_constellationpoint_to_dibits[16][2] = {
+	{ +1, -1 }, { -1, -1 }, { +3, -3 }, { -3, -3 }, { -3, -1 }, { +3, -1 }, { -1, -3 }, { +1, -3 },
+	{ -3, +3 }, { +3, +3 }, { -1, +1 }, { +1, +1 }, { +1, +3 }, { -1, +3 }, { +3, +1 }, { -3, +1 }
+};
+
+// Hamming distances between the bits of the constellation points' dibit pairs, used
+// as branch metrics by the Viterbi decoder.
+static uint8_t trellis_constellationpoint_distances[16][16] = {
+	{ 0, 1, 2, 3, 2, 1, 2, 1, 4, 3, 2, 1, 2, 3, 2, 3 },
+	{ 1, 0, 3, 2, 1, 2, 1, 2, 3, 4, 1, 2, 3, 2, 3, 2 },
+	{ 2, 3, 0, 1, 2, 1, 2, 1, 2, 1, 4, 3, 2, 3, 2, 3 },
+	{ 3, 2, 1, 0, 1, 2, 1, 2, 1, 2, 3, 4, 3, 2, 3, 2 },
+	{ 2, 1, 2, 1, 0, 1, 2, 3, 2, 3, 2, 3, 4, 3, 2, 1 },
+	{ 1, 2, 1, 2, 1, 0, 3, 2, 3, 2, 3, 2, 3, 4, 1, 2 },
+	{ 2, 1, 2, 1, 2, 3, 0, 1, 2, 3, 2, 3, 2, 1, 4, 3 },
+	{ 1, 2, 1, 2, 3, 2, 1, 0, 3, 2, 3, 2, 1, 2, 3, 4 },
+	{ 4, 3, 2, 1, 2, 3, 2, 3, 0, 1, 2, 3, 2, 1, 2, 1 },
+	{ 3, 4, 1, 2, 3, 2, 3, 2, 1, 0, 3, 2, 1, 2, 1, 2 },
+	{ 2, 1, 4, 3, 2, 3, 2, 3, 2, 3, 0, 1, 2, 1, 2, 1 },
+	{ 1, 2, 3, 4, 3, 2, 3, 2, 3, 2, 1, 0, 1, 2, 1, 2 },
+	{ 2, 3, 2, 3, 4, 3, 2, 1, 2, 1, 2, 1, 0, 1, 2, 3 },
+	{ 3, 2, 3, 2, 3, 4, 1, 2, 1, 2, 1, 2, 1, 0, 3, 2 },
+	{ 2, 3, 2, 3, 2, 1, 4, 3, 2, 1, 2, 1, 2, 3, 0, 1 },
+	{ 3, 2, 3, 2, 1, 2, 3, 4, 1, 2, 1, 2, 3, 2, 1, 0 }
+};
+
+// Initial metric of the unreachable states. It can't overflow when adding the branch metrics to it.
+#define TRELLIS_VITERBI_METRIC_INFINITE 0x1000
+
+trellis_dibits_t *trellis_extract_dibits_r(dmrpacket_payload_info_bits_t *info_bits, trellis_dibits_t *dibits) {
 	loglevel_t loglevel = console_get_loglevel();
 	int i;
 
-	if (info_bits == NULL)
+	if (info_bits == NULL || dibits == NULL)
 		return NULL;
 
 	if (loglevel.flags.dmrdata && loglevel.flags.debug) {
@@ -57,34 +119,31 @@ trellis_dibits_t *trellis_extract_dibits(dmrpacket_payload_info_bits_t *info_bit
 		console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "\n");
 	}
 
-	for (i = 0; i < 196; i += 2) {
-		// Calculate the dibits from the 4FSK symbol mapping, see DMR AI protocol spec. page 111.
-		if (info_bits->bits[i] == 0 && info_bits->bits[i+1] == 1)
-			dibits.dibits[i/2] = 3;
-		else if (info_bits->bits[i] == 0 && info_bits->bits[i+1] == 0)
-			dibits.dibits[i/2] = 1;
-		else if (info_bits->bits[i] == 1 && info_bits->bits[i+1] == 0)
-			dibits.dibits[i/2] = -1;
-		else if (info_bits->bits[i] == 1 && info_bits->bits[i+1] == 1)
-			dibits.dibits[i/2] = -3;
-	}
+	for (i = 0; i < 196; i += 2)
+		dibits->dibits[i/2] = trellis_bits_to_dibit[(info_bits->bits[i] & 1) << 1 | (info_bits->bits[i+1] & 1)];
 
 	if (loglevel.flags.dmrdata && loglevel.flags.debug) {
 		console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "  output: ");
 		for (i = 0; i < 98; i++)
-			console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "%d ", dibits.dibits[i]);
+			console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "%d ", dibits->dibits[i]);
 		console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "\n");
 	}
 
-	return &dibits;
+	return dibits;
 }
 
-dmrpacket_payload_info_bits_t *trellis_construct_payload_info_bits(trellis_dibits_t *dibits) {
-	static dmrpacket_payload_info_bits_t info_bits;
+trellis_dibits_t *trellis_extract_dibits(dmrpacket_payload_info_bits_t *info_bits) {
+	static trellis_dibits_t dibits;
+
+	return trellis_extract_dibits_r(info_bits, &dibits);
+}
+
+dmrpacket_payload_info_bits_t *trellis_construct_payload_info_bits_r(trellis_dibits_t *dibits, dmrpacket_payload_info_bits_t *info_bits) {
 	loglevel_t loglevel = console_get_loglevel();
+	uint8_t bits;
 	int i;
 
-	if (dibits == NULL)
+	if (dibits == NULL || info_bits == NULL)
 		return NULL;
 
 	if (loglevel.flags.dmrdata && loglevel.flags.debug) {
@@ -96,31 +155,32 @@ dmrpacket_payload_info_bits_t *trellis_construct_payload_info_bits(trellis_dibit
 	}
 
 	for (i = 0; i < sizeof(trellis_dibits_t); i++) {
-		switch (dibits->dibits[i]) {
-			case +3: info_bits.bits[i*2] = 0; info_bits.bits[i*2+1] = 1; break;
-			case +1: info_bits.bits[i*2] = 0; info_bits.bits[i*2+1] = 0; break;
-			case -1: info_bits.bits[i*2] = 1; info_bits.bits[i*2+1] = 0; break;
-			case -3: info_bits.bits[i*2] = 1; info_bits.bits[i*2+1] = 1; break;
-			default: break;
-		}
+		bits = trellis_dibit_to_bits[TRELLIS_DIBIT_INDEX(dibits->dibits[i])];
+		info_bits->bits[i*2] = bits >> 1;
+		info_bits->bits[i*2+1] = bits & 1;
 	}
 
 	if (loglevel.flags.dmrdata && loglevel.flags.debug) {
 		console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "  output: ");
 		for (i = 0; i < sizeof(dmrpacket_payload_info_bits_t); i += 2)
-			console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "%u%u ", info_bits.bits[i], info_bits.bits[i+1]);
+			console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "%u%u ", info_bits->bits[i], info_bits->bits[i+1]);
 		console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "\n");
 	}
 
-	return &info_bits;
+	return info_bits;
 }
 
-trellis_dibits_t *trellis_deinterleave_dibits(trellis_dibits_t *dibits) {
-	static trellis_dibits_t deinterleaved_dibits;
+dmrpacket_payload_info_bits_t *trellis_construct_payload_info_bits(trellis_dibits_t *dibits) {
+	static dmrpacket_payload_info_bits_t info_bits;
+
+	return trellis_construct_payload_info_bits_r(dibits, &info_bits);
+}
+
+trellis_dibits_t *trellis_deinterleave_dibits_r(trellis_dibits_t *dibits, trellis_dibits_t *deinterleaved_dibits) {
 	loglevel_t loglevel = console_get_loglevel();
 	int i;
 
-	if (dibits == NULL)
+	if (dibits == NULL || deinterleaved_dibits == NULL)
 		return NULL;
 
 	if (loglevel.flags.dmrdata && loglevel.flags.debug) {
@@ -132,24 +192,29 @@ trellis_dibits_t *trellis_deinterleave_dibits(trellis_dibits_t *dibits) {
 	}
 
 	for (i = 0; i < 98; i++)
-		deinterleaved_dibits.dibits[trellis_dibit_interleave_matrix[i]] = dibits->dibits[i];
+		deinterleaved_dibits->dibits[i] = dibits->dibits[trellis_dibit_deinterleave_matrix[i]];
 
 	if (loglevel.flags.dmrdata && loglevel.flags.debug) {
 		console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "  output: ");
 		for (i = 0; i < 98; i++)
-			console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "%d ", deinterleaved_dibits.dibits[i]);
+			console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "%d ", deinterleaved_dibits->dibits[i]);
 		console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "\n");
 	}
 
-	return &deinterleaved_dibits;
+	return deinterleaved_dibits;
 }
 
-trellis_dibits_t *trellis_interleave_dibits(trellis_dibits_t *dibits) {
-	static trellis_dibits_t interleaved_dibits;
+trellis_dibits_t *trellis_deinterleave_dibits(trellis_dibits_t *dibits) {
+	static trellis_dibits_t deinterleaved_dibits;
+
+	return trellis_deinterleave_dibits_r(dibits, &deinterleaved_dibits);
+}
+
+trellis_dibits_t *trellis_interleave_dibits_r(trellis_dibits_t *dibits, trellis_dibits_t *interleaved_dibits) {
 	loglevel_t loglevel = console_get_loglevel();
 	int i;
 
-	if (dibits == NULL)
+	if (dibits == NULL || interleaved_dibits == NULL)
 		return NULL;
 
 	if (loglevel.flags.dmrdata && loglevel.flags.debug) {
@@ -161,24 +226,29 @@ trellis_dibits_t *trellis_interleave_dibits(trellis_dibits_t *dibits) {
 	}
 
 	for (i = 0; i < 98; i++)
-		interleaved_dibits.dibits[i] = dibits->dibits[trellis_dibit_interleave_matrix[i]];
+		interleaved_dibits->dibits[i] = dibits->dibits[trellis_dibit_interleave_matrix[i]];
 
 	if (loglevel.flags.dmrdata && loglevel.flags.debug) {
 		console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "  output: ");
 		for (i = 0; i < sizeof(trellis_dibits_t); i++)
-			console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "%d ", interleaved_dibits.dibits[i]);
+			console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "%d ", interleaved_dibits->dibits[i]);
 		console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "\n");
 	}
 
-	return &interleaved_dibits;
+	return interleaved_dibits;
 }
 
-trellis_constellationpoints_t *trellis_getconstellationpoints(trellis_dibits_t *deinterleaved_dibits) {
-	static trellis_constellationpoints_t constellationpoints;
+trellis_dibits_t *trellis_interleave_dibits(trellis_dibits_t *dibits) {
+	static trellis_dibits_t interleaved_dibits;
+
+	return trellis_interleave_dibits_r(dibits, &interleaved_dibits);
+}
+
+trellis_constellationpoints_t *trellis_getconstellationpoints_r(trellis_dibits_t *deinterleaved_dibits, trellis_constellationpoints_t *constellationpoints) {
 	loglevel_t loglevel = console_get_loglevel();
 	int i;
 
-	if (deinterleaved_dibits == NULL)
+	if (deinterleaved_dibits == NULL || constellationpoints == NULL)
 		return NULL;
 
 	if (loglevel.flags.dmrdata && loglevel.flags.debug) {
@@ -190,40 +260,31 @@ trellis_constellationpoints_t *trellis_getconstellationpoints(trellis_dibits_t *
 	}
 
 	for (i = 0; i < 98; i += 2) {
-		if		(deinterleaved_dibits->dibits[i] == +1 && deinterleaved_dibits->dibits[i+1] == -1) constellationpoints.points[i/2] = 0;
-		else if	(deinterleaved_dibits->dibits[i] == -1 && deinterleaved_dibits->dibits[i+1] == -1) constellationpoints.points[i/2] = 1;
-		else if	(deinterleaved_dibits->dibits[i] == +3 && deinterleaved_dibits->dibits[i+1] == -3) constellationpoints.points[i/2] = 2;
-		else if	(deinterleaved_dibits->dibits[i] == -3 && deinterleaved_dibits->dibits[i+1] == -3) constellationpoints.points[i/2] = 3;
-		else if	(deinterleaved_dibits->dibits[i] == -3 && deinterleaved_dibits->dibits[i+1] == -1) constellationpoints.points[i/2] = 4;
-		else if	(deinterleaved_dibits->dibits[i] == +3 && deinterleaved_dibits->dibits[i+1] == -1) constellationpoints.points[i/2] = 5;
-		else if	(deinterleaved_dibits->dibits[i] == -1 && deinterleaved_dibits->dibits[i+1] == -3) constellationpoints.points[i/2] = 6;
-		else if	(deinterleaved_dibits->dibits[i] == +1 && deinterleaved_dibits->dibits[i+1] == -3) constellationpoints.points[i/2] = 7;
-		else if	(deinterleaved_dibits->dibits[i] == -3 && deinterleaved_dibits->dibits[i+1] == +3) constellationpoints.points[i/2] = 8;
-		else if	(deinterleaved_dibits->dibits[i] == +3 && deinterleaved_dibits->dibits[i+1] == +3) constellationpoints.points[i/2] = 9;
-		else if	(deinterleaved_dibits->dibits[i] == -1 && deinterleaved_dibits->dibits[i+1] == +1) constellationpoints.points[i/2] = 10;
-		else if	(deinterleaved_dibits->dibits[i] == +1 && deinterleaved_dibits->dibits[i+1] == +1) constellationpoints.points[i/2] = 11;
-		else if	(deinterleaved_dibits->dibits[i] == +1 && deinterleaved_dibits->dibits[i+1] == +3) constellationpoints.points[i/2] = 12;
-		else if	(deinterleaved_dibits->dibits[i] == -1 && deinterleaved_dibits->dibits[i+1] == +3) constellationpoints.points[i/2] = 13;
-		else if	(deinterleaved_dibits->dibits[i] == +3 && deinterleaved_dibits->dibits[i+1] == +1) constellationpoints.points[i/2] = 14;
-		else if	(deinterleaved_dibits->dibits[i] == -3 && deinterleaved_dibits->dibits[i+1] == +1) constellationpoints.points[i/2] = 15;
+		constellationpoints->points[i/2] = trellis_dibits_to_constellationpoint[TRELLIS_DIBIT_INDEX(deinterleaved_dibits->dibits[i])]
+			[TRELLIS_DIBIT_INDEX(deinterleaved_dibits->dibits[i+1])];
 	}
 
 	if (loglevel.flags.dmrdata && loglevel.flags.debug) {
 		console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "  output: ");
 		for (i = 0; i < 49; i++)
-			console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "%u ", constellationpoints.points[i]);
+			console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "%u ", constellationpoints->points[i]);
 		console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "\n");
 	}
 
-	return &constellationpoints;
+	return constellationpoints;
 }
 
-trellis_dibits_t *trellis_construct_deinterleaved_dibits(trellis_constellationpoints_t *constellationpoints) {
-	static trellis_dibits_t deinterleaved_dibits;
+trellis_constellationpoints_t *trellis_getconstellationpoints(trellis_dibits_t *deinterleaved_dibits) {
+	static trellis_constellationpoints_t constellationpoints;
+
+	return trellis_getconstellationpoints_r(deinterleaved_dibits, &constellationpoints);
+}
+
+trellis_dibits_t *trellis_construct_deinterleaved_dibits_r(trellis_constellationpoints_t *constellationpoints, trellis_dibits_t *deinterleaved_dibits) {
 	loglevel_t loglevel = console_get_loglevel();
 	int i;
 
-	if (constellationpoints == NULL)
+	if (constellationpoints == NULL || deinterleaved_dibits == NULL)
 		return NULL;
 
 	if (loglevel.flags.dmrdata && loglevel.flags.debug) {
@@ -235,45 +296,81 @@ trellis_dibits_t *trellis_construct_deinterleaved_dibits(trellis_constellationpo
 	}
 
 	for (i = 0; i < sizeof(trellis_constellationpoints_t); i++) {
-		switch (constellationpoints->points[i]) {
-			case 0: deinterleaved_dibits.dibits[i*2]  = +1; deinterleaved_dibits.dibits[i*2+1] = -1; break;
-			case 1: deinterleaved_dibits.dibits[i*2]  = -1; deinterleaved_dibits.dibits[i*2+1] = -1; break;
-			case 2: deinterleaved_dibits.dibits[i*2]  = +3; deinterleaved_dibits.dibits[i*2+1] = -3; break;
-			case 3: deinterleaved_dibits.dibits[i*2]  = -3; deinterleaved_dibits.dibits[i*2+1] = -3; break;
-			case 4: deinterleaved_dibits.dibits[i*2]  = -3; deinterleaved_dibits.dibits[i*2+1] = -1; break;
-			case 5: deinterleaved_dibits.dibits[i*2]  = +3; deinterleaved_dibits.dibits[i*2+1] = -1; break;
-			case 6: deinterleaved_dibits.dibits[i*2]  = -1; deinterleaved_dibits.dibits[i*2+1] = -3; break;
-			case 7: deinterleaved_dibits.dibits[i*2]  = +1; deinterleaved_dibits.dibits[i*2+1] = -3; break;
-			case 8: deinterleaved_dibits.dibits[i*2]  = -3; deinterleaved_dibits.dibits[i*2+1] = +3; break;
-			case 9: deinterleaved_dibits.dibits[i*2]  = +3; deinterleaved_dibits.dibits[i*2+1] = +3; break;
-			case 10: deinterleaved_dibits.dibits[i*2] = -1; deinterleaved_dibits.dibits[i*2+1] = +1; break;
-			case 11: deinterleaved_dibits.dibits[i*2] = +1; deinterleaved_dibits.dibits[i*2+1] = +1; break;
-			case 12: deinterleaved_dibits.dibits[i*2] = +1; deinterleaved_dibits.dibits[i*2+1] = +3; break;
-			case 13: deinterleaved_dibits.dibits[i*2] = -1; deinterleaved_dibits.dibits[i*2+1] = +3; break;
-			case 14: deinterleaved_dibits.dibits[i*2] = +3; deinterleaved_dibits.dibits[i*2+1] = +1; break;
-			case 15: deinterleaved_dibits.dibits[i*2] = -3; deinterleaved_dibits.dibits[i*2+1] = +1; break;
-			default: break;
-		}
+		deinterleaved_dibits->dibits[i*2] = trellis_constellationpoint_to_dibits[constellationpoints->points[i] & 0x0f][0];
+		deinterleaved_dibits->dibits[i*2+1] = trellis_constellationpoint_to_dibits[constellationpoints->points[i] & 0x0f][1];
 	}
 
 	if (loglevel.flags.dmrdata && loglevel.flags.debug) {
 		console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "  output: ");
 		for (i = 0; i < sizeof(trellis_dibits_t); i++)
-			console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "%d ", deinterleaved_dibits.dibits[i]);
+			console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "%d ", deinterleaved_dibits->dibits[i]);
 		console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "\n");
 	}
 
-	return &deinterleaved_dibits;
+	return deinterleaved_dibits;
 }
 
-trellis_tribits_t *trellis_extract_tribits(trellis_constellationpoints_t *constellationpoints) {
-	static trellis_tribits_t tribits;
-	int i, j, row_start;
-	flag_t match;
-	trellis_tribit_t last_state = 0;
+trellis_dibits_t *trellis_construct_deinterleaved_dibits(trellis_constellationpoints_t *constellationpoints) {
+	static trellis_dibits_t deinterleaved_dibits;
+
+	return trellis_construct_deinterleaved_dibits_r(constellationpoints, &deinterleaved_dibits);
+}
+
+// Viterbi decoder for the 8 state encoder. branch_metrics contains the cost of receiving each of the
+// 16 constellation points at every position. Hard decision decoding fills it with Hamming distances,
+// but soft metrics can be given as well. Returns the path metric of the surviving path.
+static uint16_t trellis_viterbi_decode(uint8_t branch_metrics[49][16], trellis_tribits_t *tribits) {
+	uint16_t path_metrics[8];
+	uint16_t new_path_metrics[8];
+	uint8_t survivors[49][8];
+	uint16_t metric;
+	uint8_t i, state, prev_state, new_states_count;
+
+	path_metrics[0] = 0; // The encoder starts from state 0.
+	for (state = 1; state < 8; state++)
+		path_metrics[state] = TRELLIS_VITERBI_METRIC_INFINITE;
+
+	for (i = 0; i < 49; i++) {
+		// The last constellation point is generated with a flushing 0 tribit, so only state 0 is valid there.
+		new_states_count = (i == 48 ? 1 : 8);
+
+		// Add-compare-select. The new state is always the input tribit.
+		for (state = 0; state < new_states_count; state++) {
+			new_path_metrics[state] = TRELLIS_VITERBI_METRIC_INFINITE;
+			survivors[i][state] = 0;
+			for (prev_state = 0; prev_state < 8; prev_state++) {
+				metric = path_metrics[prev_state] + branch_metrics[i][trellis_trellis_encoder_state_transition_table[prev_state*8+state]];
+				if (metric < new_path_metrics[state]) {
+					new_path_metrics[state] = metric;
+					survivors[i][state] = prev_state;
+				}
+			}
+		}
+		for (state = 0; state < new_states_count; state++)
+			path_metrics[state] = new_path_metrics[state];
+	}
+
+	// Tracing back from the final state 0.
+	state = survivors[48][0];
+	for (i = 48; i > 0; i--) {
+		tribits->tribits[i-1] = state;
+		state = survivors[i-1][state];
+	}
+
+	return path_metrics[0];
+}
+
+// Decodes the tribits using the Viterbi algorithm, so bit errors in the constellation points can be corrected.
+// If path_metric is not NULL, the metric of the decoded path is stored in it. It's the number of bits which differ
+// between the received and the decoded constellation points. These are the corrected bit errors only if the data
+// was correctable, which is checked by the caller with the data's CRC.
+trellis_tribits_t *trellis_extract_tribits_r(trellis_constellationpoints_t *constellationpoints, uint16_t *path_metric, trellis_tribits_t *tribits) {
+	uint8_t branch_metrics[49][16];
+	uint16_t metric;
+	int i;
 	loglevel_t loglevel = console_get_loglevel();
 
-	if (constellationpoints == NULL)
+	if (constellationpoints == NULL || tribits == NULL)
 		return NULL;
 
 	if (loglevel.flags.dmrdata && loglevel.flags.debug) {
@@ -284,42 +381,38 @@ trellis_tribits_t *trellis_extract_tribits(trellis_constellationpoints_t *conste
 		console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "\n");
 	}
 
-	for (i = 0; i < 49; i++) {
-		row_start = last_state*8;
-		match = 0;
-		for (j = row_start; j < row_start+8; j++) {
-			// Check if this constellation point matches an element of this row of the state table.
-			if (constellationpoints->points[i] == trellis_trellis_encoder_state_transition_table[j]) {
-				match = 1;
-				last_state = j-row_start;
-				tribits.tribits[i] = last_state;
-			}
-		}
+	for (i = 0; i < 49; i++)
+		memcpy(branch_metrics[i], trellis_constellationpoint_distances[constellationpoints->points[i] & 0x0f], sizeof(branch_metrics[i]));
 
-		// If no match found then we have a problem.
-		if (match == 0) {
-			console_log("trellis: trellis tribit extract error, data is corrupted\n");
-			return NULL;
-		}
-	}
+	metric = trellis_viterbi_decode(branch_metrics, tribits);
+	if (path_metric)
+		*path_metric = metric;
+
+	if (metric > 0)
+		console_log(LOGLEVEL_CODING "trellis: path metric of the decoded data is %u\n", metric);
 
 	if (loglevel.flags.dmrdata && loglevel.flags.debug) {
 		console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "  output: ");
 		for (i = 0; i < 48; i++)
-			console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "%u ", tribits.tribits[i]);
+			console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "%u ", tribits->tribits[i]);
 		console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "\n");
 	}
 
-	return &tribits;
+	return tribits;
 }
 
-trellis_constellationpoints_t *trellis_construct_constellationpoints(trellis_tribits_t *tribits) {
-	static trellis_constellationpoints_t constellationpoints;
+trellis_tribits_t *trellis_extract_tribits(trellis_constellationpoints_t *constellationpoints, uint16_t *path_metric) {
+	static trellis_tribits_t tribits;
+
+	return trellis_extract_tribits_r(constellationpoints, path_metric, &tribits);
+}
+
+trellis_constellationpoints_t *trellis_construct_constellationpoints_r(trellis_tribits_t *tribits, trellis_constellationpoints_t *constellationpoints) {
 	int i, row_start;
 	trellis_tribit_t last_state = 0;
 	loglevel_t loglevel = console_get_loglevel();
 
-	if (tribits == NULL)
+	if (tribits == NULL || constellationpoints == NULL)
 		return NULL;
 
 	if (loglevel.flags.dmrdata && loglevel.flags.debug) {
@@ -332,27 +425,32 @@ trellis_constellationpoints_t *trellis_construct_constellationpoints(trellis_tri
 
 	for (i = 0; i < sizeof(trellis_tribits_t); i++) {
 		row_start = last_state*8;
-		constellationpoints.points[i] = trellis_trellis_encoder_state_transition_table[row_start+tribits->tribits[i]];
+		constellationpoints->points[i] = trellis_trellis_encoder_state_transition_table[row_start+tribits->tribits[i]];
 		last_state = tribits->tribits[i];
 	}
-	constellationpoints.points[i] = trellis_trellis_encoder_state_transition_table[last_state*8];
+	constellationpoints->points[i] = trellis_trellis_encoder_state_transition_table[last_state*8];
 
 	if (loglevel.flags.dmrdata && loglevel.flags.debug) {
 		console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "  output: ");
 		for (i = 0; i < sizeof(trellis_constellationpoints_t); i++)
-			console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "%u ", constellationpoints.points[i]);
+			console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "%u ", constellationpoints->points[i]);
 		console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "\n");
 	}
 
-	return &constellationpoints;
+	return constellationpoints;
 }
 
-dmrpacket_data_binary_t *trellis_extract_binary(trellis_tribits_t *tribits) {
-	static dmrpacket_data_binary_t binary;
+trellis_constellationpoints_t *trellis_construct_constellationpoints(trellis_tribits_t *tribits) {
+	static trellis_constellationpoints_t constellationpoints;
+
+	return trellis_construct_constellationpoints_r(tribits, &constellationpoints);
+}
+
+dmrpacket_data_binary_t *trellis_extract_binary_r(trellis_tribits_t *tribits, dmrpacket_data_binary_t *binary) {
 	int i;
 	loglevel_t loglevel = console_get_loglevel();
 
-	if (tribits == NULL)
+	if (tribits == NULL || binary == NULL)
 		return NULL;
 
 	if (loglevel.flags.dmrdata && loglevel.flags.debug) {
@@ -364,39 +462,44 @@ dmrpacket_data_binary_t *trellis_extract_binary(trellis_tribits_t *tribits) {
 	}
 
 	for (i = 0; i < 144; i += 3) {
-		binary.bits[i] =	((tribits->tribits[i/3] & 0b100) > 0);
-		binary.bits[i+1] =	((tribits->tribits[i/3] & 0b010) > 0);
-		binary.bits[i+2] =	((tribits->tribits[i/3] & 0b001) > 0);
+		binary->bits[i] =	((tribits->tribits[i/3] & 0b100) > 0);
+		binary->bits[i+1] =	((tribits->tribits[i/3] & 0b010) > 0);
+		binary->bits[i+2] =	((tribits->tribits[i/3] & 0b001) > 0);
 	}
 
 	if (loglevel.flags.dmrdata && loglevel.flags.debug) {
 		console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "  output: ");
 		for (i = 0; i < 144; i += 3)
-			console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "%u%u%u ", binary.bits[i], binary.bits[i+1], binary.bits[i+2]);
+			console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "%u%u%u ", binary->bits[i], binary->bits[i+1], binary->bits[i+2]);
 		console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "\n");
 	}
 
-	return &binary;
+	return binary;
 }
 
-trellis_tribits_t *trellis_construct_tribits(dmrpacket_data_binary_t *binary) {
-	static trellis_tribits_t tribits;
+dmrpacket_data_binary_t *trellis_extract_binary(trellis_tribits_t *tribits) {
+	static dmrpacket_data_binary_t binary;
+
+	return trellis_extract_binary_r(tribits, &binary);
+}
+
+trellis_tribits_t *trellis_construct_tribits_r(dmrpacket_data_binary_t *binary, trellis_tribits_t *tribits) {
 	int i;
 	loglevel_t loglevel = console_get_loglevel();
 
-	if (binary == NULL)
+	if (binary == NULL || tribits == NULL)
 		return NULL;
 
 	if (loglevel.flags.dmrdata && loglevel.flags.debug) {
 		console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "trellis: constructing tribits from binary data\n");
 		console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "  input: ");
-		for (i = 0; i < sizeof(dmrpacket_data_binary_t); i += 3)
+		for (i = 0; i < 144; i += 3)
 			console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "%u%u%u ", binary->bits[i], binary->bits[i+1], binary->bits[i+2]);
 		console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "\n");
 	}
 
-	for (i = 0; i < sizeof(dmrpacket_data_binary_t); i += 3) {
-		tribits.tribits[i/3] =	(binary->bits[i] == 1) << 2 |
+	for (i = 0; i < 144; i += 3) {
+		tribits->tribits[i/3] =	(binary->bits[i] == 1) << 2 |
 								(binary->bits[i+1] == 1) << 1 |
 								(binary->bits[i+2] == 1);
 	}
@@ -404,9 +507,15 @@ trellis_tribits_t *trellis_construct_tribits(dmrpacket_data_binary_t *binary) {
 	if (loglevel.flags.dmrdata && loglevel.flags.debug) {
 		console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "  output: ");
 		for (i = 0; i < sizeof(trellis_tribits_t); i++)
-			console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "%u ", tribits.tribits[i]);
+			console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "%u ", tribits->tribits[i]);
 		console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "\n");
 	}
 
-	return &tribits;
+	return tribits;
+}
+
+trellis_tribits_t *trellis_construct_tribits(dmrpacket_data_binary_t *binary) {
+	static trellis_tribits_t tribits;
+
+	return trellis_construct_tribits_r(binary, &tribits);
 }
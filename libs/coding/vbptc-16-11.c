@@ -22,16 +22,34 @@
 #include <libs/daemon/console.h>
 
 #include <string.h>
-#include <stdlib.h>
 
-typedef struct {
-	flag_t bits[5];
-} hamming_error_vector_t;
+// Hamming(16,11) parity check matrix rows as masks on a matrix row. Column 0 of a matrix row is the
+// MSB. See vbptc_16_11_get_syndrome() for details.
+static const uint16_t vbptc_16_11_hamming_parity_check_masks[5] = { 0xf590, 0x7ac8, 0x3d64, 0xeb22, 0xa6e1 };
+
+// Erroneous bit positions indexed by the error vector (syndrome), -1 if the error can't be located.
+// This is the inverse of the generator matrix P part (see page 136 of the DMR AI. spec.) extended with
+// the identity matrix, which is used to determine errors in the Hamming checksum bits.
+static const int8_t vbptc_16_11_hamming_error_positions[32] = {
+	-1, 15, 14, -1, 13, -1, -1, 10, 12, -1, -1,  6, -1,  9,  4, -1,
+	11, -1, -1,  0, -1,  5,  7, -1, -1,  8,  1, -1,  3, -1, -1,  2
+};
 
 static uint16_t vbptc_16_11_get_matrix_free_space(vbptc_16_11_t *vbptc) {
 	return vbptc->expected_rows*16-(vbptc->current_col*vbptc->expected_rows+vbptc->current_row);
 }
 
+static flag_t vbptc_16_11_get_bit(vbptc_16_11_t *vbptc, uint8_t row, uint8_t col) {
+	return (vbptc->rows[row] >> (15-col)) & 1;
+}
+
+static void vbptc_16_11_set_bit(vbptc_16_11_t *vbptc, uint8_t row, uint8_t col, flag_t bit) {
+	if (bit)
+		vbptc->rows[row] |= 1 << (15-col);
+	else
+		vbptc->rows[row] &= ~(1 << (15-col));
+}
+
 static void vbptc_16_11_print_matrix(vbptc_16_11_t *vbptc) {
 	loglevel_t loglevel = console_get_loglevel();
 	uint8_t row;
@@ -42,7 +60,7 @@ static void vbptc_16_11_print_matrix(vbptc_16_11_t *vbptc) {
 
 	console_log(LOGLEVEL_DEBUG LOGLEVEL_CODING "    vbptc (16,11) matrix: ");
 
-	if (vbptc == NULL || vbptc->matrix == NULL || vbptc->expected_rows == 0) {
+	if (vbptc == NULL || vbptc->expected_rows == 0) {
 		console_log(LOGLEVEL_DEBUG LOGLEVEL_CODING "empty\n");
 		return;
 	}
@@ -54,7 +72,7 @@ static void vbptc_16_11_print_matrix(vbptc_16_11_t *vbptc) {
 		for (col = 0; col < 16; col++) {
 			if (col == 11)
 				console_log(LOGLEVEL_DEBUG LOGLEVEL_CODING " ");
-			console_log(LOGLEVEL_DEBUG LOGLEVEL_CODING "%u", vbptc->matrix[row*16+col]);
+			console_log(LOGLEVEL_DEBUG LOGLEVEL_CODING "%u", vbptc_16_11_get_bit(vbptc, row, col));
 		}
 		console_log(LOGLEVEL_DEBUG LOGLEVEL_CODING "\n");
 		if (row == vbptc->expected_rows-2)
@@ -70,7 +88,7 @@ flag_t vbptc_16_11_add_burst(vbptc_16_11_t *vbptc, flag_t *burst_data, uint8_t b
 	uint16_t bits_to_add;
 	uint8_t i;
 
-	if (vbptc == NULL || vbptc->matrix == NULL)
+	if (vbptc == NULL || vbptc->expected_rows == 0)
 		return 0;
 
 	matrix_free_space = vbptc_16_11_get_matrix_free_space(vbptc);
@@ -80,7 +98,7 @@ flag_t vbptc_16_11_add_burst(vbptc_16_11_t *vbptc, flag_t *burst_data, uint8_t b
 	bits_to_add = min(burst_data_length, matrix_free_space);
 
 	for (i = 0; i < bits_to_add; i++) {
-		vbptc->matrix[vbptc->current_col+vbptc->current_row*16] = burst_data[i];
+		vbptc_16_11_set_bit(vbptc, vbptc->current_row, vbptc->current_col, burst_data[i]);
 		vbptc->current_row++;
 		if (vbptc->current_row == vbptc->expected_rows) {
 			vbptc->current_col++;
@@ -91,123 +109,74 @@ flag_t vbptc_16_11_add_burst(vbptc_16_11_t *vbptc, flag_t *burst_data, uint8_t b
 	return 1;
 }
 
+// Returns the parity of the given 16 bit word.
+static uint8_t vbptc_16_11_get_parity(uint16_t word) {
+	word ^= word >> 8;
+	word ^= word >> 4;
+	return (0x6996 >> (word & 0x0f)) & 1;
+}
+
 // Hamming(16, 11, 4) checking of a matrix row (16 total bits, 11 data bits, min. distance: 4)
 // See page 136 of the DMR Air Interface protocol specification for the generator matrix.
 // A generator matrix looks like this: G = [Ik | P]. The parity check matrix is: H = [-P^T|In-k]
 // In binary codes, then -P = P, so the negation is unnecessary. We can get the parity check matrix
-// only by transposing the generator matrix. We then take a data row, and multiply it with each row
-// of the parity check matrix, then xor each resulting row bits together with the corresponding
-// parity check bit. The xor result (error vector) should be 0, if it's not, it can be used
-// to determine the location of the erroneous bit using the generator matrix (P).
-static void vbptc_16_11_get_parity_bits(flag_t *data_bits, hamming_error_vector_t *error_vector) {
-	if (data_bits == NULL || error_vector == NULL)
-		return;
-
-	error_vector->bits[0] = (data_bits[0] ^ data_bits[1] ^ data_bits[2] ^ data_bits[3] ^ data_bits[5] ^ data_bits[7] ^ data_bits[8]);
-	error_vector->bits[1] = (data_bits[1] ^ data_bits[2] ^ data_bits[3] ^ data_bits[4] ^ data_bits[6] ^ data_bits[8] ^ data_bits[9]);
-	error_vector->bits[2] = (data_bits[2] ^ data_bits[3] ^ data_bits[4] ^ data_bits[5] ^ data_bits[7] ^ data_bits[9] ^ data_bits[10]);
-	error_vector->bits[3] = (data_bits[0] ^ data_bits[1] ^ data_bits[2] ^ data_bits[4] ^ data_bits[6] ^ data_bits[7] ^ data_bits[10]);
-	error_vector->bits[4] = (data_bits[0] ^ data_bits[2] ^ data_bits[5] ^ data_bits[6] ^ data_bits[8] ^ data_bits[9] ^ data_bits[10]);
+// only by transposing the generator matrix. As a matrix row is stored in a 16 bit word, multiplying
+// it with a row of the parity check matrix is an AND with the row's mask, and xoring the resulting
+// bits together is the parity of the result. The error vector (syndrome) should be 0, if it's not,
+// it can be used to determine the location of the erroneous bit.
+// If the Hamming checksum bits of the row are 0, the returned value is the checksum itself.
+static uint8_t vbptc_16_11_get_syndrome(uint16_t row) {
+	return	vbptc_16_11_get_parity(row & vbptc_16_11_hamming_parity_check_masks[0]) << 4 |
+			vbptc_16_11_get_parity(row & vbptc_16_11_hamming_parity_check_masks[1]) << 3 |
+			vbptc_16_11_get_parity(row & vbptc_16_11_hamming_parity_check_masks[2]) << 2 |
+			vbptc_16_11_get_parity(row & vbptc_16_11_hamming_parity_check_masks[3]) << 1 |
+			vbptc_16_11_get_parity(row & vbptc_16_11_hamming_parity_check_masks[4]);
 }
 
-static flag_t vbptc_16_11_check_row(flag_t *data_bits, hamming_error_vector_t *error_vector) {
-	if (data_bits == NULL || error_vector == NULL)
-		return 0;
-
-	vbptc_16_11_get_parity_bits(data_bits, error_vector);
-
-	error_vector->bits[0] ^= data_bits[11];
-	error_vector->bits[1] ^= data_bits[12];
-	error_vector->bits[2] ^= data_bits[13];
-	error_vector->bits[3] ^= data_bits[14];
-	error_vector->bits[4] ^= data_bits[15];
-
-	if (error_vector->bits[0] == 0 &&
-		error_vector->bits[1] == 0 &&
-		error_vector->bits[2] == 0 &&
-		error_vector->bits[3] == 0 &&
-		error_vector->bits[4] == 0)
-			return 1;
+static flag_t vbptc_16_11_check_row(uint16_t row, uint8_t *syndrome) {
+	*syndrome = vbptc_16_11_get_syndrome(row);
+	if (*syndrome == 0)
+		return 1;
 
 	console_log(LOGLEVEL_DEBUG LOGLEVEL_CODING "    vbptc (16,11): hamming(16,11) error vector: %u%u%u%u%u\n",
-		error_vector->bits[0],
-		error_vector->bits[1],
-		error_vector->bits[2],
-		error_vector->bits[3],
-		error_vector->bits[4]);
+		(*syndrome >> 4) & 1,
+		(*syndrome >> 3) & 1,
+		(*syndrome >> 2) & 1,
+		(*syndrome >> 1) & 1,
+		*syndrome & 1);
 
 	return 0;
 }
 
-// Searches for the given error vector in the generator matrix.
-// Returns the erroneous bit number if the error vector is found, otherwise it returns -1.
-static int8_t vbptc_16_11_find_error_position(hamming_error_vector_t *error_vector) {
-	// See page 136 of the DMR AI. spec. for the generator matrix.
-	static flag_t hamming_16_11_generator_matrix[] = {
-		1,	0,	0,	1,	1,
-		1,	1,	0,	1,	0,
-		1,	1,	1,	1,	1,
-		1,	1,	1,	0,	0,
-		0,	1,	1,	1,	0,
-		1,	0,	1,	0,	1,
-		0,	1,	0,	1,	1,
-		1,	0,	1,	1,	0,
-		1,	1,	0,	0,	1,
-		0,	1,	1,	0,	1,
-		0,	0,	1,	1,	1,
-
-		1,	0,	0,	0,	0, // These are used to determine errors in the Hamming checksum bits.
-		0,	1,	0,	0,	0,
-		0,	0,	1,	0,	0,
-		0,	0,	0,	1,	0,
-		0,	0,	0,	0,	1
-	};
-	uint8_t row;
-
-	if (error_vector == NULL)
-		return -1;
-
-	for (row = 0; row < 16; row++) {
-		if (hamming_16_11_generator_matrix[row*5] == error_vector->bits[0] &&
-			hamming_16_11_generator_matrix[row*5+1] == error_vector->bits[1] &&
-			hamming_16_11_generator_matrix[row*5+2] == error_vector->bits[2] &&
-			hamming_16_11_generator_matrix[row*5+3] == error_vector->bits[3] &&
-			hamming_16_11_generator_matrix[row*5+4] == error_vector->bits[4])
-				return row;
-	}
-
-	return -1;
-}
-
 // Checks data for errors and tries to repair them.
 flag_t vbptc_16_11_check_and_repair(vbptc_16_11_t *vbptc) {
-	hamming_error_vector_t hamming_error_vector = { .bits = {0,} };
+	uint8_t syndrome;
 	uint8_t row, col;
 	int8_t wrongbitnr = -1;
-	uint8_t parity;
+	uint16_t parity;
 	flag_t errors_found = 0;
 	flag_t result = 1;
 
-	if (vbptc == NULL || vbptc->matrix == NULL || vbptc->expected_rows < 2)
+	if (vbptc == NULL || vbptc->expected_rows < 2)
 		return 0;
 
 	vbptc_16_11_print_matrix(vbptc);
 
 	for (row = 0; row < vbptc->expected_rows-1; row++) { // -1 because the last row contains only single parity check bits.
-		if (!vbptc_16_11_check_row(vbptc->matrix+row*16, &hamming_error_vector)) {
+		if (!vbptc_16_11_check_row(vbptc->rows[row], &syndrome)) {
 			errors_found = 1;
 			// Error check failed, checking if we can determine the location of the bit error.
-			wrongbitnr = vbptc_16_11_find_error_position(&hamming_error_vector);
+			wrongbitnr = vbptc_16_11_hamming_error_positions[syndrome];
 			if (wrongbitnr < 0) {
 				console_log(LOGLEVEL_CODING "    vbptc (16,11): hamming(16,11) check error, can't repair row #%u\n", row);
 				result = 0;
 			} else {
 				console_log(LOGLEVEL_CODING "    vbptc (16,11): hamming(16,11) check error, fixing bit pos. #%u in row #%u\n", wrongbitnr, row);
-				vbptc->matrix[row*16+wrongbitnr] = !vbptc->matrix[row*16+wrongbitnr];
+				vbptc->rows[row] ^= 1 << (15-wrongbitnr);
 
 				vbptc_16_11_print_matrix(vbptc);
 
-				if (!vbptc_16_11_check_row(vbptc->matrix+row*16, &hamming_error_vector)) {
+				if (!vbptc_16_11_check_row(vbptc->rows[row], &syndrome)) {
 					console_log(LOGLEVEL_CODING "    vbptc (16,11): hamming(16,11) check error, couldn't repair row #%u\n", row);
 					result = 0;
 				}
@@ -215,15 +184,17 @@ flag_t vbptc_16_11_check_and_repair(vbptc_16_11_t *vbptc) {
 		}
 	}
 
-	for (col = 0; col < 16; col++) {
-		parity = 0;
-		for (row = 0; row < vbptc->expected_rows-1; row++)
-			parity = (parity + vbptc->matrix[row*16+col]) % 2;
-
-		if (parity != vbptc->matrix[(vbptc->expected_rows-1)*16+col]) {
-			console_log(LOGLEVEL_CODING "    vbptc (16,11): parity check error in col. #%u\n", col);
-			return 0; // As we don't modify the parity bits we can return here immediately.
-		}
+	// Checking all column parities at once, the bits of the xored rows should match the last row.
+	parity = 0;
+	for (row = 0; row < vbptc->expected_rows-1; row++)
+		parity ^= vbptc->rows[row];
+	parity ^= vbptc->rows[vbptc->expected_rows-1];
+
+	if (parity) {
+		for (col = 0; !(parity & (1 << (15-col))); col++)
+			;
+		console_log(LOGLEVEL_CODING "    vbptc (16,11): parity check error in col. #%u\n", col);
+		return 0; // As we don't modify the parity bits we can return here immediately.
 	}
 
 	if (result && !errors_found)
@@ -240,10 +211,9 @@ void vbptc_16_11_construct(vbptc_16_11_t *vbptc, flag_t *bits, uint16_t bits_siz
 	uint16_t bits_to_add;
 	uint8_t row;
 	uint8_t col;
-	hamming_error_vector_t parity_bits;
-	flag_t parity;
+	uint16_t parity;
 
-	if (vbptc == NULL || vbptc->matrix == NULL || vbptc->expected_rows == 0 || bits == NULL || bits_size == 0)
+	if (vbptc == NULL || vbptc->expected_rows == 0 || bits == NULL || bits_size == 0)
 		return;
 
 	vbptc_16_11_clear(vbptc);
@@ -251,7 +221,7 @@ void vbptc_16_11_construct(vbptc_16_11_t *vbptc, flag_t *bits, uint16_t bits_siz
 	// Adding data bits.
 	bits_to_add = min(bits_size, vbptc_16_11_get_matrix_free_space(vbptc));
 	for (col = 0; col < bits_to_add; col++) {
-		vbptc->matrix[vbptc->current_col+vbptc->current_row*16] = bits[col];
+		vbptc_16_11_set_bit(vbptc, vbptc->current_row, vbptc->current_col, bits[col]);
 		vbptc->current_col++;
 		if (vbptc->current_col == 11) {
 			vbptc->current_row++;
@@ -259,20 +229,15 @@ void vbptc_16_11_construct(vbptc_16_11_t *vbptc, flag_t *bits, uint16_t bits_siz
 		}
 	}
 
-	// Calculating Hamming(16,11) paritys.
+	// Calculating Hamming(16,11) paritys. As the checksum bits are 0, the syndrome is the checksum.
+	parity = 0;
 	for (row = 0; row < vbptc->expected_rows-1; row++) { // -1 because the last row contains only single parity check bits.
-		vbptc_16_11_get_parity_bits(&vbptc->matrix[row*16], &parity_bits);
-		memcpy(&vbptc->matrix[row*16+11], parity_bits.bits, sizeof(hamming_error_vector_t));
+		vbptc->rows[row] = (vbptc->rows[row] & 0xffe0) | vbptc_16_11_get_syndrome(vbptc->rows[row] & 0xffe0);
+		parity ^= vbptc->rows[row];
 	}
 
-	// Calculating simple parity bits to the last row.
-	for (col = 0; col < 16; col++) {
-		parity = 0;
-		for (row = 0; row < vbptc->expected_rows-1; row++)
-			parity = (parity + vbptc->matrix[row*16+col]) % 2;
-
-		vbptc->matrix[(vbptc->expected_rows-1)*16+col] = parity;
-	}
+	// Storing simple parity bits to the last row.
+	vbptc->rows[vbptc->expected_rows-1] = parity;
 
 	//console_log(LOGLEVEL_CODING LOGLEVEL_DEBUG "vbptc (16,11): constructed matrix:\n");
 	//vbptc_16_11_print_matrix(vbptc);
@@ -283,7 +248,7 @@ void vbptc_16_11_get_data_bits(vbptc_16_11_t *vbptc, flag_t *bits, uint16_t bits
 	uint8_t row;
 	uint8_t col;
 
-	if (vbptc == NULL || vbptc->matrix == NULL || vbptc->expected_rows == 0)
+	if (vbptc == NULL || vbptc->expected_rows == 0)
 		return;
 
 	for (row = 0; row < vbptc->expected_rows-1; row++) { // -1 because the last row contains only single parity check bits.
@@ -291,7 +256,7 @@ void vbptc_16_11_get_data_bits(vbptc_16_11_t *vbptc, flag_t *bits, uint16_t bits
 			if (row*11+col >= bits_size)
 				break;
 
-			bits[row*11+col] = vbptc->matrix[row*16+col];
+			bits[row*11+col] = vbptc_16_11_get_bit(vbptc, row, col);
 		}
 	}
 }
@@ -303,7 +268,7 @@ void vbptc_16_11_get_interleaved_bits(vbptc_16_11_t *vbptc, uint16_t from_bit_nu
 	uint16_t bits_to_get;
 	uint16_t bits_got = 0;
 
-	if (vbptc == NULL || vbptc->matrix == NULL || vbptc->expected_rows == 0)
+	if (vbptc == NULL || vbptc->expected_rows == 0)
 		return;
 
 	bits_to_get = min(vbptc->expected_rows*16, bits_count);
@@ -314,42 +279,31 @@ void vbptc_16_11_get_interleaved_bits(vbptc_16_11_t *vbptc, uint16_t from_bit_nu
 				break;
 
 			if (from_bit_number == 0)
-				bits[bits_got++] = vbptc->matrix[row*16+col];
+				bits[bits_got++] = vbptc_16_11_get_bit(vbptc, row, col);
 			else
 				from_bit_number--;
 		}
 	}
 }
 
-void vbptc_16_11_free(vbptc_16_11_t *vbptc) {
-	if (vbptc == NULL)
-		return;
-
-	if (vbptc->matrix != NULL)
-		free(vbptc->matrix);
-
-	memset(vbptc, 0, sizeof(vbptc_16_11_t));
-}
-
 void vbptc_16_11_clear(vbptc_16_11_t *vbptc) {
 	if (vbptc == NULL)
 		return;
 
 	vbptc->current_row = vbptc->current_col = 0;
-	if (vbptc->matrix)
-		memset(vbptc->matrix, 0, vbptc->expected_rows*16);
+	memset(vbptc->rows, 0, sizeof(vbptc->rows));
 }
 
-// Allocates memory for the given number of expected bits.
+// Sets up the matrix for the given number of expected rows.
+// Returns 0 if the matrix can't hold that many rows.
 flag_t vbptc_16_11_init(vbptc_16_11_t *vbptc, uint8_t expected_rows) {
-	uint16_t bytes_to_allocate = expected_rows*16;
-
 	if (vbptc == NULL)
 		return 0;
 
-	vbptc->matrix = (flag_t *)calloc(bytes_to_allocate, 1);
-	if (vbptc->matrix == NULL) {
-		console_log(LOGLEVEL_DEBUG LOGLEVEL_CODING "    vbptc (16,11): can't allocate %u bytes for the vbptc matrix\n", bytes_to_allocate);
+	vbptc_16_11_clear(vbptc);
+	if (expected_rows > VBPTC_16_11_MAX_ROWS) {
+		console_log(LOGLEVEL_DEBUG LOGLEVEL_CODING "    vbptc (16,11): can't handle %u rows, max. is %u\n", expected_rows, VBPTC_16_11_MAX_ROWS);
+		vbptc->expected_rows = 0;
 		return 0;
 	}
 	vbptc->expected_rows = expected_rows;
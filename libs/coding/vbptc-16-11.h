@@ -20,8 +20,11 @@
 
 #include <libs/base/types.h>
 
+// Embedded signalling LC uses 8 rows.
+#define VBPTC_16_11_MAX_ROWS	8
+
 typedef struct {
-	flag_t *matrix;
+	uint16_t rows[VBPTC_16_11_MAX_ROWS]; // Column 0 of a row is the MSB.
 	uint8_t current_row;
 	uint8_t current_col;
 	uint8_t expected_rows;
@@ -34,7 +37,6 @@ void vbptc_16_11_construct(vbptc_16_11_t *vbptc, flag_t *bits, uint16_t bits_siz
 void vbptc_16_11_get_data_bits(vbptc_16_11_t *vbptc, flag_t *bits, uint16_t bits_size);
 void vbptc_16_11_get_interleaved_bits(vbptc_16_11_t *vbptc, uint16_t from_bit_number, flag_t *bits, uint16_t bits_count);
 
-void vbptc_16_11_free(vbptc_16_11_t *vbptc);
 void vbptc_16_11_clear(vbptc_16_11_t *vbptc);
 flag_t vbptc_16_11_init(vbptc_16_11_t *vbptc, uint8_t expected_rows);
 
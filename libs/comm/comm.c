@@ -22,9 +22,11 @@
 #include "snmp.h"
 #include "repeaters.h"
 #include "httpserver.h"
+#include "pcapreplay.h"
 
 #include <libs/daemon/console.h>
 #include <libs/daemon/daemon-poll.h>
+#include <libs/daemon/daemon-latency.h>
 #include <libs/config/config.h>
 
 #include <pcap/pcap.h>
@@ -37,7 +39,6 @@
 #include <string.h>
 
 static pcap_t *comm_pcap_handle = NULL;
-static pcap_t *comm_pcap_file_handle = NULL;
 
 struct __attribute__((packed)) linux_sll {
 	// Packet_* describing packet origins:
@@ -226,26 +227,7 @@ uint16_t comm_calcudpchecksum(struct ip *ipheader, struct udphdr *udpheader) {
 	return ~checksum;
 }
 
-void comm_pcapfile_open(char *filename) {
-	char errbuf[PCAP_ERRBUF_SIZE];
-	comm_pcap_file_handle = pcap_open_offline(filename, errbuf);
-	int pcap_dev = -1;
-
-	if (!comm_pcap_file_handle) {
-		console_log("comm error: can't open pcap file %s: %s\n", filename, errbuf);
-		return;
-	}
-
-	pcap_dev = pcap_get_selectable_fd(comm_pcap_handle);
-	if (pcap_dev == -1)
-		console_log("comm warning: can't add pcap file handle to the poll list\n");
-	else
-		daemon_poll_addfd_read(pcap_dev);
-
-	console_log("comm: opened pcap file %s\n", filename);
-}
-
-static uint8_t *comm_get_ip_packet_from_pcap_packet(uint8_t *packet, pcap_t *pcap_handle, uint16_t *ip_packet_length) {
+uint8_t *comm_get_ip_packet_from_pcap_packet(uint8_t *packet, pcap_t *pcap_handle, uint16_t *ip_packet_length) {
 	struct ether_header *eth_packet = NULL;
 	struct linux_sll *linux_sll_packet = NULL;
 
@@ -281,53 +263,43 @@ static void comm_log_packet(uint8_t *packet, uint16_t length) {
 	}
 }
 
+// Processes a packet read from the given pcap handle.
+void comm_process_pcap_packet(pcap_t *pcap_handle, struct pcap_pkthdr *pkthdr, uint8_t *packet) {
+	uint16_t ip_packet_length = 0;
+
+	if (pcap_handle == NULL || pkthdr == NULL || packet == NULL)
+		return;
+
+	console_log(LOGLEVEL_COMM_IP "comm got packet: %u bytes\n", pkthdr->len);
+	ip_packet_length = pkthdr->len;
+	packet = comm_get_ip_packet_from_pcap_packet(packet, pcap_handle, &ip_packet_length);
+	if (packet) {
+		comm_log_packet(packet, ip_packet_length);
+		ipsc_processpacket((ipscpacket_raw_t *)packet, ip_packet_length);
+	}
+}
+
 void comm_process(void) {
 	uint8_t *packet = NULL;
 	struct pcap_pkthdr pkthdr;
-	uint16_t ip_packet_length = 0;
-	int pcap_dev = -1;
 
 	snmp_process();
+	daemon_latency_mark(DAEMON_LATENCY_STAGE_SNMP);
 
 	if (comm_pcap_handle != NULL) {
 		packet = (uint8_t *)pcap_next(comm_pcap_handle, &pkthdr);
-		if (packet != NULL) {
-			console_log(LOGLEVEL_COMM_IP "comm got packet: %u bytes\n", pkthdr.len);
-			ip_packet_length = pkthdr.len;
-			packet = comm_get_ip_packet_from_pcap_packet(packet, comm_pcap_handle, &ip_packet_length);
-			if (packet) {
-				comm_log_packet(packet, ip_packet_length);
-				ipsc_processpacket((ipscpacket_raw_t *)packet, ip_packet_length);
-			}
-		}
+		if (packet != NULL)
+			comm_process_pcap_packet(comm_pcap_handle, &pkthdr, packet);
 	}
+	daemon_latency_mark(DAEMON_LATENCY_STAGE_PCAP);
 
-	if (comm_pcap_file_handle != NULL) {
-		packet = (uint8_t *)pcap_next(comm_pcap_file_handle, &pkthdr);
-		if (packet != NULL) {
-			console_log(LOGLEVEL_COMM_IP "comm got packet: %u bytes\n", pkthdr.len);
-			ip_packet_length = pkthdr.len;
-			packet = comm_get_ip_packet_from_pcap_packet(packet, comm_pcap_file_handle, &ip_packet_length);
-			if (packet) {
-				comm_log_packet(packet, ip_packet_length);
-				ipsc_processpacket((ipscpacket_raw_t *)packet, ip_packet_length);
-			}
-		} else {
-			console_log("comm: finished processing pcap file.\n");
-			pcap_dev = pcap_get_selectable_fd(comm_pcap_file_handle);
-			if (pcap_dev > -1)
-				daemon_poll_removefd(pcap_dev);
-			pcap_close(comm_pcap_file_handle);
-			comm_pcap_file_handle = NULL;
-		}
-
-		// Setting timeout to 0 because select() and poll() do not work correctly on BPF devices.
-		// See man pcap_get_selectable_fd for more info.
-		daemon_poll_setmaxtimeout(0);
-	}
+	pcapreplay_process();
+	daemon_latency_mark(DAEMON_LATENCY_STAGE_PCAPREPLAY);
 
 	repeaters_process();
+	daemon_latency_mark(DAEMON_LATENCY_STAGE_REPEATERS);
 	httpserver_process();
+	daemon_latency_mark(DAEMON_LATENCY_STAGE_HTTPSERVER);
 }
 
 flag_t comm_init(void) {
@@ -393,14 +365,7 @@ void comm_deinit(void) {
 		comm_pcap_handle = NULL;
 	}
 
-	if (comm_pcap_file_handle != NULL) {
-		pcap_dev = pcap_get_selectable_fd(comm_pcap_file_handle);
-		if (pcap_dev > -1)
-			daemon_poll_removefd(pcap_dev);
-		pcap_close(comm_pcap_file_handle);
-		comm_pcap_file_handle = NULL;
-	}
-
+	pcapreplay_deinit();
 	httpserver_deinit();
 	snmp_deinit();
 	repeaters_deinit();
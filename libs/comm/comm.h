@@ -22,6 +22,7 @@
 
 #include <netinet/ip.h>
 #include <netinet/udp.h>
+#include <pcap/pcap.h>
 
 flag_t comm_is_masteripaddr(struct in_addr *ip);
 flag_t comm_hostname_to_ip(char *hostname, struct in_addr *ipaddr);
@@ -31,7 +32,8 @@ flag_t comm_is_our_ipaddr(struct in_addr *ipaddr);
 uint16_t comm_calcipheaderchecksum(struct ip *ipheader);
 uint16_t comm_calcudpchecksum(struct ip *ipheader, struct udphdr *udpheader);
 
-void comm_pcapfile_open(char *filename);
+uint8_t *comm_get_ip_packet_from_pcap_packet(uint8_t *packet, pcap_t *pcap_handle, uint16_t *ip_packet_length);
+void comm_process_pcap_packet(pcap_t *pcap_handle, struct pcap_pkthdr *pkthdr, uint8_t *packet);
 
 void comm_process(void);
 flag_t comm_init(void);
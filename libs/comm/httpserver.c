@@ -22,11 +22,26 @@
 #include <libs/config/config.h>
 #include <libs/daemon/console.h>
 #include <libs/daemon/daemon-poll.h>
+#include <libs/daemon/daemon-latency.h>
 #include <libs/voicestreams/voicestreams-mp3.h>
+#include <libs/voicestreams/voicestreams-file.h>
+#include <libs/voicestreams/voicestreams-governor.h>
 
 #include <libwebsockets.h>
 
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+
 #define HTTPSERVER_LWS_TXBUFFER_SIZE 65000
+// Max. number of bytes of a recorded call passed to one sendfile() call.
+#define HTTPSERVER_SENDFILE_CHUNK_SIZE 65536
+
+ASSERT(VOICESTREAMS_SHARED_FRAME_PRE_PADDING >= LWS_SEND_BUFFER_PRE_PADDING && VOICESTREAMS_SHARED_FRAME_POST_PADDING >= LWS_SEND_BUFFER_POST_PADDING);
 
 static struct lws_context *httpserver_lws_context = NULL;
 
@@ -36,10 +51,20 @@ typedef struct httpserver_client_st {
 	char host[100];
 	flag_t is_on_websockets;
 	voicestream_t *voicestream;
-	uint8_t buf[HTTPSERVER_LWS_TXBUFFER_SIZE];
+	voicestreams_format_t format; // Websocket clients can change it with the changeformat command.
+	// Sequence number of the next shared frame of the voicestream to send, and the number of its already sent bytes.
+	uint32_t frame_seq;
+	uint16_t frame_offset;
+	// Data which is sent only to this client (HTTP headers, pages, silent frames). It's sent before shared frames.
+	// The buffer is allocated with LWS padding when needed, and freed when it gets empty.
+	uint8_t *buf;
 	uint16_t bytesinbuf;
 	flag_t close_on_buf_empty;
 	struct timeval last_silent_frame_sent_time;
+	// Part of a recording file which is sent to the client after its own buffer, -1 if there's none.
+	int sendfile_fd;
+	off_t sendfile_offset;
+	off_t sendfile_end;
 
 	struct httpserver_client_st *next;
 	struct httpserver_client_st *prev;
@@ -65,22 +90,46 @@ static httpserver_client_t *httpserver_get_client_by_wsi(struct lws *wsi) {
 // If there's not enough space, it will fill the buffer up and discards remaining bytes.
 // Returns the number of bytes put into the buffer.
 static uint16_t httpserver_sendtoclient(httpserver_client_t *client, uint8_t *buf, uint16_t bytestosend) {
-	uint16_t bytesfreeinbuf;
 	uint16_t bytestowritetobuf;
+	uint8_t *newbuf;
 
 	if (client == NULL || buf == NULL || bytestosend == 0)
 		return 0;
 
-	bytesfreeinbuf = sizeof(client->buf)-client->bytesinbuf;
-	bytestowritetobuf = min(bytestosend, bytesfreeinbuf);
+	bytestowritetobuf = min(bytestosend, HTTPSERVER_LWS_TXBUFFER_SIZE-client->bytesinbuf);
 	if (bytestowritetobuf) {
-		memcpy(client->buf+client->bytesinbuf, buf, bytestowritetobuf);
+		newbuf = (uint8_t *)realloc(client->buf, LWS_SEND_BUFFER_PRE_PADDING+client->bytesinbuf+bytestowritetobuf+LWS_SEND_BUFFER_POST_PADDING);
+		if (newbuf == NULL) {
+			console_log(LOGLEVEL_HTTPSERVER "httpserver [%s] error: can't allocate memory for tx buffer\n", client->host);
+			return 0;
+		}
+		client->buf = newbuf;
+		memcpy(client->buf+LWS_SEND_BUFFER_PRE_PADDING+client->bytesinbuf, buf, bytestowritetobuf);
 		client->bytesinbuf += bytestowritetobuf;
 		lws_callback_on_writable(client->wsi);
 	}
 	return bytestowritetobuf;
 }
 
+// Starts sending the given voicestream's shared frames of the given format to the client from the next
+// encoded frame. The stream's listener counts are used to decide which formats its voice needs to be encoded to.
+static void httpserver_client_set_voicestream_and_format(httpserver_client_t *client, voicestream_t *voicestream, voicestreams_format_t format) {
+	if (client->voicestream != NULL)
+		client->voicestream->listeners_count[client->format]--;
+	if (voicestream != NULL)
+		voicestream->listeners_count[format]++;
+
+	client->voicestream = voicestream;
+	client->format = format;
+	client->frame_offset = 0;
+	if (voicestream != NULL)
+		client->frame_seq = voicestream->listener_frames_head[format];
+}
+
+static void httpserver_client_set_voicestream(httpserver_client_t *client, voicestream_t *voicestream) {
+	httpserver_client_set_voicestream_and_format(client, voicestream, client->format);
+}
+
 static char *httpserver_get_client_host_or_ip(struct lws *wsi) {
 	static char clienthost[100];
 	static char clientip[INET6_ADDRSTRLEN];
@@ -97,11 +146,16 @@ static char *httpserver_get_client_host_or_ip(struct lws *wsi) {
 	return clienthost;
 }
 
-static uint16_t httpserver_calc_datatosendsize(struct lws *wsi, httpserver_client_t *httpserver_client) {
+// Websocket messages are always written in one piece, as the parts of a split write would arrive as separate
+// messages. These writes are never partial, libwebsockets buffers the part which can't be sent immediately.
+static uint16_t httpserver_calc_datatosendsize(struct lws *wsi, httpserver_client_t *client, uint16_t bytestosend) {
 	uint16_t datatosendsize;
 	int peerallowance;
 
-	datatosendsize = min(httpserver_client->bytesinbuf, HTTPSERVER_LWS_TXBUFFER_SIZE);
+	if (client->is_on_websockets)
+		return bytestosend;
+
+	datatosendsize = min(bytestosend, HTTPSERVER_LWS_TXBUFFER_SIZE);
 	peerallowance = lws_get_peer_write_allowance(wsi);
 	if (peerallowance >= 0)
 		datatosendsize = min(datatosendsize, peerallowance);
@@ -109,6 +163,261 @@ static uint16_t httpserver_calc_datatosendsize(struct lws *wsi, httpserver_clien
 	return datatosendsize;
 }
 
+// Sends the client's own buffer, then the voicestream's shared frames which haven't been sent to the client yet.
+// Shared frames are written directly from the frame's buffer, so they are not copied for each client.
+// The client's own buffer is not sent while a shared frame is partially sent, so they don't get mixed.
+// Returns -1 if the connection should be closed.
+static int httpserver_client_write(struct lws *wsi, httpserver_client_t *client, enum lws_write_protocol protocol) {
+	voicestream_t *voicestream = client->voicestream;
+	voicestreams_shared_frame_t *frame;
+	uint32_t *frames_head;
+	uint16_t datatosendsize;
+	int bytes_sent;
+
+	while (client->bytesinbuf > 0 && client->frame_offset == 0) {
+		datatosendsize = httpserver_calc_datatosendsize(wsi, client, client->bytesinbuf);
+		bytes_sent = lws_write(wsi, client->buf+LWS_SEND_BUFFER_PRE_PADDING, datatosendsize, protocol);
+		console_log(LOGLEVEL_HTTPSERVER LOGLEVEL_DEBUG "httpserver [%s%s]: sent %u bytes\n", client->host, (client->is_on_websockets ? "/ws" : ""), bytes_sent);
+		if (bytes_sent < 0)
+			return -1;
+		if (client->is_on_websockets)
+			bytes_sent = datatosendsize;
+
+		// Shifting the buffer, so we can continue sending the data next time.
+		client->bytesinbuf -= bytes_sent;
+		memmove(client->buf+LWS_SEND_BUFFER_PRE_PADDING, client->buf+LWS_SEND_BUFFER_PRE_PADDING+bytes_sent, client->bytesinbuf);
+		if (client->bytesinbuf == 0) {
+			free(client->buf);
+			client->buf = NULL;
+		}
+
+		if (lws_partial_buffered(wsi) || lws_send_pipe_choked(wsi)) {
+			lws_callback_on_writable(wsi);
+			return 0;
+		}
+	}
+
+	if (voicestream == NULL)
+		return 0;
+
+	frames_head = &voicestream->listener_frames_head[client->format];
+	if (*frames_head-client->frame_seq > VOICESTREAMS_LISTENER_FRAMES_COUNT) {
+		console_log(LOGLEVEL_HTTPSERVER "httpserver [%s]: client is too slow, skipping %u frames\n", client->host,
+			*frames_head-client->frame_seq-VOICESTREAMS_LISTENER_FRAMES_COUNT);
+		client->frame_seq = *frames_head-VOICESTREAMS_LISTENER_FRAMES_COUNT;
+		client->frame_offset = 0;
+	}
+
+	while (client->frame_seq != *frames_head) {
+		frame = voicestream->listener_frames[client->format][client->frame_seq & (VOICESTREAMS_LISTENER_FRAMES_COUNT-1)];
+		// Websocket writes put the frame header before the data, into the frame's padding. As these writes
+		// are never partial, the offset is always 0 for them, so the header can't overwrite the frame's data.
+		// HTTP writes can be partial, but they don't write into the padding.
+		datatosendsize = httpserver_calc_datatosendsize(wsi, client, frame->bytes_size-client->frame_offset);
+		bytes_sent = lws_write(wsi, VOICESTREAMS_SHARED_FRAME_BYTES(frame)+client->frame_offset, datatosendsize, protocol);
+		console_log(LOGLEVEL_HTTPSERVER LOGLEVEL_DEBUG "httpserver [%s%s]: sent %u frame bytes\n", client->host, (client->is_on_websockets ? "/ws" : ""), bytes_sent);
+		if (bytes_sent < 0)
+			return -1;
+		if (client->is_on_websockets)
+			bytes_sent = datatosendsize;
+
+		client->frame_offset += bytes_sent;
+		if (client->frame_offset >= frame->bytes_size) {
+			client->frame_seq++;
+			client->frame_offset = 0;
+		}
+
+		if (lws_partial_buffered(wsi) || lws_send_pipe_choked(wsi))
+			break;
+	}
+
+	// Schedule a callback again for async tx.
+	if (client->frame_seq != *frames_head || client->bytesinbuf > 0)
+		lws_callback_on_writable(wsi);
+	return 0;
+}
+
+// Sends the client's part of the recording file directly from the file to the socket. The server
+// doesn't use SSL, so the data doesn't have to go through libwebsockets.
+// Returns -1 if the connection should be closed.
+static int httpserver_client_sendfile(struct lws *wsi, httpserver_client_t *client) {
+	ssize_t bytes_sent;
+	int sockfd;
+
+	// Data buffered by libwebsockets has to be sent out first.
+	if (lws_partial_buffered(wsi)) {
+		lws_callback_on_writable(wsi);
+		return 0;
+	}
+
+	sockfd = lws_get_socket_fd(wsi);
+	if (sockfd < 0)
+		return -1;
+
+	while (client->sendfile_offset < client->sendfile_end) {
+		bytes_sent = sendfile(sockfd, client->sendfile_fd, &client->sendfile_offset, min(client->sendfile_end-client->sendfile_offset, HTTPSERVER_SENDFILE_CHUNK_SIZE));
+		if (bytes_sent < 0) {
+			if (errno == EAGAIN || errno == EINTR) {
+				lws_callback_on_writable(wsi);
+				return 0;
+			}
+			console_log(LOGLEVEL_HTTPSERVER "httpserver [%s] error: sendfile failed: %s\n", client->host, strerror(errno));
+			return -1;
+		}
+		if (bytes_sent == 0) { // The file has been truncated.
+			console_log(LOGLEVEL_HTTPSERVER "httpserver [%s] error: recording file is shorter than indexed\n", client->host);
+			return -1;
+		}
+		console_log(LOGLEVEL_HTTPSERVER LOGLEVEL_DEBUG "httpserver [%s]: sent %zd recording bytes\n", client->host, bytes_sent);
+	}
+
+	close(client->sendfile_fd);
+	client->sendfile_fd = -1;
+	return 0;
+}
+
+// Returns 1 if the given date is in YYYYMMDD format.
+static flag_t httpserver_is_valid_date(char *date) {
+	int i;
+
+	for (i = 0; date[i] != 0; i++) {
+		if (date[i] < '0' || date[i] > '9')
+			return 0;
+	}
+	return (i == 8);
+}
+
+// Puts the list of the day's indexed calls of the stream's recording file of the given type to the client's buffer.
+static void httpserver_send_recording_list(httpserver_client_t *client, voicestream_t *voicestream, voicestreams_file_type_t type, char *date) {
+	uint8_t txbuf[HTTPSERVER_LWS_TXBUFFER_SIZE];
+	voicestreams_file_index_entry_t entries[64];
+	uint32_t entries_count;
+	uint32_t call_nr = 0;
+	uint32_t i;
+	int length;
+	time_t t;
+	struct tm tm;
+	char started_at[20];
+	char ended_at[20];
+
+	length = snprintf((char *)txbuf, sizeof(txbuf),
+		"HTTP/1.0 200 OK\r\n"
+		"Content-Type: text/plain\r\n"
+		"Cache-Control: no-cache, no-store\r\n"
+		"\r\n"
+		"# call started ended src dst type ts repeater bytes\n");
+
+	do {
+		entries_count = voicestreams_file_read_index(voicestream, type, date, call_nr, entries, sizeof(entries)/sizeof(entries[0]));
+		for (i = 0; i < entries_count && length < sizeof(txbuf)-150; i++, call_nr++) {
+			t = entries[i].started_at;
+			localtime_r(&t, &tm);
+			strftime(started_at, sizeof(started_at), "%Y-%m-%d %H:%M:%S", &tm);
+			t = entries[i].ended_at;
+			localtime_r(&t, &tm);
+			strftime(ended_at, sizeof(ended_at), "%H:%M:%S", &tm);
+			length += snprintf((char *)txbuf+length, sizeof(txbuf)-length, "%u %s %s %u %u %s %u %u %llu\n", call_nr, started_at, ended_at,
+				entries[i].src_id, entries[i].dst_id, dmr_get_readable_call_type(entries[i].call_type), entries[i].timeslot, entries[i].repeater_id,
+				(unsigned long long)(entries[i].end_offset-entries[i].start_offset));
+		}
+	} while (entries_count == sizeof(entries)/sizeof(entries[0]) && length < sizeof(txbuf)-150);
+
+	client->close_on_buf_empty = 1;
+	httpserver_sendtoclient(client, txbuf, length);
+}
+
+// Starts sending the given call of the day's recording file of the given type to the client.
+// The call's position is read from the recording's index. Returns 0 if the call is not found.
+static flag_t httpserver_send_recording(httpserver_client_t *client, voicestream_t *voicestream, voicestreams_file_type_t type, char *date, uint32_t call_nr) {
+	uint8_t txbuf[512];
+	voicestreams_file_index_entry_t entry;
+	char fn[255];
+	struct stat st;
+	int fd;
+
+	if (voicestreams_file_read_index(voicestream, type, date, call_nr, &entry, 1) != 1)
+		return 0;
+
+	voicestreams_file_get_filename_for_date_r(voicestream, type, date, fn, sizeof(fn));
+	fd = open(fn, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	if (fstat(fd, &st) != 0 || entry.end_offset > st.st_size || entry.start_offset >= entry.end_offset) {
+		console_log(LOGLEVEL_HTTPSERVER "httpserver [%s] error: invalid index entry for call #%u in %s\n", client->host, call_nr, fn);
+		close(fd);
+		return 0;
+	}
+
+	snprintf((char *)txbuf, sizeof(txbuf),
+		"HTTP/1.1 200 OK\r\n"
+		"Server: dmrshark v%u.%u.%u\r\n"
+		"Content-Type: %s\r\n"
+		"Content-Length: %llu\r\n"
+		"Content-Disposition: inline; filename=\"dmrshark-%s-%s-%u.%s\"\r\n"
+		"Connection: close\r\n"
+		"\r\n", VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH,
+		(type == VOICESTREAMS_FILE_TYPE_MP3 ? "audio/mpeg" : "application/octet-stream"),
+		(unsigned long long)(entry.end_offset-entry.start_offset),
+		voicestream->name, date, call_nr, voicestreams_file_get_type_name(type));
+	httpserver_sendtoclient(client, txbuf, strlen((char *)txbuf));
+
+	client->sendfile_fd = fd;
+	client->sendfile_offset = entry.start_offset;
+	client->sendfile_end = entry.end_offset;
+	client->close_on_buf_empty = 1;
+	return 1;
+}
+
+// Handles /recordings/[stream]/[YYYYMMDD]/[type] requests, which list the day's indexed calls, and
+// /recordings/[stream]/[YYYYMMDD]/[type]/[call] requests, which download a call. Type is the recording's
+// file extension (ambe, decoded.raw or mp3). Returns 0 if the page is not found.
+static flag_t httpserver_handle_recordings_request(httpserver_client_t *client) {
+	voicestream_t *voicestream;
+	voicestreams_file_type_t type;
+	char *date;
+	char *tok;
+	char *endptr;
+	unsigned long call_nr;
+
+	// Any of the path elements can be missing, for example for /recordings or /recordings/.
+	tok = strtok(NULL, "/");
+	if (tok == NULL)
+		return 0;
+	voicestream = voicestreams_get_stream_by_name(tok);
+	if (voicestream == NULL || !voicestream->savecallindex)
+		return 0;
+
+	date = strtok(NULL, "/");
+	if (date == NULL || !httpserver_is_valid_date(date))
+		return 0;
+
+	tok = strtok(NULL, "/");
+	if (tok == NULL)
+		return 0;
+	type = voicestreams_file_get_type_by_name(tok);
+	if (type >= VOICESTREAMS_FILE_TYPE_COUNT)
+		return 0;
+
+	tok = strtok(NULL, "/");
+	if (tok == NULL) {
+		console_log(LOGLEVEL_HTTPSERVER LOGLEVEL_DEBUG "(recording list request for %s)\n", voicestream->name);
+		httpserver_send_recording_list(client, voicestream, type, date);
+		return 1;
+	}
+
+	call_nr = strtoul(tok, &endptr, 10);
+	if (*endptr != 0 || call_nr > UINT32_MAX)
+		return 0;
+
+	console_log(LOGLEVEL_HTTPSERVER LOGLEVEL_DEBUG "(recording request for %s call #%lu)\n", voicestream->name, call_nr);
+	return httpserver_send_recording(client, voicestream, type, date, call_nr);
+}
+
+static void httpserver_poll_callback(struct pollfd *pfd, void *arg) {
+	if (httpserver_lws_context != NULL)
+		lws_service_fd(httpserver_lws_context, pfd);
+}
+
 static int httpserver_http_callback(struct lws *wsi,
 	enum lws_callback_reasons reason, void *user, void *in, size_t len)
 {
@@ -117,8 +426,8 @@ static int httpserver_http_callback(struct lws *wsi,
 	char *requrl = (char *)in;
 	flag_t pagefound = 0;
 	httpserver_client_t *httpserver_client = NULL;
-	uint16_t datatosendsize;
-	int bytes_sent;
+	voicestream_t *voicestream;
+	int length;
 	char *tok;
 	char *clienthost;
 
@@ -157,9 +466,35 @@ static int httpserver_http_callback(struct lws *wsi,
 					"Hello World!\r\n");
 				httpserver_client->close_on_buf_empty = 1;
 				httpserver_sendtoclient(httpserver_client, txbuf, strlen((char *)txbuf));
-			} else{
-				httpserver_client->voicestream = voicestreams_get_stream_by_name(tok);
-				if (httpserver_client->voicestream != NULL) { // Request is for an existing voicestream?
+			} else if (strcmp(tok, "latency") == 0) {
+				console_log(LOGLEVEL_HTTPSERVER LOGLEVEL_DEBUG "(latency stats request)\n");
+				pagefound = 1;
+
+				length = snprintf((char *)txbuf, sizeof(txbuf),
+					"HTTP/1.0 200 OK\r\n"
+					"Content-Type: text/plain\r\n"
+					"Cache-Control: no-cache, no-store\r\n"
+					"\r\n");
+				length += daemon_latency_get_report((char *)txbuf+length, sizeof(txbuf)-length);
+				httpserver_client->close_on_buf_empty = 1;
+				httpserver_sendtoclient(httpserver_client, txbuf, length);
+			} else if (strcmp(tok, "loadgovernor") == 0) {
+				console_log(LOGLEVEL_HTTPSERVER LOGLEVEL_DEBUG "(load governor state request)\n");
+				pagefound = 1;
+
+				length = snprintf((char *)txbuf, sizeof(txbuf),
+					"HTTP/1.0 200 OK\r\n"
+					"Content-Type: text/plain\r\n"
+					"Cache-Control: no-cache, no-store\r\n"
+					"\r\n");
+				length += voicestreams_governor_get_report((char *)txbuf+length, sizeof(txbuf)-length);
+				httpserver_client->close_on_buf_empty = 1;
+				httpserver_sendtoclient(httpserver_client, txbuf, length);
+			} else if (strcmp(tok, "recordings") == 0) {
+				pagefound = httpserver_handle_recordings_request(httpserver_client);
+			} else {
+				voicestream = voicestreams_get_stream_by_name(tok);
+				if (voicestream != NULL) { // Request is for an existing voicestream?
 					console_log(LOGLEVEL_HTTPSERVER LOGLEVEL_DEBUG "(request for %s)\n", tok);
 					pagefound = 1;
 					snprintf((char *)txbuf, sizeof(txbuf),
@@ -181,6 +516,7 @@ static int httpserver_http_callback(struct lws *wsi,
 						"\r\n", VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH,
 						VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH, tok);
 					httpserver_sendtoclient(httpserver_client, txbuf, strlen((char *)txbuf));
+					httpserver_client_set_voicestream(httpserver_client, voicestream);
 				}
 			}
 
@@ -196,28 +532,16 @@ static int httpserver_http_callback(struct lws *wsi,
 			if (httpserver_client == NULL)
 				return -1;
 
-			while (httpserver_client->bytesinbuf > 0) {
-				datatosendsize = httpserver_calc_datatosendsize(wsi, httpserver_client);
-				memcpy(txbuf, httpserver_client->buf, datatosendsize);
-				bytes_sent = lws_write(wsi, txbuf, datatosendsize, LWS_WRITE_HTTP);
-				console_log(LOGLEVEL_HTTPSERVER LOGLEVEL_DEBUG "httpserver [%s]: sent %u bytes\n", httpserver_client->host, bytes_sent);
-				if (bytes_sent < 0)
-					return -1;
-
-				// Shifting the buffer, so we can continue sending the data next time.
-				memmove(httpserver_client->buf, httpserver_client->buf+bytes_sent, sizeof(httpserver_client->buf)-bytes_sent);
-				httpserver_client->bytesinbuf -= bytes_sent;
+			if (httpserver_client_write(wsi, httpserver_client, LWS_WRITE_HTTP) < 0)
+				return -1;
 
-				if (lws_partial_buffered(wsi) || lws_send_pipe_choked(wsi))
-					break;
+			if (httpserver_client->bytesinbuf == 0 && httpserver_client->sendfile_fd >= 0) {
+				if (httpserver_client_sendfile(wsi, httpserver_client) < 0)
+					return -1;
 			}
 
-			if (httpserver_client->bytesinbuf == 0 && httpserver_client->close_on_buf_empty)
+			if (httpserver_client->bytesinbuf == 0 && httpserver_client->sendfile_fd < 0 && httpserver_client->close_on_buf_empty)
 				return -1;
-
-			// Schedule a callback again for async tx.
-			if (httpserver_client->bytesinbuf > 0)
-				lws_callback_on_writable(wsi);
 			break;
 
 		case LWS_CALLBACK_SERVER_NEW_CLIENT_INSTANTIATED:
@@ -230,6 +554,7 @@ static int httpserver_http_callback(struct lws *wsi,
 			}
 			strncpy(httpserver_client->host, clienthost, sizeof(httpserver_client->host));
 			httpserver_client->wsi = wsi;
+			httpserver_client->sendfile_fd = -1;
 			if (httpserver_clients == NULL)
 				httpserver_clients = httpserver_client;
 			else {
@@ -254,13 +579,17 @@ static int httpserver_http_callback(struct lws *wsi,
 					httpserver_client->next->prev = httpserver_client->prev;
 				if (httpserver_client == httpserver_clients)
 					httpserver_clients = httpserver_client->next;
+				httpserver_client_set_voicestream(httpserver_client, NULL);
+				if (httpserver_client->sendfile_fd >= 0)
+					close(httpserver_client->sendfile_fd);
+				free(httpserver_client->buf);
 				free(httpserver_client);
 				break;
 			}
 			break;
 
 		case LWS_CALLBACK_ADD_POLL_FD:
-			daemon_poll_addfd(pa->fd, pa->events);
+			daemon_poll_addfd_callback(pa->fd, pa->events, httpserver_poll_callback, NULL);
 			break;
 
 		case LWS_CALLBACK_DEL_POLL_FD:
@@ -278,18 +607,27 @@ static int httpserver_http_callback(struct lws *wsi,
 	return 0;
 }
 
-static void httpserver_wesockets_parse_command_line(httpserver_client_t *httpserver_client, char *line, uint8_t *txbuf) {
+static void httpserver_wesockets_parse_command_line(httpserver_client_t *httpserver_client, char *line) {
 	char *wordtok = NULL;
 	char *wordtok_saveptr = NULL;
+	voicestreams_format_t format;
 
 	wordtok = strtok_r(line, " ", &wordtok_saveptr); // First word is the command.
 	if (strcmp("changestream", wordtok) == 0) {
 		wordtok = strtok_r(NULL, " ", &wordtok_saveptr);
-		httpserver_client->voicestream = voicestreams_get_stream_by_name(wordtok);
+		httpserver_client_set_voicestream(httpserver_client, voicestreams_get_stream_by_name(wordtok));
 		if (httpserver_client->voicestream != NULL)
 			console_log(LOGLEVEL_HTTPSERVER "httpserver [%s]: stream changed to %s\n", httpserver_client->host, wordtok);
 		else
 			console_log(LOGLEVEL_HTTPSERVER LOGLEVEL_DEBUG "httpserver [%s] error: stream %s not found\n", httpserver_client->host, wordtok);
+	} else if (strcmp("changeformat", wordtok) == 0) {
+		wordtok = strtok_r(NULL, " ", &wordtok_saveptr);
+		format = voicestreams_get_format_by_name(wordtok);
+		if (format < VOICESTREAMS_FORMAT_COUNT) {
+			httpserver_client_set_voicestream_and_format(httpserver_client, httpserver_client->voicestream, format);
+			console_log(LOGLEVEL_HTTPSERVER "httpserver [%s]: format changed to %s\n", httpserver_client->host, wordtok);
+		} else
+			console_log(LOGLEVEL_HTTPSERVER LOGLEVEL_DEBUG "httpserver [%s] error: unknown format %s\n", httpserver_client->host, (wordtok ? wordtok : ""));
 	}
 }
 
@@ -297,10 +635,6 @@ static void httpserver_wesockets_parse_command_line(httpserver_client_t *httpser
 static int httpserver_websockets_voicestream_callback(struct lws *wsi,
 	enum lws_callback_reasons reason, void *user, void *in, size_t len)
 {
-	uint8_t txbuf_padded[LWS_SEND_BUFFER_PRE_PADDING + HTTPSERVER_LWS_TXBUFFER_SIZE + LWS_SEND_BUFFER_POST_PADDING];
-	uint8_t *txbuf = &txbuf_padded[LWS_SEND_BUFFER_PRE_PADDING];
-	int bytes_sent;
-	uint16_t datatosendsize;
 	httpserver_client_t *httpserver_client = NULL;
 	char *linetok = NULL;
 	char *linetok_saveptr = NULL;
@@ -333,7 +667,7 @@ static int httpserver_websockets_voicestream_callback(struct lws *wsi,
 
 			linetok = strtok_r((char *)in, "\n", &linetok_saveptr);
 			while (linetok != NULL) {
-				httpserver_wesockets_parse_command_line(httpserver_client, linetok, txbuf);
+				httpserver_wesockets_parse_command_line(httpserver_client, linetok);
 				linetok = strtok_r(NULL, "\n", &linetok_saveptr);
 			}
 			break;
@@ -343,25 +677,8 @@ static int httpserver_websockets_voicestream_callback(struct lws *wsi,
 			if (httpserver_client == NULL)
 				return -1;
 
-			while (httpserver_client->bytesinbuf > 0) {
-				datatosendsize = httpserver_calc_datatosendsize(wsi, httpserver_client);
-				memcpy(txbuf, httpserver_client->buf, datatosendsize);
-				bytes_sent = lws_write(wsi, txbuf, datatosendsize, LWS_WRITE_BINARY);
-				console_log(LOGLEVEL_HTTPSERVER LOGLEVEL_DEBUG "httpserver [%s/ws]: sent %u bytes\n", httpserver_client->host, bytes_sent);
-				if (bytes_sent < 0)
-					return -1;
-
-				// Shifting the buffer, so we can continue sending the data next time.
-				memmove(httpserver_client->buf, httpserver_client->buf+bytes_sent, sizeof(httpserver_client->buf)-bytes_sent);
-				httpserver_client->bytesinbuf -= bytes_sent;
-
-				if (lws_partial_buffered(wsi) || lws_send_pipe_choked(wsi))
-					break;
-			}
-
-			// Schedule a callback again for async tx.
-			if (httpserver_client->bytesinbuf > 0)
-				lws_callback_on_writable(wsi);
+			if (httpserver_client_write(wsi, httpserver_client, LWS_WRITE_BINARY) < 0)
+				return -1;
 			break;
 
 		default:
@@ -390,17 +707,24 @@ static struct lws_protocols lwsprotocols[] = {
 	{ NULL, NULL, 0, 0 }
 };
 
-void httpserver_sendtoclients(voicestream_t *voicestream, uint8_t *buf, uint16_t bytestosend) {
+// Adds the frame to the voicestream's ring of shared frames of the frame's format, and schedules
+// sending it to the stream's clients which use that format.
+void httpserver_sendtoclients(voicestream_t *voicestream, voicestreams_shared_frame_t *frame) {
 	httpserver_client_t *client = httpserver_clients;
+	voicestreams_shared_frame_t **slot;
 
-	if (voicestream == NULL || buf == NULL || bytestosend == 0 || !config_get_httpserverenabled())
+	if (voicestream == NULL || frame == NULL || frame->bytes_size == 0 || frame->format >= VOICESTREAMS_FORMAT_COUNT || !config_get_httpserverenabled())
 		return;
 
-	// Looping through all clients and putting data into their buffers if the voicestream matches.
-	// Sending will be handled by the periodic callbacks.
+	slot = &voicestream->listener_frames[frame->format][voicestream->listener_frames_head[frame->format] & (VOICESTREAMS_LISTENER_FRAMES_COUNT-1)];
+	voicestreams_shared_frame_unref(*slot);
+	*slot = voicestreams_shared_frame_ref(frame);
+	voicestream->listener_frames_head[frame->format]++;
+
+	// Sending will be handled by the writable callbacks.
 	while (client) {
-		if (voicestream == client->voicestream)
-			httpserver_sendtoclient(client, buf, bytestosend);
+		if (voicestream == client->voicestream && frame->format == client->format)
+			lws_callback_on_writable(client->wsi);
 
 		client = client->next;
 	}
@@ -434,7 +758,7 @@ void httpserver_print_client_list(void) {
 		else
 			streamname = client->voicestream->name;
 
-		console_log("  #%u websockets: %u stream: %s host: %s\n", i++, client->is_on_websockets, streamname, client->host);
+		console_log("  #%u websockets: %u stream: %s format: %s host: %s\n", i++, client->is_on_websockets, streamname, voicestreams_get_format_name(client->format), client->host);
 
 		client = client->next;
 	}
@@ -446,9 +770,6 @@ void httpserver_process(void) {
 	struct timeval currtime = {0,};
 	struct timeval difftime = {0,};
 #endif
-	int i;
-	int pfdcount;
-	struct pollfd *pfd;
 
 	if (!config_get_httpserverenabled() || httpserver_lws_context == NULL)
 		return;
@@ -456,24 +777,23 @@ void httpserver_process(void) {
 #ifdef MP3ENCODEVOICE
 	// Sending silent MP3 frames to idle HTTP clients.
 	while (client) {
-		if (!client->is_on_websockets && client->voicestream != NULL && client->voicestream->silent_mp3_frame.bytes_size > 0 && !client->voicestream->streaming_active_call) {
+		if (!client->is_on_websockets && client->voicestream != NULL && client->voicestream->silent_mp3_frame != NULL && !client->voicestream->streaming_active_call &&
+			client->frame_seq == client->voicestream->listener_frames_head[client->format] && client->frame_offset == 0) { // Silent frames are only sent after the shared ones.
 			gettimeofday(&currtime, NULL);
 			timersub(&currtime, &client->last_silent_frame_sent_time, &difftime);
-			if (difftime.tv_sec*1000+difftime.tv_usec/1000 >= VOICESTREAMS_MP3_SILENT_FRAME_LENGTH_IN_MS) { // Sending a frame every x ms.
-				i = httpserver_sendtoclient(client, client->voicestream->silent_mp3_frame.bytes, client->voicestream->silent_mp3_frame.bytes_size);
+			if (difftime.tv_sec*1000+difftime.tv_usec/1000 >= client->voicestream->mp3chunkinms) { // The silent frame is one chunk long.
+				httpserver_sendtoclient(client, VOICESTREAMS_SHARED_FRAME_BYTES(client->voicestream->silent_mp3_frame), client->voicestream->silent_mp3_frame->bytes_size);
 				gettimeofday(&client->last_silent_frame_sent_time, NULL);
 			}
-			daemon_poll_setmaxtimeout(VOICESTREAMS_MP3_SILENT_FRAME_LENGTH_IN_MS);
+			daemon_poll_setmaxtimeout(client->voicestream->mp3chunkinms);
 		}
 		client = client->next;
 	}
 #endif
 
-	pfdcount = daemon_poll_getpfdcount();
-	pfd = daemon_poll_getpfd();
-
-	for (i = 0; i < pfdcount-1; i++)
-		lws_service_fd(httpserver_lws_context, &pfd[i]);
+	// Sockets with pending events are serviced by httpserver_poll_callback(), here we only
+	// let libwebsockets handle timeouts.
+	lws_service_fd(httpserver_lws_context, NULL);
 }
 
 void httpserver_init(void) {
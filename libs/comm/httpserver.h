@@ -22,7 +22,7 @@
 
 #include <libs/base/types.h>
 
-void httpserver_sendtoclients(voicestream_t *voicestream, uint8_t *buf, uint16_t bytestosend);
+void httpserver_sendtoclients(voicestream_t *voicestream, voicestreams_shared_frame_t *frame);
 
 void httpserver_print_client_list(void);
 
@@ -18,12 +18,14 @@
 
 
 #include "ipsc-handle.h"
+#include "replaybench.h"
 
 #include <libs/daemon/console.h>
 #include <libs/base/dmr-handle.h>
 #include <libs/dmrpacket/dmrpacket-sync.h>
 #include <libs/voicestreams/voicestreams-process.h>
 #include <libs/base/log.h>
+#include <libs/base/virtclock.h>
 
 void ipsc_handle_by_slot_type(struct ip *ip_packet, ipscpacket_t *ipscpacket, repeater_t *repeater) {
 	loglevel_t loglevel;
@@ -40,7 +42,7 @@ void ipsc_handle_by_slot_type(struct ip *ip_packet, ipscpacket_t *ipscpacket, re
 			if (!loglevel.flags.comm_ip && !loglevel.flags.ipsc && loglevel.flags.dmrlc)
 				log_print_separator();
 
-			repeater->slot[ipscpacket->timeslot-1].last_call_or_data_packet_received_at = time(NULL);
+			repeater->slot[ipscpacket->timeslot-1].last_call_or_data_packet_received_at = virtclock_time();
 			dmr_handle_csbk(ip_packet, ipscpacket, repeater);
 			break;
 		case IPSCPACKET_SLOT_TYPE_VOICE_LC_HEADER:
@@ -48,7 +50,7 @@ void ipsc_handle_by_slot_type(struct ip *ip_packet, ipscpacket_t *ipscpacket, re
 				log_print_separator();
 
 			dmr_handle_data_call_end(repeater, ipscpacket->timeslot-1);
-			repeater->slot[ipscpacket->timeslot-1].last_call_or_data_packet_received_at = time(NULL);
+			repeater->slot[ipscpacket->timeslot-1].last_call_or_data_packet_received_at = virtclock_time();
 			dmr_handle_voice_lc_header(ip_packet, ipscpacket, repeater);
 			break;
 		case IPSCPACKET_SLOT_TYPE_VOICE_DATA_A:
@@ -61,7 +63,7 @@ void ipsc_handle_by_slot_type(struct ip *ip_packet, ipscpacket_t *ipscpacket, re
 				log_print_separator();
 
 			dmr_handle_data_call_end(repeater, ipscpacket->timeslot-1);
-			repeater->slot[ipscpacket->timeslot-1].last_call_or_data_packet_received_at = time(NULL);
+			repeater->slot[ipscpacket->timeslot-1].last_call_or_data_packet_received_at = virtclock_time();
 			if (repeater->slot[ipscpacket->timeslot-1].state != REPEATER_SLOT_STATE_VOICE_CALL_RUNNING) {
 				// Checking if this call is already running on another repeater. This can happen if dmrshark is running
 				// on a server which has multiple repeaters' traffic running through it.
@@ -80,7 +82,9 @@ void ipsc_handle_by_slot_type(struct ip *ip_packet, ipscpacket_t *ipscpacket, re
 					}
 			}
 			dmr_handle_voice_frame(ip_packet, ipscpacket, repeater);
+			replaybench_stage_enter(REPLAYBENCH_STAGE_VOICESTREAMS);
 			voicestreams_processpacket(ipscpacket, repeater);
+			replaybench_stage_leave();
 			break;
 		case IPSCPACKET_SLOT_TYPE_TERMINATOR_WITH_LC:
 			if (!loglevel.flags.comm_ip && !loglevel.flags.ipsc && loglevel.flags.dmrlc)
@@ -94,7 +98,7 @@ void ipsc_handle_by_slot_type(struct ip *ip_packet, ipscpacket_t *ipscpacket, re
 			if (!loglevel.flags.comm_ip && !loglevel.flags.ipsc && loglevel.flags.dmrlc)
 				log_print_separator();
 
-			repeater->slot[ipscpacket->timeslot-1].last_call_or_data_packet_received_at = time(NULL);
+			repeater->slot[ipscpacket->timeslot-1].last_call_or_data_packet_received_at = virtclock_time();
 			dmr_handle_voice_call_end(ip_packet, ipscpacket, repeater);
 			dmr_handle_data_header(ip_packet, ipscpacket, repeater);
 			break;
@@ -102,7 +106,7 @@ void ipsc_handle_by_slot_type(struct ip *ip_packet, ipscpacket_t *ipscpacket, re
 			if (!loglevel.flags.comm_ip && !loglevel.flags.ipsc && loglevel.flags.dmrlc)
 				log_print_separator();
 
-			repeater->slot[ipscpacket->timeslot-1].last_call_or_data_packet_received_at = time(NULL);
+			repeater->slot[ipscpacket->timeslot-1].last_call_or_data_packet_received_at = virtclock_time();
 			dmr_handle_voice_call_end(ip_packet, ipscpacket, repeater);
 			dmr_handle_data_34rate(ip_packet, ipscpacket, repeater);
 			break;
@@ -110,7 +114,7 @@ void ipsc_handle_by_slot_type(struct ip *ip_packet, ipscpacket_t *ipscpacket, re
 			if (!loglevel.flags.comm_ip && !loglevel.flags.ipsc && loglevel.flags.dmrlc)
 				log_print_separator();
 
-			repeater->slot[ipscpacket->timeslot-1].last_call_or_data_packet_received_at = time(NULL);
+			repeater->slot[ipscpacket->timeslot-1].last_call_or_data_packet_received_at = virtclock_time();
 			dmr_handle_voice_call_end(ip_packet, ipscpacket, repeater);
 			dmr_handle_data_12rate(ip_packet, ipscpacket, repeater);
 			break;
@@ -21,6 +21,7 @@
 #include "comm.h"
 #include "ipsc-handle.h"
 #include "snmp.h"
+#include "replaybench.h"
 
 #include <libs/remotedb/remotedb.h>
 #include <libs/config/config.h>
@@ -164,8 +165,11 @@ static void ipsc_examinepacket(struct ip *ip_packet, ipscpacket_t *ipscpacket, f
 		console_log(LOGLEVEL_IPSC " (call already running, ignored)");
 
 	console_log(LOGLEVEL_IPSC "\n");
-	if (!duplicate_seqnum && !talkgroup_ignored && !call_already_running)
+	if (!duplicate_seqnum && !talkgroup_ignored && !call_already_running) {
+		replaybench_stage_enter(REPLAYBENCH_STAGE_DMR);
 		ipsc_handle_by_slot_type(ip_packet, ipscpacket, repeater);
+		replaybench_stage_leave();
+	}
 }
 
 void ipsc_processpacket(ipscpacket_raw_t *ipscpacket_raw, uint16_t length) {
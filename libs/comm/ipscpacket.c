@@ -203,20 +203,16 @@ flag_t ipscpacket_heartbeat_decode(struct udphdr *udppacket) {
 	return 0;
 }
 
-// Constructs a raw IPSC packet (IP packet) from given raw IPSC packet payload.
-ipscpacket_raw_t *ipscpacket_construct_raw_packet(struct in_addr *dst_addr, ipscpacket_payload_raw_t *ipscpacket_payload_raw) {
+// Constructs a raw IPSC packet (IP packet) from given raw IPSC packet payload, with the given source address.
+ipscpacket_raw_t *ipscpacket_construct_raw_packet_from_addr(struct in_addr *src_addr, struct in_addr *dst_addr, ipscpacket_payload_raw_t *ipscpacket_payload_raw) {
 	static ipscpacket_raw_t ipscpacket_raw;
 	struct iphdr *ip_packet = (struct iphdr *)ipscpacket_raw.bytes;
 	struct udphdr *udp_packet = (struct udphdr *)(ipscpacket_raw.bytes+20);
-	struct in_addr *master_ip_addr = config_get_masteripaddr();
 
-	if (master_ip_addr == NULL) {
-		console_log("ipscpacket error: can't construct raw packet for sending as master ip address is not set in the config\n");
+	if (src_addr == NULL || dst_addr == NULL || ipscpacket_payload_raw == NULL)
 		return NULL;
-	}
 
-	memcpy(&ip_packet->saddr, master_ip_addr, sizeof(struct in_addr));
-	free(master_ip_addr);
+	memcpy(&ip_packet->saddr, src_addr, sizeof(struct in_addr));
 	memcpy(&ip_packet->daddr, dst_addr, sizeof(struct in_addr));
 	ip_packet->ihl = 5;
 	ip_packet->version = 4;
@@ -234,6 +230,21 @@ ipscpacket_raw_t *ipscpacket_construct_raw_packet(struct in_addr *dst_addr, ipsc
 	return &ipscpacket_raw;
 }
 
+// Constructs a raw IPSC packet (IP packet) from given raw IPSC packet payload, sent by the master.
+ipscpacket_raw_t *ipscpacket_construct_raw_packet(struct in_addr *dst_addr, ipscpacket_payload_raw_t *ipscpacket_payload_raw) {
+	ipscpacket_raw_t *ipscpacket_raw;
+	struct in_addr *master_ip_addr = config_get_masteripaddr();
+
+	if (master_ip_addr == NULL) {
+		console_log("ipscpacket error: can't construct raw packet for sending as master ip address is not set in the config\n");
+		return NULL;
+	}
+
+	ipscpacket_raw = ipscpacket_construct_raw_packet_from_addr(master_ip_addr, dst_addr, ipscpacket_payload_raw);
+	free(master_ip_addr);
+	return ipscpacket_raw;
+}
+
 ipscpacket_payload_raw_t *ipscpacket_construct_raw_payload(uint8_t seqnum, dmr_timeslot_t ts, ipscpacket_slot_type_t slot_type,
 	dmr_call_type_t calltype, dmr_id_t dstid, dmr_id_t srcid, ipscpacket_payload_t *payload) {
 
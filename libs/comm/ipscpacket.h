@@ -101,6 +101,7 @@ ipscpacket_slot_type_t ipscpacket_get_slot_type_for_data_type(dmrpacket_data_typ
 flag_t ipscpacket_decode(struct ip *ippacket, struct udphdr *udppacket, ipscpacket_t *ipscpacket, flag_t packet_from_us);
 flag_t ipscpacket_heartbeat_decode(struct udphdr *udppacket);
 
+ipscpacket_raw_t *ipscpacket_construct_raw_packet_from_addr(struct in_addr *src_addr, struct in_addr *dst_addr, ipscpacket_payload_raw_t *ipscpacket_payload_raw);
 ipscpacket_raw_t *ipscpacket_construct_raw_packet(struct in_addr *dst_addr, ipscpacket_payload_raw_t *ipscpacket_payload_raw);
 ipscpacket_payload_raw_t *ipscpacket_construct_raw_payload(uint8_t seqnum, dmr_timeslot_t ts, ipscpacket_slot_type_t slot_type, dmr_call_type_t calltype, dmr_id_t dstid, dmr_id_t srcid, ipscpacket_payload_t *payload);
 ipscpacket_payload_t *ipscpacket_construct_payload_voice_lc_header(dmr_call_type_t calltype, dmr_id_t dst_id, dmr_id_t src_id);
@@ -0,0 +1,375 @@
+/*
+ * This file is part of dmrshark.
+ *
+ * dmrshark is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dmrshark is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dmrshark.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+// The pcap replay scheduler replays packets of pcap files keeping the time between them
+// as it was at capture time, multiplied by the replay speed. The virtual clock is set to
+// the time of every replayed packet, so call timeouts, TX pacing and RSSI polling behave
+// the same way as they did on the air. The virtual clock starts from the current time when
+// the first file is added. Multiple files can be replayed at the same time, their packets
+// are merged, and each file starts at the virtual time it was added.
+
+
+
+#include "pcapreplay.h"
+#include "comm.h"
+
+#include <libs/daemon/console.h>
+#include <libs/daemon/daemon-poll.h>
+#include <libs/base/virtclock.h>
+
+#include <pcap/pcap.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#define PCAPREPLAY_LOOP_GAP_IN_USEC				1000000
+#define PCAPREPLAY_MAX_PACKETS_PER_PROCESS		50
+
+typedef struct pcapreplay_source_st {
+	char *filename;
+	pcap_t *pcap_handle;
+	unsigned int loops; // 0 - looping forever
+	unsigned int loop;
+	flag_t first_packet_read;
+	uint64_t first_packet_ts; // Capture timestamp of the first packet in the file.
+	uint64_t last_packet_ts;
+	uint64_t started_at; // Virtual time of the first packet in the current loop.
+
+	struct pcap_pkthdr pkthdr;
+	uint8_t *packet;
+	uint64_t packet_at; // Virtual time when the next packet should be replayed.
+	uint32_t packets_replayed;
+
+	struct pcapreplay_source_st *next;
+} pcapreplay_source_t;
+
+static pcapreplay_source_t *pcapreplay_sources = NULL;
+static double pcapreplay_speed = PCAPREPLAY_SPEED_MAX;
+
+// Virtual times are in microseconds. In timed mode the virtual time is calculated from the
+// monotonic time elapsed since the anchor, so changes of the system time don't affect the
+// replay. In max speed mode it jumps to the next packet's time.
+static uint64_t pcapreplay_virtual_now = 0;
+static uint64_t pcapreplay_anchor_monotonic = 0;
+static uint64_t pcapreplay_anchor_virtual = 0;
+
+static uint64_t pcapreplay_timeval_to_usec(struct timeval *tv) {
+	return (uint64_t)tv->tv_sec*1000000+tv->tv_usec;
+}
+
+static void pcapreplay_usec_to_timeval(uint64_t usec, struct timeval *tv) {
+	tv->tv_sec = usec/1000000;
+	tv->tv_usec = usec%1000000;
+}
+
+static uint64_t pcapreplay_get_real_now(void) {
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return pcapreplay_timeval_to_usec(&tv);
+}
+
+static uint64_t pcapreplay_get_monotonic_now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000+ts.tv_nsec/1000;
+}
+
+static uint64_t pcapreplay_get_virtual_now(void) {
+	if (pcapreplay_speed == PCAPREPLAY_SPEED_MAX)
+		return pcapreplay_virtual_now;
+
+	return pcapreplay_anchor_virtual+(pcapreplay_get_monotonic_now()-pcapreplay_anchor_monotonic)*pcapreplay_speed;
+}
+
+static void pcapreplay_set_virtual_now(uint64_t now) {
+	struct timeval tv;
+
+	if (now > pcapreplay_virtual_now)
+		pcapreplay_virtual_now = now;
+	pcapreplay_usec_to_timeval(pcapreplay_virtual_now, &tv);
+	virtclock_set(&tv);
+}
+
+static void pcapreplay_anchor(void) {
+	pcapreplay_anchor_monotonic = pcapreplay_get_monotonic_now();
+	pcapreplay_anchor_virtual = pcapreplay_virtual_now;
+}
+
+static void pcapreplay_remove_source(pcapreplay_source_t *source) {
+	pcapreplay_source_t *prev_source;
+
+	if (source == NULL)
+		return;
+
+	if (pcapreplay_sources == source)
+		pcapreplay_sources = source->next;
+	else {
+		prev_source = pcapreplay_sources;
+		while (prev_source && prev_source->next != source)
+			prev_source = prev_source->next;
+		if (prev_source)
+			prev_source->next = source->next;
+	}
+
+	if (source->pcap_handle)
+		pcap_close(source->pcap_handle);
+	free(source->filename);
+	free(source);
+
+	if (pcapreplay_sources == NULL) {
+		console_log("pcapreplay: finished, switching back to real time\n");
+		virtclock_release();
+	}
+}
+
+// Reads the next packet of the given source and calculates when it should be replayed.
+// Returns 0 if there are no more packets to replay from the source.
+static flag_t pcapreplay_source_readnext(pcapreplay_source_t *source) {
+	char errbuf[PCAP_ERRBUF_SIZE];
+	uint64_t ts;
+
+	source->packet = (uint8_t *)pcap_next(source->pcap_handle, &source->pkthdr);
+	if (source->packet == NULL) {
+		if (!source->first_packet_read || (source->loops != 0 && source->loop+1 >= source->loops))
+			return 0;
+
+		pcap_close(source->pcap_handle);
+		source->pcap_handle = pcap_open_offline(source->filename, errbuf);
+		if (source->pcap_handle == NULL) {
+			console_log("pcapreplay error: can't reopen pcap file %s: %s\n", source->filename, errbuf);
+			return 0;
+		}
+		source->loop++;
+		// The next loop starts a bit after the last packet of the previous loop.
+		source->started_at += source->last_packet_ts-source->first_packet_ts+PCAPREPLAY_LOOP_GAP_IN_USEC;
+		source->first_packet_read = 0;
+		source->last_packet_ts = 0;
+
+		source->packet = (uint8_t *)pcap_next(source->pcap_handle, &source->pkthdr);
+		if (source->packet == NULL)
+			return 0;
+	}
+
+	ts = pcapreplay_timeval_to_usec(&source->pkthdr.ts);
+	if (!source->first_packet_read) {
+		source->first_packet_ts = ts;
+		source->first_packet_read = 1;
+	}
+	// Packets with timestamps going backwards are replayed immediately.
+	if (ts < source->last_packet_ts)
+		ts = source->last_packet_ts;
+	source->last_packet_ts = ts;
+	source->packet_at = source->started_at+ts-source->first_packet_ts;
+	return 1;
+}
+
+static pcapreplay_source_t *pcapreplay_get_next_source(void) {
+	pcapreplay_source_t *source = pcapreplay_sources;
+	pcapreplay_source_t *next_source = NULL;
+
+	while (source) {
+		if (next_source == NULL || source->packet_at < next_source->packet_at)
+			next_source = source;
+		source = source->next;
+	}
+	return next_source;
+}
+
+static void pcapreplay_replay_packet(pcapreplay_source_t *source) {
+	pcapreplay_set_virtual_now(source->packet_at);
+
+	comm_process_pcap_packet(source->pcap_handle, &source->pkthdr, source->packet);
+	source->packets_replayed++;
+
+	if (!pcapreplay_source_readnext(source)) {
+		console_log("pcapreplay: finished replaying %s, %u packets replayed\n", source->filename, source->packets_replayed);
+		pcapreplay_remove_source(source);
+	}
+}
+
+// Adds the given pcap file to the replay. If loops is 0, the file is replayed forever.
+flag_t pcapreplay_add(char *filename, unsigned int loops) {
+	char errbuf[PCAP_ERRBUF_SIZE];
+	pcapreplay_source_t *new_source;
+	pcapreplay_source_t *source;
+
+	if (filename == NULL)
+		return 0;
+
+	new_source = (pcapreplay_source_t *)calloc(1, sizeof(pcapreplay_source_t));
+	if (new_source == NULL) {
+		console_log("pcapreplay error: couldn't allocate memory for new source\n");
+		return 0;
+	}
+	new_source->filename = strdup(filename);
+	if (new_source->filename == NULL) {
+		console_log("pcapreplay error: couldn't allocate memory for new source\n");
+		free(new_source);
+		return 0;
+	}
+	new_source->pcap_handle = pcap_open_offline(filename, errbuf);
+	if (new_source->pcap_handle == NULL) {
+		console_log("pcapreplay error: can't open pcap file %s: %s\n", filename, errbuf);
+		free(new_source->filename);
+		free(new_source);
+		return 0;
+	}
+	new_source->loops = loops;
+
+	if (pcapreplay_sources == NULL) {
+		pcapreplay_virtual_now = pcapreplay_get_real_now();
+		pcapreplay_anchor();
+	} else
+		pcapreplay_virtual_now = pcapreplay_get_virtual_now();
+	new_source->started_at = pcapreplay_virtual_now;
+
+	if (!pcapreplay_source_readnext(new_source)) {
+		console_log("pcapreplay error: pcap file %s is empty\n", filename);
+		pcap_close(new_source->pcap_handle);
+		free(new_source->filename);
+		free(new_source);
+		return 0;
+	}
+
+	if (pcapreplay_sources == NULL)
+		pcapreplay_sources = new_source;
+	else {
+		source = pcapreplay_sources;
+		while (source->next)
+			source = source->next;
+		source->next = new_source;
+	}
+
+	pcapreplay_set_virtual_now(pcapreplay_virtual_now);
+
+	console_log("pcapreplay: replaying %s", filename);
+	if (loops == 0)
+		console_log(" looping forever\n");
+	else
+		console_log(" %u times\n", loops);
+
+	// Not waiting for the poll timeout, the first packet is due now.
+	daemon_poll_setmaxtimeout(0);
+	return 1;
+}
+
+// Sets the replay speed multiplier, 0 (PCAPREPLAY_SPEED_MAX) means as fast as possible.
+void pcapreplay_set_speed(double speed) {
+	if (speed < 0)
+		return;
+
+	pcapreplay_virtual_now = pcapreplay_get_virtual_now();
+	pcapreplay_speed = speed;
+	pcapreplay_anchor();
+}
+
+// Parses speed strings like "max", "1x", "10", "0.5x".
+flag_t pcapreplay_parse_speed(char *str, double *speed) {
+	char *endptr = NULL;
+
+	if (str == NULL || speed == NULL)
+		return 0;
+
+	if (strcmp(str, "max") == 0) {
+		*speed = PCAPREPLAY_SPEED_MAX;
+		return 1;
+	}
+
+	*speed = strtod(str, &endptr);
+	if (endptr == str || (*endptr != 0 && strcmp(endptr, "x") != 0) || *speed <= 0)
+		return 0;
+	return 1;
+}
+
+void pcapreplay_stop(void) {
+	if (pcapreplay_sources == NULL)
+		return;
+
+	while (pcapreplay_sources)
+		pcapreplay_remove_source(pcapreplay_sources);
+}
+
+void pcapreplay_print(void) {
+	pcapreplay_source_t *source = pcapreplay_sources;
+	struct timeval tv;
+	time_t t;
+	char virtual_now_str[20];
+
+	if (pcapreplay_speed == PCAPREPLAY_SPEED_MAX)
+		console_log("pcapreplay: speed: max");
+	else
+		console_log("pcapreplay: speed: %gx", pcapreplay_speed);
+
+	if (source == NULL) {
+		console_log(", not running\n");
+		return;
+	}
+
+	pcapreplay_usec_to_timeval(pcapreplay_virtual_now, &tv);
+	t = tv.tv_sec;
+	strftime(virtual_now_str, sizeof(virtual_now_str), "%F %T", gmtime(&t));
+	console_log(", virtual time: %s\n", virtual_now_str);
+
+	while (source) {
+		console_log("  %s loop: %u/", source->filename, source->loop+1);
+		if (source->loops == 0)
+			console_log("inf");
+		else
+			console_log("%u", source->loops);
+		console_log(" replayed packets: %u\n", source->packets_replayed);
+		source = source->next;
+	}
+}
+
+void pcapreplay_process(void) {
+	pcapreplay_source_t *source;
+	uint64_t now;
+	uint16_t replayed = 0;
+
+	if (pcapreplay_sources == NULL)
+		return;
+
+	if (pcapreplay_speed == PCAPREPLAY_SPEED_MAX) {
+		// Only one packet per main loop, so the periodic processing can see the
+		// virtual time between every packet.
+		pcapreplay_replay_packet(pcapreplay_get_next_source());
+		daemon_poll_setmaxtimeout(0);
+		return;
+	}
+
+	now = pcapreplay_get_virtual_now();
+	while ((source = pcapreplay_get_next_source()) != NULL && source->packet_at <= now && replayed < PCAPREPLAY_MAX_PACKETS_PER_PROCESS) {
+		pcapreplay_replay_packet(source);
+		replayed++;
+	}
+	if (pcapreplay_sources == NULL)
+		return;
+
+	pcapreplay_set_virtual_now(now);
+
+	if (replayed == PCAPREPLAY_MAX_PACKETS_PER_PROCESS)
+		daemon_poll_setmaxtimeout(0);
+	else // Waking up when the next packet is due.
+		daemon_poll_setmaxtimeout((source->packet_at-now)/pcapreplay_speed/1000+1);
+}
+
+void pcapreplay_deinit(void) {
+	pcapreplay_stop();
+}
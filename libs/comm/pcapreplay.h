@@ -0,0 +1,34 @@
+/*
+ * This file is part of dmrshark.
+ *
+ * dmrshark is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dmrshark is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dmrshark.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+#ifndef PCAPREPLAY_H_
+#define PCAPREPLAY_H_
+
+#include <libs/base/types.h>
+
+#define PCAPREPLAY_SPEED_MAX	0
+
+flag_t pcapreplay_add(char *filename, unsigned int loops);
+void pcapreplay_set_speed(double speed);
+flag_t pcapreplay_parse_speed(char *str, double *speed);
+void pcapreplay_stop(void);
+void pcapreplay_print(void);
+
+void pcapreplay_process(void);
+void pcapreplay_deinit(void);
+
+#endif
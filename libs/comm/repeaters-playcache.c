@@ -0,0 +1,221 @@
+/*
+ * This file is part of dmrshark.
+ *
+ * dmrshark is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dmrshark is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dmrshark.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+
+
+#include "repeaters-playcache.h"
+
+#include <libs/daemon/console.h>
+#include <libs/base/base.h>
+#include <libs/dmrpacket/dmrpacket-emb.h>
+#include <libs/dmrpacket/dmrpacket-lc.h>
+
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Played files are kept in the cache with different call parameters, the least recently used entry is replaced.
+#define REPEATERS_PLAYCACHE_MAX_ENTRIES		16
+
+static repeaters_playcache_entry_t *repeaters_playcache = NULL;
+static uint8_t repeaters_playcache_entries_count = 0;
+static uint32_t repeaters_playcache_use_counter = 0;
+
+// Slot types of the voice frames in a superframe. Voice frame A has the sync pattern.
+static const ipscpacket_slot_type_t repeaters_playcache_voice_slot_types[6] = {
+	IPSCPACKET_SLOT_TYPE_VOICE_DATA_A,
+	IPSCPACKET_SLOT_TYPE_VOICE_DATA_B,
+	IPSCPACKET_SLOT_TYPE_VOICE_DATA_C,
+	IPSCPACKET_SLOT_TYPE_VOICE_DATA_D,
+	IPSCPACKET_SLOT_TYPE_VOICE_DATA_E,
+	IPSCPACKET_SLOT_TYPE_VOICE_DATA_F
+};
+
+static void repeaters_playcache_entry_free(repeaters_playcache_entry_t *entry) {
+	free(entry->filename);
+	free(entry->payloads);
+	free(entry);
+}
+
+static flag_t repeaters_playcache_add_payload(repeaters_playcache_entry_t *entry, ipscpacket_payload_raw_t *payload_raw) {
+	if (payload_raw == NULL)
+		return 0;
+
+	memcpy(&entry->payloads[entry->payloads_count], payload_raw, sizeof(ipscpacket_payload_raw_t));
+	entry->payloads_count++;
+	return 1;
+}
+
+// Constructs the IPSC payloads of the whole call from the given AMBE frames, the same way as
+// repeaters_start_voice_call(), repeaters_play_ambe_data() and repeaters_end_voice_call() do.
+// Playing a call always starts with sequence number 0, so the sequence numbers are stored in the payloads.
+static flag_t repeaters_playcache_construct_payloads(repeaters_playcache_entry_t *entry, uint8_t *ambe_bytes, uint32_t frames_count) {
+	vbptc_16_11_t emb_sig_lc_vbptc_storage;
+	dmrpacket_emb_signalling_lc_bits_t *emb_signalling_lc_bits;
+	dmrpacket_payload_voice_bits_t voice_bits;
+	ipscpacket_slot_type_t slot_type;
+	uint8_t voice_frame_num = 2;
+	uint32_t i;
+
+	entry->payloads = (ipscpacket_payload_raw_t *)malloc((3+frames_count+1)*sizeof(ipscpacket_payload_raw_t));
+	if (entry->payloads == NULL)
+		return 0;
+
+	vbptc_16_11_init(&emb_sig_lc_vbptc_storage, 8);
+	emb_signalling_lc_bits = dmrpacket_emb_signalling_lc_interleave(dmrpacket_lc_construct_emb_signalling_lc(entry->calltype, entry->dstid, entry->srcid));
+	vbptc_16_11_construct(&emb_sig_lc_vbptc_storage, emb_signalling_lc_bits->bits, sizeof(dmrpacket_emb_signalling_lc_bits_t));
+
+	for (i = 0; i < 3; i++) {
+		if (!repeaters_playcache_add_payload(entry, ipscpacket_construct_raw_payload(entry->payloads_count, entry->ts, IPSCPACKET_SLOT_TYPE_VOICE_LC_HEADER, entry->calltype, entry->dstid, entry->srcid,
+			ipscpacket_construct_payload_voice_lc_header(entry->calltype, entry->dstid, entry->srcid))))
+				return 0;
+	}
+
+	for (i = 0; i < frames_count; i++) {
+		base_bytestobits(ambe_bytes+i*sizeof(dmrpacket_payload_voice_bytes_t), sizeof(dmrpacket_payload_voice_bytes_t), voice_bits.raw.bits, sizeof(dmrpacket_payload_voice_bits_t));
+		slot_type = repeaters_playcache_voice_slot_types[voice_frame_num];
+		if (!repeaters_playcache_add_payload(entry, ipscpacket_construct_raw_payload(entry->payloads_count, entry->ts, slot_type, entry->calltype, entry->dstid, entry->srcid,
+			ipscpacket_construct_payload_voice_frame(slot_type, &voice_bits, &emb_sig_lc_vbptc_storage))))
+				return 0;
+
+		voice_frame_num++;
+		if (voice_frame_num > 5)
+			voice_frame_num = 0;
+	}
+
+	return repeaters_playcache_add_payload(entry, ipscpacket_construct_raw_payload(entry->payloads_count, entry->ts, IPSCPACKET_SLOT_TYPE_TERMINATOR_WITH_LC, entry->calltype, entry->dstid, entry->srcid,
+		ipscpacket_construct_payload_terminator_with_lc(entry->calltype, entry->dstid, entry->srcid)));
+}
+
+// Maps the AMBE file to memory, and constructs the IPSC payloads of its frames.
+static repeaters_playcache_entry_t *repeaters_playcache_entry_new(char *filename, struct stat *st, dmr_timeslot_t ts, dmr_call_type_t calltype, dmr_id_t dstid, dmr_id_t srcid) {
+	repeaters_playcache_entry_t *entry;
+	uint8_t *ambe_bytes = NULL;
+	uint32_t frames_count;
+	int fd;
+
+	entry = (repeaters_playcache_entry_t *)calloc(1, sizeof(repeaters_playcache_entry_t));
+	if (entry == NULL)
+		return NULL;
+
+	entry->filename = strdup(filename);
+	entry->mtime = st->st_mtime;
+	entry->size = st->st_size;
+	entry->ts = ts;
+	entry->calltype = calltype;
+	entry->dstid = dstid;
+	entry->srcid = srcid;
+	if (entry->filename == NULL) {
+		repeaters_playcache_entry_free(entry);
+		return NULL;
+	}
+
+	frames_count = st->st_size/sizeof(dmrpacket_payload_voice_bytes_t);
+	if (frames_count > 0) {
+		fd = open(filename, O_RDONLY);
+		if (fd < 0) {
+			repeaters_playcache_entry_free(entry);
+			return NULL;
+		}
+		ambe_bytes = (uint8_t *)mmap(NULL, st->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (ambe_bytes == MAP_FAILED) {
+			repeaters_playcache_entry_free(entry);
+			return NULL;
+		}
+	}
+
+	if (!repeaters_playcache_construct_payloads(entry, ambe_bytes, frames_count)) {
+		if (ambe_bytes != NULL)
+			munmap(ambe_bytes, st->st_size);
+		repeaters_playcache_entry_free(entry);
+		return NULL;
+	}
+	if (ambe_bytes != NULL)
+		munmap(ambe_bytes, st->st_size);
+
+	console_log(LOGLEVEL_REPEATERS LOGLEVEL_DEBUG "repeaters playcache: cached %u packets of %s\n", entry->payloads_count, filename);
+	return entry;
+}
+
+static void repeaters_playcache_remove(repeaters_playcache_entry_t *entry) {
+	repeaters_playcache_entry_t **prev = &repeaters_playcache;
+
+	while (*prev != NULL) {
+		if (*prev == entry) {
+			*prev = entry->next;
+			repeaters_playcache_entry_free(entry);
+			repeaters_playcache_entries_count--;
+			return;
+		}
+		prev = &(*prev)->next;
+	}
+}
+
+// Returns the cached IPSC payloads of the given AMBE file for the given call parameters.
+// The payloads are constructed if the file is not in the cache yet, or if it has been modified.
+repeaters_playcache_entry_t *repeaters_playcache_get(char *filename, dmr_timeslot_t ts, dmr_call_type_t calltype, dmr_id_t dstid, dmr_id_t srcid) {
+	repeaters_playcache_entry_t *entry = repeaters_playcache;
+	repeaters_playcache_entry_t *lru_entry = NULL;
+	struct stat st;
+
+	if (filename == NULL || stat(filename, &st) != 0)
+		return NULL;
+
+	while (entry != NULL) {
+		if (entry->ts == ts && entry->calltype == calltype && entry->dstid == dstid && entry->srcid == srcid && strcmp(entry->filename, filename) == 0)
+			break;
+		if (lru_entry == NULL || entry->last_used < lru_entry->last_used)
+			lru_entry = entry;
+		entry = entry->next;
+	}
+
+	if (entry != NULL && (entry->mtime != st.st_mtime || entry->size != st.st_size)) {
+		console_log(LOGLEVEL_REPEATERS LOGLEVEL_DEBUG "repeaters playcache: %s has been modified\n", filename);
+		repeaters_playcache_remove(entry);
+		entry = NULL;
+	}
+
+	if (entry == NULL) {
+		entry = repeaters_playcache_entry_new(filename, &st, ts, calltype, dstid, srcid);
+		if (entry == NULL)
+			return NULL;
+
+		if (repeaters_playcache_entries_count >= REPEATERS_PLAYCACHE_MAX_ENTRIES && lru_entry != NULL)
+			repeaters_playcache_remove(lru_entry);
+		entry->next = repeaters_playcache;
+		repeaters_playcache = entry;
+		repeaters_playcache_entries_count++;
+	}
+
+	entry->last_used = ++repeaters_playcache_use_counter;
+	return entry;
+}
+
+void repeaters_playcache_deinit(void) {
+	repeaters_playcache_entry_t *next_entry;
+
+	while (repeaters_playcache != NULL) {
+		next_entry = repeaters_playcache->next;
+		repeaters_playcache_entry_free(repeaters_playcache);
+		repeaters_playcache = next_entry;
+	}
+	repeaters_playcache_entries_count = 0;
+}
@@ -0,0 +1,49 @@
+/*
+ * This file is part of dmrshark.
+ *
+ * dmrshark is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dmrshark is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dmrshark.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+#ifndef REPEATERS_PLAYCACHE_H_
+#define REPEATERS_PLAYCACHE_H_
+
+#include "ipscpacket.h"
+
+#include <libs/base/dmr.h>
+
+#include <sys/types.h>
+#include <time.h>
+
+// IPSC payloads of a played AMBE file, from the voice LC headers to the terminator.
+typedef struct repeaters_playcache_entry_st {
+	char *filename;
+	time_t mtime;
+	off_t size;
+	dmr_timeslot_t ts;
+	dmr_call_type_t calltype;
+	dmr_id_t dstid;
+	dmr_id_t srcid;
+
+	ipscpacket_payload_raw_t *payloads;
+	uint32_t payloads_count;
+	uint32_t last_used; // Value of the cache's use counter when the entry was last played.
+
+	struct repeaters_playcache_entry_st *next;
+} repeaters_playcache_entry_t;
+
+repeaters_playcache_entry_t *repeaters_playcache_get(char *filename, dmr_timeslot_t ts, dmr_call_type_t calltype, dmr_id_t dstid, dmr_id_t srcid);
+
+void repeaters_playcache_deinit(void);
+
+#endif
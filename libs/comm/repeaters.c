@@ -21,6 +21,8 @@
 #include "comm.h"
 #include "snmp.h"
 #include "ipsc.h"
+#include "replaybench.h"
+#include "repeaters-playcache.h"
 
 #include <libs/daemon/console.h>
 #include <libs/daemon/daemon-poll.h>
@@ -30,9 +32,9 @@
 #include <libs/base/base.h>
 #include <libs/dmrpacket/dmrpacket-emb.h>
 #include <libs/dmrpacket/dmrpacket-lc.h>
-#include <libs/voicestreams/voicestreams-decode.h>
 #include <libs/coding/crc.h>
 #include <libs/base/dmr-data.h>
+#include <libs/base/virtclock.h>
 
 #include <string.h>
 #include <sys/time.h>
@@ -157,11 +159,6 @@ static void repeaters_remove(repeater_t *repeater) {
 
 	console_log("repeaters [%s]: removing\n", repeaters_get_display_string_for_ip(&repeater->ipaddr));
 
-	vbptc_16_11_free(&repeater->slot[0].emb_sig_lc_vbptc_storage);
-	vbptc_16_11_free(&repeater->slot[1].emb_sig_lc_vbptc_storage);
-	vbptc_16_11_free(&repeater->slot[0].ipsc_tx_emb_sig_lc_vbptc_storage);
-	vbptc_16_11_free(&repeater->slot[1].ipsc_tx_emb_sig_lc_vbptc_storage);
-
 	repeaters_free_echo_buf(repeater, 0);
 	repeaters_free_echo_buf(repeater, 1);
 
@@ -189,7 +186,6 @@ static void repeaters_remove(repeater_t *repeater) {
 }
 
 repeater_t *repeaters_add(struct in_addr *ipaddr) {
-	flag_t error = 0;
 	repeater_t *repeater = repeaters_findbyip(ipaddr);
 
 	if (ipaddr == NULL)
@@ -206,31 +202,15 @@ repeater_t *repeaters_add(struct in_addr *ipaddr) {
 		// Expecting 8 rows of variable length BPTC coded embedded LC data.
 		// It will contain 77 data bits (without the Hamming (16,11) checksums
 		// and the last row of parity bits).
-		if (!vbptc_16_11_init(&repeater->slot[0].emb_sig_lc_vbptc_storage, 8))
-			error = 1;
-		else {
-			if (!vbptc_16_11_init(&repeater->slot[1].emb_sig_lc_vbptc_storage, 8)) {
-				vbptc_16_11_free(&repeater->slot[0].emb_sig_lc_vbptc_storage);
-				error = 1;
-			}
-		}
-		if (error) {
-			console_log("repeaters [%s]: can't add, not enough memory for embedded signalling lc storage\n", repeaters_get_display_string_for_ip(&repeater->ipaddr));
-			free(repeater);
-			return NULL;
-		}
+		vbptc_16_11_init(&repeater->slot[0].emb_sig_lc_vbptc_storage, 8);
+		vbptc_16_11_init(&repeater->slot[1].emb_sig_lc_vbptc_storage, 8);
 
 		if (repeaters_issnmpignoredforip(ipaddr))
 			repeater->snmpignored = 1;
 
+		// Decoders are initialized at call start, separately for every repeater's call on the stream.
 		repeater->slot[0].voicestream = voicestreams_get_stream_for_repeater(ipaddr, 1);
-#ifdef AMBEDECODEVOICE
-		voicestreams_decode_ambe_init(repeater->slot[0].voicestream);
-#endif
 		repeater->slot[1].voicestream = voicestreams_get_stream_for_repeater(ipaddr, 2);
-#ifdef AMBEDECODEVOICE
-		voicestreams_decode_ambe_init(repeater->slot[1].voicestream);
-#endif
 		if (repeaters != NULL) {
 			repeaters->prev = repeater;
 			repeater->next = repeaters;
@@ -242,7 +222,7 @@ repeater_t *repeaters_add(struct in_addr *ipaddr) {
 			repeater->slot[0].voicestream != NULL ? repeater->slot[0].voicestream->name : "no stream defined",
 			repeater->slot[1].voicestream != NULL ? repeater->slot[1].voicestream->name : "no stream defined");
 	}
-	repeater->last_active_time = time(NULL);
+	repeater->last_active_time = virtclock_time();
 
 	return repeater;
 }
@@ -266,8 +246,8 @@ void repeaters_list(void) {
 			comm_get_ip_str(&repeater->ipaddr),
 			repeater->id,
 			master ? "master" : repeater->callsign,
-			master ? 0 : time(NULL)-repeater->last_active_time,
-			master ? 0 : time(NULL)-repeater->last_repeaterinfo_request_time,
+			master ? 0 : virtclock_time()-repeater->last_active_time,
+			master ? 0 : virtclock_time()-repeater->last_repeaterinfo_request_time,
 			repeater->type,
 			repeater->fwversion,
 			repeater->dlfreq,
@@ -301,11 +281,11 @@ void repeaters_add_to_ipsc_packet_buffer(repeater_t *repeater, dmr_timeslot_t ts
 	if (repeater == NULL || ipscpacket_raw == NULL)
 		return;
 
-	console_log(LOGLEVEL_REPEATERS LOGLEVEL_DEBUG "repeaters [%s]: adding entry to ts%u ipsc packet buffer\n", repeaters_get_display_string_for_ip(&repeater->ipaddr), ts+1);
+	console_log(LOGLEVEL_REPEATERS LOGLEVEL_DEBUG "repeaters [%s]: adding entry to ts%u ipsc packet buffer\n", repeaters_get_display_string(repeater), ts+1);
 
 	newpbentry = (ipscrawpacketbuf_t *)calloc(1, sizeof(ipscrawpacketbuf_t));
 	if (newpbentry == NULL) {
-		console_log(LOGLEVEL_REPEATERS "repeaters [%s] error: couldn't allocate memory for new ipsc packet buffer entry\n", repeaters_get_display_string_for_ip(&repeater->ipaddr));
+		console_log(LOGLEVEL_REPEATERS "repeaters [%s] error: couldn't allocate memory for new ipsc packet buffer entry\n", repeaters_get_display_string(repeater));
 		return;
 	}
 
@@ -333,6 +313,11 @@ static flag_t repeaters_send_raw_ipsc_packet(repeater_t *repeater, ipscpacket_ra
 	if (repeater == NULL || ipscpacket_raw == NULL)
 		return 0;
 
+	if (replaybench_is_running()) {
+		replaybench_count_stubbed_tx();
+		return 1;
+	}
+
 	// Need to use raw socket here, because if the master software is running,
 	// we can't bind to the source port to set it in our UDP packet.
 	if ((sockfd = socket(AF_INET, SOCK_RAW, IPPROTO_RAW)) == -1) {
@@ -376,10 +361,7 @@ void repeaters_start_voice_call(repeater_t *repeater, dmr_timeslot_t ts, dmr_cal
 
 	repeater->slot[ts].ipsc_tx_seqnum = 0;
 	repeater->slot[ts].ipsc_tx_voice_frame_num = 2;
-	if (!vbptc_16_11_init(&repeater->slot[ts].ipsc_tx_emb_sig_lc_vbptc_storage, 8)) {
-		console_log("repeaters [%s] error: can't allocate memory for vbptc encoding\n", repeaters_get_display_string_for_ip(&repeater->ipaddr));
-		return;
-	}
+	vbptc_16_11_init(&repeater->slot[ts].ipsc_tx_emb_sig_lc_vbptc_storage, 8);
 	emb_signalling_lc_bits = dmrpacket_emb_signalling_lc_interleave(dmrpacket_lc_construct_emb_signalling_lc(calltype, dstid, srcid));
 	vbptc_16_11_construct(&repeater->slot[ts].ipsc_tx_emb_sig_lc_vbptc_storage, emb_signalling_lc_bits->bits, sizeof(dmrpacket_emb_signalling_lc_bits_t));
 
@@ -433,32 +415,43 @@ void repeaters_end_voice_call(repeater_t *repeater, dmr_timeslot_t ts, dmr_call_
 		return;
 
 	repeaters_add_to_ipsc_packet_buffer(repeater, ts, ipscpacket_construct_raw_packet(&repeater->ipaddr, ipscpacket_construct_raw_payload(repeater->slot[ts].ipsc_tx_seqnum++, ts, IPSCPACKET_SLOT_TYPE_TERMINATOR_WITH_LC, calltype, dstid, srcid, ipscpacket_construct_payload_terminator_with_lc(calltype, dstid, srcid))), 0);
-	vbptc_16_11_free(&repeater->slot[ts].ipsc_tx_emb_sig_lc_vbptc_storage);
+	vbptc_16_11_clear(&repeater->slot[ts].ipsc_tx_emb_sig_lc_vbptc_storage);
 }
 
+// Plays the AMBE file as a voice call. IPSC payloads of the file are constructed only at the first play
+// with the given call parameters, after that only the IP and UDP headers are constructed for them.
 void repeaters_play_ambe_file(char *ambe_file_name, repeater_t *repeater, dmr_timeslot_t ts, dmr_call_type_t calltype, dmr_id_t dstid, dmr_id_t srcid) {
-	FILE *f;
-	dmrpacket_payload_voice_bytes_t voice_bytes;
+	repeaters_playcache_entry_t *playcache_entry;
+	struct in_addr *master_ip_addr;
+	uint32_t i;
 
 	if (ambe_file_name == NULL || repeater == NULL)
 		return;
 
-	f = fopen(ambe_file_name, "r");
-	if (!f) {
+	playcache_entry = repeaters_playcache_get(ambe_file_name, ts, calltype, dstid, srcid);
+	if (playcache_entry == NULL) {
 		console_log("repeaters [%s] error: can't open %s for playing\n", repeaters_get_display_string_for_ip(&repeater->ipaddr), ambe_file_name);
 		return;
 	}
 
+	// The master's address is resolved only once for all packets.
+	master_ip_addr = config_get_masteripaddr();
+	if (master_ip_addr == NULL) {
+		console_log("repeaters [%s] error: can't play %s as master ip address is not set in the config\n", repeaters_get_display_string_for_ip(&repeater->ipaddr), ambe_file_name);
+		return;
+	}
+
 	console_log("repeaters [%s]: playing %s\n", repeaters_get_display_string_for_ip(&repeater->ipaddr), ambe_file_name);
 
-	repeaters_start_voice_call(repeater, ts, calltype, dstid, srcid);
-	while (!feof(f)) {
-		if (fread(voice_bytes.bytes, 1, sizeof(dmrpacket_payload_voice_bytes_t), f) == sizeof(dmrpacket_payload_voice_bytes_t))
-			repeaters_play_ambe_data(&voice_bytes, repeater, ts, calltype, dstid, srcid);
-	}
-	repeaters_end_voice_call(repeater, ts, calltype, dstid, srcid);
-	fclose(f);
+	for (i = 0; i < playcache_entry->payloads_count; i++)
+		repeaters_add_to_ipsc_packet_buffer(repeater, ts, ipscpacket_construct_raw_packet_from_addr(master_ip_addr, &repeater->ipaddr, &playcache_entry->payloads[i]), 0);
+	free(master_ip_addr);
 
+	// Leaving the slot's TX state as if the call was played packet by packet.
+	repeater->slot[ts].ipsc_tx_seqnum = playcache_entry->payloads_count;
+	// The 3 voice LC headers and the terminator are not voice frames.
+	repeater->slot[ts].ipsc_tx_voice_frame_num = (2+(playcache_entry->payloads_count-4)) % 6;
+	vbptc_16_11_clear(&repeater->slot[ts].ipsc_tx_emb_sig_lc_vbptc_storage);
 }
 
 void repeaters_free_echo_buf(repeater_t *repeater, dmr_timeslot_t ts) {
@@ -673,6 +666,24 @@ flag_t repeaters_is_call_running_on_other_repeater(repeater_t *current_repeater,
 	return 0;
 }
 
+// Sets the main loop timeout to the time when the next packet can be sent from the TX buffers.
+static void repeaters_set_ipsc_tx_rawpacketbuf_timeout(repeater_t *repeater, struct timeval *currtime) {
+	struct timeval difftime = {0,};
+	int64_t elapsed_usec;
+
+	if (repeater->slot[0].ipsc_tx_rawpacketbuf == NULL && repeater->slot[1].ipsc_tx_rawpacketbuf == NULL)
+		return;
+
+	timersub(currtime, &repeater->last_ipsc_packet_sent_time, &difftime);
+	elapsed_usec = (int64_t)difftime.tv_sec*1000000+difftime.tv_usec;
+	if (elapsed_usec < 0)
+		elapsed_usec = 0;
+	if (elapsed_usec >= IPSC_PACKET_SEND_INTERVAL_IN_MS*1000)
+		daemon_poll_setmaxtimeout(0);
+	else
+		daemon_poll_setmaxtimeout_usec(IPSC_PACKET_SEND_INTERVAL_IN_MS*1000-elapsed_usec);
+}
+
 static void repeaters_process_ipsc_tx_rawpacketbuf(repeater_t *repeater) {
 	struct timeval currtime = {0,};
 	struct timeval difftime = {0,};
@@ -683,18 +694,17 @@ static void repeaters_process_ipsc_tx_rawpacketbuf(repeater_t *repeater) {
 	if (repeater == NULL)
 		return;
 
-	if (repeater->slot[0].ipsc_tx_rawpacketbuf != NULL || repeater->slot[1].ipsc_tx_rawpacketbuf != NULL)
-		daemon_poll_setmaxtimeout(0);
-
 	if (repeater->last_ipsc_packet_sent_from_slot == 1)
 		ts = 0;
 	else
 		ts = 1;
 
-	gettimeofday(&currtime, NULL);
+	virtclock_gettimeofday(&currtime);
 	timersub(&currtime, &repeater->last_ipsc_packet_sent_time, &difftime);
-	if (difftime.tv_sec*1000+difftime.tv_usec/1000 < IPSC_PACKET_SEND_INTERVAL_IN_MS)
+	if (difftime.tv_sec*1000+difftime.tv_usec/1000 < IPSC_PACKET_SEND_INTERVAL_IN_MS) {
+		repeaters_set_ipsc_tx_rawpacketbuf_timeout(repeater, &currtime);
 		return;
+	}
 
 	if (repeater->slot[ts].ipsc_tx_rawpacketbuf != NULL && repeater->slot[ts].ipsc_tx_rawpacketbuf->nowait)
 		nowait = 1;
@@ -703,12 +713,16 @@ static void repeaters_process_ipsc_tx_rawpacketbuf(repeater_t *repeater) {
 		repeater->last_ipsc_packet_sent_from_slot = ts;
 
 	if (repeater->slot[ts].ipsc_tx_rawpacketbuf == NULL) {
-		gettimeofday(&repeater->last_ipsc_packet_sent_time, NULL);
+		virtclock_gettimeofday(&repeater->last_ipsc_packet_sent_time);
+		repeaters_set_ipsc_tx_rawpacketbuf_timeout(repeater, &repeater->last_ipsc_packet_sent_time);
 		return;
 	}
 
-	if (repeaters_is_there_a_call_not_for_us_or_by_us(repeater, ts))
+	if (repeaters_is_there_a_call_not_for_us_or_by_us(repeater, ts)) {
+		// Checking again after a send interval, the running call's packets wake us up anyway.
+		daemon_poll_setmaxtimeout(IPSC_PACKET_SEND_INTERVAL_IN_MS);
 		return;
+	}
 
 	ipsc_tx_rawpacketbuf_entry_to_send = repeater->slot[ts].ipsc_tx_rawpacketbuf;
 
@@ -722,9 +736,10 @@ static void repeaters_process_ipsc_tx_rawpacketbuf(repeater_t *repeater) {
 		free(ipsc_tx_rawpacketbuf_entry_to_send);
 	}
 	if (nowait == 0)
-		gettimeofday(&repeater->last_ipsc_packet_sent_time, NULL);
+		virtclock_gettimeofday(&repeater->last_ipsc_packet_sent_time);
 	if (repeater->slot[ts].ipsc_tx_rawpacketbuf == NULL)
 		console_log(LOGLEVEL_REPEATERS "repeaters [%s]: tx packet buffer got empty\n", repeaters_get_display_string_for_ip(&repeater->ipaddr));
+	repeaters_set_ipsc_tx_rawpacketbuf_timeout(repeater, &currtime);
 }
 
 void repeaters_process(void) {
@@ -739,7 +754,7 @@ void repeaters_process(void) {
 
 		repeaters_process_ipsc_tx_rawpacketbuf(repeater);
 
-		if (!comm_is_masteripaddr(&repeater->ipaddr) && time(NULL)-repeater->last_active_time > config_get_repeaterinactivetimeoutinsec()) {
+		if (!comm_is_masteripaddr(&repeater->ipaddr) && virtclock_time()-repeater->last_active_time > config_get_repeaterinactivetimeoutinsec()) {
 			console_log(LOGLEVEL_REPEATERS "repeaters [%s]: timed out\n", repeaters_get_display_string_for_ip(&repeater->ipaddr));
 			repeater_to_remove = repeater;
 			repeater = repeater->next;
@@ -747,21 +762,21 @@ void repeaters_process(void) {
 			continue;
 		}
 
-		if (!repeater->snmpignored && config_get_repeaterinfoupdateinsec() > 0 && time(NULL)-repeater->last_repeaterinfo_request_time > config_get_repeaterinfoupdateinsec()) {
+		if (!repeater->snmpignored && config_get_repeaterinfoupdateinsec() > 0 && virtclock_time()-repeater->last_repeaterinfo_request_time > config_get_repeaterinfoupdateinsec()) {
 			console_log(LOGLEVEL_REPEATERS LOGLEVEL_DEBUG "repeaters [%s]: sending snmp info update request\n", repeaters_get_display_string_for_ip(&repeater->ipaddr));
 			snmp_start_read_repeaterinfo(comm_get_ip_str(&repeater->ipaddr));
-			repeater->last_repeaterinfo_request_time = time(NULL);
+			repeater->last_repeaterinfo_request_time = virtclock_time();
 		}
 
-		if (repeater->slot[0].state == REPEATER_SLOT_STATE_VOICE_CALL_RUNNING && time(NULL)-repeater->slot[0].last_call_or_data_packet_received_at > config_get_calltimeoutinsec())
+		if (repeater->slot[0].state == REPEATER_SLOT_STATE_VOICE_CALL_RUNNING && virtclock_time()-repeater->slot[0].last_call_or_data_packet_received_at > config_get_calltimeoutinsec())
 			dmr_handle_voice_call_timeout(repeater, 0);
 
-		if (repeater->slot[1].state == REPEATER_SLOT_STATE_VOICE_CALL_RUNNING && time(NULL)-repeater->slot[1].last_call_or_data_packet_received_at > config_get_calltimeoutinsec())
+		if (repeater->slot[1].state == REPEATER_SLOT_STATE_VOICE_CALL_RUNNING && virtclock_time()-repeater->slot[1].last_call_or_data_packet_received_at > config_get_calltimeoutinsec())
 			dmr_handle_voice_call_timeout(repeater, 1);
 
-		if (repeater->auto_rssi_update_enabled_at > 0 && repeater->auto_rssi_update_enabled_at <= time(NULL)) {
+		if (repeater->auto_rssi_update_enabled_at > 0 && repeater->auto_rssi_update_enabled_at <= virtclock_time()) {
 			if (config_get_rssiupdateduringcallinmsec() > 0) {
-				gettimeofday(&currtime, NULL);
+				virtclock_gettimeofday(&currtime);
 				timersub(&currtime, &repeater->last_rssi_request_time, &difftime);
 				if (difftime.tv_sec*1000+difftime.tv_usec/1000 > config_get_rssiupdateduringcallinmsec()) {
 					snmp_start_read_repeaterstatus(comm_get_ip_str(&repeater->ipaddr));
@@ -770,10 +785,10 @@ void repeaters_process(void) {
 			}
 		}
 
-		if (repeater->slot[0].state == REPEATER_SLOT_STATE_DATA_CALL_RUNNING && time(NULL)-repeater->slot[0].last_call_or_data_packet_received_at > config_get_datatimeoutinsec())
+		if (repeater->slot[0].state == REPEATER_SLOT_STATE_DATA_CALL_RUNNING && virtclock_time()-repeater->slot[0].last_call_or_data_packet_received_at > config_get_datatimeoutinsec())
 			dmr_handle_data_call_timeout(repeater, 0);
 
-		if (repeater->slot[1].state == REPEATER_SLOT_STATE_DATA_CALL_RUNNING && time(NULL)-repeater->slot[1].last_call_or_data_packet_received_at > config_get_datatimeoutinsec())
+		if (repeater->slot[1].state == REPEATER_SLOT_STATE_DATA_CALL_RUNNING && virtclock_time()-repeater->slot[1].last_call_or_data_packet_received_at > config_get_datatimeoutinsec())
 			dmr_handle_data_call_timeout(repeater, 1);
 
 		repeater = repeater->next;
@@ -785,4 +800,6 @@ void repeaters_deinit(void) {
 
 	while (repeaters != NULL)
 		repeaters_remove(repeaters);
+
+	repeaters_playcache_deinit();
 }
@@ -0,0 +1,236 @@
+/*
+ * This file is part of dmrshark.
+ *
+ * dmrshark is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dmrshark is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dmrshark.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+
+
+#include "replaybench.h"
+#include "comm.h"
+#include "ipsc.h"
+#include "repeaters.h"
+
+#include <libs/daemon/console.h>
+#include <libs/remotedb/remotedb.h>
+#include <libs/base/base.h>
+#include <libs/base/virtclock.h>
+#include <libs/voicestreams/voicestreams.h>
+
+#include <pcap/pcap.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#define REPLAYBENCH_MAX_STAGE_DEPTH	8
+
+static flag_t replaybench_running = 0;
+
+static replaybench_stage_t replaybench_stage_stack[REPLAYBENCH_MAX_STAGE_DEPTH];
+static uint8_t replaybench_stage_depth = 0;
+static struct timespec replaybench_stage_switched_at;
+static uint64_t replaybench_stage_nsec[REPLAYBENCH_STAGE_COUNT];
+static uint32_t replaybench_stubbed_tx_count = 0;
+
+static FILE *replaybench_events_file = NULL;
+static uint64_t replaybench_packet_count = 0;
+static uint32_t replaybench_events_count = 0;
+
+static char *replaybench_get_readable_stage(replaybench_stage_t stage) {
+	switch (stage) {
+		case REPLAYBENCH_STAGE_OTHER: return "other";
+		case REPLAYBENCH_STAGE_PCAP: return "pcap read";
+		case REPLAYBENCH_STAGE_IPSC: return "ipsc";
+		case REPLAYBENCH_STAGE_DMR: return "dmr handle";
+		case REPLAYBENCH_STAGE_VOICESTREAMS: return "voicestreams";
+		case REPLAYBENCH_STAGE_REMOTEDB: return "remotedb";
+		case REPLAYBENCH_STAGE_PROCESS: return "process";
+		default: return "unknown";
+	}
+}
+
+static uint64_t replaybench_get_nsec_since(struct timespec *since, struct timespec *now) {
+	return (uint64_t)(now->tv_sec-since->tv_sec)*1000000000ULL+now->tv_nsec-since->tv_nsec;
+}
+
+// Accounts the time elapsed since the last stage switch to the stage on the top of the stack.
+static void replaybench_stage_switch(struct timespec *now) {
+	clock_gettime(CLOCK_MONOTONIC, now);
+	replaybench_stage_nsec[replaybench_stage_stack[replaybench_stage_depth]] += replaybench_get_nsec_since(&replaybench_stage_switched_at, now);
+	replaybench_stage_switched_at = *now;
+}
+
+flag_t replaybench_is_running(void) {
+	return replaybench_running;
+}
+
+void replaybench_stage_enter(replaybench_stage_t stage) {
+	struct timespec now;
+
+	if (!replaybench_running || replaybench_stage_depth >= REPLAYBENCH_MAX_STAGE_DEPTH-1)
+		return;
+
+	replaybench_stage_switch(&now);
+	replaybench_stage_stack[++replaybench_stage_depth] = stage;
+}
+
+void replaybench_stage_leave(void) {
+	struct timespec now;
+
+	if (!replaybench_running || replaybench_stage_depth == 0)
+		return;
+
+	replaybench_stage_switch(&now);
+	replaybench_stage_depth--;
+}
+
+void replaybench_count_stubbed_tx(void) {
+	replaybench_stubbed_tx_count++;
+}
+
+// Decoded events are written to the given file while the replay is running, one event per line,
+// prefixed with the number of the packet which triggered them. The virtual clock follows the pcap
+// timestamps in this mode, so the output only depends on the pcap file and the config.
+flag_t replaybench_set_events_file(char *filename) {
+	if (replaybench_events_file != NULL) {
+		fclose(replaybench_events_file);
+		replaybench_events_file = NULL;
+	}
+	if (filename == NULL)
+		return 1;
+
+	replaybench_events_file = fopen(filename, "w");
+	if (replaybench_events_file == NULL) {
+		console_log("replaybench error: can't open events file %s for writing\n", filename);
+		return 0;
+	}
+	return 1;
+}
+
+void replaybench_event(const char *format, ...) {
+	va_list argptr;
+
+	if (!replaybench_running || replaybench_events_file == NULL)
+		return;
+
+	fprintf(replaybench_events_file, "%llu ", (unsigned long long)replaybench_packet_count);
+	va_start(argptr, format);
+	vfprintf(replaybench_events_file, format, argptr);
+	va_end(argptr);
+	fputc('\n', replaybench_events_file);
+	replaybench_events_count++;
+}
+
+// Processes the given pcap file loops times as fast as possible, then prints the results.
+// Network TX is stubbed out by the repeaters module and remotedb should be initialized in
+// dry run mode, so queries are generated but not sent to the server.
+flag_t replaybench_run(char *filename, unsigned int loops) {
+	char errbuf[PCAP_ERRBUF_SIZE];
+	pcap_t *pcap_handle = NULL;
+	struct pcap_pkthdr pkthdr;
+	uint8_t *packet = NULL;
+	uint16_t ip_packet_length = 0;
+	struct timespec started_at;
+	struct timespec now;
+	uint64_t total_nsec;
+	uint64_t ip_packet_count = 0;
+	struct rusage rusage;
+	unsigned int loop;
+	int i;
+
+	if (filename == NULL || loops == 0)
+		return 0;
+
+	console_log("replaybench: processing %s %u times\n", filename, loops);
+
+	memset(replaybench_stage_nsec, 0, sizeof(replaybench_stage_nsec));
+	replaybench_stage_depth = 0;
+	replaybench_stage_stack[0] = REPLAYBENCH_STAGE_OTHER;
+	replaybench_stubbed_tx_count = 0;
+	replaybench_packet_count = 0;
+	replaybench_events_count = 0;
+	replaybench_running = 1;
+
+	ipsc_init();
+
+	clock_gettime(CLOCK_MONOTONIC, &started_at);
+	replaybench_stage_switched_at = started_at;
+
+	for (loop = 0; loop < loops; loop++) {
+		pcap_handle = pcap_open_offline(filename, errbuf);
+		if (pcap_handle == NULL) {
+			console_log("replaybench error: can't open pcap file %s: %s\n", filename, errbuf);
+			replaybench_running = 0;
+			repeaters_deinit();
+			virtclock_release();
+			return 0;
+		}
+
+		replaybench_stage_enter(REPLAYBENCH_STAGE_PCAP);
+		while ((packet = (uint8_t *)pcap_next(pcap_handle, &pkthdr)) != NULL) {
+			replaybench_packet_count++;
+			if (replaybench_events_file != NULL)
+				virtclock_set(&pkthdr.ts);
+			ip_packet_length = pkthdr.len;
+			packet = comm_get_ip_packet_from_pcap_packet(packet, pcap_handle, &ip_packet_length);
+			replaybench_stage_leave();
+
+			if (packet != NULL) {
+				ip_packet_count++;
+				replaybench_stage_enter(REPLAYBENCH_STAGE_IPSC);
+				ipsc_processpacket((ipscpacket_raw_t *)packet, ip_packet_length);
+				replaybench_stage_leave();
+			}
+
+			// Doing the same periodic processing as the main loop does between received packets.
+			replaybench_stage_enter(REPLAYBENCH_STAGE_PROCESS);
+			base_process();
+			repeaters_process();
+			voicestreams_process();
+			replaybench_stage_leave();
+
+			replaybench_stage_enter(REPLAYBENCH_STAGE_PCAP);
+		}
+		replaybench_stage_leave();
+		pcap_close(pcap_handle);
+	}
+
+	replaybench_stage_switch(&now);
+	total_nsec = replaybench_get_nsec_since(&started_at, &now);
+	replaybench_running = 0;
+	repeaters_deinit();
+	virtclock_release();
+	if (replaybench_events_file != NULL) {
+		fflush(replaybench_events_file);
+		console_log("replaybench: %u events written\n", replaybench_events_count);
+	}
+
+	if (total_nsec == 0)
+		total_nsec = 1;
+	getrusage(RUSAGE_SELF, &rusage);
+
+	console_log("replaybench: %llu packets (%llu ip) in %.6f sec, %.0f packets/sec\n", (unsigned long long)replaybench_packet_count,
+		(unsigned long long)ip_packet_count, total_nsec/1000000000.0, replaybench_packet_count*1000000000.0/total_nsec);
+	for (i = 0; i < REPLAYBENCH_STAGE_COUNT; i++) {
+		console_log("replaybench:   %-14s %10.6f sec %5.1f%% %10.3f us/packet\n", replaybench_get_readable_stage(i),
+			replaybench_stage_nsec[i]/1000000000.0, replaybench_stage_nsec[i]*100.0/total_nsec,
+			(replaybench_packet_count ? replaybench_stage_nsec[i]/1000.0/replaybench_packet_count : 0));
+	}
+	console_log("replaybench: remotedb queries generated: %u, stubbed tx packets: %u\n", remotedb_get_dryrun_querycount(), replaybench_stubbed_tx_count);
+	console_log("replaybench: peak rss: %ld kB\n", rusage.ru_maxrss);
+
+	return 1;
+}
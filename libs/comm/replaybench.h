@@ -0,0 +1,48 @@
+/*
+ * This file is part of dmrshark.
+ *
+ * dmrshark is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dmrshark is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dmrshark.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+#ifndef REPLAYBENCH_H_
+#define REPLAYBENCH_H_
+
+#include <libs/base/types.h>
+
+// Time spent between entering and leaving a stage is accounted to that stage only,
+// nested stages are not included in the time of the enclosing stage.
+typedef enum {
+	REPLAYBENCH_STAGE_OTHER = 0,
+	REPLAYBENCH_STAGE_PCAP,
+	REPLAYBENCH_STAGE_IPSC,
+	REPLAYBENCH_STAGE_DMR,
+	REPLAYBENCH_STAGE_VOICESTREAMS,
+	REPLAYBENCH_STAGE_REMOTEDB,
+	REPLAYBENCH_STAGE_PROCESS,
+	REPLAYBENCH_STAGE_COUNT
+} replaybench_stage_t;
+
+flag_t replaybench_is_running(void);
+
+void replaybench_stage_enter(replaybench_stage_t stage);
+void replaybench_stage_leave(void);
+
+void replaybench_count_stubbed_tx(void);
+
+flag_t replaybench_set_events_file(char *filename);
+void replaybench_event(const char *format, ...);
+
+flag_t replaybench_run(char *filename, unsigned int loops);
+
+#endif
@@ -476,7 +476,7 @@ void snmp_process(void) {
 	if (snmp_select_info(&nfds, &fdset, &timeout, &block) <= 0)
 		return;
 	// Timeout is handled by daemon-poll.
-	daemon_poll_setmaxtimeout(timeout.tv_sec*1000+timeout.tv_usec/1000);
+	daemon_poll_setmaxtimeout_usec((uint64_t)timeout.tv_sec*1000000+timeout.tv_usec);
 	// As timeout is handled by daemon-poll, we want select() to return immediately here.
 	timeout.tv_sec = timeout.tv_usec = 0;
 	nfds = select(nfds, &fdset, NULL, NULL, &timeout);
@@ -206,6 +206,23 @@ int config_voicestreams_get_savedecodedtomp3file(char *streamname) {
 	return value;
 }
 
+int config_voicestreams_get_savecallindex(char *streamname) {
+	GError *error = NULL;
+	int value = 0;
+	char *key = "savecallindex";
+	int defaultvalue;
+
+	pthread_mutex_lock(config_get_mutex());
+	defaultvalue = 0;
+	value = g_key_file_get_integer(config_get_keyfile(), streamname, key, &error);
+	if (error) {
+		value = defaultvalue;
+		g_key_file_set_integer(config_get_keyfile(), streamname, key, value);
+	}
+	pthread_mutex_unlock(config_get_mutex());
+	return value;
+}
+
 int config_voicestreams_get_minmp3bitrate(char *streamname) {
 	GError *error = NULL;
 	int value = 0;
@@ -271,6 +288,22 @@ int config_voicestreams_get_mp3vbr(char *streamname) {
 	return value;
 }
 
+int config_voicestreams_get_mp3chunkinms(char *streamname) {
+	GError *error = NULL;
+	int value = 0;
+	char *key = "mp3chunkinms";
+	int defaultvalue = 1000;
+
+	pthread_mutex_lock(config_get_mutex());
+	value = g_key_file_get_integer(config_get_keyfile(), streamname, key, &error);
+	if (error || value <= 0) {
+		value = defaultvalue;
+		g_key_file_set_integer(config_get_keyfile(), streamname, key, value);
+	}
+	pthread_mutex_unlock(config_get_mutex());
+	return value;
+}
+
 int config_voicestreams_get_timeslot(char *streamname) {
 	GError *error = NULL;
 	int value = 0;
@@ -393,6 +426,38 @@ double config_voicestreams_get_rmsminsamplevalue(char *streamname) {
 	return value;
 }
 
+int config_voicestreams_get_mixermaxsources(char *streamname) {
+	GError *error = NULL;
+	int value = 0;
+	char *key = "mixermaxsources";
+	int defaultvalue = 4;
+
+	pthread_mutex_lock(config_get_mutex());
+	value = g_key_file_get_integer(config_get_keyfile(), streamname, key, &error);
+	if (error) {
+		value = defaultvalue;
+		g_key_file_set_integer(config_get_keyfile(), streamname, key, value);
+	}
+	pthread_mutex_unlock(config_get_mutex());
+	return value;
+}
+
+int config_voicestreams_get_priority(char *streamname) {
+	GError *error = NULL;
+	int value = 0;
+	char *key = "priority";
+	int defaultvalue = 5;
+
+	pthread_mutex_lock(config_get_mutex());
+	value = g_key_file_get_integer(config_get_keyfile(), streamname, key, &error);
+	if (error || value < 0 || value > 9) {
+		value = defaultvalue;
+		g_key_file_set_integer(config_get_keyfile(), streamname, key, value);
+	}
+	pthread_mutex_unlock(config_get_mutex());
+	return value;
+}
+
 void config_voicestreams_init(void) {
 	int i;
 	char *tmp;
@@ -417,10 +482,12 @@ void config_voicestreams_init(void) {
 			if (config_voicestreams_get_savedecodedtomp3file(voicestreams[i]))
 				console_log("config warning: voice stream %s has mp3 encoding enabled, but mp3 encoding is not compiled in\n", voicestreams[i]);
 #endif
+			config_voicestreams_get_savecallindex(voicestreams[i]);
 			config_voicestreams_get_minmp3bitrate(voicestreams[i]);
 			config_voicestreams_get_mp3bitrate(voicestreams[i]);
 			config_voicestreams_get_mp3quality(voicestreams[i]);
 			config_voicestreams_get_mp3vbr(voicestreams[i]);
+			config_voicestreams_get_mp3chunkinms(voicestreams[i]);
 			config_voicestreams_get_timeslot(voicestreams[i]);
 			config_voicestreams_get_decodequality(voicestreams[i]);
 			tmp = config_voicestreams_get_playrawfileatcallstart(voicestreams[i]);
@@ -430,6 +497,8 @@ void config_voicestreams_init(void) {
 			free(tmp);
 			config_voicestreams_get_rawfileatcallendgain(voicestreams[i]);
 			config_voicestreams_get_rmsminsamplevalue(voicestreams[i]);
+			config_voicestreams_get_mixermaxsources(voicestreams[i]);
+			config_voicestreams_get_priority(voicestreams[i]);
 
 			i++;
 			voicestreams_i++;
@@ -29,10 +29,12 @@ char *config_voicestreams_get_savefiledir(char *streamname);
 int config_voicestreams_get_savetorawambefile(char *streamname);
 int config_voicestreams_get_savedecodedtorawfile(char *streamname);
 int config_voicestreams_get_savedecodedtomp3file(char *streamname);
+int config_voicestreams_get_savecallindex(char *streamname);
 int config_voicestreams_get_minmp3bitrate(char *streamname);
 int config_voicestreams_get_mp3bitrate(char *streamname);
 int config_voicestreams_get_mp3quality(char *streamname);
 int config_voicestreams_get_mp3vbr(char *streamname);
+int config_voicestreams_get_mp3chunkinms(char *streamname);
 int config_voicestreams_get_timeslot(char *streamname);
 int config_voicestreams_get_decodequality(char *streamname);
 char *config_voicestreams_get_playrawfileatcallstart(char *streamname);
@@ -40,6 +42,8 @@ double config_voicestreams_get_rawfileatcallstartgain(char *streamname);
 char *config_voicestreams_get_playrawfileatcallend(char *streamname);
 double config_voicestreams_get_rawfileatcallendgain(char *streamname);
 double config_voicestreams_get_rmsminsamplevalue(char *streamname);
+int config_voicestreams_get_mixermaxsources(char *streamname);
+int config_voicestreams_get_priority(char *streamname);
 
 void config_voicestreams_init(void);
 
@@ -873,6 +873,74 @@ flag_t config_get_smsretransmitenabled(void) {
 	return (value != 0 ? 1 : 0);
 }
 
+int config_get_loopstallthresholdinms(void) {
+	GError *error = NULL;
+	int value = 0;
+	char *key = "loopstallthresholdinms";
+	int defaultvalue;
+
+	pthread_mutex_lock(&config_mutex);
+	defaultvalue = 20;
+	value = g_key_file_get_integer(keyfile, CONFIG_MAIN_SECTION_NAME, key, &error);
+	if (error || value < 0) {
+		value = defaultvalue;
+		g_key_file_set_integer(keyfile, CONFIG_MAIN_SECTION_NAME, key, value);
+	}
+	pthread_mutex_unlock(&config_mutex);
+	return value;
+}
+
+int config_get_voiceworkerthreads(void) {
+	GError *error = NULL;
+	int value = 0;
+	char *key = "voiceworkerthreads";
+	int defaultvalue;
+
+	pthread_mutex_lock(&config_mutex);
+	defaultvalue = 1;
+	value = g_key_file_get_integer(keyfile, CONFIG_MAIN_SECTION_NAME, key, &error);
+	if (error || value < 0) {
+		value = defaultvalue;
+		g_key_file_set_integer(keyfile, CONFIG_MAIN_SECTION_NAME, key, value);
+	}
+	pthread_mutex_unlock(&config_mutex);
+	return value;
+}
+
+int config_get_loadgovernorlatencyinms(void) {
+	GError *error = NULL;
+	int value = 0;
+	char *key = "loadgovernorlatencyinms";
+	int defaultvalue;
+
+	pthread_mutex_lock(&config_mutex);
+	defaultvalue = 0;
+	value = g_key_file_get_integer(keyfile, CONFIG_MAIN_SECTION_NAME, key, &error);
+	if (error || value < 0) {
+		value = defaultvalue;
+		g_key_file_set_integer(keyfile, CONFIG_MAIN_SECTION_NAME, key, value);
+	}
+	pthread_mutex_unlock(&config_mutex);
+	return value;
+}
+
+int config_get_loadgovernorqueuedepth(void) {
+	GError *error = NULL;
+	int value = 0;
+	char *key = "loadgovernorqueuedepth";
+	int defaultvalue;
+
+	pthread_mutex_lock(&config_mutex);
+	defaultvalue = 128;
+	value = g_key_file_get_integer(keyfile, CONFIG_MAIN_SECTION_NAME, key, &error);
+	if (error || value < 0) {
+		value = defaultvalue;
+		g_key_file_set_integer(keyfile, CONFIG_MAIN_SECTION_NAME, key, value);
+	}
+	pthread_mutex_unlock(&config_mutex);
+	return value;
+}
+
 void config_init(char *configfilename) {
 	GError *error = NULL;
 	char *tmp_str;
@@ -972,6 +1040,10 @@ void config_init(char *configfilename) {
 	tmp_str = config_get_aprsposdescription();
 	free(tmp_str);
 	config_get_smsretransmitenabled();
+	config_get_loopstallthresholdinms();
+	config_get_voiceworkerthreads();
+	config_get_loadgovernorlatencyinms();
+	config_get_loadgovernorqueuedepth();
 
 	config_writeconfigfile();
 }
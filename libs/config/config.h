@@ -78,6 +78,10 @@ char *config_get_aprsservercallsign(void);
 int config_get_aprsserverpasscode(void);
 char *config_get_aprsposdescription(void);
 flag_t config_get_smsretransmitenabled(void);
+int config_get_loopstallthresholdinms(void);
+int config_get_voiceworkerthreads(void);
+int config_get_loadgovernorlatencyinms(void);
+int config_get_loadgovernorqueuedepth(void);
 
 // If NULL is given, reloads the current config file.
 void config_init(char *configfilename);
@@ -0,0 +1,280 @@
+/*
+ * This file is part of dmrshark.
+ *
+ * dmrshark is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dmrshark is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dmrshark.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+#include "daemon-latency.h"
+#include "console.h"
+
+#include <libs/config/config.h>
+
+#include <time.h>
+#include <stdio.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Histogram buckets are log-linear like in HdrHistogram: every power of 2 range of
+// microseconds is split into 8 linear sub-buckets, so the error is at most 12.5%.
+#define DAEMON_LATENCY_SUB_BUCKET_BITS		3
+#define DAEMON_LATENCY_SUB_BUCKETS			(1 << DAEMON_LATENCY_SUB_BUCKET_BITS)
+#define DAEMON_LATENCY_MAX_EXPONENT			31
+#define DAEMON_LATENCY_BUCKETS				((DAEMON_LATENCY_MAX_EXPONENT-DAEMON_LATENCY_SUB_BUCKET_BITS+2)*DAEMON_LATENCY_SUB_BUCKETS)
+
+typedef struct {
+	uint32_t buckets[DAEMON_LATENCY_BUCKETS];
+	uint64_t count;
+	uint64_t sum_usec;
+	uint32_t max_usec;
+} daemon_latency_histogram_t;
+
+static char *daemon_latency_stage_names[DAEMON_LATENCY_STAGE_COUNT] = {
+	"poll callbacks (lws)",
+	"daemon",
+	"base",
+	"snmp",
+	"pcap",
+	"pcapreplay",
+	"repeaters",
+	"httpserver",
+	"voicestreams"
+};
+
+static daemon_latency_histogram_t daemon_latency_pass_histogram;
+static daemon_latency_histogram_t daemon_latency_stage_histograms[DAEMON_LATENCY_STAGE_COUNT];
+
+static double daemon_latency_usec_per_tick = 0.001;
+static uint64_t daemon_latency_pass_started_at = 0;
+static uint64_t daemon_latency_last_mark_at = 0;
+static uint32_t daemon_latency_pass_stage_usec[DAEMON_LATENCY_STAGE_COUNT];
+static flag_t daemon_latency_pass_running = 0;
+
+static uint32_t daemon_latency_stall_threshold_usec = 0;
+static uint32_t daemon_latency_stalls = 0;
+static uint32_t daemon_latency_stalls_not_logged = 0;
+static time_t daemon_latency_last_stall_logged_at = 0;
+
+// Longest pass since the last daemon_latency_get_window_max_pass_usec() call.
+static uint32_t daemon_latency_window_max_pass_usec = 0;
+
+// Returns a cheap timestamp, TSC ticks on x86 and nanoseconds elsewhere.
+static inline uint64_t daemon_latency_get_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000+ts.tv_nsec;
+#endif
+}
+
+static uint32_t daemon_latency_ticks_to_usec(uint64_t ticks) {
+	double usec = ticks*daemon_latency_usec_per_tick;
+
+	if (usec > UINT32_MAX)
+		return UINT32_MAX;
+	return usec;
+}
+
+static uint16_t daemon_latency_get_bucket(uint32_t usec) {
+	int exponent;
+
+	if (usec < DAEMON_LATENCY_SUB_BUCKETS)
+		return usec;
+
+	exponent = 31-__builtin_clz(usec);
+	return (exponent-DAEMON_LATENCY_SUB_BUCKET_BITS+1)*DAEMON_LATENCY_SUB_BUCKETS+((usec >> (exponent-DAEMON_LATENCY_SUB_BUCKET_BITS)) & (DAEMON_LATENCY_SUB_BUCKETS-1));
+}
+
+// Returns the highest value which falls into the given bucket.
+static uint32_t daemon_latency_get_bucket_max_usec(uint16_t bucket) {
+	int exponent;
+	uint64_t bucket_max;
+
+	if (bucket < DAEMON_LATENCY_SUB_BUCKETS)
+		return bucket;
+
+	exponent = bucket/DAEMON_LATENCY_SUB_BUCKETS+DAEMON_LATENCY_SUB_BUCKET_BITS-1;
+	bucket_max = ((uint64_t)(DAEMON_LATENCY_SUB_BUCKETS+bucket%DAEMON_LATENCY_SUB_BUCKETS+1) << (exponent-DAEMON_LATENCY_SUB_BUCKET_BITS))-1;
+	return (bucket_max > UINT32_MAX ? UINT32_MAX : bucket_max);
+}
+
+static void daemon_latency_histogram_add(daemon_latency_histogram_t *histogram, uint32_t usec) {
+	histogram->buckets[daemon_latency_get_bucket(usec)]++;
+	histogram->count++;
+	histogram->sum_usec += usec;
+	if (usec > histogram->max_usec)
+		histogram->max_usec = usec;
+}
+
+static uint32_t daemon_latency_histogram_get_percentile(daemon_latency_histogram_t *histogram, double percentile) {
+	uint64_t count_to_reach;
+	uint64_t count = 0;
+	uint16_t i;
+	uint32_t bucket_max_usec;
+
+	if (histogram->count == 0)
+		return 0;
+
+	count_to_reach = histogram->count*percentile/100.0;
+	if (count_to_reach < histogram->count*percentile/100.0 || count_to_reach == 0) // Rounding up.
+		count_to_reach++;
+
+	for (i = 0; i < DAEMON_LATENCY_BUCKETS; i++) {
+		count += histogram->buckets[i];
+		if (count >= count_to_reach) {
+			bucket_max_usec = daemon_latency_get_bucket_max_usec(i);
+			return (bucket_max_usec < histogram->max_usec ? bucket_max_usec : histogram->max_usec);
+		}
+	}
+	return histogram->max_usec;
+}
+
+void daemon_latency_pass_start(void) {
+	daemon_latency_pass_started_at = daemon_latency_last_mark_at = daemon_latency_get_ticks();
+	memset(daemon_latency_pass_stage_usec, 0, sizeof(daemon_latency_pass_stage_usec));
+	daemon_latency_pass_running = 1;
+}
+
+void daemon_latency_mark(daemon_latency_stage_t stage) {
+	uint64_t now;
+	uint32_t usec;
+
+	if (!daemon_latency_pass_running || stage >= DAEMON_LATENCY_STAGE_COUNT)
+		return;
+
+	now = daemon_latency_get_ticks();
+	usec = daemon_latency_ticks_to_usec(now-daemon_latency_last_mark_at);
+	daemon_latency_last_mark_at = now;
+
+	daemon_latency_pass_stage_usec[stage] += usec;
+	daemon_latency_histogram_add(&daemon_latency_stage_histograms[stage], usec);
+}
+
+void daemon_latency_pass_end(void) {
+	uint32_t pass_usec;
+	daemon_latency_stage_t stage;
+	daemon_latency_stage_t slowest_stage = 0;
+	time_t now;
+
+	if (!daemon_latency_pass_running)
+		return;
+	daemon_latency_pass_running = 0;
+
+	pass_usec = daemon_latency_ticks_to_usec(daemon_latency_get_ticks()-daemon_latency_pass_started_at);
+	daemon_latency_histogram_add(&daemon_latency_pass_histogram, pass_usec);
+	if (pass_usec > daemon_latency_window_max_pass_usec)
+		daemon_latency_window_max_pass_usec = pass_usec;
+
+	if (daemon_latency_stall_threshold_usec == 0 || pass_usec < daemon_latency_stall_threshold_usec)
+		return;
+
+	daemon_latency_stalls++;
+
+	// Logging at most one stall per second, so a stalling loop doesn't get slower by logging.
+	now = time(NULL);
+	if (now == daemon_latency_last_stall_logged_at) {
+		daemon_latency_stalls_not_logged++;
+		return;
+	}
+	daemon_latency_last_stall_logged_at = now;
+
+	for (stage = 1; stage < DAEMON_LATENCY_STAGE_COUNT; stage++) {
+		if (daemon_latency_pass_stage_usec[stage] > daemon_latency_pass_stage_usec[slowest_stage])
+			slowest_stage = stage;
+	}
+	console_log("daemon-latency: stall: main loop pass took %.1f ms, slowest stage: %s (%.1f ms)", pass_usec/1000.0,
+		daemon_latency_stage_names[slowest_stage], daemon_latency_pass_stage_usec[slowest_stage]/1000.0);
+	if (daemon_latency_stalls_not_logged)
+		console_log(", %u stalls not logged", daemon_latency_stalls_not_logged);
+	console_log("\n");
+	daemon_latency_stalls_not_logged = 0;
+}
+
+// Returns the longest main loop pass since the previous call of this function.
+uint32_t daemon_latency_get_window_max_pass_usec(void) {
+	uint32_t max_pass_usec = daemon_latency_window_max_pass_usec;
+
+	daemon_latency_window_max_pass_usec = 0;
+	return max_pass_usec;
+}
+
+static int daemon_latency_get_histogram_report(char *buf, int buf_size, char *name, daemon_latency_histogram_t *histogram) {
+	return snprintf(buf, buf_size, "  %-20s %10llu %8llu %8u %8u %8u %8u %8u\n", name, (unsigned long long)histogram->count,
+		(unsigned long long)(histogram->count ? histogram->sum_usec/histogram->count : 0),
+		daemon_latency_histogram_get_percentile(histogram, 50), daemon_latency_histogram_get_percentile(histogram, 90),
+		daemon_latency_histogram_get_percentile(histogram, 99), daemon_latency_histogram_get_percentile(histogram, 99.9),
+		histogram->max_usec);
+}
+
+int daemon_latency_get_report(char *buf, int buf_size) {
+	int length;
+	daemon_latency_stage_t stage;
+
+	if (buf == NULL || buf_size <= 0)
+		return 0;
+
+	length = snprintf(buf, buf_size, "main loop latencies in usec, stalls over %u ms: %u\n", daemon_latency_stall_threshold_usec/1000, daemon_latency_stalls);
+	if (length < buf_size)
+		length += snprintf(buf+length, buf_size-length, "  %-20s %10s %8s %8s %8s %8s %8s %8s\n", "stage", "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+	if (length < buf_size)
+		length += daemon_latency_get_histogram_report(buf+length, buf_size-length, "whole pass", &daemon_latency_pass_histogram);
+	for (stage = 0; stage < DAEMON_LATENCY_STAGE_COUNT && length < buf_size; stage++)
+		length += daemon_latency_get_histogram_report(buf+length, buf_size-length, daemon_latency_stage_names[stage], &daemon_latency_stage_histograms[stage]);
+
+	return (length < buf_size ? length : buf_size-1);
+}
+
+void daemon_latency_print(void) {
+	char buf[2048];
+
+	daemon_latency_get_report(buf, sizeof(buf));
+	console_log("%s", buf);
+}
+
+void daemon_latency_reset(void) {
+	memset(&daemon_latency_pass_histogram, 0, sizeof(daemon_latency_histogram_t));
+	memset(daemon_latency_stage_histograms, 0, sizeof(daemon_latency_stage_histograms));
+	daemon_latency_stalls = 0;
+	daemon_latency_stalls_not_logged = 0;
+}
+
+// Measures the TSC frequency against the monotonic clock.
+static void daemon_latency_calibrate(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	struct timespec start_ts;
+	struct timespec ts;
+	uint64_t start_ticks;
+	uint64_t elapsed_nsec;
+
+	clock_gettime(CLOCK_MONOTONIC, &start_ts);
+	start_ticks = daemon_latency_get_ticks();
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		elapsed_nsec = (ts.tv_sec-start_ts.tv_sec)*1000000000LL+(ts.tv_nsec-start_ts.tv_nsec);
+	} while (elapsed_nsec < 2000000);
+	daemon_latency_usec_per_tick = elapsed_nsec/1000.0/(daemon_latency_get_ticks()-start_ticks);
+#else
+	daemon_latency_usec_per_tick = 0.001;
+#endif
+}
+
+void daemon_latency_init(void) {
+	daemon_latency_calibrate();
+	daemon_latency_stall_threshold_usec = config_get_loopstallthresholdinms()*1000;
+	daemon_latency_reset();
+}
@@ -0,0 +1,51 @@
+/*
+ * This file is part of dmrshark.
+ *
+ * dmrshark is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dmrshark is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dmrshark.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+#ifndef DAEMON_LATENCY_H_
+#define DAEMON_LATENCY_H_
+
+#include <libs/base/types.h>
+
+// Stages of a main loop pass. Each stage is measured from the previous mark.
+#define DAEMON_LATENCY_STAGE_POLL_CALLBACKS		0
+#define DAEMON_LATENCY_STAGE_DAEMON				1
+#define DAEMON_LATENCY_STAGE_BASE				2
+#define DAEMON_LATENCY_STAGE_SNMP				3
+#define DAEMON_LATENCY_STAGE_PCAP				4
+#define DAEMON_LATENCY_STAGE_PCAPREPLAY			5
+#define DAEMON_LATENCY_STAGE_REPEATERS			6
+#define DAEMON_LATENCY_STAGE_HTTPSERVER			7
+#define DAEMON_LATENCY_STAGE_VOICESTREAMS		8
+#define DAEMON_LATENCY_STAGE_COUNT				9
+typedef uint8_t daemon_latency_stage_t;
+
+// Called when the main loop wakes up, and before it goes to sleep again.
+void daemon_latency_pass_start(void);
+void daemon_latency_pass_end(void);
+// Accounts the time elapsed since the previous mark to the given stage.
+void daemon_latency_mark(daemon_latency_stage_t stage);
+
+uint32_t daemon_latency_get_window_max_pass_usec(void);
+
+// Writes the latency statistics as text to buf. Returns the length of the written text.
+int daemon_latency_get_report(char *buf, int buf_size);
+void daemon_latency_print(void);
+void daemon_latency_reset(void);
+
+void daemon_latency_init(void);
+
+#endif
@@ -16,57 +16,200 @@
 **/
 
 #include "daemon-poll.h"
-
+#include "console.h"
+#include "daemon-latency.h"
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
 #include <stdlib.h>
-#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define DAEMON_POLL_MIN_EPOLL_EVENTS	16
+#define DAEMON_POLL_DEFAULT_TIMEOUT_USEC	1000000
+
+typedef struct {
+	uint8_t watched;
+	uint8_t always_ready; // Regular files can't be added to epoll, but poll() always reports them as ready.
+	short events;
+	short revents;
+	daemon_poll_callback_t callback;
+	void *callback_arg;
+} daemon_poll_fd_t;
+
+static int daemon_poll_epollfd = -1;
+static daemon_poll_fd_t *daemon_poll_fds = NULL; // Indexed by fd.
+static int daemon_poll_fds_size = 0;
+static int daemon_poll_watched_count = 0;
+static int daemon_poll_always_ready_count = 0;
+
+static struct epoll_event *daemon_poll_epoll_events = NULL;
+static int daemon_poll_epoll_events_size = 0;
+
+// Fds which have nonzero revents since the last daemon_poll_process() call.
+static int *daemon_poll_ready_fds = NULL;
+static int daemon_poll_ready_fds_count = 0;
+
+static struct pollfd *pfd = NULL; // Snapshot returned by daemon_poll_getpfd().
+static int pfdcount = 0;
+static uint64_t polltimeout_usec = 0;
+
+// The timeout is done by this timerfd, so it has microsecond resolution unlike epoll_wait().
+static int daemon_poll_timerfd = -1;
+// Other threads can wake up the main loop by writing to this eventfd.
+static int daemon_poll_eventfd = -1;
+
+typedef struct {
+	uint32_t wakeups;
+	uint32_t zero_timeout_wakeups;
+	uint32_t timer_wakeups;
+	uint32_t notify_wakeups;
+	uint32_t fd_wakeups;
+} daemon_poll_wakeup_counters_t;
+
+static struct {
+	struct timespec started_at;
+	daemon_poll_wakeup_counters_t total;
+
+	// Counters of the current and the last full second.
+	struct timespec sample_started_at;
+	struct timeval sample_started_cputime;
+	daemon_poll_wakeup_counters_t sample;
+	daemon_poll_wakeup_counters_t last_sample;
+	double last_sample_cpu_usage;
+} daemon_poll_stats;
+
+static uint8_t daemon_poll_timer_fired;
+static uint8_t daemon_poll_notified;
+
+static uint32_t daemon_poll_events_to_epoll(short events) {
+	uint32_t epoll_events = 0;
+
+	if (events & POLLIN)
+		epoll_events |= EPOLLIN;
+	if (events & POLLOUT)
+		epoll_events |= EPOLLOUT;
+	if (events & POLLPRI)
+		epoll_events |= EPOLLPRI;
+	return epoll_events;
+}
 
-static struct pollfd *pfd = NULL; // This stores the watched file descriptors as pollfd structures.
-static int pfdcount = 0; // How much pollfd structures we store.
-static int polltimeout = 0;
+static short daemon_poll_epoll_to_revents(uint32_t epoll_events) {
+	short revents = 0;
+
+	if (epoll_events & EPOLLIN)
+		revents |= POLLIN;
+	if (epoll_events & EPOLLOUT)
+		revents |= POLLOUT;
+	if (epoll_events & EPOLLPRI)
+		revents |= POLLPRI;
+	if (epoll_events & EPOLLERR)
+		revents |= POLLERR;
+	if (epoll_events & EPOLLHUP)
+		revents |= POLLHUP;
+	return revents;
+}
 
-static int daemon_poll_pfdrealloc(int count) {
-	struct pollfd *newpfd;
+static daemon_poll_fd_t *daemon_poll_getfd(int fd) {
+	if (fd < 0 || fd >= daemon_poll_fds_size || !daemon_poll_fds[fd].watched)
+		return NULL;
+	return &daemon_poll_fds[fd];
+}
 
-	if (count <= 0) {
-		free(pfd);
-		pfd = NULL;
+static int daemon_poll_fdsrealloc(int fd) {
+	daemon_poll_fd_t *newfds;
+	int *newready_fds;
+	int newsize;
+
+	if (fd < daemon_poll_fds_size)
 		return 1;
-	}
 
-	newpfd = (struct pollfd *)realloc(pfd, sizeof(struct pollfd) * count);
-	if (!newpfd)
+	newsize = (daemon_poll_fds_size > 0 ? daemon_poll_fds_size : DAEMON_POLL_MIN_EPOLL_EVENTS);
+	while (newsize <= fd)
+		newsize *= 2;
+
+	newfds = (daemon_poll_fd_t *)realloc(daemon_poll_fds, sizeof(daemon_poll_fd_t) * newsize);
+	if (!newfds)
 		return 0;
+	memset(&newfds[daemon_poll_fds_size], 0, sizeof(daemon_poll_fd_t) * (newsize-daemon_poll_fds_size));
+	daemon_poll_fds = newfds;
 
-	pfd = newpfd;
+	// An fd can be in the ready list only once, so its size can't exceed the table size.
+	newready_fds = (int *)realloc(daemon_poll_ready_fds, sizeof(int) * newsize);
+	if (!newready_fds)
+		return 0;
+	daemon_poll_ready_fds = newready_fds;
+
+	daemon_poll_fds_size = newsize;
 	return 1;
 }
 
-static int daemon_poll_getpfdindex(int fd) {
-	int i;
+static int daemon_poll_epollctl(int op, int fd, short events) {
+	struct epoll_event ev;
 
-	for (i = 0; i < pfdcount; i++) {
-		if (pfd[i].fd == fd)
-			return i;
-	}
-	return -1;
+	memset(&ev, 0, sizeof(struct epoll_event));
+	ev.events = daemon_poll_events_to_epoll(events);
+	ev.data.fd = fd;
+	return epoll_ctl(daemon_poll_epollfd, op, fd, &ev);
 }
 
-void daemon_poll_addfd(int fd, short events) {
-	int i = daemon_poll_getpfdindex(fd);
+static void daemon_poll_set_ready(int fd, short revents) {
+	if (daemon_poll_fds[fd].revents == 0)
+		daemon_poll_ready_fds[daemon_poll_ready_fds_count++] = fd;
+	daemon_poll_fds[fd].revents |= revents;
+}
 
-	if (i >= 0) { // If we already watch the fd, we update the watched events
-		pfd[i].events |= events;
-		pfd[i].revents = 0;
+void daemon_poll_addfd_callback(int fd, short events, daemon_poll_callback_t callback, void *arg) {
+	daemon_poll_fd_t *pollfd = daemon_poll_getfd(fd);
+	struct epoll_event *newepoll_events;
+
+	if (pollfd) { // If we already watch the fd, we update the watched events
+		pollfd->events |= events;
+		if (callback) {
+			pollfd->callback = callback;
+			pollfd->callback_arg = arg;
+		}
+		if (!pollfd->always_ready && daemon_poll_epollctl(EPOLL_CTL_MOD, fd, pollfd->events) < 0 && errno == ENOENT) // The fd was closed without removing it.
+			daemon_poll_epollctl(EPOLL_CTL_ADD, fd, pollfd->events);
 		return;
 	}
 
-	if (!daemon_poll_pfdrealloc(pfdcount+1))
+	if (fd < 0 || daemon_poll_epollfd < 0 || !daemon_poll_fdsrealloc(fd))
 		return;
 
-	pfd[pfdcount].fd = fd;
-	pfd[pfdcount].events = events;
-	pfd[pfdcount].revents = 0;
-	pfdcount++;
+	if (daemon_poll_watched_count+1 > daemon_poll_epoll_events_size) {
+		newepoll_events = (struct epoll_event *)realloc(daemon_poll_epoll_events, sizeof(struct epoll_event) * (daemon_poll_epoll_events_size+DAEMON_POLL_MIN_EPOLL_EVENTS));
+		if (!newepoll_events)
+			return;
+		daemon_poll_epoll_events = newepoll_events;
+		daemon_poll_epoll_events_size += DAEMON_POLL_MIN_EPOLL_EVENTS;
+	}
+
+	pollfd = &daemon_poll_fds[fd];
+	memset(pollfd, 0, sizeof(daemon_poll_fd_t));
+	if (daemon_poll_epollctl(EPOLL_CTL_ADD, fd, events) < 0) {
+		if (errno != EPERM) {
+			console_log("daemon-poll error: can't watch fd %d: %s\n", fd, strerror(errno));
+			return;
+		}
+		pollfd->always_ready = 1;
+		daemon_poll_always_ready_count++;
+	}
+	pollfd->watched = 1;
+	pollfd->events = events;
+	pollfd->callback = callback;
+	pollfd->callback_arg = arg;
+	daemon_poll_watched_count++;
+}
+
+void daemon_poll_addfd(int fd, short events) {
+	daemon_poll_addfd_callback(fd, events, NULL, NULL);
 }
 
 void daemon_poll_addfd_read(int fd) {
@@ -82,62 +225,93 @@ void daemon_poll_addfd_readwrite(int fd) {
 }
 
 void daemon_poll_changefd(int fd, short events) {
-	int i = daemon_poll_getpfdindex(fd);
+	daemon_poll_fd_t *pollfd = daemon_poll_getfd(fd);
 
-	if (i >= 0) {
-		pfd[i].events = events;
-//		pfd[i].revents = 0;
-	}
+	if (!pollfd)
+		return;
+
+	pollfd->events = events;
+	if (!pollfd->always_ready && daemon_poll_epollctl(EPOLL_CTL_MOD, fd, events) < 0 && errno == ENOENT)
+		daemon_poll_epollctl(EPOLL_CTL_ADD, fd, events);
 }
 
 void daemon_poll_removefd(int fd) {
-	int i, found = 0;
+	daemon_poll_fd_t *pollfd = daemon_poll_getfd(fd);
 
-	if (pfdcount <= 0)
+	if (!pollfd)
 		return;
 
-	// Searching for the fd
-	for (i = 0; i < pfdcount-1; i++) {
-		if (pfd[i].fd == fd)
-			found = 1;
-		// If the item was found, we shift the other ones to the left
-		if (found)
-			pfd[i] = pfd[i+1];
-	}
-
-	if (pfd[pfdcount-1].fd == fd)
-		found = 1;
+	// This fails if the fd is already closed, epoll removes those automatically.
+	if (!pollfd->always_ready)
+		epoll_ctl(daemon_poll_epollfd, EPOLL_CTL_DEL, fd, NULL);
+	else
+		daemon_poll_always_ready_count--;
 
-	if (found) {
-		pfdcount--;
-		daemon_poll_pfdrealloc(pfdcount);
-	}
+	pollfd->watched = 0;
+	pollfd->callback = NULL;
+	pollfd->callback_arg = NULL;
+	daemon_poll_watched_count--;
 }
 
 void daemon_poll_setmaxtimeout(int timeout) {
-	if (timeout < polltimeout)
-		polltimeout = timeout;
+	if (timeout < 0)
+		timeout = 0;
+	daemon_poll_setmaxtimeout_usec((uint64_t)timeout*1000);
+}
+
+void daemon_poll_setmaxtimeout_usec(uint64_t timeout_usec) {
+	if (timeout_usec < polltimeout_usec)
+		polltimeout_usec = timeout_usec;
+}
+
+// Can be called from any thread.
+void daemon_poll_wakeup(void) {
+	uint64_t value = 1;
+
+	if (daemon_poll_eventfd >= 0 && write(daemon_poll_eventfd, &value, sizeof(value)) != sizeof(value) && errno != EAGAIN)
+		console_log("daemon-poll error: can't write eventfd: %s\n", strerror(errno));
 }
 
 int daemon_poll_isfdreadable(int fd) {
-	int i = daemon_poll_getpfdindex(fd);
+	daemon_poll_fd_t *pollfd = daemon_poll_getfd(fd);
 
-	if (i < 0)
+	if (!pollfd)
 		return 0;
 
-	return ((pfd[i].revents & POLLIN) > 0);
+	return ((pollfd->revents & POLLIN) > 0);
 }
 
 int daemon_poll_isfdwritable(int fd) {
-	int i = daemon_poll_getpfdindex(fd);
+	daemon_poll_fd_t *pollfd = daemon_poll_getfd(fd);
 
-	if (i < 0)
+	if (!pollfd)
 		return 0;
 
-	return ((pfd[i].revents & POLLOUT) > 0);
+	return ((pollfd->revents & POLLOUT) > 0);
 }
 
 struct pollfd *daemon_poll_getpfd(void) {
+	struct pollfd *newpfd;
+	int fd;
+
+	pfdcount = 0;
+	if (daemon_poll_watched_count <= 0)
+		return NULL;
+
+	newpfd = (struct pollfd *)realloc(pfd, sizeof(struct pollfd) * daemon_poll_watched_count);
+	if (!newpfd)
+		return NULL;
+	pfd = newpfd;
+
+	for (fd = 0; fd < daemon_poll_fds_size && pfdcount < daemon_poll_watched_count; fd++) {
+		if (!daemon_poll_fds[fd].watched)
+			continue;
+
+		pfd[pfdcount].fd = fd;
+		pfd[pfdcount].events = daemon_poll_fds[fd].events;
+		pfd[pfdcount].revents = daemon_poll_fds[fd].revents;
+		pfdcount++;
+	}
 	return pfd;
 }
 
@@ -145,20 +319,242 @@ int daemon_poll_getpfdcount(void) {
 	return pfdcount;
 }
 
+static void daemon_poll_timerfd_callback(struct pollfd *pfd, void *arg) {
+	uint64_t expirations;
+
+	if (read(pfd->fd, &expirations, sizeof(expirations)) > 0)
+		daemon_poll_timer_fired = 1;
+}
+
+static void daemon_poll_eventfd_callback(struct pollfd *pfd, void *arg) {
+	uint64_t value;
+
+	if (read(pfd->fd, &value, sizeof(value)) > 0)
+		daemon_poll_notified = 1;
+}
+
+static uint64_t daemon_poll_get_elapsed_usec(struct timespec *since, struct timespec *now) {
+	return (now->tv_sec-since->tv_sec)*1000000LL+(now->tv_nsec-since->tv_nsec)/1000;
+}
+
+static void daemon_poll_get_cputime(struct timeval *cputime) {
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+	timeradd(&usage.ru_utime, &usage.ru_stime, cputime);
+}
+
+static void daemon_poll_update_stats(flag_t zero_timeout) {
+	struct timespec now;
+	struct timeval cputime;
+	struct timeval cputime_diff;
+	uint64_t elapsed_usec;
+	flag_t fd_events = 0;
+	int i;
+
+	for (i = 0; i < daemon_poll_ready_fds_count; i++) {
+		if (daemon_poll_ready_fds[i] != daemon_poll_timerfd && daemon_poll_ready_fds[i] != daemon_poll_eventfd) {
+			fd_events = 1;
+			break;
+		}
+	}
+
+	// A wakeup is counted only once, by its most specific reason.
+	daemon_poll_stats.sample.wakeups++;
+	if (fd_events)
+		daemon_poll_stats.sample.fd_wakeups++;
+	else if (daemon_poll_notified)
+		daemon_poll_stats.sample.notify_wakeups++;
+	else if (daemon_poll_timer_fired)
+		daemon_poll_stats.sample.timer_wakeups++;
+	else if (zero_timeout)
+		daemon_poll_stats.sample.zero_timeout_wakeups++;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed_usec = daemon_poll_get_elapsed_usec(&daemon_poll_stats.sample_started_at, &now);
+	if (elapsed_usec < 1000000)
+		return;
+
+	daemon_poll_get_cputime(&cputime);
+	timersub(&cputime, &daemon_poll_stats.sample_started_cputime, &cputime_diff);
+	daemon_poll_stats.last_sample_cpu_usage = (cputime_diff.tv_sec*1000000.0+cputime_diff.tv_usec)*100.0/elapsed_usec;
+
+	// Normalizing to one second.
+	daemon_poll_stats.last_sample.wakeups = daemon_poll_stats.sample.wakeups*1000000ULL/elapsed_usec;
+	daemon_poll_stats.last_sample.zero_timeout_wakeups = daemon_poll_stats.sample.zero_timeout_wakeups*1000000ULL/elapsed_usec;
+	daemon_poll_stats.last_sample.timer_wakeups = daemon_poll_stats.sample.timer_wakeups*1000000ULL/elapsed_usec;
+	daemon_poll_stats.last_sample.notify_wakeups = daemon_poll_stats.sample.notify_wakeups*1000000ULL/elapsed_usec;
+	daemon_poll_stats.last_sample.fd_wakeups = daemon_poll_stats.sample.fd_wakeups*1000000ULL/elapsed_usec;
+
+	daemon_poll_stats.total.wakeups += daemon_poll_stats.sample.wakeups;
+	daemon_poll_stats.total.zero_timeout_wakeups += daemon_poll_stats.sample.zero_timeout_wakeups;
+	daemon_poll_stats.total.timer_wakeups += daemon_poll_stats.sample.timer_wakeups;
+	daemon_poll_stats.total.notify_wakeups += daemon_poll_stats.sample.notify_wakeups;
+	daemon_poll_stats.total.fd_wakeups += daemon_poll_stats.sample.fd_wakeups;
+
+	memset(&daemon_poll_stats.sample, 0, sizeof(daemon_poll_wakeup_counters_t));
+	daemon_poll_stats.sample_started_at = now;
+	daemon_poll_stats.sample_started_cputime = cputime;
+}
+
+void daemon_poll_print_stats(void) {
+	struct timespec now;
+	struct timeval cputime;
+	daemon_poll_wakeup_counters_t total;
+	double elapsed_sec;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed_sec = daemon_poll_get_elapsed_usec(&daemon_poll_stats.started_at, &now)/1000000.0;
+	daemon_poll_get_cputime(&cputime);
+
+	// Adding the counters of the current, not yet finished second.
+	total.wakeups = daemon_poll_stats.total.wakeups+daemon_poll_stats.sample.wakeups;
+	total.zero_timeout_wakeups = daemon_poll_stats.total.zero_timeout_wakeups+daemon_poll_stats.sample.zero_timeout_wakeups;
+	total.timer_wakeups = daemon_poll_stats.total.timer_wakeups+daemon_poll_stats.sample.timer_wakeups;
+	total.notify_wakeups = daemon_poll_stats.total.notify_wakeups+daemon_poll_stats.sample.notify_wakeups;
+	total.fd_wakeups = daemon_poll_stats.total.fd_wakeups+daemon_poll_stats.sample.fd_wakeups;
+
+	console_log("daemon-poll: watched fds: %u\n", daemon_poll_watched_count);
+	console_log("  last second: cpu usage: %.1f%% wakeups: %u (fd events: %u notifications: %u timer: %u zero timeout: %u)\n",
+		daemon_poll_stats.last_sample_cpu_usage, daemon_poll_stats.last_sample.wakeups, daemon_poll_stats.last_sample.fd_wakeups,
+		daemon_poll_stats.last_sample.notify_wakeups, daemon_poll_stats.last_sample.timer_wakeups, daemon_poll_stats.last_sample.zero_timeout_wakeups);
+	if (elapsed_sec <= 0)
+		return;
+	console_log("  average: cpu usage: %.1f%% wakeups/sec: %.1f (fd events: %.1f notifications: %.1f timer: %.1f zero timeout: %.1f)\n",
+		(cputime.tv_sec+cputime.tv_usec/1000000.0)*100.0/elapsed_sec, total.wakeups/elapsed_sec, total.fd_wakeups/elapsed_sec,
+		total.notify_wakeups/elapsed_sec, total.timer_wakeups/elapsed_sec, total.zero_timeout_wakeups/elapsed_sec);
+}
+
 void daemon_poll_process(void) {
-	poll(pfd, pfdcount, polltimeout);
+	int i, fd, count;
+	int timeout = -1;
+	daemon_poll_fd_t *pollfd;
+	struct pollfd readypfd;
+	struct itimerspec timerspec;
+
+	daemon_latency_pass_end();
+
+	// Clearing the results of the previous call.
+	for (i = 0; i < daemon_poll_ready_fds_count; i++)
+		daemon_poll_fds[daemon_poll_ready_fds[i]].revents = 0;
+	daemon_poll_ready_fds_count = 0;
+	daemon_poll_timer_fired = daemon_poll_notified = 0;
+
+	if (daemon_poll_always_ready_count > 0)
+		polltimeout_usec = 0;
+
+	if (polltimeout_usec == 0)
+		timeout = 0;
+	else if (daemon_poll_timerfd >= 0) {
+		memset(&timerspec, 0, sizeof(struct itimerspec));
+		timerspec.it_value.tv_sec = polltimeout_usec/1000000;
+		timerspec.it_value.tv_nsec = (polltimeout_usec%1000000)*1000;
+		if (timerfd_settime(daemon_poll_timerfd, 0, &timerspec, NULL) < 0)
+			timeout = (polltimeout_usec+999)/1000;
+	} else
+		timeout = (polltimeout_usec+999)/1000;
+
+	if (daemon_poll_epollfd < 0) { // Init failed, we only sleep.
+		poll(NULL, 0, (timeout < 0 ? (polltimeout_usec+999)/1000 : timeout));
+		count = 0;
+	} else {
+		count = epoll_wait(daemon_poll_epollfd, daemon_poll_epoll_events, daemon_poll_epoll_events_size, timeout);
+		if (count < 0 && errno != EINTR)
+			console_log("daemon-poll error: epoll_wait() failed: %s\n", strerror(errno));
+	}
+	daemon_latency_pass_start();
+
+	for (i = 0; i < count; i++) {
+		fd = daemon_poll_epoll_events[i].data.fd;
+		if (daemon_poll_getfd(fd))
+			daemon_poll_set_ready(fd, daemon_poll_epoll_to_revents(daemon_poll_epoll_events[i].events));
+	}
+
+	if (daemon_poll_always_ready_count > 0) {
+		for (fd = 0; fd < daemon_poll_fds_size; fd++) {
+			if (daemon_poll_fds[fd].watched && daemon_poll_fds[fd].always_ready)
+				daemon_poll_set_ready(fd, daemon_poll_fds[fd].events & (POLLIN | POLLOUT));
+		}
+	}
 
 	// Setting a default poll timeout, this can be overridden once at a time by daemon_poll_setmaxtimeout()
-	polltimeout = 1000;
+	polltimeout_usec = DAEMON_POLL_DEFAULT_TIMEOUT_USEC;
+
+	// Callbacks can add and remove fds, so the table entry is looked up again for each one.
+	count = daemon_poll_ready_fds_count;
+	for (i = 0; i < count; i++) {
+		fd = daemon_poll_ready_fds[i];
+		pollfd = daemon_poll_getfd(fd);
+		if (pollfd && pollfd->callback && pollfd->revents) {
+			readypfd.fd = fd;
+			readypfd.events = pollfd->events;
+			readypfd.revents = pollfd->revents;
+			pollfd->callback(&readypfd, pollfd->callback_arg);
+		}
+	}
+
+	daemon_poll_update_stats(timeout == 0);
+	daemon_latency_mark(DAEMON_LATENCY_STAGE_POLL_CALLBACKS);
 }
 
 void daemon_poll_init(void) {
-	pfdcount = 0;
+	daemon_poll_epollfd = epoll_create1(EPOLL_CLOEXEC);
+	if (daemon_poll_epollfd < 0)
+		console_log("daemon-poll error: can't create epoll instance: %s\n", strerror(errno));
+	daemon_poll_epoll_events = (struct epoll_event *)malloc(sizeof(struct epoll_event) * DAEMON_POLL_MIN_EPOLL_EVENTS);
+	daemon_poll_epoll_events_size = (daemon_poll_epoll_events ? DAEMON_POLL_MIN_EPOLL_EVENTS : 0);
+	daemon_poll_watched_count = 0;
+	daemon_poll_always_ready_count = 0;
+	daemon_poll_ready_fds_count = 0;
+	polltimeout_usec = 0;
+
+	daemon_poll_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (daemon_poll_timerfd < 0)
+		console_log("daemon-poll error: can't create timerfd: %s\n", strerror(errno));
+	else
+		daemon_poll_addfd_callback(daemon_poll_timerfd, POLLIN, daemon_poll_timerfd_callback, NULL);
+
+	daemon_poll_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (daemon_poll_eventfd < 0)
+		console_log("daemon-poll error: can't create eventfd: %s\n", strerror(errno));
+	else
+		daemon_poll_addfd_callback(daemon_poll_eventfd, POLLIN, daemon_poll_eventfd_callback, NULL);
+
+	memset(&daemon_poll_stats, 0, sizeof(daemon_poll_stats));
+	clock_gettime(CLOCK_MONOTONIC, &daemon_poll_stats.started_at);
+	daemon_poll_stats.sample_started_at = daemon_poll_stats.started_at;
+	daemon_poll_get_cputime(&daemon_poll_stats.sample_started_cputime);
 }
 
 void daemon_poll_deinit(void) {
-	if (pfd)
-		free(pfd);
+	if (daemon_poll_timerfd >= 0) {
+		daemon_poll_removefd(daemon_poll_timerfd);
+		close(daemon_poll_timerfd);
+		daemon_poll_timerfd = -1;
+	}
+	if (daemon_poll_eventfd >= 0) {
+		daemon_poll_removefd(daemon_poll_eventfd);
+		close(daemon_poll_eventfd);
+		daemon_poll_eventfd = -1;
+	}
+
+	if (daemon_poll_epollfd >= 0)
+		close(daemon_poll_epollfd);
+	daemon_poll_epollfd = -1;
+
+	free(daemon_poll_fds);
+	daemon_poll_fds = NULL;
+	daemon_poll_fds_size = 0;
+	free(daemon_poll_ready_fds);
+	daemon_poll_ready_fds = NULL;
+	daemon_poll_ready_fds_count = 0;
+	free(daemon_poll_epoll_events);
+	daemon_poll_epoll_events = NULL;
+	daemon_poll_epoll_events_size = 0;
+	daemon_poll_watched_count = 0;
+	daemon_poll_always_ready_count = 0;
+
+	free(pfd);
 	pfd = NULL;
 	pfdcount = 0;
 }
@@ -19,6 +19,11 @@
 #define DAEMON_POLL_H_
 
 #include <sys/poll.h>
+#include <stdint.h>
+
+// Called by daemon_poll_process() for every watched fd which has pending events.
+// Pfd is only valid during the call.
+typedef void (*daemon_poll_callback_t)(struct pollfd *pfd, void *arg);
 
 // This function adds the given file descriptor to the watched file descriptor list.
 // Events represents the events we need to watch on this fd (see "man poll").
@@ -27,6 +32,9 @@ void daemon_poll_addfd(int fd, short events);
 void daemon_poll_addfd_read(int fd);
 void daemon_poll_addfd_write(int fd);
 void daemon_poll_addfd_readwrite(int fd);
+// Same as daemon_poll_addfd(), but the callback gets called with the given arg
+// when events happen on the fd, so the caller doesn't have to query it every loop.
+void daemon_poll_addfd_callback(int fd, short events, daemon_poll_callback_t callback, void *arg);
 void daemon_poll_changefd(int fd, short events);
 // This function removes the given file descriptor from the watched file descriptor list.
 void daemon_poll_removefd(int fd);
@@ -34,13 +42,21 @@ void daemon_poll_removefd(int fd);
 // the watched file descriptors. The timeout will be reseted to a default value after the
 // poll() call.
 void daemon_poll_setmaxtimeout(int timeout);
+void daemon_poll_setmaxtimeout_usec(uint64_t timeout_usec);
+// Makes the next (or the currently waiting) daemon_poll_process() call return immediately.
+// Unlike the other functions, this can be called from any thread.
+void daemon_poll_wakeup(void);
 // These functions query the result of the poll() call for the given file descriptor.
 int daemon_poll_isfdreadable(int fd);
 int daemon_poll_isfdwritable(int fd);
 
+// Returns a snapshot of all watched file descriptors and their last events. It's rebuilt
+// on every call, so use callbacks instead in code which runs in every loop.
 struct pollfd *daemon_poll_getpfd(void);
 int daemon_poll_getpfdcount(void);
 
+void daemon_poll_print_stats(void);
+
 void daemon_poll_process(void);
 void daemon_poll_init(void);
 void daemon_poll_deinit(void);
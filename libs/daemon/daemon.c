@@ -19,6 +19,7 @@
 
 #include "daemon.h"
 #include "daemon-poll.h"
+#include "daemon-latency.h"
 #include "daemon-consoleserver.h"
 #include "daemon-consoleclient.h"
 #include "console.h"
@@ -179,6 +180,7 @@ flag_t daemon_process(void) {
 	}
 
 	console_process();
+	daemon_latency_mark(DAEMON_LATENCY_STAGE_DAEMON);
 
 	if (base_flags.sigexit)
 		return 0;
@@ -205,6 +207,7 @@ flag_t daemon_init(flag_t daemonize, flag_t consoleclient) {
 	}
 
 	daemon_poll_init();
+	daemon_latency_init();
 
 	if (daemon_daemonize) {
 		console_log("daemon: forking to the background\n");
@@ -46,51 +46,70 @@ char *dmrpacket_data_get_readable_data_type(dmrpacket_data_type_t data_type) {
 	}
 }
 
-bptc_196_96_data_bits_t *dmrpacket_data_extract_and_repair_bptc_data(dmrpacket_payload_bits_t *packet_payload_bits) {
-	dmrpacket_payload_info_bits_t *packet_payload_info_bits = NULL;
+bptc_196_96_data_bits_t *dmrpacket_data_extract_and_repair_bptc_data_r(dmrpacket_payload_bits_t *packet_payload_bits, bptc_196_96_data_bits_t *data_bits) {
+	dmrpacket_payload_info_bits_t packet_payload_info_bits;
+	dmrpacket_payload_info_bits_t deint_packet_payload_info_bits;
+
+	if (packet_payload_bits == NULL || data_bits == NULL)
+		return NULL;
 
-	packet_payload_info_bits = dmrpacket_extract_info_bits(packet_payload_bits);
-	packet_payload_info_bits = dmrpacket_data_bptc_deinterleave(packet_payload_info_bits);
-	if (bptc_196_96_check_and_repair(packet_payload_info_bits->bits))
-		return bptc_196_96_extractdata(packet_payload_info_bits->bits);
+	dmrpacket_extract_info_bits_r(packet_payload_bits, &packet_payload_info_bits);
+	dmrpacket_data_bptc_deinterleave_r(&packet_payload_info_bits, &deint_packet_payload_info_bits);
+	if (bptc_196_96_check_and_repair(deint_packet_payload_info_bits.bits))
+		return bptc_196_96_extractdata_r(deint_packet_payload_info_bits.bits, data_bits);
 	else
 		return NULL;
 }
 
+bptc_196_96_data_bits_t *dmrpacket_data_extract_and_repair_bptc_data(dmrpacket_payload_bits_t *packet_payload_bits) {
+	static bptc_196_96_data_bits_t data_bits;
+
+	return dmrpacket_data_extract_and_repair_bptc_data_r(packet_payload_bits, &data_bits);
+}
+
 // Deinterleaves given info bits according to the used BPTC(196,96) interleaving in the DMR standard (see DMR AI spec. page 120).
-dmrpacket_payload_info_bits_t *dmrpacket_data_bptc_deinterleave(dmrpacket_payload_info_bits_t *info_bits) {
-	static dmrpacket_payload_info_bits_t deint_info_bits;
+dmrpacket_payload_info_bits_t *dmrpacket_data_bptc_deinterleave_r(dmrpacket_payload_info_bits_t *info_bits, dmrpacket_payload_info_bits_t *deint_info_bits) {
 	int i;
 
-	if (info_bits == NULL)
+	if (info_bits == NULL || deint_info_bits == NULL)
 		return NULL;
 
 	for (i = 0; i < sizeof(info_bits->bits); i++)
-		deint_info_bits.bits[i] = info_bits->bits[(i*181) % sizeof(info_bits->bits)];
+		deint_info_bits->bits[i] = info_bits->bits[(i*181) % sizeof(info_bits->bits)];
+
+	return deint_info_bits;
+}
 
-	return &deint_info_bits;
+dmrpacket_payload_info_bits_t *dmrpacket_data_bptc_deinterleave(dmrpacket_payload_info_bits_t *info_bits) {
+	static dmrpacket_payload_info_bits_t deint_info_bits;
+
+	return dmrpacket_data_bptc_deinterleave_r(info_bits, &deint_info_bits);
 }
 
 // Interleaves given info bits according to the used BPTC(196,96) interleaving in the DMR standard (see DMR AI spec. page 120).
-dmrpacket_payload_info_bits_t *dmrpacket_data_bptc_interleave(dmrpacket_payload_info_bits_t *deint_info_bits) {
-	static dmrpacket_payload_info_bits_t int_info_bits;
+dmrpacket_payload_info_bits_t *dmrpacket_data_bptc_interleave_r(dmrpacket_payload_info_bits_t *deint_info_bits, dmrpacket_payload_info_bits_t *int_info_bits) {
 	int i;
 
-	if (deint_info_bits == NULL)
+	if (deint_info_bits == NULL || int_info_bits == NULL)
 		return NULL;
 
 	for (i = 0; i < sizeof(deint_info_bits->bits); i++)
-		int_info_bits.bits[(i*181) % sizeof(int_info_bits.bits)] = deint_info_bits->bits[i];
+		int_info_bits->bits[(i*181) % sizeof(int_info_bits->bits)] = deint_info_bits->bits[i];
 
-	return &int_info_bits;
+	return int_info_bits;
 }
 
-dmrpacket_data_block_bytes_t *dmrpacket_data_convert_binary_to_block_bytes(dmrpacket_data_binary_t *binary) {
-	static dmrpacket_data_block_bytes_t bytes;
+dmrpacket_payload_info_bits_t *dmrpacket_data_bptc_interleave(dmrpacket_payload_info_bits_t *deint_info_bits) {
+	static dmrpacket_payload_info_bits_t int_info_bits;
+
+	return dmrpacket_data_bptc_interleave_r(deint_info_bits, &int_info_bits);
+}
+
+dmrpacket_data_block_bytes_t *dmrpacket_data_convert_binary_to_block_bytes_r(dmrpacket_data_binary_t *binary, dmrpacket_data_block_bytes_t *bytes) {
 	uint8_t i;
 	//loglevel_t loglevel = console_get_loglevel();
 
-	if (binary == NULL)
+	if (binary == NULL || bytes == NULL)
 		return NULL;
 
 	/*if (loglevel.flags.dmrdata && loglevel.flags.debug) {
@@ -105,24 +124,29 @@ dmrpacket_data_block_bytes_t *dmrpacket_data_convert_binary_to_block_bytes(dmrpa
 	}*/
 
 	for (i = 0; i < sizeof(binary->bits)/8; i++)
-		bytes.bytes[i] = base_bitstobyte(&binary->bits[i*8]);
+		bytes->bytes[i] = base_bitstobyte(&binary->bits[i*8]);
 
 	/*if (loglevel.flags.dmrdata && loglevel.flags.debug) {
 		console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "  output: ");
 		for (i = 0; i < sizeof(binary->bits)/8; i++)
-			console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "%.2x ", bytes.bytes[i]);
+			console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "%.2x ", bytes->bytes[i]);
 		console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "\n");
 	}*/
 
-	return &bytes;
+	return bytes;
 }
 
-dmrpacket_data_block_bytes_t *dmrpacket_data_convert_payload_bptc_data_bits_to_block_bytes(bptc_196_96_data_bits_t *binary) {
+dmrpacket_data_block_bytes_t *dmrpacket_data_convert_binary_to_block_bytes(dmrpacket_data_binary_t *binary) {
 	static dmrpacket_data_block_bytes_t bytes;
+
+	return dmrpacket_data_convert_binary_to_block_bytes_r(binary, &bytes);
+}
+
+dmrpacket_data_block_bytes_t *dmrpacket_data_convert_payload_bptc_data_bits_to_block_bytes_r(bptc_196_96_data_bits_t *binary, dmrpacket_data_block_bytes_t *bytes) {
 	uint8_t i;
 	loglevel_t loglevel = console_get_loglevel();
 
-	if (binary == NULL)
+	if (binary == NULL || bytes == NULL)
 		return NULL;
 
 	if (loglevel.flags.dmrdata && loglevel.flags.debug) {
@@ -137,16 +161,22 @@ dmrpacket_data_block_bytes_t *dmrpacket_data_convert_payload_bptc_data_bits_to_b
 	}
 
 	for (i = 0; i < sizeof(binary->bits)/8; i++)
-		bytes.bytes[i] = base_bitstobyte(&binary->bits[i*8]);
+		bytes->bytes[i] = base_bitstobyte(&binary->bits[i*8]);
 
 	if (loglevel.flags.dmrdata && loglevel.flags.debug) {
 		console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "  output: ");
 		for (i = 0; i < sizeof(binary->bits)/8; i++)
-			console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "%.2x ", bytes.bytes[i]);
+			console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "%.2x ", bytes->bytes[i]);
 		console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "\n");
 	}
 
-	return &bytes;
+	return bytes;
+}
+
+dmrpacket_data_block_bytes_t *dmrpacket_data_convert_payload_bptc_data_bits_to_block_bytes(bptc_196_96_data_bits_t *binary) {
+	static dmrpacket_data_block_bytes_t bytes;
+
+	return dmrpacket_data_convert_payload_bptc_data_bits_to_block_bytes_r(binary, &bytes);
 }
 
 // See DMR AI spec. page. 73. for block sizes.
@@ -159,13 +189,31 @@ uint8_t dmrpacket_data_get_block_size(dmrpacket_data_type_t data_type, flag_t co
 	}
 }
 
-dmrpacket_data_block_t *dmrpacket_data_decode_block(dmrpacket_data_block_bytes_t *bytes, dmrpacket_data_type_t data_type, flag_t confirmed) {
-	static dmrpacket_data_block_t data_block;
+// The fragment CRC is calculated on 16 bit words with swapped byte order, bytes after bytes_count
+// are treated as zeros until crc_length is reached.
+static uint32_t dmrpacket_data_calc_fragment_crc(uint8_t *bytes, uint16_t bytes_count, uint16_t crc_length) {
+	uint8_t swapped_bytes[64];
+	uint32_t crcval = 0;
+	uint16_t i;
+	uint16_t j;
+
+	for (i = 0; i < crc_length; i += j) {
+		for (j = 0; j < sizeof(swapped_bytes) && i+j < crc_length; j += 2) {
+			swapped_bytes[j] = (i+j+1 < bytes_count ? bytes[i+j+1] : 0);
+			swapped_bytes[j+1] = (i+j < bytes_count ? bytes[i+j] : 0);
+		}
+		crc_calc_crc32_bytes(&crcval, swapped_bytes, j);
+	}
+	crc_calc_crc32_finish(&crcval);
+	return crcval;
+}
+
+dmrpacket_data_block_t *dmrpacket_data_decode_block_r(dmrpacket_data_block_bytes_t *bytes, dmrpacket_data_type_t data_type, flag_t confirmed, dmrpacket_data_block_t *data_block) {
 	uint16_t crcval = 0; // See DMR AI spec. page 142.
 	uint8_t i;
 	loglevel_t loglevel = console_get_loglevel();
 
-	if (bytes == NULL)
+	if (bytes == NULL || data_block == NULL)
 		return NULL;
 
 	console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "dmrpacket data: decoding ");
@@ -173,27 +221,26 @@ dmrpacket_data_block_t *dmrpacket_data_decode_block(dmrpacket_data_block_bytes_t
 		console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "un");
 	console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "confirmed data block type %s\n", dmrpacket_data_get_readable_data_type(data_type));
 
-	memset(&data_block, 0, sizeof(dmrpacket_data_block_t));
-	data_block.data_length = dmrpacket_data_get_block_size(data_type, confirmed);
+	memset(data_block, 0, sizeof(dmrpacket_data_block_t));
+	data_block->data_length = dmrpacket_data_get_block_size(data_type, confirmed);
 
 	if (confirmed) {
-		data_block.serialnr = bytes->bytes[0] >> 1;
-		console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "  serialnr: %u\n", data_block.serialnr);
+		data_block->serialnr = bytes->bytes[0] >> 1;
+		console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "  serialnr: %u\n", data_block->serialnr);
 
-		data_block.crc = ((bytes->bytes[0] & 0b00000001) << 8) | bytes->bytes[1];
-		console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "  crc: 0x%.4x\n", data_block.crc);
+		data_block->crc = ((bytes->bytes[0] & 0b00000001) << 8) | bytes->bytes[1];
+		console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "  crc: 0x%.4x\n", data_block->crc);
 
-		memcpy(data_block.data, &bytes->bytes[2], sizeof(data_block.data));
+		memcpy(data_block->data, &bytes->bytes[2], sizeof(data_block->data));
 		if (loglevel.flags.dmrdata && loglevel.flags.debug) {
-			console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "  data (len. %u): ", data_block.data_length);
-			for (i = 0; i < data_block.data_length; i++)
-				console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "%.2x", data_block.data[i]);
+			console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "  data (len. %u): ", data_block->data_length);
+			for (i = 0; i < data_block->data_length; i++)
+				console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "%.2x", data_block->data[i]);
 			console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "\n");
 		}
 
-		for (i = 0; i < data_block.data_length; i++)
-			crc_calc_crc9(&crcval, data_block.data[i], 8);
-		crc_calc_crc9(&crcval, data_block.serialnr, 7);
+		crc_calc_crc9_bytes(&crcval, data_block->data, data_block->data_length);
+		crc_calc_crc9(&crcval, data_block->serialnr, 7);
 		// Getting out only 8 bits from the shift registers as previously we only put in 7 bits.
 		crc_calc_crc9_finish(&crcval, 8);
 
@@ -203,39 +250,44 @@ dmrpacket_data_block_t *dmrpacket_data_decode_block(dmrpacket_data_block_bytes_t
 		// Applying CRC mask, see DMR AI spec. page 143.
 		crcval ^= 0x01ff;
 
-		if (crcval == data_block.crc) {
-			data_block.received_ok = 1;
+		if (crcval == data_block->crc) {
+			data_block->received_ok = 1;
 			console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "  crc ok\n", crcval);
-			return &data_block;
+			return data_block;
 		} else {
 			console_log(LOGLEVEL_DMRDATA "dmrpacket data: block crc error (calculated: 0x%.4x)\n", crcval);
 			return NULL;
 		}
 	} else {
-		memcpy(data_block.data, bytes->bytes, sizeof(data_block.data));
+		memcpy(data_block->data, bytes->bytes, sizeof(data_block->data));
 		if (loglevel.flags.dmrdata && loglevel.flags.debug) {
-			console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "  data (len. %u): ", data_block.data_length);
-			for (i = 0; i < data_block.data_length; i++)
-				console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "%.2x", data_block.data[i]);
+			console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "  data (len. %u): ", data_block->data_length);
+			for (i = 0; i < data_block->data_length; i++)
+				console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "%.2x", data_block->data[i]);
 			console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "\n");
 		}
 
-		data_block.received_ok = 1;
+		data_block->received_ok = 1;
 
-		return &data_block;
+		return data_block;
 	}
 }
 
-dmrpacket_data_fragment_t *dmrpacket_data_extract_fragment_from_blocks(dmrpacket_data_block_t *blocks, uint8_t blocks_count) {
-	static dmrpacket_data_fragment_t data;
+dmrpacket_data_block_t *dmrpacket_data_decode_block(dmrpacket_data_block_bytes_t *bytes, dmrpacket_data_type_t data_type, flag_t confirmed) {
+	static dmrpacket_data_block_t data_block;
+
+	return dmrpacket_data_decode_block_r(bytes, data_type, confirmed, &data_block);
+}
+
+dmrpacket_data_fragment_t *dmrpacket_data_extract_fragment_from_blocks_r(dmrpacket_data_block_t *blocks, uint8_t blocks_count, dmrpacket_data_fragment_t *data) {
 	uint16_t i;
 	uint32_t crcval = 0;
 	loglevel_t loglevel = console_get_loglevel();
 
-	if (blocks == NULL || blocks_count == 0)
+	if (blocks == NULL || blocks_count == 0 || data == NULL)
 		return NULL;
 
-	memset(&data, 0, sizeof(dmrpacket_data_fragment_t));
+	memset(data, 0, sizeof(dmrpacket_data_fragment_t));
 
 	console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "dmrpacket data: extracting fragment from %u blocks\n", blocks_count);
 	for (i = 0; i < blocks_count; i++) {
@@ -243,16 +295,16 @@ dmrpacket_data_fragment_t *dmrpacket_data_extract_fragment_from_blocks(dmrpacket
 			continue;
 
 		if (i < blocks_count-1) {
-			if (data.bytes_stored+blocks[i].data_length < sizeof(data.bytes)) {
-				memcpy(&data.bytes[data.bytes_stored], blocks[i].data, blocks[i].data_length);
-				data.bytes_stored += blocks[i].data_length;
+			if (data->bytes_stored+blocks[i].data_length < sizeof(data->bytes)) {
+				memcpy(&data->bytes[data->bytes_stored], blocks[i].data, blocks[i].data_length);
+				data->bytes_stored += blocks[i].data_length;
 			}
 		} else {
-			if (data.bytes_stored+blocks[i].data_length-4 < sizeof(data.bytes)) {
-				memcpy(&data.bytes[data.bytes_stored], blocks[i].data, blocks[i].data_length);
-				data.bytes_stored += blocks[i].data_length;
+			if (data->bytes_stored+blocks[i].data_length-4 < sizeof(data->bytes)) {
+				memcpy(&data->bytes[data->bytes_stored], blocks[i].data, blocks[i].data_length);
+				data->bytes_stored += blocks[i].data_length;
 			}
-			data.crc =	blocks[i].data[blocks[i].data_length-1] << 24 |
+			data->crc =	blocks[i].data[blocks[i].data_length-1] << 24 |
 						blocks[i].data[blocks[i].data_length-2] << 16 |
 						blocks[i].data[blocks[i].data_length-3] << 8 |
 						blocks[i].data[blocks[i].data_length-4];
@@ -260,32 +312,34 @@ dmrpacket_data_fragment_t *dmrpacket_data_extract_fragment_from_blocks(dmrpacket
 	}
 
 	if (loglevel.flags.dmrdata) {
-		console_log(LOGLEVEL_DMRDATA "  data (len. %u): ", data.bytes_stored);
-		for (i = 0; i < data.bytes_stored-4; i++)
-			console_log(LOGLEVEL_DMRDATA "%.2x", data.bytes[i]);
+		console_log(LOGLEVEL_DMRDATA "  data (len. %u): ", data->bytes_stored);
+		for (i = 0; i < data->bytes_stored-4; i++)
+			console_log(LOGLEVEL_DMRDATA "%.2x", data->bytes[i]);
 		// Printing the CRC separated.
 		console_log(LOGLEVEL_DMRDATA " ");
-		for (; i < data.bytes_stored; i++)
-			console_log(LOGLEVEL_DMRDATA "%.2x", data.bytes[i]);
+		for (; i < data->bytes_stored; i++)
+			console_log(LOGLEVEL_DMRDATA "%.2x", data->bytes[i]);
 		console_log(LOGLEVEL_DMRDATA "\n");
 	}
 
-	for (i = 0; i < data.bytes_stored-4; i += 2) {
-		crc_calc_crc32(&crcval, data.bytes[i+1]);
-		crc_calc_crc32(&crcval, data.bytes[i]);
-	}
-	crc_calc_crc32_finish(&crcval);
-	console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "  fragment crc: %.8x, calculated: %.8x (", data.crc, crcval);
+	crcval = dmrpacket_data_calc_fragment_crc(data->bytes, data->bytes_stored, (data->bytes_stored < 4 ? 0 : data->bytes_stored-4));
+	console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "  fragment crc: %.8x, calculated: %.8x (", data->crc, crcval);
 
-	if (crcval == data.crc) {
+	if (crcval == data->crc) {
 		console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "ok)\n");
-		return &data;
+		return data;
 	} else {
 		console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "error)\n");
 		return NULL;
 	}
 }
 
+dmrpacket_data_fragment_t *dmrpacket_data_extract_fragment_from_blocks(dmrpacket_data_block_t *blocks, uint8_t blocks_count) {
+	static dmrpacket_data_fragment_t data;
+
+	return dmrpacket_data_extract_fragment_from_blocks_r(blocks, blocks_count, &data);
+}
+
 // Result must be freed after use.
 char *dmrpacket_data_convertmsg(uint8_t *data, uint16_t data_length, uint16_t *out_length, dmrpacket_data_header_dd_format_t src_dd_format, dmrpacket_data_header_dd_format_t dst_dd_format, uint8_t add_to_left) {
 	iconv_t iconv_handle;
@@ -339,20 +393,24 @@ char *dmrpacket_data_convertmsg(uint8_t *data, uint16_t data_length, uint16_t *o
 	return outbuf;
 }
 
-dmrpacket_data_block_bytes_t *dmrpacket_data_construct_block_bytes(dmrpacket_data_block_t *data_block, flag_t confirmed) {
-	static dmrpacket_data_block_bytes_t bytes;
-
-	if (data_block == NULL)
+dmrpacket_data_block_bytes_t *dmrpacket_data_construct_block_bytes_r(dmrpacket_data_block_t *data_block, flag_t confirmed, dmrpacket_data_block_bytes_t *bytes) {
+	if (data_block == NULL || bytes == NULL)
 		return NULL;
 
-	memset(bytes.bytes, 0, sizeof(dmrpacket_data_block_bytes_t));
+	memset(bytes->bytes, 0, sizeof(dmrpacket_data_block_bytes_t));
 	if (confirmed) {
-		bytes.bytes[0] = ((data_block->serialnr & 0x7f) << 1) | ((data_block->crc & 0x0100) >> 8);
-		bytes.bytes[1] = data_block->crc & 0xff;
-		memcpy(bytes.bytes+2, data_block->data, data_block->data_length);
+		bytes->bytes[0] = ((data_block->serialnr & 0x7f) << 1) | ((data_block->crc & 0x0100) >> 8);
+		bytes->bytes[1] = data_block->crc & 0xff;
+		memcpy(bytes->bytes+2, data_block->data, data_block->data_length);
 	} else
-		memcpy(bytes.bytes, data_block->data, data_block->data_length);
-	return &bytes;
+		memcpy(bytes->bytes, data_block->data, data_block->data_length);
+	return bytes;
+}
+
+dmrpacket_data_block_bytes_t *dmrpacket_data_construct_block_bytes(dmrpacket_data_block_t *data_block, flag_t confirmed) {
+	static dmrpacket_data_block_bytes_t bytes;
+
+	return dmrpacket_data_construct_block_bytes_r(data_block, confirmed, &bytes);
 }
 
 dmrpacket_data_block_t *dmrpacket_data_construct_data_blocks(dmrpacket_data_fragment_t *fragment, dmrpacket_data_type_t data_type, flag_t confirmed) {
@@ -389,8 +447,7 @@ dmrpacket_data_block_t *dmrpacket_data_construct_data_blocks(dmrpacket_data_frag
 		bytes_stored_in_blocks += bytes_to_store;
 
 		data_blocks[i].crc = 0;
-		for (j = 0; j < data_blocks[i].data_length; j++)
-			crc_calc_crc9(&data_blocks[i].crc, data_blocks[i].data[j], 8);
+		crc_calc_crc9_bytes(&data_blocks[i].crc, data_blocks[i].data, data_blocks[i].data_length);
 		crc_calc_crc9(&data_blocks[i].crc, data_blocks[i].serialnr, 7);
 		// Getting out only 8 bits from the shift registers as previously we only put in 7 bits.
 		crc_calc_crc9_finish(&data_blocks[i].crc, 8);
@@ -415,6 +472,11 @@ dmrpacket_data_block_t *dmrpacket_data_construct_data_blocks(dmrpacket_data_frag
 void dmrpacket_data_get_needed_blocks_count(uint16_t data_bytes_count, dmrpacket_data_type_t data_type, flag_t confirmed, uint8_t *data_blocks_needed) {
 	uint8_t block_size = dmrpacket_data_get_block_size(data_type, confirmed);
 
+	if (block_size == 0) { // Unknown data type.
+		*data_blocks_needed = 0;
+		return;
+	}
+
 	*data_blocks_needed = ceil(data_bytes_count / (float)block_size);
 
 	// Checking if there's no space left in the last data block for the fragment CRC.
@@ -431,22 +493,20 @@ void dmrpacket_data_construct_fragment(uint8_t *data, uint16_t data_size, dmrpac
 		return;
 
 	memset((uint8_t *)fragment, 0, sizeof(dmrpacket_data_fragment_t));
+
+	// The CRC is calculated on the blocks' total size minus the 4 CRC bytes, so a block has to be bigger than that.
+	// On error the fragment is left empty, so no data blocks are constructed from it.
+	block_size = dmrpacket_data_get_block_size(data_type, confirmed);
+	if (block_size < 4) {
+		console_log(LOGLEVEL_DMRDATA "dmrpacket data error: can't construct fragment for unknown data type %u\n", data_type);
+		return;
+	}
+
 	fragment->bytes_stored = min(data_size, DMRPACKET_MAX_FRAGMENTSIZE);
 	memcpy(fragment->bytes, data, fragment->bytes_stored);
 
 	dmrpacket_data_get_needed_blocks_count(fragment->bytes_stored, data_type, confirmed, &fragment->data_blocks_needed);
-	block_size = dmrpacket_data_get_block_size(data_type, confirmed);
-	for (i = 0; i < fragment->data_blocks_needed*block_size-4; i += 2) {
-		if (i+1 < fragment->bytes_stored)
-			crc_calc_crc32(&fragment->crc, fragment->bytes[i+1]);
-		else
-			crc_calc_crc32(&fragment->crc, 0);
-		if (i < fragment->bytes_stored)
-			crc_calc_crc32(&fragment->crc, fragment->bytes[i]);
-		else
-			crc_calc_crc32(&fragment->crc, 0);
-	}
-	crc_calc_crc32_finish(&fragment->crc);
+	fragment->crc = dmrpacket_data_calc_fragment_crc(fragment->bytes, fragment->bytes_stored, fragment->data_blocks_needed*block_size-4);
 
 	if (loglevel.flags.dmrdata && loglevel.flags.debug) {
 		console_log(LOGLEVEL_DMRDATA LOGLEVEL_DEBUG "  data length: %u bytes, fragment crc: %.8x, needed blocks: %u, total data length: %u\n",
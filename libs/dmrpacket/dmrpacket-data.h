@@ -77,18 +77,26 @@ typedef struct {
 char *dmrpacket_data_get_readable_data_type(dmrpacket_data_type_t data_type);
 
 bptc_196_96_data_bits_t *dmrpacket_data_extract_and_repair_bptc_data(dmrpacket_payload_bits_t *packet_payload_bits);
+bptc_196_96_data_bits_t *dmrpacket_data_extract_and_repair_bptc_data_r(dmrpacket_payload_bits_t *packet_payload_bits, bptc_196_96_data_bits_t *data_bits);
 dmrpacket_payload_info_bits_t *dmrpacket_data_bptc_deinterleave(dmrpacket_payload_info_bits_t *info_bits);
+dmrpacket_payload_info_bits_t *dmrpacket_data_bptc_deinterleave_r(dmrpacket_payload_info_bits_t *info_bits, dmrpacket_payload_info_bits_t *deint_info_bits);
 dmrpacket_payload_info_bits_t *dmrpacket_data_bptc_interleave(dmrpacket_payload_info_bits_t *deint_info_bits);
+dmrpacket_payload_info_bits_t *dmrpacket_data_bptc_interleave_r(dmrpacket_payload_info_bits_t *deint_info_bits, dmrpacket_payload_info_bits_t *int_info_bits);
 
 dmrpacket_data_block_bytes_t *dmrpacket_data_convert_binary_to_block_bytes(dmrpacket_data_binary_t *binary);
+dmrpacket_data_block_bytes_t *dmrpacket_data_convert_binary_to_block_bytes_r(dmrpacket_data_binary_t *binary, dmrpacket_data_block_bytes_t *bytes);
 dmrpacket_data_block_bytes_t *dmrpacket_data_convert_payload_bptc_data_bits_to_block_bytes(bptc_196_96_data_bits_t *binary);
+dmrpacket_data_block_bytes_t *dmrpacket_data_convert_payload_bptc_data_bits_to_block_bytes_r(bptc_196_96_data_bits_t *binary, dmrpacket_data_block_bytes_t *bytes);
 
 uint8_t dmrpacket_data_get_block_size(dmrpacket_data_type_t data_type, flag_t confirmed);
 dmrpacket_data_block_t *dmrpacket_data_decode_block(dmrpacket_data_block_bytes_t *bytes, dmrpacket_data_type_t data_type, flag_t confirmed);
+dmrpacket_data_block_t *dmrpacket_data_decode_block_r(dmrpacket_data_block_bytes_t *bytes, dmrpacket_data_type_t data_type, flag_t confirmed, dmrpacket_data_block_t *data_block);
 dmrpacket_data_fragment_t *dmrpacket_data_extract_fragment_from_blocks(dmrpacket_data_block_t *blocks, uint8_t blocks_count);
+dmrpacket_data_fragment_t *dmrpacket_data_extract_fragment_from_blocks_r(dmrpacket_data_block_t *blocks, uint8_t blocks_count, dmrpacket_data_fragment_t *data);
 char *dmrpacket_data_convertmsg(uint8_t *in, uint16_t in_length, uint16_t *out_length, dmrpacket_data_header_dd_format_t src_dd_format, dmrpacket_data_header_dd_format_t dst_dd_format, uint8_t add_to_left);
 
 dmrpacket_data_block_bytes_t *dmrpacket_data_construct_block_bytes(dmrpacket_data_block_t *data_block, flag_t confirmed);
+dmrpacket_data_block_bytes_t *dmrpacket_data_construct_block_bytes_r(dmrpacket_data_block_t *data_block, flag_t confirmed, dmrpacket_data_block_bytes_t *bytes);
 dmrpacket_data_block_t *dmrpacket_data_construct_data_blocks(dmrpacket_data_fragment_t *fragment, dmrpacket_data_type_t data_type, flag_t confirmed);
 
 void dmrpacket_data_get_needed_blocks_count(uint16_t data_bytes_count, dmrpacket_data_type_t data_type, flag_t confirmed, uint8_t *data_blocks_needed);
@@ -52,14 +52,20 @@ typedef struct {
 flag_t dmrpacket_emb_is_null_fragment(dmrpacket_emb_signalling_lc_fragment_bits_t *fragment_bits);
 
 dmrpacket_emb_signalling_lc_bits_t *dmrpacket_emb_signalling_lc_deinterleave(dmrpacket_emb_signalling_lc_bits_t *emb_signalling_lc_bits);
+dmrpacket_emb_signalling_lc_bits_t *dmrpacket_emb_signalling_lc_deinterleave_r(dmrpacket_emb_signalling_lc_bits_t *emb_signalling_lc_bits, dmrpacket_emb_signalling_lc_bits_t *deinterleaved_lc);
 dmrpacket_emb_signalling_lc_bits_t *dmrpacket_emb_signalling_lc_interleave(dmrpacket_emb_signalling_lc_bits_t *emb_signalling_lc_bits);
+dmrpacket_emb_signalling_lc_bits_t *dmrpacket_emb_signalling_lc_interleave_r(dmrpacket_emb_signalling_lc_bits_t *emb_signalling_lc_bits, dmrpacket_emb_signalling_lc_bits_t *interleaved_lc);
 flag_t dmrpacket_emb_check_checksum(dmrpacket_emb_signalling_lc_bits_t *emb_signalling_lc_bits);
 
 dmrpacket_emb_signalling_lc_fragment_bits_t *dmrpacket_emb_signalling_lc_fragment_extract_from_sync(dmrpacket_sync_bits_t *sync_bits);
+dmrpacket_emb_signalling_lc_fragment_bits_t *dmrpacket_emb_signalling_lc_fragment_extract_from_sync_r(dmrpacket_sync_bits_t *sync_bits, dmrpacket_emb_signalling_lc_fragment_bits_t *emb_signalling_lc_fragment_bits);
 dmrpacket_emb_bits_t *dmrpacket_emb_extract_from_sync(dmrpacket_sync_bits_t *sync_bits);
+dmrpacket_emb_bits_t *dmrpacket_emb_extract_from_sync_r(dmrpacket_sync_bits_t *sync_bits, dmrpacket_emb_bits_t *emb_bits);
 
 dmrpacket_emb_t *dmrpacket_emb_decode(dmrpacket_emb_bits_t *emb_bits);
+dmrpacket_emb_t *dmrpacket_emb_decode_r(dmrpacket_emb_bits_t *emb_bits, dmrpacket_emb_t *emb);
 void dmrpacket_emb_insert_bits(dmrpacket_payload_bits_t *payload_bits, dmrpacket_emb_bits_t *emb_bits);
 dmrpacket_emb_bits_t *dmrpacket_emb_construct_bits(dmr_emb_lcss_t lcss);
+dmrpacket_emb_bits_t *dmrpacket_emb_construct_bits_r(dmr_emb_lcss_t lcss, dmrpacket_emb_bits_t *emb_bits);
 
 #endif
@@ -34,8 +34,11 @@ typedef struct {
 } dmrpacket_slot_type_t;
 
 dmrpacket_slot_type_bits_t *dmrpacket_slot_type_extract_bits(dmrpacket_payload_bits_t *payload_bits);
+dmrpacket_slot_type_bits_t *dmrpacket_slot_type_extract_bits_r(dmrpacket_payload_bits_t *payload_bits, dmrpacket_slot_type_bits_t *slot_type_bits);
 void dmrpacket_slot_type_insert_bits(dmrpacket_payload_bits_t *payload_bits, dmrpacket_slot_type_bits_t *slot_type_bits);
 dmrpacket_slot_type_bits_t *dmrpacket_slot_type_construct_bits(dmr_color_code_t cc, dmrpacket_data_type_t data_type);
+dmrpacket_slot_type_bits_t *dmrpacket_slot_type_construct_bits_r(dmr_color_code_t cc, dmrpacket_data_type_t data_type, dmrpacket_slot_type_bits_t *slot_type_bits);
 dmrpacket_slot_type_t *dmrpacket_slot_type_decode(dmrpacket_slot_type_bits_t *slot_type_bits);
+dmrpacket_slot_type_t *dmrpacket_slot_type_decode_r(dmrpacket_slot_type_bits_t *slot_type_bits, dmrpacket_slot_type_t *slot_type);
 
 #endif
@@ -37,15 +37,19 @@ static uint8_t dmrpacket_sync_pattern_direct_voice_ts2[6] = { 0x7D, 0xFF, 0xD5,
 static uint8_t dmrpacket_sync_pattern_direct_data_ts2[6] = { 0xD7, 0x55, 0x7F, 0x5F, 0xF7, 0xF5 };
 
 // Extracts the sync field of the payload (leaves out info and slot type parts).
-dmrpacket_sync_bits_t *dmrpacket_sync_extract_bits(dmrpacket_payload_bits_t *payload_bits) {
-	static dmrpacket_sync_bits_t sync_bits;
-
-	if (payload_bits == NULL)
+dmrpacket_sync_bits_t *dmrpacket_sync_extract_bits_r(dmrpacket_payload_bits_t *payload_bits, dmrpacket_sync_bits_t *sync_bits) {
+	if (payload_bits == NULL || sync_bits == NULL)
 		return NULL;
 
-	memcpy(&sync_bits.bits, payload_bits->bits+sizeof(dmrpacket_payload_info_bits_t)/2+sizeof(dmrpacket_slot_type_bits_t)/2, sizeof(sync_bits.bits));
+	memcpy(&sync_bits->bits, payload_bits->bits+sizeof(dmrpacket_payload_info_bits_t)/2+sizeof(dmrpacket_slot_type_bits_t)/2, sizeof(sync_bits->bits));
+
+	return sync_bits;
+}
+
+dmrpacket_sync_bits_t *dmrpacket_sync_extract_bits(dmrpacket_payload_bits_t *payload_bits) {
+	static dmrpacket_sync_bits_t sync_bits;
 
-	return &sync_bits;
+	return dmrpacket_sync_extract_bits_r(payload_bits, &sync_bits);
 }
 
 void dmrpacket_sync_insert_bits(dmrpacket_payload_bits_t *payload_bits, dmrpacket_sync_bits_t *sync_bits) {
@@ -55,52 +59,56 @@ void dmrpacket_sync_insert_bits(dmrpacket_payload_bits_t *payload_bits, dmrpacke
 	memcpy(payload_bits->bits+sizeof(dmrpacket_payload_info_bits_t)/2+sizeof(dmrpacket_slot_type_bits_t)/2, sync_bits->bits, sizeof(dmrpacket_sync_bits_t));
 }
 
-dmrpacket_sync_bits_t *dmrpacket_sync_construct_bits(dmrpacket_sync_pattern_type_t sync_pattern_type) {
-	static dmrpacket_sync_bits_t sync_bits;
-
+dmrpacket_sync_bits_t *dmrpacket_sync_construct_bits_r(dmrpacket_sync_pattern_type_t sync_pattern_type, dmrpacket_sync_bits_t *sync_bits) {
 	switch (sync_pattern_type) {
 		case DMRPACKET_SYNC_PATTERN_TYPE_BS_SOURCED_VOICE:
 			base_bytestobits(dmrpacket_sync_pattern_bs_sourced_voice, sizeof(dmrpacket_sync_pattern_bs_sourced_voice),
-				sync_bits.bits, sizeof(dmrpacket_sync_bits_t));
+				sync_bits->bits, sizeof(dmrpacket_sync_bits_t));
 			break;
 		case DMRPACKET_SYNC_PATTERN_TYPE_BS_SOURCED_DATA:
 			base_bytestobits(dmrpacket_sync_pattern_bs_sourced_data, sizeof(dmrpacket_sync_pattern_bs_sourced_data),
-				sync_bits.bits, sizeof(dmrpacket_sync_bits_t));
+				sync_bits->bits, sizeof(dmrpacket_sync_bits_t));
 			break;
 		case DMRPACKET_SYNC_PATTERN_TYPE_MS_SOURCED_VOICE:
 			base_bytestobits(dmrpacket_sync_pattern_ms_sourced_voice, sizeof(dmrpacket_sync_pattern_ms_sourced_voice),
-				sync_bits.bits, sizeof(dmrpacket_sync_bits_t));
+				sync_bits->bits, sizeof(dmrpacket_sync_bits_t));
 			break;
 		case DMRPACKET_SYNC_PATTERN_TYPE_MS_SOURCED_DATA:
 			base_bytestobits(dmrpacket_sync_pattern_ms_sourced_data, sizeof(dmrpacket_sync_pattern_ms_sourced_data),
-				sync_bits.bits, sizeof(dmrpacket_sync_bits_t));
+				sync_bits->bits, sizeof(dmrpacket_sync_bits_t));
 			break;
 		case DMRPACKET_SYNC_PATTERN_TYPE_MS_SOURCED_RC:
 			base_bytestobits(dmrpacket_sync_pattern_ms_sourced_rc, sizeof(dmrpacket_sync_pattern_ms_sourced_rc),
-				sync_bits.bits, sizeof(dmrpacket_sync_bits_t));
+				sync_bits->bits, sizeof(dmrpacket_sync_bits_t));
 			break;
 		case DMRPACKET_SYNC_PATTERN_TYPE_DIRECT_VOICE_TS1:
 			base_bytestobits(dmrpacket_sync_pattern_direct_voice_ts1, sizeof(dmrpacket_sync_pattern_direct_voice_ts1),
-				sync_bits.bits, sizeof(dmrpacket_sync_bits_t));
+				sync_bits->bits, sizeof(dmrpacket_sync_bits_t));
 			break;
 		case DMRPACKET_SYNC_PATTERN_TYPE_DIRECT_DATA_TS1:
 			base_bytestobits(dmrpacket_sync_pattern_direct_data_ts1, sizeof(dmrpacket_sync_pattern_direct_data_ts1),
-				sync_bits.bits, sizeof(dmrpacket_sync_bits_t));
+				sync_bits->bits, sizeof(dmrpacket_sync_bits_t));
 			break;
 		case DMRPACKET_SYNC_PATTERN_TYPE_DIRECT_VOICE_TS2:
 			base_bytestobits(dmrpacket_sync_pattern_direct_voice_ts2, sizeof(dmrpacket_sync_pattern_direct_voice_ts2),
-				sync_bits.bits, sizeof(dmrpacket_sync_bits_t));
+				sync_bits->bits, sizeof(dmrpacket_sync_bits_t));
 			break;
 		case DMRPACKET_SYNC_PATTERN_TYPE_DIRECT_DATA_TS2:
 			base_bytestobits(dmrpacket_sync_pattern_direct_data_ts2, sizeof(dmrpacket_sync_pattern_direct_data_ts2),
-				sync_bits.bits, sizeof(dmrpacket_sync_bits_t));
+				sync_bits->bits, sizeof(dmrpacket_sync_bits_t));
 			break;
 		default:
-			memset(sync_bits.bits, 0, sizeof(dmrpacket_sync_bits_t));
+			memset(sync_bits->bits, 0, sizeof(dmrpacket_sync_bits_t));
 			break;
 	}
 
-	return &sync_bits;
+	return sync_bits;
+}
+
+dmrpacket_sync_bits_t *dmrpacket_sync_construct_bits(dmrpacket_sync_pattern_type_t sync_pattern_type) {
+	static dmrpacket_sync_bits_t sync_bits;
+
+	return dmrpacket_sync_construct_bits_r(sync_pattern_type, &sync_bits);
 }
 
 char *dmrpacket_sync_get_readable_sync_pattern_type(dmrpacket_sync_pattern_type_t sync_pattern_type) {
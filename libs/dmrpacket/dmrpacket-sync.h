@@ -37,8 +37,10 @@ typedef struct {
 typedef uint8_t dmrpacket_sync_pattern_type_t;
 
 dmrpacket_sync_bits_t *dmrpacket_sync_extract_bits(dmrpacket_payload_bits_t *payload_bits);
+dmrpacket_sync_bits_t *dmrpacket_sync_extract_bits_r(dmrpacket_payload_bits_t *payload_bits, dmrpacket_sync_bits_t *sync_bits);
 void dmrpacket_sync_insert_bits(dmrpacket_payload_bits_t *payload_bits, dmrpacket_sync_bits_t *sync_bits);
 dmrpacket_sync_bits_t *dmrpacket_sync_construct_bits(dmrpacket_sync_pattern_type_t sync_pattern_type);
+dmrpacket_sync_bits_t *dmrpacket_sync_construct_bits_r(dmrpacket_sync_pattern_type_t sync_pattern_type, dmrpacket_sync_bits_t *sync_bits);
 
 char *dmrpacket_sync_get_readable_sync_pattern_type(dmrpacket_sync_pattern_type_t sync_pattern_type);
 dmrpacket_sync_pattern_type_t dmrpacket_sync_get_sync_pattern_type(dmrpacket_sync_bits_t *sync_bits);
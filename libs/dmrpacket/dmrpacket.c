@@ -25,16 +25,20 @@
 #include <string.h>
 
 // Extracts the info part of the payload (leaves out slot type and sync parts).
-dmrpacket_payload_info_bits_t *dmrpacket_extract_info_bits(dmrpacket_payload_bits_t *payload_bits) {
-	static dmrpacket_payload_info_bits_t info_bits;
-
-	if (payload_bits == NULL)
+dmrpacket_payload_info_bits_t *dmrpacket_extract_info_bits_r(dmrpacket_payload_bits_t *payload_bits, dmrpacket_payload_info_bits_t *info_bits) {
+	if (payload_bits == NULL || info_bits == NULL)
 		return NULL;
 
-	memcpy(&info_bits.bits, payload_bits->bits, sizeof(info_bits.bits)/2);
-	memcpy(&info_bits.bits[sizeof(info_bits.bits)/2], payload_bits->bits+98+10+48+10, sizeof(info_bits.bits)/2);
+	memcpy(&info_bits->bits, payload_bits->bits, sizeof(info_bits->bits)/2);
+	memcpy(&info_bits->bits[sizeof(info_bits->bits)/2], payload_bits->bits+98+10+48+10, sizeof(info_bits->bits)/2);
+
+	return info_bits;
+}
+
+dmrpacket_payload_info_bits_t *dmrpacket_extract_info_bits(dmrpacket_payload_bits_t *payload_bits) {
+	static dmrpacket_payload_info_bits_t info_bits;
 
-	return &info_bits;
+	return dmrpacket_extract_info_bits_r(payload_bits, &info_bits);
 }
 
 void dmrpacket_insert_info_bits(dmrpacket_payload_bits_t *payload_bits, dmrpacket_payload_info_bits_t *info_bits) {
@@ -45,16 +49,20 @@ void dmrpacket_insert_info_bits(dmrpacket_payload_bits_t *payload_bits, dmrpacke
 	memcpy(payload_bits->bits+98+10+48+10, &info_bits->bits[sizeof(dmrpacket_payload_info_bits_t)/2], sizeof(dmrpacket_payload_info_bits_t)/2);
 }
 
-dmrpacket_payload_voice_bits_t *dmrpacket_extract_voice_bits(dmrpacket_payload_bits_t *payload_bits) {
-	static dmrpacket_payload_voice_bits_t voice_bits;
-
-	if (payload_bits == NULL)
+dmrpacket_payload_voice_bits_t *dmrpacket_extract_voice_bits_r(dmrpacket_payload_bits_t *payload_bits, dmrpacket_payload_voice_bits_t *voice_bits) {
+	if (payload_bits == NULL || voice_bits == NULL)
 		return NULL;
 
-	memcpy(voice_bits.raw.bits, payload_bits->bits, sizeof(dmrpacket_payload_voice_bits_t)/2);
-	memcpy(&voice_bits.raw.bits[sizeof(dmrpacket_payload_voice_bits_t)/2], payload_bits->bits+108+48, sizeof(dmrpacket_payload_voice_bits_t)/2);
+	memcpy(voice_bits->raw.bits, payload_bits->bits, sizeof(dmrpacket_payload_voice_bits_t)/2);
+	memcpy(&voice_bits->raw.bits[sizeof(dmrpacket_payload_voice_bits_t)/2], payload_bits->bits+108+48, sizeof(dmrpacket_payload_voice_bits_t)/2);
+
+	return voice_bits;
+}
+
+dmrpacket_payload_voice_bits_t *dmrpacket_extract_voice_bits(dmrpacket_payload_bits_t *payload_bits) {
+	static dmrpacket_payload_voice_bits_t voice_bits;
 
-	return &voice_bits;
+	return dmrpacket_extract_voice_bits_r(payload_bits, &voice_bits);
 }
 
 void dmrpacket_insert_voice_bits(dmrpacket_payload_bits_t *payload_bits, dmrpacket_payload_voice_bits_t *voice_bits) {
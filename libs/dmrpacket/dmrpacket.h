@@ -23,9 +23,11 @@
 #include <libs/base/dmr.h>
 
 dmrpacket_payload_info_bits_t *dmrpacket_extract_info_bits(dmrpacket_payload_bits_t *payload_bits);
+dmrpacket_payload_info_bits_t *dmrpacket_extract_info_bits_r(dmrpacket_payload_bits_t *payload_bits, dmrpacket_payload_info_bits_t *info_bits);
 void dmrpacket_insert_info_bits(dmrpacket_payload_bits_t *payload_bits, dmrpacket_payload_info_bits_t *info_bits);
 
 dmrpacket_payload_voice_bits_t *dmrpacket_extract_voice_bits(dmrpacket_payload_bits_t *payload_bits);
+dmrpacket_payload_voice_bits_t *dmrpacket_extract_voice_bits_r(dmrpacket_payload_bits_t *payload_bits, dmrpacket_payload_voice_bits_t *voice_bits);
 void dmrpacket_insert_voice_bits(dmrpacket_payload_bits_t *payload_bits, dmrpacket_payload_voice_bits_t *voice_bits);
 
 #endif
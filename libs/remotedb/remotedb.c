@@ -23,6 +23,7 @@
 
 #include <libs/config/config.h>
 #include <libs/comm/comm.h>
+#include <libs/comm/replaybench.h>
 #include <libs/base/smstxbuf.h>
 
 #include <stdlib.h>
@@ -52,12 +53,34 @@ static remotedb_query_t remotedb_querybuf[REMOTEDB_QUERYBUFSIZE];
 static pthread_mutex_t remotedb_mutex_wakeup = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t remotedb_cond_wakeup;
 
+// Set if a remote db server is configured.
+static flag_t remotedb_enabled = 0;
+
+// In dry run mode queries are generated, but only counted instead of sending them to the server.
+static flag_t remotedb_dryrun = 0;
+static uint32_t remotedb_dryrun_querycount = 0;
+
+static void remotedb_escape_string(char *to, char *from, unsigned long length) {
+	pthread_mutex_lock(&remotedb_mutex_remotedb_conn);
+	if (remotedb_conn == NULL)
+		mysql_escape_string(to, from, length);
+	else
+		mysql_real_escape_string(remotedb_conn, to, from, length);
+	pthread_mutex_unlock(&remotedb_mutex_remotedb_conn);
+}
+
 static void remotedb_addquery(char *query) {
 	int i;
 
 	if (query == NULL)
 		return;
 
+	if (remotedb_dryrun) {
+		remotedb_dryrun_querycount++;
+		replaybench_event("sql %s", query);
+		return;
+	}
+
 	pthread_mutex_lock(&remotedb_mutex_querybuf);
 	for (i = 0; i < REMOTEDB_QUERYBUFSIZE; i++) {
 		if (remotedb_querybuf[i].query[0] == 0) {
@@ -101,10 +124,9 @@ void remotedb_add_email_to_send(char *dstemail, dmr_id_t srcid, char *msg) {
 		return;
 	}
 
-	pthread_mutex_lock(&remotedb_mutex_remotedb_conn);
-	mysql_real_escape_string(remotedb_conn, dstemail_escaped, dstemail, dstemail_length);
-	mysql_real_escape_string(remotedb_conn, msg_escaped, msg, msg_length);
-	pthread_mutex_unlock(&remotedb_mutex_remotedb_conn);
+	replaybench_stage_enter(REPLAYBENCH_STAGE_REMOTEDB);
+	remotedb_escape_string(dstemail_escaped, dstemail, dstemail_length);
+	remotedb_escape_string(msg_escaped, msg, msg_length);
 
 	tableprefix = config_get_remotedbtableprefix();
 	snprintf(query, sizeof(query), "insert into `%semails-out` (`dstemail`, `srcid`, `msg`, `addedat`) values ('%s', %u, '%s', now())",
@@ -114,6 +136,7 @@ void remotedb_add_email_to_send(char *dstemail, dmr_id_t srcid, char *msg) {
 	free(msg_escaped);
 
 	remotedb_addquery(query);
+	replaybench_stage_leave();
 }
 
 void remotedb_add_data_to_log(repeater_t *repeater, dmr_timeslot_t ts, dmr_id_t dstid, dmr_id_t srcid, dmr_call_type_t calltype, dmr_data_type_t decoded_data_type, char *decoded_data) {
@@ -128,9 +151,8 @@ void remotedb_add_data_to_log(repeater_t *repeater, dmr_timeslot_t ts, dmr_id_t
 		console_log("remotedb error: can't allocate memory for escaped data\n");
 		return;
 	}
-	pthread_mutex_lock(&remotedb_mutex_remotedb_conn);
-	mysql_real_escape_string(remotedb_conn, decoded_data_escaped, decoded_data, decoded_data_length);
-	pthread_mutex_unlock(&remotedb_mutex_remotedb_conn);
+	replaybench_stage_enter(REPLAYBENCH_STAGE_REMOTEDB);
+	remotedb_escape_string(decoded_data_escaped, decoded_data, decoded_data_length);
 
 	tableprefix = config_get_remotedbtableprefix();
 	snprintf(query, sizeof(query), "insert into `%slog` (`repeaterid`, `srcid`, `timeslot`, `dstid`, `calltype`, `startts`, `endts`, `datatype`, `datadecoded`) "
@@ -143,6 +165,7 @@ void remotedb_add_data_to_log(repeater_t *repeater, dmr_timeslot_t ts, dmr_id_t
 	free(decoded_data_escaped);
 
 	remotedb_addquery(query);
+	replaybench_stage_leave();
 }
 
 static void remotedb_update_timeslot(repeater_t *repeater, dmr_timeslot_t ts) {
@@ -154,17 +177,16 @@ static void remotedb_update_timeslot(repeater_t *repeater, dmr_timeslot_t ts) {
 	if (repeater == NULL || ts > 1 || ts < 0 || repeater->slot[ts].src_id == 0 || repeater->slot[ts].dst_id == 0)
 		return;
 
-	if (remotedb_conn == NULL)
+	if (remotedb_conn == NULL && !remotedb_dryrun)
 		return;
 
 	if (repeater->slot[ts].state == REPEATER_SLOT_STATE_DATA_CALL_RUNNING)
 		return;
 
-	if (repeater->slot[ts].voicestream) {
-		rms_vol = repeater->slot[ts].voicestream->rms_vol;
-		avg_rms_vol = repeater->slot[ts].voicestream->avg_rms_vol;
-	}
+	if (repeater->slot[ts].voicestream)
+		voicestreams_get_rms_vol(repeater->slot[ts].voicestream, repeater, &rms_vol, &avg_rms_vol);
 
+	replaybench_stage_enter(REPLAYBENCH_STAGE_REMOTEDB);
 	tableprefix = config_get_remotedbtableprefix();
 	snprintf(query, sizeof(query), "insert into `%slog` (`repeaterid`, `srcid`, `timeslot`, `dstid`, `calltype`, `startts`, `endts`, `currrssi`, `avgrssi`, `currrmsvol`, `avgrmsvol`) "
 		"values (%u, %u, %u, %u, %u, from_unixtime(%lld), from_unixtime(%lld), %d, %d, %d, %d) on duplicate key update `endts`=from_unixtime(%lld), `currrssi`=%d, `avgrssi`=%d, `currrmsvol`=%d, `avgrmsvol`=%d",
@@ -175,15 +197,17 @@ static void remotedb_update_timeslot(repeater_t *repeater, dmr_timeslot_t ts) {
 	free(tableprefix);
 
 	remotedb_addquery(query);
+	replaybench_stage_leave();
 }
 
 void remotedb_update_repeater(repeater_t *repeater) {
 	char *tableprefix = NULL;
 	char query[REMOTEDB_MAXQUERYSIZE] = {0,};
 
-	if (repeater == NULL || remotedb_conn == NULL || repeater->id == 0 || strlen(repeater->callsign) == 0)
+	if (repeater == NULL || (remotedb_conn == NULL && !remotedb_dryrun) || repeater->id == 0 || strlen(repeater->callsign) == 0)
 		return;
 
+	replaybench_stage_enter(REPLAYBENCH_STAGE_REMOTEDB);
 	tableprefix = config_get_remotedbtableprefix();
 	snprintf(query, sizeof(query), "replace into `%srepeaters` (`callsign`, `id`, `type`, `fwversion`, `dlfreq`, `ulfreq`, "
 		"`psuvoltage`, `patemperature`, `vswr`, `txfwdpower`, `txrefpower`, `lastactive`) "
@@ -195,21 +219,24 @@ void remotedb_update_repeater(repeater_t *repeater) {
 	free(tableprefix);
 
 	remotedb_addquery(query);
+	replaybench_stage_leave();
 }
 
 void remotedb_update_repeater_lastactive(repeater_t *repeater) {
 	char *tableprefix = NULL;
 	char query[REMOTEDB_MAXQUERYSIZE] = {0,};
 
-	if (repeater == NULL || remotedb_conn == NULL || repeater->id == 0 || strlen(repeater->callsign) == 0)
+	if (repeater == NULL || (remotedb_conn == NULL && !remotedb_dryrun) || repeater->id == 0 || strlen(repeater->callsign) == 0)
 		return;
 
+	replaybench_stage_enter(REPLAYBENCH_STAGE_REMOTEDB);
 	tableprefix = config_get_remotedbtableprefix();
 	snprintf(query, sizeof(query), "update `%srepeaters` set `lastactive` = from_unixtime(%lld) where `id` = %u",
 		tableprefix, (long long)repeater->last_active_time, repeater->id);
 	free(tableprefix);
 
 	remotedb_addquery(query);
+	replaybench_stage_leave();
 }
 
 void remotedb_update(repeater_t *repeater) {
@@ -232,6 +259,7 @@ void remotedb_update_stats_callend(repeater_t *repeater, dmr_timeslot_t ts) {
 	if (talktime <= 0)
 		return;
 
+	replaybench_stage_enter(REPLAYBENCH_STAGE_REMOTEDB);
 	tableprefix = config_get_remotedbtableprefix();
 	snprintf(query, sizeof(query), "insert into `%sstats` (`id`, `date`, `talktime`) "
 		"values (%u, now(), %u) on duplicate key update `talktime`=`talktime`+%u",
@@ -239,6 +267,7 @@ void remotedb_update_stats_callend(repeater_t *repeater, dmr_timeslot_t ts) {
 	free(tableprefix);
 
 	remotedb_addquery(query);
+	replaybench_stage_leave();
 }
 
 static void remotedb_thread_msgqueue_poll(void) {
@@ -553,6 +582,7 @@ void remotedb_init(void) {
 	server = config_get_remotedbhost();
 	if (strlen(server) != 0) {
 		console_log("remotedb: starting thread for remote db\n");
+		remotedb_enabled = 1;
 
 		// Explicitly creating the thread as joinable to be compatible with other systems.
 		pthread_attr_init(&attr);
@@ -563,6 +593,23 @@ void remotedb_init(void) {
 	free(server);
 }
 
+// Queries are generated without a server connection and only counted, used by the replay benchmark.
+void remotedb_init_dryrun(void) {
+	console_log("remotedb: init in dry run mode\n");
+
+	remotedb_dryrun = 1;
+	remotedb_dryrun_querycount = 0;
+}
+
+// Returns 1 if call logs are written to the remote db, or generated in dry run mode.
+flag_t remotedb_is_enabled(void) {
+	return (remotedb_enabled || remotedb_dryrun);
+}
+
+uint32_t remotedb_get_dryrun_querycount(void) {
+	return remotedb_dryrun_querycount;
+}
+
 void remotedb_deinit(void) {
 	void *status = NULL;
 
@@ -38,6 +38,9 @@ void remotedb_maintain(void);
 void remotedb_maintain_repeaterlist(void);
 
 void remotedb_init(void);
+void remotedb_init_dryrun(void);
+flag_t remotedb_is_enabled(void);
+uint32_t remotedb_get_dryrun_querycount(void);
 void remotedb_deinit(void);
 
 #endif
@@ -18,6 +18,7 @@
 
 
 #include "voicestreams-decode.h"
+#include "voicestreams-dsp.h"
 
 #include <libs/daemon/console.h>
 
@@ -61,8 +62,8 @@ static uint8_t voicestreams_decode_deinterleave_matrix_z[36] = {
 	13, 2, 12, 1, 11, 0
 };
 
-voicestreams_decoded_frame_t *voicestreams_decode_ambe_frame(dmrpacket_payload_ambe_frame_bits_t *ambe_frame_bits, voicestream_t *voicestream) {
-	static voicestreams_decoded_frame_t decoded_frame;
+// Decodes the frame with the decoder state of the given source of the stream.
+voicestreams_decoded_frame_t *voicestreams_decode_ambe_frame_r(dmrpacket_payload_ambe_frame_bits_t *ambe_frame_bits, voicestream_t *voicestream, voicestreams_source_t *source, voicestreams_decoded_frame_t *decoded_frame) {
 	char deinterleaved_ambe_frame_bits[4][24];
 	uint8_t j;
 	uint8_t *w, *x, *y, *z;
@@ -85,22 +86,28 @@ voicestreams_decoded_frame_t *voicestreams_decode_ambe_frame(dmrpacket_payload_a
 		z++;
 	}
 
-	mbe_processAmbe3600x2450Framef(decoded_frame.samples, &errs, &errs2, err_str, deinterleaved_ambe_frame_bits, ambe_d, &voicestream->cur_mp, &voicestream->prev_mp, &voicestream->prev_mp_enhanced, voicestream->decodequality);
+	mbe_processAmbe3600x2450Framef(decoded_frame->samples, &errs, &errs2, err_str, deinterleaved_ambe_frame_bits, ambe_d, &source->cur_mp, &source->prev_mp, &source->prev_mp_enhanced,
+		__atomic_load_n(&voicestream->active_decodequality, __ATOMIC_RELAXED));
 
 	if (errs2 > 0)
 		console_log(LOGLEVEL_VOICESTREAMS "voicestreams [%s]: mbelib decoding errors: %u %s\n", voicestream->name, errs2, err_str);
 
-	for (j = 0; j < VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT; j++)
-		decoded_frame.samples[j] /= 32767.0;
+	voicestreams_dsp_scale(decoded_frame->samples, VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT, 1.0f/32767.0f);
+
+	return decoded_frame;
+}
+
+voicestreams_decoded_frame_t *voicestreams_decode_ambe_frame(dmrpacket_payload_ambe_frame_bits_t *ambe_frame_bits, voicestream_t *voicestream, voicestreams_source_t *source) {
+	static voicestreams_decoded_frame_t decoded_frame;
 
-	return &decoded_frame;
+	return voicestreams_decode_ambe_frame_r(ambe_frame_bits, voicestream, source, &decoded_frame);
 }
 
-void voicestreams_decode_ambe_init(voicestream_t *voicestream) {
-	if (voicestream == NULL)
+void voicestreams_decode_ambe_init(voicestreams_source_t *source) {
+	if (source == NULL)
 		return;
 
-	mbe_initMbeParms(&voicestream->cur_mp, &voicestream->prev_mp, &voicestream->prev_mp_enhanced);
+	mbe_initMbeParms(&source->cur_mp, &source->prev_mp, &source->prev_mp_enhanced);
 }
 
 #endif /* ifdef AMBEDECODEVOICE */
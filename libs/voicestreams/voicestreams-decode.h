@@ -27,7 +27,8 @@ typedef struct {
 	float samples[VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT];
 } voicestreams_decoded_frame_t;
 
-voicestreams_decoded_frame_t *voicestreams_decode_ambe_frame(dmrpacket_payload_ambe_frame_bits_t *ambe_frame_bits, voicestream_t *voicestream);
-void voicestreams_decode_ambe_init(voicestream_t *voicestream);
+voicestreams_decoded_frame_t *voicestreams_decode_ambe_frame(dmrpacket_payload_ambe_frame_bits_t *ambe_frame_bits, voicestream_t *voicestream, voicestreams_source_t *source);
+voicestreams_decoded_frame_t *voicestreams_decode_ambe_frame_r(dmrpacket_payload_ambe_frame_bits_t *ambe_frame_bits, voicestream_t *voicestream, voicestreams_source_t *source, voicestreams_decoded_frame_t *decoded_frame);
+void voicestreams_decode_ambe_init(voicestreams_source_t *source);
 
 #endif
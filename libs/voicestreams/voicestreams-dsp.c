@@ -0,0 +1,265 @@
+/*
+ * This file is part of dmrshark.
+ *
+ * dmrshark is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dmrshark is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dmrshark.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+
+
+#include "voicestreams-dsp.h"
+
+#include <libs/daemon/console.h>
+
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VOICESTREAMS_DSP_X86
+#endif
+
+// Decoded voice is processed in 160 sample frames. The vectorized kernels handle
+// the samples in 4 (SSE2) or 8 (AVX) wide chunks, the rest is done by the scalar code.
+
+typedef struct {
+	void (*add)(float *samples, float *samples_to_add, uint16_t count);
+	void (*scale)(float *samples, uint16_t count, float factor);
+	void (*scale_and_clip)(float *samples, uint16_t count, float factor);
+	float (*sum_of_squares_above)(float *samples, uint16_t count, float threshold, uint16_t *elements);
+} voicestreams_dsp_kernels_t;
+
+static void voicestreams_dsp_add_scalar(float *samples, float *samples_to_add, uint16_t count) {
+	uint16_t i;
+
+	for (i = 0; i < count; i++)
+		samples[i] += samples_to_add[i];
+}
+
+static void voicestreams_dsp_scale_scalar(float *samples, uint16_t count, float factor) {
+	uint16_t i;
+
+	for (i = 0; i < count; i++)
+		samples[i] *= factor;
+}
+
+static void voicestreams_dsp_scale_and_clip_scalar(float *samples, uint16_t count, float factor) {
+	uint16_t i;
+
+	for (i = 0; i < count; i++) {
+		samples[i] *= factor;
+		if (samples[i] > 1.0f)
+			samples[i] = 1.0f;
+		else if (samples[i] < -1.0f)
+			samples[i] = -1.0f;
+	}
+}
+
+static float voicestreams_dsp_sum_of_squares_above_scalar(float *samples, uint16_t count, float threshold, uint16_t *elements) {
+	uint16_t i;
+	uint16_t selected = 0;
+	float sum = 0;
+
+	for (i = 0; i < count; i++) {
+		if (fabsf(samples[i]) > threshold) {
+			sum += samples[i]*samples[i];
+			selected++;
+		}
+	}
+	*elements += selected;
+	return sum;
+}
+
+#ifdef VOICESTREAMS_DSP_X86
+__attribute__((target("sse2")))
+static void voicestreams_dsp_add_sse2(float *samples, float *samples_to_add, uint16_t count) {
+	uint16_t i;
+
+	for (i = 0; i+4 <= count; i += 4)
+		_mm_storeu_ps(&samples[i], _mm_add_ps(_mm_loadu_ps(&samples[i]), _mm_loadu_ps(&samples_to_add[i])));
+	voicestreams_dsp_add_scalar(&samples[i], &samples_to_add[i], count-i);
+}
+
+__attribute__((target("sse2")))
+static void voicestreams_dsp_scale_sse2(float *samples, uint16_t count, float factor) {
+	__m128 f = _mm_set1_ps(factor);
+	uint16_t i;
+
+	for (i = 0; i+4 <= count; i += 4)
+		_mm_storeu_ps(&samples[i], _mm_mul_ps(_mm_loadu_ps(&samples[i]), f));
+	voicestreams_dsp_scale_scalar(&samples[i], count-i, factor);
+}
+
+__attribute__((target("sse2")))
+static void voicestreams_dsp_scale_and_clip_sse2(float *samples, uint16_t count, float factor) {
+	__m128 f = _mm_set1_ps(factor);
+	__m128 max = _mm_set1_ps(1.0f);
+	__m128 min = _mm_set1_ps(-1.0f);
+	uint16_t i;
+
+	for (i = 0; i+4 <= count; i += 4)
+		_mm_storeu_ps(&samples[i], _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(&samples[i]), f), max), min));
+	voicestreams_dsp_scale_and_clip_scalar(&samples[i], count-i, factor);
+}
+
+__attribute__((target("sse2")))
+static float voicestreams_dsp_sum_of_squares_above_sse2(float *samples, uint16_t count, float threshold, uint16_t *elements) {
+	__m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 thr = _mm_set1_ps(threshold);
+	__m128 sum = _mm_setzero_ps();
+	__m128i selected = _mm_setzero_si128();
+	__m128 s, mask;
+	float lanes[4];
+	int32_t selected_lanes[4];
+	uint16_t i;
+
+	for (i = 0; i+4 <= count; i += 4) {
+		s = _mm_loadu_ps(&samples[i]);
+		mask = _mm_cmpgt_ps(_mm_and_ps(s, abs_mask), thr);
+		sum = _mm_add_ps(sum, _mm_and_ps(mask, _mm_mul_ps(s, s)));
+		selected = _mm_sub_epi32(selected, _mm_castps_si128(mask)); // Mask lanes are -1 if selected.
+	}
+	_mm_storeu_ps(lanes, sum);
+	_mm_storeu_si128((__m128i *)selected_lanes, selected);
+	*elements += selected_lanes[0]+selected_lanes[1]+selected_lanes[2]+selected_lanes[3];
+	return lanes[0]+lanes[1]+lanes[2]+lanes[3]+voicestreams_dsp_sum_of_squares_above_scalar(&samples[i], count-i, threshold, elements);
+}
+
+__attribute__((target("avx")))
+static void voicestreams_dsp_add_avx(float *samples, float *samples_to_add, uint16_t count) {
+	uint16_t i;
+
+	for (i = 0; i+8 <= count; i += 8)
+		_mm256_storeu_ps(&samples[i], _mm256_add_ps(_mm256_loadu_ps(&samples[i]), _mm256_loadu_ps(&samples_to_add[i])));
+	voicestreams_dsp_add_scalar(&samples[i], &samples_to_add[i], count-i);
+}
+
+__attribute__((target("avx")))
+static void voicestreams_dsp_scale_avx(float *samples, uint16_t count, float factor) {
+	__m256 f = _mm256_set1_ps(factor);
+	uint16_t i;
+
+	for (i = 0; i+8 <= count; i += 8)
+		_mm256_storeu_ps(&samples[i], _mm256_mul_ps(_mm256_loadu_ps(&samples[i]), f));
+	voicestreams_dsp_scale_scalar(&samples[i], count-i, factor);
+}
+
+__attribute__((target("avx")))
+static void voicestreams_dsp_scale_and_clip_avx(float *samples, uint16_t count, float factor) {
+	__m256 f = _mm256_set1_ps(factor);
+	__m256 max = _mm256_set1_ps(1.0f);
+	__m256 min = _mm256_set1_ps(-1.0f);
+	uint16_t i;
+
+	for (i = 0; i+8 <= count; i += 8)
+		_mm256_storeu_ps(&samples[i], _mm256_max_ps(_mm256_min_ps(_mm256_mul_ps(_mm256_loadu_ps(&samples[i]), f), max), min));
+	voicestreams_dsp_scale_and_clip_scalar(&samples[i], count-i, factor);
+}
+
+__attribute__((target("avx")))
+static float voicestreams_dsp_sum_of_squares_above_avx(float *samples, uint16_t count, float threshold, uint16_t *elements) {
+	__m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 thr = _mm256_set1_ps(threshold);
+	__m256 sum = _mm256_setzero_ps();
+	__m256 s, mask;
+	float lanes[8];
+	uint16_t selected = 0;
+	uint16_t i;
+
+	for (i = 0; i+8 <= count; i += 8) {
+		s = _mm256_loadu_ps(&samples[i]);
+		mask = _mm256_cmp_ps(_mm256_and_ps(s, abs_mask), thr, _CMP_GT_OQ);
+		sum = _mm256_add_ps(sum, _mm256_and_ps(mask, _mm256_mul_ps(s, s)));
+		selected += __builtin_popcount(_mm256_movemask_ps(mask));
+	}
+	_mm256_storeu_ps(lanes, sum);
+	*elements += selected;
+	return lanes[0]+lanes[1]+lanes[2]+lanes[3]+lanes[4]+lanes[5]+lanes[6]+lanes[7]+
+		voicestreams_dsp_sum_of_squares_above_scalar(&samples[i], count-i, threshold, elements);
+}
+#endif
+
+static voicestreams_dsp_kernels_t voicestreams_dsp_kernels[VOICESTREAMS_DSP_ISA_COUNT] = {
+	{ voicestreams_dsp_add_scalar, voicestreams_dsp_scale_scalar, voicestreams_dsp_scale_and_clip_scalar, voicestreams_dsp_sum_of_squares_above_scalar },
+#ifdef VOICESTREAMS_DSP_X86
+	{ voicestreams_dsp_add_sse2, voicestreams_dsp_scale_sse2, voicestreams_dsp_scale_and_clip_sse2, voicestreams_dsp_sum_of_squares_above_sse2 },
+	{ voicestreams_dsp_add_avx, voicestreams_dsp_scale_avx, voicestreams_dsp_scale_and_clip_avx, voicestreams_dsp_sum_of_squares_above_avx }
+#endif
+};
+
+// Set before the voice worker threads are started, and only read after that.
+static voicestreams_dsp_isa_t voicestreams_dsp_isa = VOICESTREAMS_DSP_ISA_SCALAR;
+
+char *voicestreams_dsp_get_readable_isa(voicestreams_dsp_isa_t isa) {
+	switch (isa) {
+		case VOICESTREAMS_DSP_ISA_SCALAR: return "scalar";
+		case VOICESTREAMS_DSP_ISA_SSE2: return "sse2";
+		case VOICESTREAMS_DSP_ISA_AVX: return "avx";
+		default: return "unknown";
+	}
+}
+
+static flag_t voicestreams_dsp_is_isa_supported(voicestreams_dsp_isa_t isa) {
+	switch (isa) {
+		case VOICESTREAMS_DSP_ISA_SCALAR: return 1;
+#ifdef VOICESTREAMS_DSP_X86
+		case VOICESTREAMS_DSP_ISA_SSE2: __builtin_cpu_init(); return (__builtin_cpu_supports("sse2") != 0);
+		case VOICESTREAMS_DSP_ISA_AVX: __builtin_cpu_init(); return (__builtin_cpu_supports("avx") != 0);
+#endif
+		default: return 0;
+	}
+}
+
+// Returns 0 if the CPU doesn't support the given instruction set.
+flag_t voicestreams_dsp_set_isa(voicestreams_dsp_isa_t isa) {
+	if (!voicestreams_dsp_is_isa_supported(isa))
+		return 0;
+
+	voicestreams_dsp_isa = isa;
+	return 1;
+}
+
+voicestreams_dsp_isa_t voicestreams_dsp_get_isa(void) {
+	return voicestreams_dsp_isa;
+}
+
+// Adds samples_to_add to the samples.
+void voicestreams_dsp_add(float *samples, float *samples_to_add, uint16_t count) {
+	voicestreams_dsp_kernels[voicestreams_dsp_isa].add(samples, samples_to_add, count);
+}
+
+// Multiplies the samples with the given factor.
+void voicestreams_dsp_scale(float *samples, uint16_t count, float factor) {
+	voicestreams_dsp_kernels[voicestreams_dsp_isa].scale(samples, count, factor);
+}
+
+// Multiplies the samples with the given factor, and clips the results to the -1.0..1.0 range.
+void voicestreams_dsp_scale_and_clip(float *samples, uint16_t count, float factor) {
+	voicestreams_dsp_kernels[voicestreams_dsp_isa].scale_and_clip(samples, count, factor);
+}
+
+// Returns the sum of squares of the samples which have a higher absolute value than the threshold,
+// and adds the number of these samples to elements.
+float voicestreams_dsp_sum_of_squares_above(float *samples, uint16_t count, float threshold, uint16_t *elements) {
+	return voicestreams_dsp_kernels[voicestreams_dsp_isa].sum_of_squares_above(samples, count, threshold, elements);
+}
+
+// Selects the widest instruction set supported by the CPU.
+void voicestreams_dsp_init(void) {
+	voicestreams_dsp_isa_t isa;
+
+	for (isa = VOICESTREAMS_DSP_ISA_COUNT-1; isa > VOICESTREAMS_DSP_ISA_SCALAR; isa--) {
+		if (voicestreams_dsp_set_isa(isa))
+			break;
+	}
+	console_log("voicestreams: using %s sample processing\n", voicestreams_dsp_get_readable_isa(voicestreams_dsp_isa));
+}
@@ -0,0 +1,40 @@
+/*
+ * This file is part of dmrshark.
+ *
+ * dmrshark is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dmrshark is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dmrshark.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+#ifndef VOICESTREAMS_DSP_H_
+#define VOICESTREAMS_DSP_H_
+
+#include <libs/base/types.h>
+
+#define VOICESTREAMS_DSP_ISA_SCALAR		0
+#define VOICESTREAMS_DSP_ISA_SSE2		1
+#define VOICESTREAMS_DSP_ISA_AVX		2
+#define VOICESTREAMS_DSP_ISA_COUNT		3
+typedef uint8_t voicestreams_dsp_isa_t;
+
+char *voicestreams_dsp_get_readable_isa(voicestreams_dsp_isa_t isa);
+flag_t voicestreams_dsp_set_isa(voicestreams_dsp_isa_t isa);
+voicestreams_dsp_isa_t voicestreams_dsp_get_isa(void);
+
+void voicestreams_dsp_add(float *samples, float *samples_to_add, uint16_t count);
+void voicestreams_dsp_scale(float *samples, uint16_t count, float factor);
+void voicestreams_dsp_scale_and_clip(float *samples, uint16_t count, float factor);
+float voicestreams_dsp_sum_of_squares_above(float *samples, uint16_t count, float threshold, uint16_t *elements);
+
+void voicestreams_dsp_init(void);
+
+#endif
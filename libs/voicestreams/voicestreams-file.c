@@ -0,0 +1,275 @@
+/*
+ * This file is part of dmrshark.
+ *
+ * dmrshark is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dmrshark is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dmrshark.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+
+
+#include "voicestreams-file.h"
+
+#include <libs/daemon/console.h>
+#include <libs/base/virtclock.h>
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Recordings are written through a big stdio buffer, so a write is usually only a memcpy.
+#define VOICESTREAMS_FILE_BUFFER_SIZE				65536
+// Call index files are named after the recording, with this extension appended.
+#define VOICESTREAMS_FILE_INDEX_EXTENSION			".idx"
+
+ASSERT(sizeof(voicestreams_file_index_entry_t) == 48);
+
+static char *voicestreams_file_get_extension(voicestreams_file_type_t type) {
+	switch (type) {
+		case VOICESTREAMS_FILE_TYPE_AMBE: return ".ambe";
+		case VOICESTREAMS_FILE_TYPE_DECODED_RAW: return ".decoded.raw";
+		case VOICESTREAMS_FILE_TYPE_MP3: return ".mp3";
+		default: return "";
+	}
+}
+
+// Returns the file type's extension without the leading dot.
+char *voicestreams_file_get_type_name(voicestreams_file_type_t type) {
+	return voicestreams_file_get_extension(type)+1;
+}
+
+// Returns VOICESTREAMS_FILE_TYPE_COUNT if the given type name is invalid.
+voicestreams_file_type_t voicestreams_file_get_type_by_name(char *name) {
+	voicestreams_file_type_t type;
+
+	if (name == NULL)
+		return VOICESTREAMS_FILE_TYPE_COUNT;
+
+	for (type = 0; type < VOICESTREAMS_FILE_TYPE_COUNT; type++) {
+		if (strcmp(name, voicestreams_file_get_type_name(type)) == 0)
+			break;
+	}
+	return type;
+}
+
+char *voicestreams_file_get_filename_for_date_r(voicestream_t *voicestream, voicestreams_file_type_t type, char *date, char *fn, size_t fn_size) {
+	return voicestreams_get_stream_filename_for_date_r(voicestream, date, voicestreams_file_get_extension(type), fn, fn_size);
+}
+
+static time_t voicestreams_file_get_next_midnight(time_t t) {
+	struct tm tm;
+
+	localtime_r(&t, &tm);
+	tm.tm_sec = tm.tm_min = tm.tm_hour = 0;
+	tm.tm_mday++;
+	tm.tm_isdst = -1;
+	return mktime(&tm);
+}
+
+static flag_t voicestreams_file_open(voicestream_t *voicestream, voicestreams_file_t *file, voicestreams_file_type_t type, time_t now) {
+	struct stat st;
+
+	if (file->f != NULL)
+		fclose(file->f);
+
+	voicestreams_get_stream_filename_r(voicestream, voicestreams_file_get_extension(type), file->filename, sizeof(file->filename));
+	file->f = fopen(file->filename, "a");
+	if (file->f == NULL) {
+		console_log(LOGLEVEL_VOICESTREAMS LOGLEVEL_DEBUG "voicestreams [%s] error: can't open %s\n", voicestream->name, file->filename);
+		return 0;
+	}
+	setvbuf(file->f, NULL, _IOFBF, VOICESTREAMS_FILE_BUFFER_SIZE);
+	if (fstat(fileno(file->f), &st) == 0)
+		file->size = st.st_size;
+	else
+		file->size = 0;
+	file->rotate_at = voicestreams_file_get_next_midnight(now);
+	file->last_flush_at = now;
+	file->unflushed = 0;
+	console_log(LOGLEVEL_VOICESTREAMS LOGLEVEL_DEBUG "voicestreams [%s]: opened %s\n", voicestream->name, file->filename);
+	return 1;
+}
+
+// Returns the stream's open recording file of the given type, opening or rotating it if needed.
+static voicestreams_file_t *voicestreams_file_get(voicestream_t *voicestream, voicestreams_file_type_t type, time_t now) {
+	voicestreams_file_t *file = &voicestream->files[type];
+
+	if (file->f == NULL || now >= file->rotate_at) {
+		if (!voicestreams_file_open(voicestream, file, type, now))
+			return NULL;
+	}
+	return file;
+}
+
+// Appends the given buffer to the stream's recording file of the given type, and returns the number of written bytes.
+// The file is kept open between writes, and it's rotated to a new file name at the day boundary.
+size_t voicestreams_file_write(voicestream_t *voicestream, voicestreams_file_type_t type, void *buf, size_t size) {
+	voicestreams_file_t *file;
+	time_t now;
+	size_t written_bytes;
+
+	if (voicestream == NULL || type >= VOICESTREAMS_FILE_TYPE_COUNT || buf == NULL || size == 0)
+		return 0;
+
+	now = virtclock_time();
+	file = voicestreams_file_get(voicestream, type, now);
+	if (file == NULL)
+		return 0;
+
+	written_bytes = fwrite(buf, 1, size, file->f);
+	file->size += written_bytes;
+	file->unflushed = 1;
+	voicestreams_file_flush_if_needed(voicestream, type);
+	return written_bytes;
+}
+
+// Stores the position where the call's data will start in the stream's recording file of the given type.
+// The file is opened here if needed, so the position belongs to the file which the call is written to.
+void voicestreams_file_call_start(voicestream_t *voicestream, voicestreams_file_type_t type, voicestreams_file_pos_t *pos) {
+	voicestreams_file_t *file;
+
+	if (voicestream == NULL || type >= VOICESTREAMS_FILE_TYPE_COUNT || pos == NULL)
+		return;
+
+	pos->offset = -1;
+	file = voicestreams_file_get(voicestream, type, virtclock_time());
+	if (file == NULL)
+		return;
+
+	pos->offset = file->size;
+	pos->rotate_at = file->rotate_at;
+}
+
+// Appends the call's entry to the index of the stream's recording file of the given type.
+// Nothing is written if no data of the call got into the file.
+void voicestreams_file_call_end(voicestream_t *voicestream, voicestreams_file_type_t type, voicestreams_file_pos_t *pos, voicestreams_call_t *call) {
+	voicestreams_file_t *file;
+	voicestreams_file_index_entry_t entry;
+	char fn[sizeof(file->filename)+sizeof(VOICESTREAMS_FILE_INDEX_EXTENSION)];
+	FILE *f;
+
+	if (voicestream == NULL || type >= VOICESTREAMS_FILE_TYPE_COUNT || pos == NULL || call == NULL || pos->offset < 0)
+		return;
+
+	file = &voicestream->files[type];
+	if (file->f == NULL)
+		return;
+
+	memset(&entry, 0, sizeof(entry));
+	// If the file was rotated during the call, only the part in the new file is indexed.
+	entry.start_offset = (pos->rotate_at == file->rotate_at ? pos->offset : 0);
+	entry.end_offset = file->size;
+	pos->offset = -1;
+	if (entry.end_offset <= entry.start_offset)
+		return;
+
+	entry.started_at = call->started_at;
+	entry.ended_at = virtclock_time();
+	entry.src_id = call->src_id;
+	entry.dst_id = call->dst_id;
+	entry.repeater_id = call->repeater_id;
+	entry.call_type = call->call_type;
+	entry.timeslot = call->timeslot+1;
+
+	// The call's data has to be on disk before it can be served from the index.
+	voicestreams_file_flush(voicestream, type);
+
+	snprintf(fn, sizeof(fn), "%s" VOICESTREAMS_FILE_INDEX_EXTENSION, file->filename);
+	f = fopen(fn, "a");
+	if (f == NULL) {
+		console_log(LOGLEVEL_VOICESTREAMS "voicestreams [%s] error: can't open %s\n", voicestream->name, fn);
+		return;
+	}
+	if (fwrite(&entry, sizeof(entry), 1, f) != 1)
+		console_log(LOGLEVEL_VOICESTREAMS "voicestreams [%s] error: can't write to %s\n", voicestream->name, fn);
+	else {
+		console_log(LOGLEVEL_VOICESTREAMS LOGLEVEL_DEBUG "voicestreams [%s]: indexed call %u->%u at %llu-%llu in %s\n", voicestream->name,
+			entry.src_id, entry.dst_id, (unsigned long long)entry.start_offset, (unsigned long long)entry.end_offset, file->filename);
+	}
+	fclose(f);
+}
+
+// Reads max. entries_count entries from the index of the stream's recording file of the given type,
+// starting with the given call. Date is in YYYYMMDD format. Returns the number of read entries.
+uint32_t voicestreams_file_read_index(voicestream_t *voicestream, voicestreams_file_type_t type, char *date, uint32_t first_call_nr, voicestreams_file_index_entry_t *entries, uint32_t entries_count) {
+	char fn[255];
+	char index_fn[sizeof(fn)+sizeof(VOICESTREAMS_FILE_INDEX_EXTENSION)];
+	int fd;
+	ssize_t bytes_read;
+
+	if (voicestream == NULL || type >= VOICESTREAMS_FILE_TYPE_COUNT || date == NULL || entries == NULL || entries_count == 0)
+		return 0;
+
+	voicestreams_file_get_filename_for_date_r(voicestream, type, date, fn, sizeof(fn));
+	snprintf(index_fn, sizeof(index_fn), "%s" VOICESTREAMS_FILE_INDEX_EXTENSION, fn);
+	fd = open(index_fn, O_RDONLY);
+	if (fd < 0)
+		return 0;
+
+	// Entries have a fixed size, so the wanted call's entry is read directly.
+	bytes_read = pread(fd, entries, (size_t)entries_count*sizeof(voicestreams_file_index_entry_t), (off_t)first_call_nr*sizeof(voicestreams_file_index_entry_t));
+	close(fd);
+	if (bytes_read <= 0)
+		return 0;
+	return bytes_read/sizeof(voicestreams_file_index_entry_t);
+}
+
+void voicestreams_file_flush(voicestream_t *voicestream, voicestreams_file_type_t type) {
+	voicestreams_file_t *file;
+
+	if (voicestream == NULL || type >= VOICESTREAMS_FILE_TYPE_COUNT)
+		return;
+
+	file = &voicestream->files[type];
+	if (file->f == NULL)
+		return;
+
+	fflush(file->f);
+	file->last_flush_at = virtclock_time();
+	file->unflushed = 0;
+}
+
+// Flushes the stream's recording file of the given type if it has buffered data, and it hasn't been flushed
+// for the flush interval. Returns 1 if there's buffered data left, which has to be flushed later.
+// Called periodically, so data of an idle stream doesn't stay in the buffer.
+flag_t voicestreams_file_flush_if_needed(voicestream_t *voicestream, voicestreams_file_type_t type) {
+	voicestreams_file_t *file;
+
+	if (voicestream == NULL || type >= VOICESTREAMS_FILE_TYPE_COUNT)
+		return 0;
+
+	file = &voicestream->files[type];
+	if (file->f == NULL || !file->unflushed)
+		return 0;
+
+	if (virtclock_time()-file->last_flush_at < VOICESTREAMS_FILE_FLUSH_INTERVAL_IN_SEC)
+		return 1;
+
+	voicestreams_file_flush(voicestream, type);
+	return 0;
+}
+
+void voicestreams_file_close(voicestream_t *voicestream) {
+	voicestreams_file_type_t type;
+
+	if (voicestream == NULL)
+		return;
+
+	for (type = 0; type < VOICESTREAMS_FILE_TYPE_COUNT; type++) {
+		if (voicestream->files[type].f == NULL)
+			continue;
+
+		fclose(voicestream->files[type].f);
+		voicestream->files[type].f = NULL;
+	}
+}
@@ -0,0 +1,54 @@
+/*
+ * This file is part of dmrshark.
+ *
+ * dmrshark is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dmrshark is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dmrshark.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+#ifndef VOICESTREAMS_FILE_H_
+#define VOICESTREAMS_FILE_H_
+
+#include "voicestreams.h"
+
+#include <stddef.h>
+
+// An entry of a recording's index file. One is appended for every call written to the
+// recording, so the Nth call of a day can be found by reading only the Nth entry.
+// Fields are in host byte order, timeslot is 1 or 2.
+typedef struct __attribute__((packed)) {
+	uint64_t start_offset;
+	uint64_t end_offset; // Offset of the first byte after the call.
+	int64_t started_at;
+	int64_t ended_at;
+	uint32_t src_id;
+	uint32_t dst_id;
+	uint32_t repeater_id;
+	uint8_t call_type;
+	uint8_t timeslot;
+	uint8_t reserved[2];
+} voicestreams_file_index_entry_t;
+
+char *voicestreams_file_get_type_name(voicestreams_file_type_t type);
+voicestreams_file_type_t voicestreams_file_get_type_by_name(char *name);
+char *voicestreams_file_get_filename_for_date_r(voicestream_t *voicestream, voicestreams_file_type_t type, char *date, char *fn, size_t fn_size);
+uint32_t voicestreams_file_read_index(voicestream_t *voicestream, voicestreams_file_type_t type, char *date, uint32_t first_call_nr, voicestreams_file_index_entry_t *entries, uint32_t entries_count);
+
+void voicestreams_file_call_start(voicestream_t *voicestream, voicestreams_file_type_t type, voicestreams_file_pos_t *pos);
+void voicestreams_file_call_end(voicestream_t *voicestream, voicestreams_file_type_t type, voicestreams_file_pos_t *pos, voicestreams_call_t *call);
+
+size_t voicestreams_file_write(voicestream_t *voicestream, voicestreams_file_type_t type, void *buf, size_t size);
+void voicestreams_file_flush(voicestream_t *voicestream, voicestreams_file_type_t type);
+flag_t voicestreams_file_flush_if_needed(voicestream_t *voicestream, voicestreams_file_type_t type);
+void voicestreams_file_close(voicestream_t *voicestream);
+
+#endif
@@ -0,0 +1,282 @@
+/*
+ * This file is part of dmrshark.
+ *
+ * dmrshark is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dmrshark is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dmrshark.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+
+
+#include "voicestreams-governor.h"
+#include "voicestreams-worker.h"
+
+#include <libs/daemon/console.h>
+#include <libs/daemon/daemon-latency.h>
+#include <libs/daemon/daemon-poll.h>
+#include <libs/config/config.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Load is checked this often. The governor steps at most one level per check.
+#define VOICESTREAMS_GOVERNOR_CHECK_INTERVAL_IN_SEC		1
+// Load has to stay low for this many checks before the governor steps back a level.
+#define VOICESTREAMS_GOVERNOR_RECOVERY_CHECKS			5
+// Decode quality used for all streams when the governor lowers quality.
+#define VOICESTREAMS_GOVERNOR_REDUCED_DECODE_QUALITY	1
+// Streams with this priority are never shed.
+#define VOICESTREAMS_GOVERNOR_UNSHEDDABLE_PRIORITY		9
+// This many latest transitions are kept for the report.
+#define VOICESTREAMS_GOVERNOR_TRANSITIONS_COUNT			16
+
+typedef struct {
+	time_t at;
+	char description[200];
+} voicestreams_governor_transition_t;
+
+static voicestream_t *voicestreams_governor_streams = NULL;
+static uint32_t voicestreams_governor_latency_threshold_usec = 0;
+static uint32_t voicestreams_governor_queue_depth_threshold = 0;
+
+static time_t voicestreams_governor_last_check_at = 0;
+static uint8_t voicestreams_governor_low_load_checks = 0;
+static flag_t voicestreams_governor_quality_reduced = 0;
+
+static voicestreams_governor_transition_t voicestreams_governor_transitions[VOICESTREAMS_GOVERNOR_TRANSITIONS_COUNT];
+static uint32_t voicestreams_governor_transitions_head = 0;
+
+// Logs the transition, and stores it for the report.
+static void voicestreams_governor_add_transition(char *description, uint32_t max_pass_usec, uint32_t max_queue_depth) {
+	voicestreams_governor_transition_t *transition;
+
+	transition = &voicestreams_governor_transitions[voicestreams_governor_transitions_head % VOICESTREAMS_GOVERNOR_TRANSITIONS_COUNT];
+	voicestreams_governor_transitions_head++;
+	transition->at = time(NULL);
+	snprintf(transition->description, sizeof(transition->description), "%s (max. loop pass: %.1f ms, max. voice queue depth: %u)",
+		description, max_pass_usec/1000.0, max_queue_depth);
+
+	console_log("voicestreams governor: %s\n", transition->description);
+}
+
+static void voicestreams_governor_set_decode_quality(flag_t reduced) {
+	voicestream_t *vs;
+	uint8_t quality;
+
+	voicestreams_governor_quality_reduced = reduced;
+	for (vs = voicestreams_governor_streams; vs != NULL; vs = vs->next) {
+		quality = vs->decodequality;
+		if (reduced)
+			quality = min(quality, VOICESTREAMS_GOVERNOR_REDUCED_DECODE_QUALITY);
+		__atomic_store_n(&vs->active_decodequality, quality, __ATOMIC_RELAXED);
+	}
+}
+
+// Sheds the streams with priority lower than the given one, and restores the others.
+// The names of the streams which changed state are put into changed_streams.
+static void voicestreams_governor_set_shed_below_priority(uint8_t priority, char *changed_streams, size_t changed_streams_size) {
+	voicestream_t *vs;
+	flag_t shed;
+	size_t length = 0;
+
+	changed_streams[0] = 0;
+	for (vs = voicestreams_governor_streams; vs != NULL; vs = vs->next) {
+		shed = (vs->priority < priority);
+		if (shed == vs->shed)
+			continue;
+
+		vs->shed = shed;
+		if (length < changed_streams_size)
+			length += snprintf(changed_streams+length, changed_streams_size-length, "%s%s", (length ? ", " : ""), vs->name);
+	}
+}
+
+// Returns the lowest priority of the enabled streams which are not shed and can be shed,
+// or VOICESTREAMS_GOVERNOR_UNSHEDDABLE_PRIORITY if there are no such streams.
+static uint8_t voicestreams_governor_get_lowest_unshed_priority(void) {
+	voicestream_t *vs;
+	uint8_t priority = VOICESTREAMS_GOVERNOR_UNSHEDDABLE_PRIORITY;
+
+	for (vs = voicestreams_governor_streams; vs != NULL; vs = vs->next) {
+		if (vs->enabled && !vs->shed && vs->priority < priority)
+			priority = vs->priority;
+	}
+	return priority;
+}
+
+// Returns the highest priority of the shed streams, or -1 if no streams are shed.
+static int voicestreams_governor_get_highest_shed_priority(void) {
+	voicestream_t *vs;
+	int priority = -1;
+
+	for (vs = voicestreams_governor_streams; vs != NULL; vs = vs->next) {
+		if (vs->shed && vs->priority > priority)
+			priority = vs->priority;
+	}
+	return priority;
+}
+
+// Lowers decode quality first, then sheds the streams with the lowest priority.
+static void voicestreams_governor_step_up(uint32_t max_pass_usec, uint32_t max_queue_depth) {
+	char changed_streams[150];
+	char description[200];
+	uint8_t priority;
+
+	if (!voicestreams_governor_quality_reduced) {
+		voicestreams_governor_set_decode_quality(1);
+		snprintf(description, sizeof(description), "high load, decode quality lowered to %u", VOICESTREAMS_GOVERNOR_REDUCED_DECODE_QUALITY);
+		voicestreams_governor_add_transition(description, max_pass_usec, max_queue_depth);
+		return;
+	}
+
+	priority = voicestreams_governor_get_lowest_unshed_priority();
+	if (priority >= VOICESTREAMS_GOVERNOR_UNSHEDDABLE_PRIORITY)
+		return; // Nothing left to shed.
+
+	voicestreams_governor_set_shed_below_priority(priority+1, changed_streams, sizeof(changed_streams));
+	snprintf(description, sizeof(description), "high load, shedding streams with priority %u: %s", priority, changed_streams);
+	voicestreams_governor_add_transition(description, max_pass_usec, max_queue_depth);
+}
+
+// Restores the shed streams with the highest priority first, then decode quality.
+static void voicestreams_governor_step_down(uint32_t max_pass_usec, uint32_t max_queue_depth) {
+	char changed_streams[150];
+	char description[200];
+	int priority;
+
+	priority = voicestreams_governor_get_highest_shed_priority();
+	if (priority >= 0) {
+		voicestreams_governor_set_shed_below_priority(priority, changed_streams, sizeof(changed_streams));
+		snprintf(description, sizeof(description), "load subsided, restoring streams with priority %u: %s", priority, changed_streams);
+		voicestreams_governor_add_transition(description, max_pass_usec, max_queue_depth);
+		return;
+	}
+
+	if (voicestreams_governor_quality_reduced) {
+		voicestreams_governor_set_decode_quality(0);
+		voicestreams_governor_add_transition("load subsided, decode quality restored", max_pass_usec, max_queue_depth);
+	}
+}
+
+static uint32_t voicestreams_governor_get_max_queue_depth(void) {
+	uint32_t max_queue_depth = 0;
+#ifdef AMBEDECODEVOICE
+	voicestream_t *vs;
+
+	for (vs = voicestreams_governor_streams; vs != NULL; vs = vs->next)
+		max_queue_depth = max(max_queue_depth, voicestreams_worker_get_queue_depth(vs));
+#endif
+	return max_queue_depth;
+}
+
+// Checks the main loop latency and the voice worker queue depths, and steps the governor up
+// if either of them is over its threshold. If both stay under half of their threshold for a
+// few checks, the governor steps back.
+void voicestreams_governor_process(void) {
+	time_t now;
+	uint32_t max_pass_usec;
+	uint32_t max_queue_depth;
+
+	if (voicestreams_governor_latency_threshold_usec == 0)
+		return;
+
+	// Checking periodically even if there's no traffic, so shed streams get restored.
+	if (voicestreams_governor_quality_reduced)
+		daemon_poll_setmaxtimeout(VOICESTREAMS_GOVERNOR_CHECK_INTERVAL_IN_SEC*1000);
+
+	now = time(NULL);
+	if (now-voicestreams_governor_last_check_at < VOICESTREAMS_GOVERNOR_CHECK_INTERVAL_IN_SEC)
+		return;
+	voicestreams_governor_last_check_at = now;
+
+	max_pass_usec = daemon_latency_get_window_max_pass_usec();
+	max_queue_depth = voicestreams_governor_get_max_queue_depth();
+
+	if (max_pass_usec >= voicestreams_governor_latency_threshold_usec || max_queue_depth >= voicestreams_governor_queue_depth_threshold) {
+		voicestreams_governor_low_load_checks = 0;
+		voicestreams_governor_step_up(max_pass_usec, max_queue_depth);
+		return;
+	}
+
+	if (max_pass_usec >= voicestreams_governor_latency_threshold_usec/2 || max_queue_depth >= voicestreams_governor_queue_depth_threshold/2) {
+		voicestreams_governor_low_load_checks = 0;
+		return;
+	}
+
+	if (!voicestreams_governor_quality_reduced)
+		return;
+
+	voicestreams_governor_low_load_checks++;
+	if (voicestreams_governor_low_load_checks >= VOICESTREAMS_GOVERNOR_RECOVERY_CHECKS) {
+		voicestreams_governor_low_load_checks = 0;
+		voicestreams_governor_step_down(max_pass_usec, max_queue_depth);
+	}
+}
+
+// Writes the governor's state and its latest transitions as text to buf. Returns the length of the written text.
+int voicestreams_governor_get_report(char *buf, int buf_size) {
+	voicestreams_governor_transition_t *transition;
+	voicestream_t *vs;
+	uint32_t i;
+	int length;
+	struct tm tm;
+	char at[20];
+
+	if (buf == NULL || buf_size <= 0)
+		return 0;
+
+	if (voicestreams_governor_latency_threshold_usec == 0)
+		return snprintf(buf, buf_size, "load governor: disabled\n");
+
+	length = snprintf(buf, buf_size, "load governor: loop latency threshold: %u ms queue depth threshold: %u decode quality reduced: %u\n",
+		voicestreams_governor_latency_threshold_usec/1000, voicestreams_governor_queue_depth_threshold, voicestreams_governor_quality_reduced);
+	for (vs = voicestreams_governor_streams; vs != NULL && length < buf_size; vs = vs->next) {
+		length += snprintf(buf+length, buf_size-length, "  %s: priority: %u shed: %u decode quality: %u\n", vs->name, vs->priority, vs->shed,
+			__atomic_load_n(&vs->active_decodequality, __ATOMIC_RELAXED));
+	}
+	if (length < buf_size)
+		length += snprintf(buf+length, buf_size-length, "transitions:\n");
+
+	i = (voicestreams_governor_transitions_head > VOICESTREAMS_GOVERNOR_TRANSITIONS_COUNT ? voicestreams_governor_transitions_head-VOICESTREAMS_GOVERNOR_TRANSITIONS_COUNT : 0);
+	for (; i < voicestreams_governor_transitions_head && length < buf_size; i++) {
+		transition = &voicestreams_governor_transitions[i % VOICESTREAMS_GOVERNOR_TRANSITIONS_COUNT];
+		localtime_r(&transition->at, &tm);
+		strftime(at, sizeof(at), "%Y-%m-%d %H:%M:%S", &tm);
+		length += snprintf(buf+length, buf_size-length, "  %s %s\n", at, transition->description);
+	}
+
+	return (length < buf_size ? length : buf_size-1);
+}
+
+void voicestreams_governor_print(void) {
+	char buf[4096];
+
+	voicestreams_governor_get_report(buf, sizeof(buf));
+	console_log("%s", buf);
+}
+
+void voicestreams_governor_init(voicestream_t *voicestreams_list) {
+	voicestream_t *vs;
+
+	voicestreams_governor_streams = voicestreams_list;
+	voicestreams_governor_latency_threshold_usec = config_get_loadgovernorlatencyinms()*1000;
+	voicestreams_governor_queue_depth_threshold = max(2, config_get_loadgovernorqueuedepth());
+
+	for (vs = voicestreams_list; vs != NULL; vs = vs->next)
+		vs->active_decodequality = vs->decodequality;
+
+	if (voicestreams_governor_latency_threshold_usec > 0) {
+		console_log("voicestreams governor: lowering decode quality and shedding streams above %u ms main loop latency or %u queued voice jobs\n",
+			voicestreams_governor_latency_threshold_usec/1000, voicestreams_governor_queue_depth_threshold);
+	}
+}
@@ -0,0 +1,29 @@
+/*
+ * This file is part of dmrshark.
+ *
+ * dmrshark is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dmrshark is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dmrshark.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+#ifndef VOICESTREAMS_GOVERNOR_H_
+#define VOICESTREAMS_GOVERNOR_H_
+
+#include "voicestreams.h"
+
+int voicestreams_governor_get_report(char *buf, int buf_size);
+void voicestreams_governor_print(void);
+
+void voicestreams_governor_process(void);
+void voicestreams_governor_init(voicestream_t *voicestreams_list);
+
+#endif
@@ -0,0 +1,184 @@
+/*
+ * This file is part of dmrshark.
+ *
+ * dmrshark is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dmrshark is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dmrshark.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+
+
+#include "voicestreams-mixer.h"
+#include "voicestreams-dsp.h"
+
+#include <libs/daemon/console.h>
+
+#include <string.h>
+#include <time.h>
+
+// Mixing waits for the frames of all sources, but if a source is late, the others are
+// mixed without it when one of them has this many frames waiting. 6 frames are 120ms.
+#define VOICESTREAMS_MIXER_JITTER_FRAMES	6
+
+// Returns the source of the repeater's current or last call.
+voicestreams_source_t *voicestreams_mixer_get_source(voicestream_t *voicestream, repeater_t *repeater) {
+	uint8_t i;
+
+	if (voicestream == NULL || repeater == NULL)
+		return NULL;
+
+	for (i = 0; i < VOICESTREAMS_MIXER_MAX_SOURCES; i++) {
+		if (voicestream->sources[i].repeater == repeater)
+			return &voicestream->sources[i];
+	}
+	return NULL;
+}
+
+// Returns the source of the repeater's call if it's streamed currently.
+voicestreams_source_t *voicestreams_mixer_get_active_source(voicestream_t *voicestream, repeater_t *repeater) {
+	voicestreams_source_t *source = voicestreams_mixer_get_source(voicestream, repeater);
+
+	if (source == NULL || !source->active)
+		return NULL;
+	return source;
+}
+
+// Returns a free source for the repeater's new call, or NULL if the stream already mixes
+// the maximum number of calls. The repeater's previous source is reused if it's free.
+voicestreams_source_t *voicestreams_mixer_add_source(voicestream_t *voicestream, repeater_t *repeater) {
+	voicestreams_source_t *source;
+	uint8_t i;
+
+	if (voicestream == NULL || repeater == NULL)
+		return NULL;
+
+	if (voicestream->active_sources_count >= voicestream->mixermaxsources)
+		return NULL;
+
+	source = voicestreams_mixer_get_source(voicestream, repeater);
+	if (source != NULL && !source->active && source-voicestream->sources < voicestream->mixermaxsources)
+		return source;
+
+	// Sources still waiting for the RMS volume of another repeater's call are only reused if there's no other free source.
+	for (i = 0; i < voicestream->mixermaxsources; i++) {
+		if (!voicestream->sources[i].active && voicestream->sources[i].call_end_rms_vols_pending == 0) {
+			voicestream->sources[i].repeater = repeater;
+			return &voicestream->sources[i];
+		}
+	}
+	for (i = 0; i < voicestream->mixermaxsources; i++) {
+		if (!voicestream->sources[i].active) {
+			voicestream->sources[i].repeater = repeater;
+			return &voicestream->sources[i];
+		}
+	}
+	return NULL;
+}
+
+#ifdef AMBEDECODEVOICE
+// This and the other functions below are called by the thread which decodes the stream.
+void voicestreams_mixer_source_start(voicestream_t *voicestream, voicestreams_source_t *source) {
+	if (voicestream == NULL || source == NULL || source->decoding)
+		return;
+
+	// Frames of the source's previous call which haven't been mixed yet are kept.
+	source->decoding = 1;
+	voicestream->decoding_sources_count++;
+}
+
+// The source's remaining frames are mixed by the next voicestreams_mixer_mix() calls.
+void voicestreams_mixer_source_end(voicestream_t *voicestream, voicestreams_source_t *source) {
+	if (voicestream == NULL || source == NULL || !source->decoding)
+		return;
+
+	source->decoding = 0;
+	voicestream->decoding_sources_count--;
+}
+
+void voicestreams_mixer_add_frame(voicestream_t *voicestream, voicestreams_source_t *source, float *samples) {
+	if (voicestream == NULL || source == NULL || samples == NULL)
+		return;
+
+	// Dropping the oldest frame if the source is too much ahead of the others.
+	if (source->frames_head-source->frames_tail >= VOICESTREAMS_MIXER_SOURCE_FRAMES_COUNT)
+		source->frames_tail++;
+
+	memcpy(source->frames[source->frames_head & (VOICESTREAMS_MIXER_SOURCE_FRAMES_COUNT-1)], samples, sizeof(source->frames[0]));
+	source->frames_head++;
+}
+
+static uint64_t voicestreams_mixer_get_nsec(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000+ts.tv_nsec;
+}
+
+// Mixes the next frame of the sources into samples. Returns 0 if there's nothing to mix yet.
+flag_t voicestreams_mixer_mix(voicestream_t *voicestream, float *samples) {
+	voicestreams_source_t *source;
+	uint32_t pending;
+	uint32_t max_pending = 0;
+	uint8_t pending_sources = 0;
+	flag_t late = 0;
+	uint8_t mixed = 0;
+	uint64_t started_at = 0;
+	uint32_t nsec;
+	uint8_t i;
+
+	if (voicestream == NULL || samples == NULL)
+		return 0;
+
+	for (i = 0; i < VOICESTREAMS_MIXER_MAX_SOURCES; i++) {
+		source = &voicestream->sources[i];
+		pending = source->frames_head-source->frames_tail;
+		if (pending == 0 && source->decoding)
+			late = 1;
+		if (pending > max_pending)
+			max_pending = pending;
+		if (pending > 0)
+			pending_sources++;
+	}
+	if (max_pending == 0 || (late && max_pending <= VOICESTREAMS_MIXER_JITTER_FRAMES))
+		return 0;
+
+	if (pending_sources > 1)
+		started_at = voicestreams_mixer_get_nsec();
+
+	for (i = 0; i < VOICESTREAMS_MIXER_MAX_SOURCES; i++) {
+		source = &voicestream->sources[i];
+		if (source->frames_head == source->frames_tail)
+			continue;
+
+		if (mixed == 0)
+			memcpy(samples, source->frames[source->frames_tail & (VOICESTREAMS_MIXER_SOURCE_FRAMES_COUNT-1)], sizeof(source->frames[0]));
+		else
+			voicestreams_dsp_add(samples, source->frames[source->frames_tail & (VOICESTREAMS_MIXER_SOURCE_FRAMES_COUNT-1)], VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT);
+		source->frames_tail++;
+		mixed++;
+	}
+
+	if (late)
+		voicestream->mixer_late_frames++;
+
+	if (mixed > 1) {
+		voicestreams_dsp_scale_and_clip(samples, VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT, 1.0f);
+
+		nsec = voicestreams_mixer_get_nsec()-started_at;
+		voicestream->mixer_mixes++;
+		voicestream->mixer_mix_nsec_sum += nsec;
+		if (nsec > voicestream->mixer_mix_nsec_max)
+			voicestream->mixer_mix_nsec_max = nsec;
+	}
+	return 1;
+}
+#endif
@@ -0,0 +1,36 @@
+/*
+ * This file is part of dmrshark.
+ *
+ * dmrshark is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dmrshark is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dmrshark.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+#ifndef VOICESTREAMS_MIXER_H_
+#define VOICESTREAMS_MIXER_H_
+
+#include "voicestreams.h"
+
+#include <libs/comm/repeaters.h>
+
+voicestreams_source_t *voicestreams_mixer_get_source(voicestream_t *voicestream, repeater_t *repeater);
+voicestreams_source_t *voicestreams_mixer_get_active_source(voicestream_t *voicestream, repeater_t *repeater);
+voicestreams_source_t *voicestreams_mixer_add_source(voicestream_t *voicestream, repeater_t *repeater);
+
+#ifdef AMBEDECODEVOICE
+void voicestreams_mixer_source_start(voicestream_t *voicestream, voicestreams_source_t *source);
+void voicestreams_mixer_source_end(voicestream_t *voicestream, voicestreams_source_t *source);
+void voicestreams_mixer_add_frame(voicestream_t *voicestream, voicestreams_source_t *source, float *samples);
+flag_t voicestreams_mixer_mix(voicestream_t *voicestream, float *samples);
+#endif
+
+#endif
@@ -23,7 +23,10 @@
 #include "voicestreams-mp3.h"
 
 #include <libs/daemon/console.h>
+
 #include <string.h>
+#include <stdlib.h>
+#include <time.h>
 
 static void voicestreams_mp3_handleerror(int resultcode) {
 	switch (resultcode) {
@@ -34,44 +37,94 @@ static void voicestreams_mp3_handleerror(int resultcode) {
 	}
 }
 
+uint64_t voicestreams_mp3_get_usec(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000+ts.tv_nsec/1000;
+}
+
+static uint64_t voicestreams_mp3_get_thread_cpu_nsec(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec*1000000000+ts.tv_nsec;
+}
+
+// Adds the CPU time used by the calling thread since started_at_nsec to the stream's
+// statistics. Called by the thread which encodes the stream.
+static void voicestreams_mp3_measure_encode(voicestream_t *voicestream, uint64_t started_at_nsec, uint16_t samples_count) {
+	if (__atomic_load_n(&voicestream->mp3_measure_reset_requested, __ATOMIC_ACQUIRE)) {
+		voicestream->mp3_encode_cpu_nsec = 0;
+		voicestream->mp3_encoded_samples = 0;
+		voicestream->mp3_encodes = 0;
+		__atomic_store_n(&voicestream->mp3_measure_reset_requested, 0, __ATOMIC_RELEASE);
+	}
+	voicestream->mp3_encode_cpu_nsec += voicestreams_mp3_get_thread_cpu_nsec()-started_at_nsec;
+	voicestream->mp3_encoded_samples += samples_count;
+	voicestream->mp3_encodes++;
+}
+
 // If the function is called with decoded_frame == NULL, then it only empties out the remaining buffer.
-voicestreams_mp3_frame_t *voicestreams_mp3_encode(voicestream_t *voicestream, voicestreams_decoded_frame_t *decoded_frame) {
-	static voicestreams_mp3_frame_t mp3frame;
+voicestreams_mp3_frame_t *voicestreams_mp3_encode_r(voicestream_t *voicestream, voicestreams_decoded_frame_t *decoded_frame, voicestreams_mp3_frame_t *mp3frame) {
+	flag_t measuring;
+	uint64_t started_at_nsec = 0;
+	uint16_t samples_count;
 	int res;
 
-	if (voicestream->mp3_flags == NULL || voicestream == NULL)
+	if (voicestream == NULL || voicestream->mp3_flags == NULL || mp3frame == NULL)
 		return NULL;
 
+	measuring = __atomic_load_n(&voicestream->mp3_measuring, __ATOMIC_RELAXED);
 	if (decoded_frame) {
 		// Putting the decoded frame to the mp3_buf.
-		if (voicestream->mp3_buf_pos < sizeof(voicestream->mp3_buf)/sizeof(voicestream->mp3_buf[0])) {
+		if (voicestream->mp3_buf_pos < voicestream->mp3_buf_size) {
+			// Without a worker, voice is decoded as soon as it's received.
+			if (voicestream->mp3_buf_pos == 0 && measuring)
+				voicestream->mp3_buf_received_at_usec = (voicestream->mp3_queued_at_usec ? voicestream->mp3_queued_at_usec : voicestreams_mp3_get_usec());
 			memcpy(voicestream->mp3_buf+voicestream->mp3_buf_pos, decoded_frame->samples, VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT*sizeof(decoded_frame->samples[0]));
 			voicestream->mp3_buf_pos += VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT;
 		}
 	}
 
-	if (voicestream->mp3_buf_pos >= sizeof(voicestream->mp3_buf)/sizeof(voicestream->mp3_buf[0]) || decoded_frame == NULL) {
-		res = lame_encode_buffer_ieee_float(voicestream->mp3_flags, voicestream->mp3_buf, voicestream->mp3_buf, voicestream->mp3_buf_pos, mp3frame.bytes, sizeof(mp3frame.bytes));
+	if (voicestream->mp3_buf_pos >= voicestream->mp3_buf_size || decoded_frame == NULL) {
+		if (measuring)
+			started_at_nsec = voicestreams_mp3_get_thread_cpu_nsec();
+		samples_count = voicestream->mp3_buf_pos;
+		res = lame_encode_buffer_ieee_float(voicestream->mp3_flags, voicestream->mp3_buf, voicestream->mp3_buf, samples_count, voicestream->mp3_encoded_buf, voicestream->mp3_encoded_buf_size);
 		voicestream->mp3_buf_pos = 0;
+		mp3frame->bytes = voicestream->mp3_encoded_buf;
+		mp3frame->received_at_usec = (measuring && samples_count > 0 ? voicestream->mp3_buf_received_at_usec : 0);
 		if (res < 0) {
-			mp3frame.bytes_size = 0;
+			mp3frame->bytes_size = 0;
 			voicestreams_mp3_handleerror(res);
 			return NULL;
 		}
-		mp3frame.bytes_size = res;
-		return &mp3frame;
+		mp3frame->bytes_size = res;
+		if (measuring)
+			voicestreams_mp3_measure_encode(voicestream, started_at_nsec, samples_count);
+		return mp3frame;
 	}
 	return NULL;
 }
 
+voicestreams_mp3_frame_t *voicestreams_mp3_encode(voicestream_t *voicestream, voicestreams_decoded_frame_t *decoded_frame) {
+	static voicestreams_mp3_frame_t mp3frame;
+
+	return voicestreams_mp3_encode_r(voicestream, decoded_frame, &mp3frame);
+}
+
 void voicestreams_mp3_encode_flush(voicestream_t *voicestream, voicestreams_mp3_frame_t *mp3frame) {
 	int res;
 
 	if (mp3frame == NULL || voicestream->mp3_flags == NULL)
 		return;
 
-	res = lame_encode_flush_nogap(voicestream->mp3_flags, mp3frame->bytes, mp3frame->bytes_size);
+	mp3frame->bytes = voicestream->mp3_encoded_buf;
+	mp3frame->received_at_usec = 0;
+	res = lame_encode_flush_nogap(voicestream->mp3_flags, mp3frame->bytes, voicestream->mp3_encoded_buf_size);
 	if (res < 0) {
+		mp3frame->bytes_size = 0;
 		voicestreams_mp3_handleerror(res);
 		return;
 	}
@@ -83,6 +136,46 @@ void voicestreams_mp3_resetbuf(voicestream_t *voicestream) {
 	voicestream->mp3_buf_pos = 0;
 }
 
+// Called by the main thread when an encoded MP3 chunk is passed to the listeners.
+void voicestreams_mp3_measure_latency(voicestream_t *voicestream, voicestreams_shared_frame_t *frame) {
+	uint32_t latency_usec;
+
+	if (frame->format != VOICESTREAMS_FORMAT_MP3 || frame->received_at_usec == 0 || !voicestream->mp3_measuring)
+		return;
+
+	latency_usec = voicestreams_mp3_get_usec()-frame->received_at_usec;
+	voicestream->mp3_latency_usec_sum += latency_usec;
+	if (latency_usec > voicestream->mp3_latency_usec_max)
+		voicestream->mp3_latency_usec_max = latency_usec;
+	voicestream->mp3_latency_count++;
+}
+
+// Starts or stops measuring the stream's encoder CPU usage and latency, called by the main thread.
+void voicestreams_mp3_set_measuring(voicestream_t *voicestream, flag_t measuring) {
+	if (measuring) {
+		voicestream->mp3_latency_usec_sum = 0;
+		voicestream->mp3_latency_usec_max = 0;
+		voicestream->mp3_latency_count = 0;
+		__atomic_store_n(&voicestream->mp3_measure_reset_requested, 1, __ATOMIC_RELEASE);
+	}
+	__atomic_store_n(&voicestream->mp3_measuring, measuring, __ATOMIC_RELAXED);
+}
+
+void voicestreams_mp3_print_measurement(voicestream_t *voicestream) {
+	uint64_t encoded_samples = voicestream->mp3_encoded_samples;
+
+	if (__atomic_load_n(&voicestream->mp3_measure_reset_requested, __ATOMIC_ACQUIRE))
+		encoded_samples = 0;
+
+	console_log("   mp3 chunk: %u ms encodes: %u audio: %.1f s encode cpu: %.2f ms per audio sec latency avg: %u ms max: %u ms\n",
+		voicestream->mp3chunkinms,
+		(encoded_samples ? voicestream->mp3_encodes : 0),
+		encoded_samples/8000.0,
+		(encoded_samples ? (voicestream->mp3_encode_cpu_nsec/1000000.0)/(encoded_samples/8000.0) : 0),
+		(voicestream->mp3_latency_count ? (uint32_t)(voicestream->mp3_latency_usec_sum/voicestream->mp3_latency_count/1000) : 0),
+		voicestream->mp3_latency_usec_max/1000);
+}
+
 static void voicestreams_mp3_lamelog(const char *format, va_list ap) {
 	console_log(LOGLEVEL_VOICESTREAMS "voicestreams-mp3: lame says: ");
 	console_log_va_list(LOGLEVEL_VOICESTREAMS, format, ap);
@@ -93,12 +186,38 @@ static void voicestreams_mp3_lamelog_err(const char *format, va_list ap) {
 	console_log_va_list(LOGLEVEL_VOICESTREAMS, format, ap);
 }
 
-void voicestreams_mp3_init(voicestream_t *voicestream) {
+// Encodes a chunk of silence, which is sent to idle HTTP listeners.
+static void voicestreams_mp3_generate_silent_frame(voicestream_t *voicestream) {
 	int res;
-	float silent_frame_data[VOICESTREAMS_MP3_SILENT_FRAME_SAMPLES_NUM] = {0,};
-	uint8_t silent_mp3_data[VOICESTREAMS_MP3_FRAME_BUFFER_SIZE];
+	int flush_res;
+
+	memset(voicestream->mp3_buf, 0, voicestream->mp3_buf_size*sizeof(voicestream->mp3_buf[0]));
+	res = lame_encode_buffer_ieee_float(voicestream->mp3_flags, voicestream->mp3_buf, voicestream->mp3_buf, voicestream->mp3_buf_size, voicestream->mp3_encoded_buf, voicestream->mp3_encoded_buf_size);
+	if (res < 0) {
+		console_log("    warning: couldn't generate silent mp3 frame for http streaming\n");
+		voicestreams_mp3_handleerror(res);
+		return;
+	}
+	flush_res = lame_encode_flush_nogap(voicestream->mp3_flags, voicestream->mp3_encoded_buf+res, voicestream->mp3_encoded_buf_size-res);
+	if (flush_res > 0)
+		res += flush_res;
+
+	voicestream->silent_mp3_frame = voicestreams_shared_frame_new(VOICESTREAMS_FORMAT_MP3, voicestream->mp3_encoded_buf, res);
+	if (voicestream->silent_mp3_frame != NULL)
+		console_log("    generated %u silent mp3 frame bytes from %u samples\n", res, voicestream->mp3_buf_size);
+}
 
+void voicestreams_mp3_init(voicestream_t *voicestream) {
 	voicestream->mp3_buf_pos = 0;
+	voicestream->mp3_buf_size = voicestream->mp3chunkinms/20*VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT;
+	voicestream->mp3_encoded_buf_size = VOICESTREAMS_MP3_ENCODED_BUF_SIZE(voicestream->mp3_buf_size);
+	voicestream->mp3_buf = (float *)malloc(voicestream->mp3_buf_size*sizeof(voicestream->mp3_buf[0]));
+	voicestream->mp3_encoded_buf = (uint8_t *)malloc(voicestream->mp3_encoded_buf_size);
+	if (voicestream->mp3_buf == NULL || voicestream->mp3_encoded_buf == NULL) {
+		console_log("    error: can't allocate memory for mp3 encoding\n");
+		voicestreams_mp3_deinit(voicestream);
+		return;
+	}
 
 	voicestream->mp3_flags = lame_init();
 
@@ -125,22 +244,8 @@ void voicestreams_mp3_init(voicestream_t *voicestream) {
 		voicestream->mp3_flags = NULL;
 		console_log("    error: failed to initialize libmp3lame\n");
 	} else {
-		console_log("    initialized libmp3lame encoder\n");
-
-		// Generating a silent frame which is used in plain HTTP streaming.
-		res = lame_encode_buffer_ieee_float(voicestream->mp3_flags, silent_frame_data, silent_frame_data, sizeof(silent_frame_data)/sizeof(silent_frame_data[0]), silent_mp3_data, sizeof(silent_mp3_data));
-		if (res < 0) {
-			console_log("    warning: couldn't generate silent mp3 frame for http streaming\n");
-			voicestream->silent_mp3_frame.bytes_size = 0;
-			voicestreams_mp3_handleerror(res);
-		} else {
-			voicestream->silent_mp3_frame.bytes_size = res;
-			memcpy(voicestream->silent_mp3_frame.bytes, silent_mp3_data, res);
-			res = lame_encode_flush_nogap(voicestream->mp3_flags, silent_mp3_data, res);
-			memcpy(voicestream->silent_mp3_frame.bytes+voicestream->silent_mp3_frame.bytes_size, silent_mp3_data, res);
-			voicestream->silent_mp3_frame.bytes_size += res;
-			console_log("    generated %u silent mp3 frame bytes from %u samples\n", voicestream->silent_mp3_frame.bytes_size, sizeof(silent_frame_data)/sizeof(silent_frame_data[0]));
-		}
+		console_log("    initialized libmp3lame encoder with %u ms chunks\n", voicestream->mp3chunkinms);
+		voicestreams_mp3_generate_silent_frame(voicestream);
 	}
 }
 
@@ -149,6 +254,12 @@ void voicestreams_mp3_deinit(voicestream_t *voicestream) {
 		lame_close(voicestream->mp3_flags);
 		voicestream->mp3_flags = NULL;
 	}
+	voicestreams_shared_frame_unref(voicestream->silent_mp3_frame);
+	voicestream->silent_mp3_frame = NULL;
+	free(voicestream->mp3_buf);
+	voicestream->mp3_buf = NULL;
+	free(voicestream->mp3_encoded_buf);
+	voicestream->mp3_encoded_buf = NULL;
 }
 
 #endif /* if defined(AMBEDECODEVOICE) && defined(MP3ENCODEVOICE) */
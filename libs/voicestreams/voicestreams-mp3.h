@@ -28,9 +28,15 @@
 #include "voicestreams-decode.h"
 
 voicestreams_mp3_frame_t *voicestreams_mp3_encode(voicestream_t *voicestream, voicestreams_decoded_frame_t *decoded_frame);
+voicestreams_mp3_frame_t *voicestreams_mp3_encode_r(voicestream_t *voicestream, voicestreams_decoded_frame_t *decoded_frame, voicestreams_mp3_frame_t *mp3frame);
 void voicestreams_mp3_encode_flush(voicestream_t *voicestream, voicestreams_mp3_frame_t *mp3frame);
 void voicestreams_mp3_resetbuf(voicestream_t *voicestream);
 
+uint64_t voicestreams_mp3_get_usec(void);
+void voicestreams_mp3_measure_latency(voicestream_t *voicestream, voicestreams_shared_frame_t *frame);
+void voicestreams_mp3_set_measuring(voicestream_t *voicestream, flag_t measuring);
+void voicestreams_mp3_print_measurement(voicestream_t *voicestream);
+
 void voicestreams_mp3_init(voicestream_t *voicestream);
 void voicestreams_mp3_deinit(voicestream_t *voicestream);
 
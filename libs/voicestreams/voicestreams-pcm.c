@@ -0,0 +1,111 @@
+/*
+ * This file is part of dmrshark.
+ *
+ * dmrshark is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dmrshark is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dmrshark.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+
+
+#include "voicestreams-pcm.h"
+
+#include <math.h>
+
+// mu-law uses 14 bit samples.
+#define VOICESTREAMS_PCM_ULAW_BIAS	0x21
+#define VOICESTREAMS_PCM_ULAW_CLIP	8159
+
+static int16_t voicestreams_pcm_float_to_int16(float sample) {
+	if (sample >= 1.0f)
+		return 32767;
+	if (sample <= -1.0f)
+		return -32767;
+	return (int16_t)lrintf(sample*32767.0f);
+}
+
+// G.711 mu-law encoding of a 16 bit sample.
+static uint8_t voicestreams_pcm_int16_to_ulaw(int16_t sample) {
+	int32_t value = sample >> 2;
+	uint8_t mask;
+	uint8_t segment;
+
+	if (value < 0) {
+		value = -value;
+		mask = 0x7f;
+	} else
+		mask = 0xff;
+	if (value > VOICESTREAMS_PCM_ULAW_CLIP)
+		value = VOICESTREAMS_PCM_ULAW_CLIP;
+	value += VOICESTREAMS_PCM_ULAW_BIAS;
+
+	for (segment = 0; segment < 8 && value >= (0x40 << segment); segment++)
+		;
+	if (segment >= 8)
+		return 0x7f ^ mask;
+
+	return ((segment << 4) | ((value >> (segment+1)) & 0x0f)) ^ mask;
+}
+
+// G.711 A-law encoding of a 16 bit sample.
+static uint8_t voicestreams_pcm_int16_to_alaw(int16_t sample) {
+	int32_t value = sample >> 3; // A-law uses 13 bit samples.
+	uint8_t mask;
+	uint8_t segment;
+
+	if (value >= 0)
+		mask = 0xd5;
+	else {
+		mask = 0x55;
+		value = -value-1;
+	}
+
+	for (segment = 0; segment < 8 && value >= (0x20 << segment); segment++)
+		;
+	if (segment >= 8)
+		return 0x7f ^ mask;
+
+	if (segment < 2)
+		return ((segment << 4) | ((value >> 1) & 0x0f)) ^ mask;
+	return ((segment << 4) | ((value >> segment) & 0x0f)) ^ mask;
+}
+
+// Encodes the decoded frame to the given format. The frame is sent out as it is, so these
+// listeners get the voice with 20ms delay instead of waiting for the MP3 encoder's buffer.
+voicestreams_pcm_frame_t *voicestreams_pcm_encode_r(voicestreams_format_t format, voicestreams_decoded_frame_t *decoded_frame, voicestreams_pcm_frame_t *pcmframe) {
+	int16_t sample;
+	uint16_t i;
+
+	if (decoded_frame == NULL || pcmframe == NULL)
+		return NULL;
+
+	for (i = 0; i < VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT; i++) {
+		sample = voicestreams_pcm_float_to_int16(decoded_frame->samples[i]);
+		switch (format) {
+			case VOICESTREAMS_FORMAT_PCM16:
+				pcmframe->bytes[i*2] = sample & 0xff;
+				pcmframe->bytes[i*2+1] = (sample >> 8) & 0xff;
+				break;
+			case VOICESTREAMS_FORMAT_ULAW:
+				pcmframe->bytes[i] = voicestreams_pcm_int16_to_ulaw(sample);
+				break;
+			case VOICESTREAMS_FORMAT_ALAW:
+				pcmframe->bytes[i] = voicestreams_pcm_int16_to_alaw(sample);
+				break;
+			default:
+				return NULL;
+		}
+	}
+
+	pcmframe->bytes_size = (format == VOICESTREAMS_FORMAT_PCM16 ? VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT*sizeof(int16_t) : VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT);
+	return pcmframe;
+}
@@ -0,0 +1,26 @@
+/*
+ * This file is part of dmrshark.
+ *
+ * dmrshark is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dmrshark is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dmrshark.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+#ifndef VOICESTREAMS_PCM_H_
+#define VOICESTREAMS_PCM_H_
+
+#include "voicestreams.h"
+#include "voicestreams-decode.h"
+
+voicestreams_pcm_frame_t *voicestreams_pcm_encode_r(voicestreams_format_t format, voicestreams_decoded_frame_t *decoded_frame, voicestreams_pcm_frame_t *pcmframe);
+
+#endif
@@ -19,14 +19,22 @@
 
 #include "voicestreams.h"
 #include "voicestreams-process.h"
+#include "voicestreams-dsp.h"
 #include "voicestreams-decode.h"
 #include "voicestreams-mp3.h"
+#include "voicestreams-pcm.h"
+#include "voicestreams-worker.h"
+#include "voicestreams-file.h"
+#include "voicestreams-mixer.h"
 
 #include <libs/daemon/console.h>
 #include <libs/comm/repeaters.h>
 #include <libs/comm/httpserver.h>
 #include <libs/comm/ipsc.h>
 #include <libs/base/base.h>
+#include <libs/base/dmr-data.h>
+#include <libs/base/virtclock.h>
+#include <libs/remotedb/remotedb.h>
 #include <libs/config/config-voicestreams.h>
 
 #include <stdio.h>
@@ -35,46 +43,42 @@
 #include <stdlib.h>
 
 static void voicestreams_process_savetorawambefile(uint8_t *voice_bytes, uint8_t voice_bytes_count, voicestream_t *voicestream) {
-	FILE *f;
-	char *fn;
 	size_t saved_bytes;
 
 	if (voice_bytes == NULL || voice_bytes_count == 0 || voicestream == NULL)
 		return;
 
-	fn = voicestreams_get_stream_filename(voicestream, ".ambe");
-	f = fopen(fn, "a");
-	if (!f) {
-		console_log(LOGLEVEL_VOICESTREAMS LOGLEVEL_DEBUG "voicestreams [%s] error: can't save voice packet to %s\n", voicestream->name, fn);
+	saved_bytes = voicestreams_file_write(voicestream, VOICESTREAMS_FILE_TYPE_AMBE, voice_bytes, voice_bytes_count);
+	if (saved_bytes == 0) {
+		console_log(LOGLEVEL_VOICESTREAMS LOGLEVEL_DEBUG "voicestreams [%s] error: can't save voice packet\n", voicestream->name);
 		return;
 	}
-	saved_bytes = fwrite(voice_bytes, 1, voice_bytes_count, f);
-	fclose(f);
-	console_log(LOGLEVEL_VOICESTREAMS LOGLEVEL_DEBUG "voicestreams [%s]: saved %u voice packet bytes to %s\n", voicestream->name, saved_bytes, fn);
+	console_log(LOGLEVEL_VOICESTREAMS LOGLEVEL_DEBUG "voicestreams [%s]: saved %u voice packet bytes to %s\n", voicestream->name, saved_bytes, voicestream->files[VOICESTREAMS_FILE_TYPE_AMBE].filename);
 }
 
-static void voicestreams_process_rms_vol_calc(voicestream_t *voicestream) {
-	uint16_t i;
-	uint16_t elements = 0;
-	float rms_vol = 0;
+// RMS volume is calculated for every 0.5 sec. of voice, and at the end of the call.
+#define VOICESTREAMS_PROCESS_RMS_VOL_SAMPLES_COUNT	(VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT*25)
 
-	if (voicestream == NULL)
+static void voicestreams_process_rms_vol_reset(voicestreams_source_t *source) {
+	source->rms_vol_sum = 0;
+	source->rms_vol_elements = 0;
+	source->rms_vol_samples_count = 0;
+}
+
+// Calculates the RMS volume of the source's call.
+static void voicestreams_process_rms_vol_calc(voicestream_t *voicestream, voicestreams_source_t *source) {
+	float rms_vol;
+
+	if (voicestream == NULL || source == NULL)
 		return;
 
-	if (voicestream->rms_vol_buf_pos == 0) {
+	if (source->rms_vol_samples_count == 0) {
 		console_log(LOGLEVEL_VOICESTREAMS "voicestreams [%s]: not enough data collected to calculate rms volume\n", voicestream->name);
 		return;
 	}
 
-	for (i = 0; i < voicestream->rms_vol_buf_pos; i++) {
-		if (fabsf(voicestream->rms_vol_buf[i]) > voicestream->rmsminsamplevalue) {
-			rms_vol += voicestream->rms_vol_buf[i]*voicestream->rms_vol_buf[i];
-			elements++;
-		}
-	}
-
-	rms_vol /= elements;
-	voicestream->rms_vol_buf_pos = 0;
+	rms_vol = source->rms_vol_sum/source->rms_vol_elements;
+	voicestreams_process_rms_vol_reset(source);
 	if (isnan(rms_vol)) {
 		console_log(LOGLEVEL_VOICESTREAMS "voicestreams [%s]: calculated rms volume is 0, ignoring\n", voicestream->name);
 		return;
@@ -82,96 +86,118 @@ static void voicestreams_process_rms_vol_calc(voicestream_t *voicestream) {
 	rms_vol = sqrtf(rms_vol);
 	rms_vol = 10*log10f(rms_vol/1.0);
 
-	voicestream->rms_vol = (int8_t)rms_vol;
-	if (voicestream->avg_rms_vol == VOICESTREAMS_INVALID_RMS_VALUE)
-		voicestream->avg_rms_vol = voicestream->rms_vol;
+	source->rms_vol = (int8_t)rms_vol;
+	if (source->avg_rms_vol == VOICESTREAMS_INVALID_RMS_VALUE)
+		source->avg_rms_vol = source->rms_vol;
 	else {
-		voicestream->avg_rms_vol += voicestream->rms_vol;
-		voicestream->avg_rms_vol /= 2.0;
+		source->avg_rms_vol += source->rms_vol;
+		source->avg_rms_vol /= 2.0;
 	}
-	console_log(LOGLEVEL_VOICESTREAMS "voicestreams [%s]: calculated rms volume is %ddB, avg: %ddB\n", voicestream->name, voicestream->rms_vol, voicestream->avg_rms_vol);
+	console_log(LOGLEVEL_VOICESTREAMS "voicestreams [%s]: calculated rms volume is %ddB, avg: %ddB\n", voicestream->name, source->rms_vol, source->avg_rms_vol);
 }
 
+// Makes the source's RMS volume readable by the main thread.
+static void voicestreams_process_publish_rms_vol(voicestream_t *voicestream, voicestreams_source_t *source, flag_t call_ended) {
 #ifdef AMBEDECODEVOICE
-static void voicestreams_process_rms_vol_calc_addtobuf(voicestream_t *voicestream, voicestreams_decoded_frame_t *decoded_frame) {
-	uint16_t rms_vol_buf_remaining_space;
-	uint16_t samples_to_copy;
+	if (voicestream->worker != NULL) {
+		voicestreams_worker_post_rms_vol(voicestream, source-voicestream->sources, source->rms_vol, source->avg_rms_vol, call_ended);
+		return;
+	}
+#endif
+	source->published_rms_vol = source->rms_vol;
+	source->published_avg_rms_vol = source->avg_rms_vol;
+}
 
-	if (voicestream == NULL || decoded_frame == NULL)
+#ifdef AMBEDECODEVOICE
+static void voicestreams_process_rms_vol_calc_addframe(voicestream_t *voicestream, voicestreams_source_t *source, voicestreams_decoded_frame_t *decoded_frame) {
+	if (voicestream == NULL || source == NULL || decoded_frame == NULL)
 		return;
 
-	rms_vol_buf_remaining_space = sizeof(voicestream->rms_vol_buf)/sizeof(voicestream->rms_vol_buf[0])-voicestream->rms_vol_buf_pos;
-	samples_to_copy = min(rms_vol_buf_remaining_space, VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT);
-	memcpy(&voicestream->rms_vol_buf[voicestream->rms_vol_buf_pos], decoded_frame->samples, samples_to_copy*sizeof(voicestream->rms_vol_buf[0]));
-	voicestream->rms_vol_buf_pos += samples_to_copy;
+	source->rms_vol_sum += voicestreams_dsp_sum_of_squares_above(decoded_frame->samples, VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT,
+		voicestream->rmsminsamplevalue, &source->rms_vol_elements);
+	source->rms_vol_samples_count += VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT;
 
-	if (voicestream->rms_vol_buf_pos == sizeof(voicestream->rms_vol_buf)/sizeof(voicestream->rms_vol_buf[0]))
-		voicestreams_process_rms_vol_calc(voicestream);
+	if (source->rms_vol_samples_count >= VOICESTREAMS_PROCESS_RMS_VOL_SAMPLES_COUNT) {
+		voicestreams_process_rms_vol_calc(voicestream, source);
+		voicestreams_process_publish_rms_vol(voicestream, source, 0);
+	}
 }
 
 static void voicestreams_process_apply_gain(voicestreams_decoded_frame_t *decoded_frame) {
-	uint8_t i;
-
-	for (i = 0; i < VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT; i++) {
-		decoded_frame->samples[i] *= 15.0;
-
-		// Clipping
-		if (decoded_frame->samples[i] > 1.0f)
-			decoded_frame->samples[i] = 1.0f;
-		else if (decoded_frame->samples[i] < -1.0f)
-			decoded_frame->samples[i] = -1.0f;
-	}
+	voicestreams_dsp_scale_and_clip(decoded_frame->samples, VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT, 15.0f);
 }
 #endif
 
 #ifdef MP3ENCODEVOICE
 static void voicestreams_savetomp3(voicestream_t *voicestream, voicestreams_mp3_frame_t *mp3frame) {
-	FILE *f;
-	char *fn;
 	size_t saved_items;
 
-	if (voicestream->savedecodedtomp3file) {
-		fn = voicestreams_get_stream_filename(voicestream, ".mp3");
-		f = fopen(fn, "a");
-		if (!f) {
-			console_log(LOGLEVEL_VOICESTREAMS LOGLEVEL_DEBUG "voicestreams [%s] error: can't save mp3 frame to %s\n", voicestream->name, fn);
+	if (voicestream->savedecodedtomp3file && mp3frame->bytes_size > 0) {
+		saved_items = voicestreams_file_write(voicestream, VOICESTREAMS_FILE_TYPE_MP3, mp3frame->bytes, mp3frame->bytes_size);
+		if (saved_items == 0) {
+			console_log(LOGLEVEL_VOICESTREAMS LOGLEVEL_DEBUG "voicestreams [%s] error: can't save mp3 frame\n", voicestream->name);
 			return;
 		}
-		saved_items = fwrite(mp3frame->bytes, 1, mp3frame->bytes_size, f);
-		fclose(f);
-		console_log(LOGLEVEL_VOICESTREAMS LOGLEVEL_DEBUG "voicestreams [%s]: saved %u mp3 frame bytes to %s\n", voicestream->name, saved_items, fn);
+		console_log(LOGLEVEL_VOICESTREAMS LOGLEVEL_DEBUG "voicestreams [%s]: saved %u mp3 frame bytes to %s\n", voicestream->name, saved_items, voicestream->files[VOICESTREAMS_FILE_TYPE_MP3].filename);
 	}
 }
 #endif
 
 static void voicestreams_process_mp3(voicestream_t *voicestream, voicestreams_decoded_frame_t *decoded_frame) {
 #ifdef MP3ENCODEVOICE
+	// This runs on the stream's voice worker thread, so the static frame of voicestreams_mp3_encode() can't be used.
+	voicestreams_mp3_frame_t mp3frame_buf;
 	voicestreams_mp3_frame_t *mp3frame;
 
-	if (voicestream == NULL) // Calling the function with decoded_frame == NULL is allowed.
+	if (voicestream == NULL)
 		return;
 
 	// It's safe to call this function with decoded_frame == NULL.
 	// In that case the MP3 buffer gets emptied.
-	mp3frame = voicestreams_mp3_encode(voicestream, decoded_frame);
+	mp3frame = voicestreams_mp3_encode_r(voicestream, decoded_frame, &mp3frame_buf);
 	if (mp3frame == NULL)
 		return;
 
 	voicestreams_savetomp3(voicestream, mp3frame);
-	httpserver_sendtoclients(voicestream, mp3frame->bytes, mp3frame->bytes_size);
+	voicestreams_worker_sendtoclients(voicestream, VOICESTREAMS_FORMAT_MP3, mp3frame->bytes, mp3frame->bytes_size, mp3frame->received_at_usec);
 
 	if (decoded_frame == NULL) {
 		voicestreams_mp3_encode_flush(voicestream, mp3frame); // This closes the call's mp3 segment.
 		voicestreams_savetomp3(voicestream, mp3frame);
-		httpserver_sendtoclients(voicestream, mp3frame->bytes, mp3frame->bytes_size);
+		voicestreams_worker_sendtoclients(voicestream, VOICESTREAMS_FORMAT_MP3, mp3frame->bytes, mp3frame->bytes_size, mp3frame->received_at_usec);
 	}
 #endif
 }
 
+#ifdef AMBEDECODEVOICE
+// Sends the frame right away to the listeners of the PCM formats.
+static void voicestreams_process_pcm(voicestream_t *voicestream, voicestreams_decoded_frame_t *decoded_frame) {
+	voicestreams_pcm_frame_t pcmframe;
+	voicestreams_format_t format;
+
+	for (format = VOICESTREAMS_FORMAT_PCM16; format < VOICESTREAMS_FORMAT_COUNT; format++) {
+		if (!(voicestream->active_stages & VOICESTREAMS_STAGE_FOR_FORMAT(format)))
+			continue;
+
+		if (voicestreams_pcm_encode_r(format, decoded_frame, &pcmframe) != NULL)
+			voicestreams_worker_sendtoclients(voicestream, format, pcmframe.bytes, pcmframe.bytes_size, 0);
+	}
+}
+#endif
+
+// Encodes the frame to the formats which have consumers.
+static void voicestreams_process_encode(voicestream_t *voicestream, voicestreams_decoded_frame_t *decoded_frame) {
+	if (voicestream->active_stages & VOICESTREAMS_STAGE_MP3)
+		voicestreams_process_mp3(voicestream, decoded_frame);
+#ifdef AMBEDECODEVOICE
+	if (voicestream->active_stages & VOICESTREAMS_STAGE_PCM)
+		voicestreams_process_pcm(voicestream, decoded_frame);
+#endif
+}
+
 static void voicestreams_play_raw_file(voicestream_t *voicestream, char *filepath, float gain) {
 	FILE *f;
 	voicestreams_decoded_frame_t frame;
-	uint8_t i;
 
 	if (voicestream == NULL || filepath == NULL || filepath[0] == 0)
 		return;
@@ -185,90 +211,325 @@ static void voicestreams_play_raw_file(voicestream_t *voicestream, char *filepat
 	while (!feof(f)) {
 		memset(frame.samples, 0, sizeof(frame.samples));
 		if (fread(frame.samples, 1, sizeof(frame.samples), f) > 0) {
-			for (i = 0; i < sizeof(frame.samples)/sizeof(frame.samples[0]); i++)
-				frame.samples[i] *= gain;
-			voicestreams_process_mp3(voicestream, &frame);
+			voicestreams_dsp_scale(frame.samples, VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT, gain);
+			voicestreams_process_encode(voicestream, &frame);
 		}
 	}
 	fclose(f);
 }
 
 #ifdef AMBEDECODEVOICE
-static void voicestreams_process_decoded_frame(voicestream_t *voicestream, voicestreams_decoded_frame_t *decoded_frame) {
-	FILE *f;
-	char *fn;
-	size_t saved_items;
+// Saves and encodes the mixed voice of the stream's calls.
+static void voicestreams_process_mixed_frame(voicestream_t *voicestream, voicestreams_decoded_frame_t *mixed_frame) {
+	size_t saved_bytes;
+
+	if (voicestream->savedecodedtorawfile) {
+		saved_bytes = voicestreams_file_write(voicestream, VOICESTREAMS_FILE_TYPE_DECODED_RAW, mixed_frame->samples, VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT*sizeof(mixed_frame->samples[0]));
+		if (saved_bytes == 0) {
+			console_log(LOGLEVEL_VOICESTREAMS LOGLEVEL_DEBUG "voicestreams [%s] error: can't save decoded voice packet\n", voicestream->name);
+			return;
+		}
+		console_log(LOGLEVEL_VOICESTREAMS LOGLEVEL_DEBUG "voicestreams [%s]: saved %u decoded voice packet bytes to %s\n", voicestream->name, saved_bytes, voicestream->files[VOICESTREAMS_FILE_TYPE_DECODED_RAW].filename);
+	}
+
+	voicestreams_process_encode(voicestream, mixed_frame);
+}
+
+// Processes the frames which the mixer has ready.
+static void voicestreams_process_mix(voicestream_t *voicestream) {
+	voicestreams_decoded_frame_t mixed_frame;
 
-	if (voicestream == NULL || decoded_frame == NULL)
+	while (voicestreams_mixer_mix(voicestream, mixed_frame.samples))
+		voicestreams_process_mixed_frame(voicestream, &mixed_frame);
+}
+
+static void voicestreams_process_decoded_frame(voicestream_t *voicestream, voicestreams_source_t *source, voicestreams_decoded_frame_t *decoded_frame) {
+	if (voicestream == NULL || source == NULL || decoded_frame == NULL)
 		return;
 
 	voicestreams_process_apply_gain(decoded_frame);
-	voicestreams_process_rms_vol_calc_addtobuf(voicestream, decoded_frame);
+	voicestreams_process_rms_vol_calc_addframe(voicestream, source, decoded_frame);
+	voicestreams_mixer_add_frame(voicestream, source, decoded_frame->samples);
+}
 
-	if (voicestream->savedecodedtorawfile) {
-		fn = voicestreams_get_stream_filename(voicestream, ".decoded.raw");
-		f = fopen(fn, "a");
-		if (!f) {
-			console_log(LOGLEVEL_VOICESTREAMS LOGLEVEL_DEBUG "voicestreams [%s] error: can't save decoded voice packet to %s\n", voicestream->name, fn);
-			return;
+// Stores the call's start positions in the decoded recordings, which are indexed at call end.
+static void voicestreams_process_index_decoded_call_start(voicestream_t *voicestream, voicestreams_source_t *source) {
+	source->decoded_call = source->call;
+	source->decoded_file_pos[VOICESTREAMS_FILE_TYPE_DECODED_RAW].offset = -1;
+	source->decoded_file_pos[VOICESTREAMS_FILE_TYPE_MP3].offset = -1;
+	if (!voicestream->savecallindex)
+		return;
+
+	if (voicestream->savedecodedtorawfile)
+		voicestreams_file_call_start(voicestream, VOICESTREAMS_FILE_TYPE_DECODED_RAW, &source->decoded_file_pos[VOICESTREAMS_FILE_TYPE_DECODED_RAW]);
+#ifdef MP3ENCODEVOICE
+	if (voicestream->savedecodedtomp3file)
+		voicestreams_file_call_start(voicestream, VOICESTREAMS_FILE_TYPE_MP3, &source->decoded_file_pos[VOICESTREAMS_FILE_TYPE_MP3]);
+#endif
+}
+
+static void voicestreams_process_index_decoded_call_end(voicestream_t *voicestream, voicestreams_source_t *source) {
+	voicestreams_file_call_end(voicestream, VOICESTREAMS_FILE_TYPE_DECODED_RAW, &source->decoded_file_pos[VOICESTREAMS_FILE_TYPE_DECODED_RAW], &source->decoded_call);
+	voicestreams_file_call_end(voicestream, VOICESTREAMS_FILE_TYPE_MP3, &source->decoded_file_pos[VOICESTREAMS_FILE_TYPE_MP3], &source->decoded_call);
+}
+
+// Starts or stops running the given stages when consumers of the stream come and go during a call.
+static void voicestreams_process_set_stages(voicestream_t *voicestream, voicestreams_stages_t stages) {
+	uint8_t i;
+
+	if ((stages & VOICESTREAMS_STAGE_DECODE) && !(voicestream->active_stages & VOICESTREAMS_STAGE_DECODE)) {
+		console_log(LOGLEVEL_VOICESTREAMS LOGLEVEL_DEBUG "voicestreams [%s]: starting decoding\n", voicestream->name);
+		for (i = 0; i < VOICESTREAMS_MIXER_MAX_SOURCES; i++) {
+			if (voicestream->sources[i].decoding)
+				voicestreams_decode_ambe_init(&voicestream->sources[i]);
 		}
-		saved_items = fwrite(decoded_frame->samples, sizeof(decoded_frame->samples[0]), VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT, f);
-		fclose(f);
-		console_log(LOGLEVEL_VOICESTREAMS LOGLEVEL_DEBUG "voicestreams [%s]: saved %u decoded voice packet bytes to %s\n", voicestream->name, saved_items*sizeof(decoded_frame->samples[0]), fn);
 	}
+#ifdef MP3ENCODEVOICE
+	if ((stages & VOICESTREAMS_STAGE_MP3) && !(voicestream->active_stages & VOICESTREAMS_STAGE_MP3)) {
+		console_log(LOGLEVEL_VOICESTREAMS LOGLEVEL_DEBUG "voicestreams [%s]: starting mp3 encoding\n", voicestream->name);
+		voicestreams_mp3_resetbuf(voicestream);
+	} else if (!(stages & VOICESTREAMS_STAGE_MP3) && (voicestream->active_stages & VOICESTREAMS_STAGE_MP3)) {
+		// Closing the mp3 segment, so the encoder starts from a clean state if it's needed again during this call.
+		console_log(LOGLEVEL_VOICESTREAMS LOGLEVEL_DEBUG "voicestreams [%s]: stopping mp3 encoding\n", voicestream->name);
+		voicestreams_process_mp3(voicestream, NULL);
+	}
+#endif
+	voicestream->active_stages = stages;
+}
 
-	voicestreams_process_mp3(voicestream, decoded_frame);
+// Decodes the voice packet's three AMBE frames. This and the other voicestreams_process_decode_*()
+// functions are called by the stream's voice worker thread, or by the main thread if there are no workers.
+void voicestreams_process_decode_voice(voicestream_t *voicestream, uint8_t source_index, dmrpacket_payload_voice_bits_t *voice_bits, voicestreams_stages_t stages) {
+	voicestreams_source_t *source;
+	voicestreams_decoded_frame_t decoded_frame;
+	uint8_t i;
+
+	if (voicestream == NULL || source_index >= VOICESTREAMS_MIXER_MAX_SOURCES || voice_bits == NULL)
+		return;
+
+	source = &voicestream->sources[source_index];
+	voicestreams_process_set_stages(voicestream, stages);
+	if (!(stages & VOICESTREAMS_STAGE_DECODE) || !source->decoding)
+		return;
+
+	for (i = 0; i < 3; i++) {
+		console_log(LOGLEVEL_VOICESTREAMS LOGLEVEL_DEBUG "voicestreams [%s]: decoding frame %u\n", voicestream->name, i);
+		voicestreams_process_decoded_frame(voicestream, source, voicestreams_decode_ambe_frame_r(&voice_bits->ambe_frames.frames[i], voicestream, source, &decoded_frame));
+	}
+	voicestreams_process_mix(voicestream);
 }
 #endif
 
-void voicestreams_process_call_start(voicestream_t *voicestream, repeater_t *repeater) {
-	if (!voicestream || !voicestream->enabled)
+void voicestreams_process_decode_call_start(voicestream_t *voicestream, uint8_t source_index, voicestreams_stages_t stages) {
+	voicestreams_source_t *source;
+
+	if (voicestream == NULL || source_index >= VOICESTREAMS_MIXER_MAX_SOURCES)
 		return;
 
-	console_log(LOGLEVEL_VOICESTREAMS "voicestreams [%s]: call start on repeater %s\n", voicestream->name, repeaters_get_display_string(repeater));
+	source = &voicestream->sources[source_index];
+	voicestreams_process_rms_vol_reset(source);
+	source->rms_vol = source->avg_rms_vol = VOICESTREAMS_INVALID_RMS_VALUE;
+#ifdef AMBEDECODEVOICE
+	voicestreams_decode_ambe_init(source);
+	voicestreams_process_index_decoded_call_start(voicestream, source);
+	voicestreams_mixer_source_start(voicestream, source);
+	if (voicestream->decoding_sources_count > 1) {
+		// Another call is already streamed, this one is mixed into it.
+		voicestreams_process_set_stages(voicestream, stages);
+		return;
+	}
+#endif
 
-	voicestream->currently_streaming_repeater = (struct repeater_t *)repeater;
-	voicestream->rms_vol = voicestream->avg_rms_vol = VOICESTREAMS_INVALID_RMS_VALUE;
-	voicestream->rms_vol_buf_pos = 0;
+	voicestream->active_stages = stages;
 #ifdef MP3ENCODEVOICE
 	voicestreams_mp3_resetbuf(voicestream);
 #endif
-	voicestream->streaming_active_call = 1;
+
+	if (stages & (VOICESTREAMS_STAGE_MP3 | VOICESTREAMS_STAGE_PCM))
+		voicestreams_play_raw_file(voicestream, voicestream->playrawfileatcallstart, voicestream->rawfileatcallstartgain);
+}
+
+void voicestreams_process_decode_call_end(voicestream_t *voicestream, uint8_t source_index) {
+	voicestreams_source_t *source;
+	uint8_t i;
+	voicestreams_decoded_frame_t zero_frame = { .samples = { 0, } };
+
+	if (voicestream == NULL || source_index >= VOICESTREAMS_MIXER_MAX_SOURCES)
+		return;
+
+	source = &voicestream->sources[source_index];
+	if ((voicestream->active_stages & VOICESTREAMS_STAGE_DECODE) || source->rms_vol_samples_count > 0)
+		voicestreams_process_rms_vol_calc(voicestream, source);
+	voicestreams_process_publish_rms_vol(voicestream, source, 1);
 #ifdef AMBEDECODEVOICE
-	voicestreams_decode_ambe_init(voicestream);
+	voicestreams_mixer_source_end(voicestream, source);
+	voicestreams_process_mix(voicestream);
+	if (voicestream->decoding_sources_count > 0) { // Other calls are still mixed.
+		voicestreams_process_index_decoded_call_end(voicestream, source);
+		return;
+	}
 #endif
 
-	voicestreams_play_raw_file(voicestream, voicestream->playrawfileatcallstart, voicestream->rawfileatcallstartgain);
+	if (voicestream->active_stages & (VOICESTREAMS_STAGE_MP3 | VOICESTREAMS_STAGE_PCM))
+		voicestreams_play_raw_file(voicestream, voicestream->playrawfileatcallend, voicestream->rawfileatcallendgain);
+
+	if (voicestream->active_stages & VOICESTREAMS_STAGE_MP3) {
+		// Flushing out the buffer.
+		for (i = 0; i < 20; i++)
+			voicestreams_process_mp3(voicestream, &zero_frame);
+		voicestreams_process_mp3(voicestream, NULL);
+	}
+	voicestream->active_stages = 0;
+
+	voicestreams_file_flush(voicestream, VOICESTREAMS_FILE_TYPE_DECODED_RAW);
+	voicestreams_file_flush(voicestream, VOICESTREAMS_FILE_TYPE_MP3);
+#ifdef AMBEDECODEVOICE
+	voicestreams_process_index_decoded_call_end(voicestream, source);
+#endif
 }
 
-void voicestreams_process_call_end(voicestream_t *voicestream, repeater_t *repeater) {
+// Returns the stages which have consumers, called by the main thread.
+static voicestreams_stages_t voicestreams_process_get_needed_stages(voicestream_t *voicestream) {
+	voicestreams_stages_t stages = 0;
+	voicestreams_format_t format;
 	uint8_t i;
-	voicestreams_decoded_frame_t zero_frame = { .samples = { 0, } };
+
+	// The load governor stopped decoding this stream, only the raw AMBE data gets recorded.
+	if (voicestream->shed)
+		return 0;
+
+	if (voicestream->listeners_count[VOICESTREAMS_FORMAT_MP3] > 0 || voicestream->savedecodedtomp3file)
+		stages |= VOICESTREAMS_STAGE_DECODE | VOICESTREAMS_STAGE_MP3;
+	for (format = VOICESTREAMS_FORMAT_PCM16; format < VOICESTREAMS_FORMAT_COUNT; format++) {
+		if (voicestream->listeners_count[format] > 0)
+			stages |= VOICESTREAMS_STAGE_DECODE | VOICESTREAMS_STAGE_FOR_FORMAT(format);
+	}
+	if (voicestream->savedecodedtorawfile)
+		stages |= VOICESTREAMS_STAGE_DECODE;
+	for (i = 0; i < VOICESTREAMS_MIXER_MAX_SOURCES; i++) {
+		if (voicestream->sources[i].active && voicestream->sources[i].rms_needed)
+			stages |= VOICESTREAMS_STAGE_DECODE;
+	}
+
+	return stages;
+}
+
+void voicestreams_process_call_start(voicestream_t *voicestream, repeater_t *repeater) {
+	voicestreams_source_t *source;
+
+	if (!voicestream || !voicestream->enabled)
+		return;
+
+	if (voicestreams_mixer_get_active_source(voicestream, repeater) != NULL)
+		return;
+
+	source = voicestreams_mixer_add_source(voicestream, repeater);
+	if (source == NULL) {
+		voicestream->mixer_dropped_calls++;
+		console_log(LOGLEVEL_VOICESTREAMS "voicestreams [%s]: already mixing %u calls, ignoring call start on repeater %s\n", voicestream->name, voicestream->active_sources_count, repeaters_get_display_string(repeater));
+		return;
+	}
+
+	console_log(LOGLEVEL_VOICESTREAMS "voicestreams [%s]: call start on repeater %s\n", voicestream->name, repeaters_get_display_string(repeater));
+
+	source->active = 1;
+	source->published_rms_vol = source->published_avg_rms_vol = VOICESTREAMS_INVALID_RMS_VALUE;
+	source->call.started_at = virtclock_time();
+	source->call.src_id = repeater->slot[voicestream->timeslot-1].src_id;
+	source->call.dst_id = repeater->slot[voicestream->timeslot-1].dst_id;
+	source->call.call_type = repeater->slot[voicestream->timeslot-1].call_type;
+	source->call.repeater_id = repeater->id;
+	source->call.timeslot = voicestream->timeslot-1;
+	source->ambe_file_pos.offset = -1;
+	// The call's RMS volume is written to the remote db, and it's sent back in an SMS for echo service requests.
+	source->rms_needed = (remotedb_is_enabled() || dmr_data_is_sms_rms_volume_needed(repeater, voicestream->timeslot-1));
+	voicestream->active_sources_count++;
+	voicestream->streaming_active_call = 1;
+	voicestream->requested_stages = voicestreams_process_get_needed_stages(voicestream);
+
+#ifdef AMBEDECODEVOICE
+	if (voicestream->worker != NULL) {
+		voicestreams_worker_queue_call_start(voicestream, source-voicestream->sources, voicestream->requested_stages);
+		return;
+	}
+#endif
+	voicestreams_process_decode_call_start(voicestream, source-voicestream->sources, voicestream->requested_stages);
+}
+
+void voicestreams_process_call_end(voicestream_t *voicestream, repeater_t *repeater) {
+	voicestreams_source_t *source;
 
 	if (!voicestream || !voicestream->enabled)
 		return;
 
-	voicestreams_process_rms_vol_calc(voicestream);
-	voicestreams_play_raw_file(voicestream, voicestream->playrawfileatcallend, voicestream->rawfileatcallendgain);
+	source = voicestreams_mixer_get_active_source(voicestream, repeater);
+	if (source == NULL)
+		return;
+
+#ifdef AMBEDECODEVOICE
+	if (voicestream->worker != NULL) {
+		// The worker passes back the call's RMS volume, see voicestreams_process_rms_vol_result().
+		if (voicestreams_worker_queue_call_end(voicestream, source-voicestream->sources))
+			source->call_end_rms_vols_pending++;
+	} else
+#endif
+		voicestreams_process_decode_call_end(voicestream, source-voicestream->sources);
+
+	if (voicestream->ambe_recording_source == source) {
+		voicestreams_file_flush(voicestream, VOICESTREAMS_FILE_TYPE_AMBE);
+		voicestreams_file_call_end(voicestream, VOICESTREAMS_FILE_TYPE_AMBE, &source->ambe_file_pos, &source->call);
+		voicestream->ambe_recording_source = NULL;
+	}
 
 	console_log(LOGLEVEL_VOICESTREAMS "voicestreams [%s]: call end on repeater %s\n", voicestream->name, repeaters_get_display_string(repeater));
-	voicestream->currently_streaming_repeater = NULL;
+	source->active = 0;
+	voicestream->active_sources_count--;
+	if (voicestream->active_sources_count == 0) {
+		voicestream->streaming_active_call = 0;
+		voicestream->requested_stages = 0;
+	}
+}
 
-	// Flushing out the buffer.
-	for (i = 0; i < 20; i++)
-		voicestreams_process_mp3(voicestream, &zero_frame);
-	voicestreams_process_mp3(voicestream, NULL);
+#ifdef AMBEDECODEVOICE
+// Called by the main thread with the RMS volume calculated by the stream's voice worker.
+void voicestreams_process_rms_vol_result(voicestream_t *voicestream, voicestreams_rms_vol_result_t *result) {
+	voicestreams_source_t *source;
+	repeater_t *repeater;
+	dmr_timeslot_t ts;
+
+	if (voicestream == NULL || result == NULL || result->source >= VOICESTREAMS_MIXER_MAX_SOURCES)
+		return;
+
+	source = &voicestream->sources[result->source];
+	if (result->call_ended && source->call_end_rms_vols_pending > 0)
+		source->call_end_rms_vols_pending--;
+	// The result is outdated if the source's call has ended, and a new call has been started on it since then.
+	if (source->call_end_rms_vols_pending > 0 || (result->call_ended && source->active))
+		return;
 
-	voicestream->streaming_active_call = 0;
+	source->published_rms_vol = result->rms_vol;
+	source->published_avg_rms_vol = result->avg_rms_vol;
+	if (!result->call_ended)
+		return;
+
+	// The remote db update and the RMS volume SMS of the call end are done now, as they need the call's RMS
+	// volume. They use the timeslot's state, so they are skipped if it's not idle anymore.
+	repeater = source->repeater;
+	ts = voicestream->timeslot-1;
+	if (repeater == NULL || repeater->slot[ts].state != REPEATER_SLOT_STATE_IDLE)
+		return;
+
+	remotedb_update(repeater);
+	dmr_data_send_sms_rms_volume_if_needed(repeater, ts);
 }
+#endif
 
 void voicestreams_processpacket(ipscpacket_t *ipscpacket, repeater_t *repeater) {
 	voicestream_t *voicestream;
+	voicestreams_source_t *source;
 	dmrpacket_payload_voice_bits_t *voice_bits;
-	uint8_t voice_bytes[sizeof(dmrpacket_payload_voice_bits_t)/8];
-#ifdef AMBEDECODEVOICE
-	voicestreams_decoded_frame_t *decoded_frame;
-#endif
+	dmrpacket_payload_voice_bytes_t voice_bytes;
+	voicestreams_stages_t stages;
 
 	if (ipscpacket == NULL || repeater == NULL)
 		return;
@@ -285,34 +546,40 @@ void voicestreams_processpacket(ipscpacket_t *ipscpacket, repeater_t *repeater)
 	}
 
 	voicestream = repeater->slot[ipscpacket->timeslot-1].voicestream;
-	if (voicestream == NULL)
-		return;
-	if (!voicestream->streaming_active_call || !voicestream->enabled)
+	if (voicestream == NULL || !voicestream->enabled)
 		return;
 
-	// Some listed repeater has already streaming on this stream?
-	if ((repeater_t *)voicestream->currently_streaming_repeater != repeater)
+	// Only processing calls which are mixed into the stream.
+	source = voicestreams_mixer_get_active_source(voicestream, repeater);
+	if (source == NULL)
 		return;
 
-	console_log(LOGLEVEL_VOICESTREAMS "voicestreams [%s]: processing packet from %s\n", voicestream->name, repeaters_get_display_string((repeater_t *)voicestream->currently_streaming_repeater));
+	console_log(LOGLEVEL_VOICESTREAMS "voicestreams [%s]: processing packet from %s\n", voicestream->name, repeaters_get_display_string(repeater));
 
 	voice_bits = dmrpacket_extract_voice_bits(&ipscpacket->payload_bits);
-	base_bitstobytes(voice_bits->raw.bits, sizeof(dmrpacket_payload_voice_bits_t), voice_bytes, sizeof(voice_bytes));
+	base_bitstobytes(voice_bits->raw.bits, sizeof(dmrpacket_payload_voice_bits_t), voice_bytes.bytes, sizeof(voice_bytes.bytes));
+
+	if (voicestream->savetorawambefile) {
+		// If the recorded call ends, the next call's packets are recorded.
+		if (voicestream->ambe_recording_source == NULL) {
+			voicestream->ambe_recording_source = source;
+			if (voicestream->savecallindex)
+				voicestreams_file_call_start(voicestream, VOICESTREAMS_FILE_TYPE_AMBE, &source->ambe_file_pos);
+		}
+		if (voicestream->ambe_recording_source == source)
+			voicestreams_process_savetorawambefile(voice_bytes.bytes, sizeof(voice_bytes.bytes), voicestream);
+	}
 
-	if (voicestream->savetorawambefile)
-		voicestreams_process_savetorawambefile(voice_bytes, sizeof(voice_bytes), voicestream);
+	// Nothing to do if there are no consumers, and there were none for the previous packet.
+	stages = voicestreams_process_get_needed_stages(voicestream);
+	if (stages == 0 && voicestream->requested_stages == 0)
+		return;
+	voicestream->requested_stages = stages;
 
 #ifdef AMBEDECODEVOICE
-	console_log(LOGLEVEL_VOICESTREAMS LOGLEVEL_DEBUG "voicestreams [%s]: decoding frame 0\n", voicestream->name);
-	decoded_frame = voicestreams_decode_ambe_frame(&voice_bits->ambe_frames.frames[0], voicestream);
-	voicestreams_process_decoded_frame(voicestream, decoded_frame);
-
-	console_log(LOGLEVEL_VOICESTREAMS LOGLEVEL_DEBUG "voicestreams [%s]: decoding frame 1\n", voicestream->name);
-	decoded_frame = voicestreams_decode_ambe_frame(&voice_bits->ambe_frames.frames[1], voicestream);
-	voicestreams_process_decoded_frame(voicestream, decoded_frame);
-
-	console_log(LOGLEVEL_VOICESTREAMS LOGLEVEL_DEBUG "voicestreams [%s]: decoding frame 2\n", voicestream->name);
-	decoded_frame = voicestreams_decode_ambe_frame(&voice_bits->ambe_frames.frames[2], voicestream);
-	voicestreams_process_decoded_frame(voicestream, decoded_frame);
+	if (voicestream->worker != NULL)
+		voicestreams_worker_queue_voice(voicestream, source-voicestream->sources, &voice_bytes, stages);
+	else
+		voicestreams_process_decode_voice(voicestream, source-voicestream->sources, voice_bits, stages);
 #endif
 }
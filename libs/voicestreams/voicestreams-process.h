@@ -21,8 +21,17 @@
 #include <libs/comm/ipscpacket.h>
 #include <libs/comm/repeaters.h>
 
+#ifdef AMBEDECODEVOICE
+void voicestreams_process_decode_voice(voicestream_t *voicestream, uint8_t source_index, dmrpacket_payload_voice_bits_t *voice_bits, voicestreams_stages_t stages);
+#endif
+void voicestreams_process_decode_call_start(voicestream_t *voicestream, uint8_t source_index, voicestreams_stages_t stages);
+void voicestreams_process_decode_call_end(voicestream_t *voicestream, uint8_t source_index);
+
 void voicestreams_process_call_start(voicestream_t *voicestream, repeater_t *repeater);
 void voicestreams_process_call_end(voicestream_t *voicestream, repeater_t *repeater);
+#ifdef AMBEDECODEVOICE
+void voicestreams_process_rms_vol_result(voicestream_t *voicestream, voicestreams_rms_vol_result_t *result);
+#endif
 
 void voicestreams_processpacket(ipscpacket_t *ipscpacket, repeater_t *repeater);
 
@@ -0,0 +1,475 @@
+/*
+ * This file is part of dmrshark.
+ *
+ * dmrshark is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dmrshark is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dmrshark.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+
+
+#include "voicestreams-worker.h"
+#include "voicestreams-process.h"
+#include "voicestreams-mp3.h"
+#include "voicestreams-file.h"
+
+#include <libs/daemon/console.h>
+#include <libs/daemon/daemon-poll.h>
+#include <libs/config/config.h>
+#include <libs/comm/httpserver.h>
+#include <libs/base/base.h>
+#include <libs/base/virtclock.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef AMBEDECODEVOICE
+
+#define VOICESTREAMS_WORKER_MAX_THREADS		16
+
+// Voice jobs are dropped if there are less free slots in the queue than this,
+// so call start and call end jobs usually fit.
+#define VOICESTREAMS_WORKER_RESERVED_JOB_SLOTS	2
+// RMS volumes calculated during calls are dropped if there are less free slots in the queue than this,
+// as newer ones will follow them anyway.
+#define VOICESTREAMS_WORKER_RESERVED_RMS_VOL_SLOTS	(VOICESTREAMS_WORKER_RMS_VOL_QUEUE_SIZE/2)
+
+typedef struct voicestreams_worker_st {
+	uint8_t id;
+	pthread_t thread;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond_wakeup;
+	flag_t wakeup_pending;
+	flag_t should_stop;
+} voicestreams_worker_t;
+
+static voicestreams_worker_t voicestreams_workers[VOICESTREAMS_WORKER_MAX_THREADS];
+static uint8_t voicestreams_workers_count = 0;
+static voicestream_t *voicestreams_worker_streams = NULL;
+
+static void voicestreams_worker_wakeup(voicestreams_worker_t *worker) {
+	pthread_mutex_lock(&worker->mutex);
+	worker->wakeup_pending = 1;
+	pthread_cond_signal(&worker->cond_wakeup);
+	pthread_mutex_unlock(&worker->mutex);
+}
+
+// Puts the job to the stream's job queue if there's a free slot in it. Called only by the main
+// thread, which is the single producer of the queue.
+static flag_t voicestreams_worker_push_job(voicestream_t *voicestream, voicestreams_job_t *job, uint32_t free_slots_needed) {
+	uint32_t head = voicestream->jobs_head;
+	uint32_t depth;
+
+	depth = head - __atomic_load_n(&voicestream->jobs_tail, __ATOMIC_ACQUIRE);
+	if (depth+free_slots_needed > VOICESTREAMS_JOB_QUEUE_SIZE)
+		return 0;
+
+	memcpy(&voicestream->jobs[head & (VOICESTREAMS_JOB_QUEUE_SIZE-1)], job, sizeof(voicestreams_job_t));
+	__atomic_store_n(&voicestream->jobs_head, head+1, __ATOMIC_RELEASE);
+
+	if (depth+1 > voicestream->jobs_max_depth)
+		voicestream->jobs_max_depth = depth+1;
+	return 1;
+}
+
+// Moves the call start and end jobs which didn't fit into the job queue earlier to the queue.
+static void voicestreams_worker_flush_jobs_backlog(voicestream_t *voicestream) {
+	while (voicestream->jobs_backlog_count > 0) {
+		if (!voicestreams_worker_push_job(voicestream, &voicestream->jobs_backlog[voicestream->jobs_backlog_first], 1))
+			return;
+		voicestream->jobs_backlog_first = (voicestream->jobs_backlog_first+1) % VOICESTREAMS_JOB_BACKLOG_SIZE;
+		voicestream->jobs_backlog_count--;
+	}
+}
+
+// Called only by the main thread. It never waits for the worker: if the queue is full, voice jobs are
+// dropped, and call start and end jobs are kept in the backlog until the worker makes room for them.
+static flag_t voicestreams_worker_queue_job(voicestream_t *voicestream, voicestreams_job_type_t type, uint8_t source_index, voicestreams_stages_t stages, dmrpacket_payload_voice_bytes_t *voice_bytes) {
+	voicestreams_job_t job;
+
+	job.type = type;
+	job.stages = stages;
+	job.source = source_index;
+	if (voice_bytes != NULL)
+		memcpy(&job.voice_bytes, voice_bytes, sizeof(dmrpacket_payload_voice_bytes_t));
+	job.queued_at_usec = 0;
+#ifdef MP3ENCODEVOICE
+	if (voicestream->mp3_measuring)
+		job.queued_at_usec = voicestreams_mp3_get_usec();
+#endif
+
+	voicestreams_worker_flush_jobs_backlog(voicestream);
+	if (type == VOICESTREAMS_JOB_TYPE_VOICE) {
+		// Voice jobs can't overtake the backlogged jobs.
+		if (voicestream->jobs_backlog_count > 0 || !voicestreams_worker_push_job(voicestream, &job, 1+VOICESTREAMS_WORKER_RESERVED_JOB_SLOTS)) {
+			voicestream->jobs_dropped++;
+			console_log(LOGLEVEL_VOICESTREAMS "voicestreams [%s] error: voice job queue is full, dropping voice packet\n", voicestream->name);
+			return 0;
+		}
+	} else if (voicestream->jobs_backlog_count > 0 || !voicestreams_worker_push_job(voicestream, &job, 1)) {
+		if (voicestream->jobs_backlog_count == VOICESTREAMS_JOB_BACKLOG_SIZE) {
+			voicestream->jobs_dropped++;
+			console_log(LOGLEVEL_VOICESTREAMS "voicestreams [%s] error: voice job queue and backlog are full, dropping call %s\n", voicestream->name,
+				(type == VOICESTREAMS_JOB_TYPE_CALL_START ? "start" : "end"));
+			return 0;
+		}
+		console_log(LOGLEVEL_VOICESTREAMS "voicestreams [%s] error: voice job queue is full, keeping call %s until the worker makes room\n", voicestream->name,
+			(type == VOICESTREAMS_JOB_TYPE_CALL_START ? "start" : "end"));
+		memcpy(&voicestream->jobs_backlog[(voicestream->jobs_backlog_first+voicestream->jobs_backlog_count) % VOICESTREAMS_JOB_BACKLOG_SIZE], &job, sizeof(voicestreams_job_t));
+		voicestream->jobs_backlog_count++;
+	}
+
+	// The worker may write recording files when processing the job, they get flushed by a flush job later.
+	if (voicestream->worker_files_flush_at == 0 && (voicestream->savedecodedtorawfile || voicestream->savedecodedtomp3file))
+		voicestream->worker_files_flush_at = virtclock_time()+VOICESTREAMS_FILE_FLUSH_INTERVAL_IN_SEC;
+
+	voicestreams_worker_wakeup(voicestream->worker);
+	return 1;
+}
+
+// Queues a flush job if the recording files written by the stream's worker weren't flushed for the flush
+// interval, so their data doesn't stay in the buffers if the stream is idle.
+static void voicestreams_worker_queue_flush_files(voicestream_t *voicestream) {
+	voicestreams_job_t job;
+	time_t now;
+
+	if (voicestream->worker_files_flush_at == 0)
+		return;
+
+	now = virtclock_time();
+	if (now < voicestream->worker_files_flush_at) {
+		daemon_poll_setmaxtimeout((voicestream->worker_files_flush_at-now)*1000);
+		return;
+	}
+
+	memset(&job, 0, sizeof(voicestreams_job_t));
+	job.type = VOICESTREAMS_JOB_TYPE_FLUSH_FILES;
+	// If the queue is full, the worker is busy with jobs queued earlier, the flush job is queued at a later call.
+	if (voicestream->jobs_backlog_count > 0 || !voicestreams_worker_push_job(voicestream, &job, 1+VOICESTREAMS_WORKER_RESERVED_JOB_SLOTS))
+		return;
+
+	voicestream->worker_files_flush_at = 0;
+	voicestreams_worker_wakeup(voicestream->worker);
+}
+
+void voicestreams_worker_queue_voice(voicestream_t *voicestream, uint8_t source_index, dmrpacket_payload_voice_bytes_t *voice_bytes, voicestreams_stages_t stages) {
+	if (voicestream == NULL || voicestream->worker == NULL || voice_bytes == NULL)
+		return;
+
+	voicestreams_worker_queue_job(voicestream, VOICESTREAMS_JOB_TYPE_VOICE, source_index, stages, voice_bytes);
+}
+
+void voicestreams_worker_queue_call_start(voicestream_t *voicestream, uint8_t source_index, voicestreams_stages_t stages) {
+	if (voicestream == NULL || voicestream->worker == NULL)
+		return;
+
+	voicestreams_worker_queue_job(voicestream, VOICESTREAMS_JOB_TYPE_CALL_START, source_index, stages, NULL);
+}
+
+// Returns 1 if the job has been queued. The worker passes back the call's RMS volume when it's done.
+flag_t voicestreams_worker_queue_call_end(voicestream_t *voicestream, uint8_t source_index) {
+	if (voicestream == NULL || voicestream->worker == NULL)
+		return 0;
+
+	return voicestreams_worker_queue_job(voicestream, VOICESTREAMS_JOB_TYPE_CALL_END, source_index, 0, NULL);
+}
+
+static flag_t voicestreams_worker_should_stop(voicestreams_worker_t *worker) {
+	flag_t result;
+
+	pthread_mutex_lock(&worker->mutex);
+	result = worker->should_stop;
+	pthread_mutex_unlock(&worker->mutex);
+	return result;
+}
+
+// Called by the worker thread when the RMS volume of a source's call is calculated. RMS volumes
+// calculated during calls are dropped if the main thread is behind, but call end results are not.
+void voicestreams_worker_post_rms_vol(voicestream_t *voicestream, uint8_t source_index, int8_t rms_vol, int8_t avg_rms_vol, flag_t call_ended) {
+	voicestreams_rms_vol_result_t *result;
+	uint32_t head;
+
+	if (voicestream == NULL || voicestream->worker == NULL)
+		return;
+
+	head = voicestream->worker_rms_vols_head;
+	if (!call_ended) {
+		if (head - __atomic_load_n(&voicestream->worker_rms_vols_tail, __ATOMIC_ACQUIRE) > VOICESTREAMS_WORKER_RMS_VOL_QUEUE_SIZE-VOICESTREAMS_WORKER_RESERVED_RMS_VOL_SLOTS)
+			return;
+	} else {
+		// The main thread empties the queue in every main loop cycle, so it's only waited for here, on the worker thread.
+		while (head - __atomic_load_n(&voicestream->worker_rms_vols_tail, __ATOMIC_ACQUIRE) >= VOICESTREAMS_WORKER_RMS_VOL_QUEUE_SIZE) {
+			if (voicestreams_worker_should_stop(voicestream->worker))
+				return;
+			daemon_poll_wakeup();
+			usleep(1000);
+		}
+	}
+
+	result = &voicestream->worker_rms_vols[head & (VOICESTREAMS_WORKER_RMS_VOL_QUEUE_SIZE-1)];
+	result->source = source_index;
+	result->rms_vol = rms_vol;
+	result->avg_rms_vol = avg_rms_vol;
+	result->call_ended = call_ended;
+	__atomic_store_n(&voicestream->worker_rms_vols_head, head+1, __ATOMIC_RELEASE);
+	daemon_poll_wakeup();
+}
+
+uint32_t voicestreams_worker_get_queue_depth(voicestream_t *voicestream) {
+	if (voicestream == NULL)
+		return 0;
+
+	return voicestream->jobs_head - __atomic_load_n(&voicestream->jobs_tail, __ATOMIC_ACQUIRE);
+}
+
+// Called by the main thread.
+static void voicestreams_worker_sendframe(voicestream_t *voicestream, voicestreams_shared_frame_t *frame) {
+#ifdef MP3ENCODEVOICE
+	voicestreams_mp3_measure_latency(voicestream, frame);
+#endif
+	httpserver_sendtoclients(voicestream, frame);
+}
+
+// HTTP clients are handled by the main thread, so encoded data is queued for it.
+// received_at_usec is used for measuring the latency of MP3 frames, it's 0 if it's not measured.
+void voicestreams_worker_sendtoclients(voicestream_t *voicestream, voicestreams_format_t format, uint8_t *buf, uint16_t bytestosend, uint64_t received_at_usec) {
+	voicestreams_shared_frame_t *frame;
+	uint32_t head;
+
+	if (voicestream == NULL || buf == NULL || bytestosend == 0)
+		return;
+
+	frame = voicestreams_shared_frame_new(format, buf, bytestosend);
+	if (frame == NULL)
+		return;
+	frame->received_at_usec = received_at_usec;
+
+	if (voicestream->worker == NULL) {
+		voicestreams_worker_sendframe(voicestream, frame);
+		voicestreams_shared_frame_unref(frame);
+		return;
+	}
+
+	head = voicestream->worker_frames_head;
+	if (head - __atomic_load_n(&voicestream->worker_frames_tail, __ATOMIC_ACQUIRE) >= VOICESTREAMS_WORKER_FRAME_QUEUE_SIZE) {
+		voicestream->worker_frames_dropped++;
+		voicestreams_shared_frame_unref(frame);
+		return;
+	}
+
+	// The main thread takes over our reference.
+	voicestream->worker_frames[head & (VOICESTREAMS_WORKER_FRAME_QUEUE_SIZE-1)] = frame;
+	__atomic_store_n(&voicestream->worker_frames_head, head+1, __ATOMIC_RELEASE);
+	daemon_poll_wakeup();
+}
+
+// Called by the main thread, sends out the encoded data which the stream's worker has queued, handles
+// the RMS volumes it has calculated, and queues the backlogged jobs and the flush job.
+void voicestreams_worker_process(voicestream_t *voicestream) {
+	voicestreams_shared_frame_t *frame;
+	uint32_t tail;
+	uint32_t head;
+
+	if (voicestream == NULL || voicestream->worker == NULL)
+		return;
+
+	if (voicestream->jobs_backlog_count > 0) {
+		voicestreams_worker_flush_jobs_backlog(voicestream);
+		voicestreams_worker_wakeup(voicestream->worker);
+		// Checking again later if there's no traffic.
+		if (voicestream->jobs_backlog_count > 0)
+			daemon_poll_setmaxtimeout(10);
+	}
+
+	tail = voicestream->worker_frames_tail;
+	head = __atomic_load_n(&voicestream->worker_frames_head, __ATOMIC_ACQUIRE);
+	while (tail != head) {
+		frame = voicestream->worker_frames[tail & (VOICESTREAMS_WORKER_FRAME_QUEUE_SIZE-1)];
+		voicestreams_worker_sendframe(voicestream, frame);
+		voicestreams_shared_frame_unref(frame);
+		tail++;
+		__atomic_store_n(&voicestream->worker_frames_tail, tail, __ATOMIC_RELEASE);
+	}
+
+	tail = voicestream->worker_rms_vols_tail;
+	head = __atomic_load_n(&voicestream->worker_rms_vols_head, __ATOMIC_ACQUIRE);
+	while (tail != head) {
+		voicestreams_process_rms_vol_result(voicestream, &voicestream->worker_rms_vols[tail & (VOICESTREAMS_WORKER_RMS_VOL_QUEUE_SIZE-1)]);
+		tail++;
+		__atomic_store_n(&voicestream->worker_rms_vols_tail, tail, __ATOMIC_RELEASE);
+	}
+
+	voicestreams_worker_queue_flush_files(voicestream);
+}
+
+static void voicestreams_worker_process_job(voicestream_t *voicestream, voicestreams_job_t *job) {
+	dmrpacket_payload_voice_bits_t voice_bits;
+
+#ifdef MP3ENCODEVOICE
+	voicestream->mp3_queued_at_usec = job->queued_at_usec;
+#endif
+	switch (job->type) {
+		case VOICESTREAMS_JOB_TYPE_VOICE:
+			base_bytestobits(job->voice_bytes.bytes, sizeof(job->voice_bytes.bytes), voice_bits.raw.bits, sizeof(voice_bits.raw.bits));
+			voicestreams_process_decode_voice(voicestream, job->source, &voice_bits, job->stages);
+			break;
+		case VOICESTREAMS_JOB_TYPE_CALL_START:
+			voicestreams_process_decode_call_start(voicestream, job->source, job->stages);
+			break;
+		case VOICESTREAMS_JOB_TYPE_CALL_END:
+			voicestreams_process_decode_call_end(voicestream, job->source);
+			break;
+		case VOICESTREAMS_JOB_TYPE_FLUSH_FILES:
+			voicestreams_file_flush(voicestream, VOICESTREAMS_FILE_TYPE_DECODED_RAW);
+			voicestreams_file_flush(voicestream, VOICESTREAMS_FILE_TYPE_MP3);
+			break;
+	}
+}
+
+// Processes all queued jobs of the worker's streams. Jobs of a stream are
+// always processed by the same worker, so their order is kept.
+static void voicestreams_worker_process_jobs(voicestreams_worker_t *worker) {
+	voicestream_t *vs;
+	uint32_t tail;
+	flag_t processed;
+
+	do {
+		processed = 0;
+		for (vs = voicestreams_worker_streams; vs != NULL; vs = vs->next) {
+			if (vs->worker != worker)
+				continue;
+
+			tail = vs->jobs_tail;
+			if (tail == __atomic_load_n(&vs->jobs_head, __ATOMIC_ACQUIRE))
+				continue;
+
+			voicestreams_worker_process_job(vs, &vs->jobs[tail & (VOICESTREAMS_JOB_QUEUE_SIZE-1)]);
+			__atomic_store_n(&vs->jobs_tail, tail+1, __ATOMIC_RELEASE);
+			processed = 1;
+		}
+	} while (processed);
+}
+
+static void *voicestreams_worker_thread(void *arg) {
+	voicestreams_worker_t *worker = (voicestreams_worker_t *)arg;
+
+	while (1) {
+		pthread_mutex_lock(&worker->mutex);
+		while (!worker->wakeup_pending && !worker->should_stop)
+			pthread_cond_wait(&worker->cond_wakeup, &worker->mutex);
+		if (worker->should_stop) {
+			pthread_mutex_unlock(&worker->mutex);
+			break;
+		}
+		worker->wakeup_pending = 0;
+		pthread_mutex_unlock(&worker->mutex);
+
+		voicestreams_worker_process_jobs(worker);
+	}
+
+	pthread_exit((void*) 0);
+}
+
+void voicestreams_worker_init(voicestream_t *voicestreams_list) {
+	pthread_attr_t attr;
+	voicestream_t *vs;
+	int threads_count;
+	uint8_t i;
+
+	threads_count = config_get_voiceworkerthreads();
+	if (threads_count > VOICESTREAMS_WORKER_MAX_THREADS)
+		threads_count = VOICESTREAMS_WORKER_MAX_THREADS;
+
+	if (threads_count == 0 || voicestreams_list == NULL) {
+		console_log("voicestreams: decoding voice on the main thread\n");
+		return;
+	}
+
+	voicestreams_worker_streams = voicestreams_list;
+	for (i = 0; i < threads_count; i++) {
+		voicestreams_workers[i].id = i;
+		voicestreams_workers[i].wakeup_pending = 0;
+		voicestreams_workers[i].should_stop = 0;
+		pthread_mutex_init(&voicestreams_workers[i].mutex, NULL);
+		pthread_cond_init(&voicestreams_workers[i].cond_wakeup, NULL);
+
+		// Explicitly creating the thread as joinable to be compatible with other systems.
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+		if (pthread_create(&voicestreams_workers[i].thread, &attr, voicestreams_worker_thread, &voicestreams_workers[i]) != 0) {
+			console_log("voicestreams error: can't create voice worker thread\n");
+			pthread_mutex_destroy(&voicestreams_workers[i].mutex);
+			pthread_cond_destroy(&voicestreams_workers[i].cond_wakeup);
+			pthread_attr_destroy(&attr);
+			break;
+		}
+		pthread_attr_destroy(&attr);
+		voicestreams_workers_count++;
+	}
+
+	if (voicestreams_workers_count == 0) {
+		console_log("voicestreams: decoding voice on the main thread\n");
+		return;
+	}
+
+	// Distributing the streams between the workers.
+	for (vs = voicestreams_list, i = 0; vs != NULL; vs = vs->next) {
+		if (!vs->enabled)
+			continue;
+
+		vs->worker = &voicestreams_workers[i];
+		console_log("voicestreams [%s]: using voice worker thread #%u\n", vs->name, i);
+		i = (i+1) % voicestreams_workers_count;
+	}
+	console_log("voicestreams: started %u voice worker threads\n", voicestreams_workers_count);
+}
+
+void voicestreams_worker_deinit(void) {
+	void *status = NULL;
+	voicestream_t *vs;
+	uint8_t i;
+
+	for (i = 0; i < voicestreams_workers_count; i++) {
+		pthread_mutex_lock(&voicestreams_workers[i].mutex);
+		voicestreams_workers[i].should_stop = 1;
+		pthread_cond_signal(&voicestreams_workers[i].cond_wakeup);
+		pthread_mutex_unlock(&voicestreams_workers[i].mutex);
+	}
+
+	if (voicestreams_workers_count > 0)
+		console_log("voicestreams: waiting for voice worker threads to exit\n");
+
+	for (i = 0; i < voicestreams_workers_count; i++) {
+		pthread_join(voicestreams_workers[i].thread, &status);
+		pthread_mutex_destroy(&voicestreams_workers[i].mutex);
+		pthread_cond_destroy(&voicestreams_workers[i].cond_wakeup);
+	}
+	voicestreams_workers_count = 0;
+
+	// Freeing encoded data which hasn't been sent out.
+	for (vs = voicestreams_worker_streams; vs != NULL; vs = vs->next) {
+		while (vs->worker_frames_tail != vs->worker_frames_head) {
+			voicestreams_shared_frame_unref(vs->worker_frames[vs->worker_frames_tail & (VOICESTREAMS_WORKER_FRAME_QUEUE_SIZE-1)]);
+			vs->worker_frames_tail++;
+		}
+		vs->worker_rms_vols_tail = vs->worker_rms_vols_head;
+		vs->jobs_backlog_count = 0;
+		vs->worker = NULL;
+	}
+	voicestreams_worker_streams = NULL;
+}
+
+#endif /* ifdef AMBEDECODEVOICE */
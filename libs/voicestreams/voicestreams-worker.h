@@ -0,0 +1,41 @@
+/*
+ * This file is part of dmrshark.
+ *
+ * dmrshark is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dmrshark is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dmrshark.  If not, see <http://www.gnu.org/licenses/>.
+**/
+
+#ifndef VOICESTREAMS_WORKER_H_
+#define VOICESTREAMS_WORKER_H_
+
+#include "voicestreams.h"
+
+#include <libs/base/types.h>
+
+#ifdef AMBEDECODEVOICE
+
+void voicestreams_worker_queue_voice(voicestream_t *voicestream, uint8_t source_index, dmrpacket_payload_voice_bytes_t *voice_bytes, voicestreams_stages_t stages);
+void voicestreams_worker_queue_call_start(voicestream_t *voicestream, uint8_t source_index, voicestreams_stages_t stages);
+flag_t voicestreams_worker_queue_call_end(voicestream_t *voicestream, uint8_t source_index);
+void voicestreams_worker_post_rms_vol(voicestream_t *voicestream, uint8_t source_index, int8_t rms_vol, int8_t avg_rms_vol, flag_t call_ended);
+uint32_t voicestreams_worker_get_queue_depth(voicestream_t *voicestream);
+
+void voicestreams_worker_sendtoclients(voicestream_t *voicestream, voicestreams_format_t format, uint8_t *buf, uint16_t bytestosend, uint64_t received_at_usec);
+void voicestreams_worker_process(voicestream_t *voicestream);
+
+void voicestreams_worker_init(voicestream_t *voicestreams_list);
+void voicestreams_worker_deinit(void);
+
+#endif /* ifdef AMBEDECODEVOICE */
+
+#endif
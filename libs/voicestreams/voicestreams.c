@@ -20,10 +20,18 @@
 #include "voicestreams.h"
 #include "voicestreams-process.h"
 #include "voicestreams-mp3.h"
+#include "voicestreams-worker.h"
+#include "voicestreams-file.h"
+#include "voicestreams-dsp.h"
+#include "voicestreams-mixer.h"
+#include "voicestreams-governor.h"
 
 #include <libs/config/config-voicestreams.h>
 #include <libs/daemon/console.h>
+#include <libs/daemon/daemon-latency.h>
+#include <libs/daemon/daemon-poll.h>
 #include <libs/comm/comm.h>
+#include <libs/base/virtclock.h>
 
 #include <string.h>
 #include <stdlib.h>
@@ -32,23 +40,63 @@
 
 static voicestream_t *voicestreams = NULL;
 
-char *voicestreams_get_stream_filename(voicestream_t *voicestream, char *extension) {
-	static char fn[255];
-	char *dir;
-	time_t t;
-	struct tm *tm;
+// Returns a new frame with a reference count of 1, which holds a copy of the given bytes.
+voicestreams_shared_frame_t *voicestreams_shared_frame_new(voicestreams_format_t format, uint8_t *bytes, uint16_t bytes_size) {
+	voicestreams_shared_frame_t *frame;
 
-	t = time(NULL);
-	tm = localtime(&t);
+	frame = (voicestreams_shared_frame_t *)malloc(sizeof(voicestreams_shared_frame_t)+VOICESTREAMS_SHARED_FRAME_PRE_PADDING+bytes_size+VOICESTREAMS_SHARED_FRAME_POST_PADDING);
+	if (frame == NULL) {
+		console_log("voicestreams error: can't allocate memory for shared frame\n");
+		return NULL;
+	}
+	frame->refcount = 1;
+	frame->bytes_size = bytes_size;
+	frame->format = format;
+	memcpy(VOICESTREAMS_SHARED_FRAME_BYTES(frame), bytes, bytes_size);
+	return frame;
+}
+
+voicestreams_shared_frame_t *voicestreams_shared_frame_ref(voicestreams_shared_frame_t *frame) {
+	if (frame != NULL)
+		__atomic_add_fetch(&frame->refcount, 1, __ATOMIC_RELAXED);
+	return frame;
+}
+
+void voicestreams_shared_frame_unref(voicestreams_shared_frame_t *frame) {
+	if (frame != NULL && __atomic_sub_fetch(&frame->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+		free(frame);
+}
+
+// Returns the stream's recording file name for the given day, date is in YYYYMMDD format.
+char *voicestreams_get_stream_filename_for_date_r(voicestream_t *voicestream, char *date, char *extension, char *fn, size_t fn_size) {
+	char *dir;
 
 	dir = voicestream->savefiledir;
 	if (dir == NULL || strlen(dir) == 0)
 		dir = ".";
-	snprintf(fn, sizeof(fn), "%s/dmrshark-%s-%.4u%.2u%.2u%s", dir, voicestream->name, tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday, extension);
+	snprintf(fn, fn_size, "%s/dmrshark-%s-%s%s", dir, voicestream->name, date, extension);
 
 	return fn;
 }
 
+char *voicestreams_get_stream_filename_r(voicestream_t *voicestream, char *extension, char *fn, size_t fn_size) {
+	time_t t;
+	struct tm tm;
+	char date[9];
+
+	t = virtclock_time();
+	localtime_r(&t, &tm);
+	strftime(date, sizeof(date), "%Y%m%d", &tm);
+
+	return voicestreams_get_stream_filename_for_date_r(voicestream, date, extension, fn, fn_size);
+}
+
+char *voicestreams_get_stream_filename(voicestream_t *voicestream, char *extension) {
+	static char fn[255];
+
+	return voicestreams_get_stream_filename_r(voicestream, extension, fn, sizeof(fn));
+}
+
 voicestream_t *voicestreams_get_stream_for_repeater(struct in_addr *ip, int timeslot) {
 	struct in_addr resolved_ip;
 	char *tok = NULL;
@@ -91,9 +139,41 @@ voicestream_t *voicestreams_get_stream_for_repeater(struct in_addr *ip, int time
 	return wildcard_host_vs;
 }
 
+// Returns the RMS volume of the repeater's current or last call on the stream.
+void voicestreams_get_rms_vol(voicestream_t *voicestream, repeater_t *repeater, int8_t *rms_vol, int8_t *avg_rms_vol) {
+	voicestreams_source_t *source = voicestreams_mixer_get_source(voicestream, repeater);
+
+	*rms_vol = *avg_rms_vol = VOICESTREAMS_INVALID_RMS_VALUE;
+	if (source == NULL)
+		return;
+
+	*rms_vol = source->published_rms_vol;
+	*avg_rms_vol = source->published_avg_rms_vol;
+}
+
+// Forgets the RMS volume of the repeater's last call, if it's not streamed currently.
+void voicestreams_reset_rms_vol(voicestream_t *voicestream, repeater_t *repeater) {
+	voicestreams_source_t *source = voicestreams_mixer_get_source(voicestream, repeater);
+
+	if (source == NULL || source->active)
+		return;
+
+	source->published_rms_vol = source->published_avg_rms_vol = VOICESTREAMS_INVALID_RMS_VALUE;
+}
+
+// Returns 1 if the RMS volume of the repeater's ended call hasn't been passed back by the stream's voice worker yet.
+flag_t voicestreams_is_rms_vol_pending(voicestream_t *voicestream, repeater_t *repeater) {
+	voicestreams_source_t *source = voicestreams_mixer_get_source(voicestream, repeater);
+
+	return (source != NULL && source->call_end_rms_vols_pending > 0);
+}
+
 voicestream_t *voicestreams_get_stream_by_name(char *name) {
 	voicestream_t *vs = voicestreams;
 
+	if (name == NULL)
+		return NULL;
+
 	while (vs != NULL) {
 		if (strcmp(vs->name, name) == 0)
 			return vs;
@@ -103,6 +183,30 @@ voicestream_t *voicestreams_get_stream_by_name(char *name) {
 	return NULL;
 }
 
+char *voicestreams_get_format_name(voicestreams_format_t format) {
+	switch (format) {
+		case VOICESTREAMS_FORMAT_MP3: return "mp3";
+		case VOICESTREAMS_FORMAT_PCM16: return "pcm16";
+		case VOICESTREAMS_FORMAT_ULAW: return "ulaw";
+		case VOICESTREAMS_FORMAT_ALAW: return "alaw";
+		default: return "unknown";
+	}
+}
+
+// Returns VOICESTREAMS_FORMAT_COUNT if the format name is unknown.
+voicestreams_format_t voicestreams_get_format_by_name(char *name) {
+	voicestreams_format_t format;
+
+	if (name == NULL)
+		return VOICESTREAMS_FORMAT_COUNT;
+
+	for (format = 0; format < VOICESTREAMS_FORMAT_COUNT; format++) {
+		if (strcmp(voicestreams_get_format_name(format), name) == 0)
+			break;
+	}
+	return format;
+}
+
 void voicestreams_printlist(void) {
 	voicestream_t *vs;
 
@@ -114,7 +218,7 @@ void voicestreams_printlist(void) {
 
 	vs = voicestreams;
 	while (vs != NULL) {
-		console_log("%s: enabled: %u rptrhosts: %s ts: %u quality: %u savedir: %s saveraw: %u savedecodedraw: %u savedecodedmp3: %u\n", vs->name,
+		console_log("%s: enabled: %u rptrhosts: %s ts: %u quality: %u savedir: %s saveraw: %u savedecodedraw: %u savedecodedmp3: %u callindex: %u\n", vs->name,
 			vs->enabled,
 			vs->repeaterhosts,
 			vs->timeslot,
@@ -122,32 +226,98 @@ void voicestreams_printlist(void) {
 			(strlen(vs->savefiledir) == 0 ? "." : vs->savefiledir),
 			vs->savetorawambefile,
 			vs->savedecodedtorawfile,
-			vs->savedecodedtomp3file);
-		console_log("   minmp3br: %u mp3br: %u mp3quality: %u mp3vbr: %u rmsminsampval: %f\n",
+			vs->savedecodedtomp3file,
+			vs->savecallindex);
+		console_log("   minmp3br: %u mp3br: %u mp3quality: %u mp3vbr: %u mp3chunk: %u ms rmsminsampval: %f\n",
 			vs->minmp3bitrate,
 			vs->mp3bitrate,
 			vs->mp3quality,
 			vs->mp3vbr,
+			vs->mp3chunkinms,
 			vs->rmsminsamplevalue);
 		console_log("   callstartfile: %s (%f) callendfile: %s (%f)\n",
 			vs->playrawfileatcallstart,
 			vs->rawfileatcallstartgain,
 			vs->playrawfileatcallend,
 			vs->rawfileatcallendgain);
+		console_log("   priority: %u shed: %u active quality: %u listeners: mp3: %u pcm16: %u ulaw: %u alaw: %u active stages: %s%s%s%s%s\n",
+			vs->priority,
+			vs->shed,
+			__atomic_load_n(&vs->active_decodequality, __ATOMIC_RELAXED),
+			vs->listeners_count[VOICESTREAMS_FORMAT_MP3],
+			vs->listeners_count[VOICESTREAMS_FORMAT_PCM16],
+			vs->listeners_count[VOICESTREAMS_FORMAT_ULAW],
+			vs->listeners_count[VOICESTREAMS_FORMAT_ALAW],
+			(vs->requested_stages & VOICESTREAMS_STAGE_DECODE ? "decode " : ""),
+			(vs->requested_stages & VOICESTREAMS_STAGE_MP3 ? "mp3 " : ""),
+			(vs->requested_stages & VOICESTREAMS_STAGE_PCM16 ? "pcm16 " : ""),
+			(vs->requested_stages & VOICESTREAMS_STAGE_ULAW ? "ulaw " : ""),
+			(vs->requested_stages & VOICESTREAMS_STAGE_ALAW ? "alaw" : ""));
+		console_log("   mixer: calls: %u/%u dropped calls: %u mixed frames: %u late frames: %u avg. mix time: %llu ns max: %u ns\n",
+			vs->active_sources_count,
+			vs->mixermaxsources,
+			vs->mixer_dropped_calls,
+			vs->mixer_mixes,
+			vs->mixer_late_frames,
+			(unsigned long long)(vs->mixer_mixes ? vs->mixer_mix_nsec_sum/vs->mixer_mixes : 0),
+			vs->mixer_mix_nsec_max);
+#ifdef AMBEDECODEVOICE
+		if (vs->worker != NULL) {
+			console_log("   voice worker queue depth: %u max: %u dropped: %u encoded frames dropped: %u\n",
+				voicestreams_worker_get_queue_depth(vs),
+				vs->jobs_max_depth,
+				vs->jobs_dropped,
+				vs->worker_frames_dropped);
+		}
+#endif
+#ifdef MP3ENCODEVOICE
+		if (vs->mp3_measuring)
+			voicestreams_mp3_print_measurement(vs);
+#endif
 
 		vs = vs->next;
 	}
 }
 
+void voicestreams_process(void) {
+	voicestream_t *vs;
+	voicestreams_file_type_t type;
+	flag_t unflushed = 0;
+
+	for (vs = voicestreams; vs != NULL; vs = vs->next) {
+#ifdef AMBEDECODEVOICE
+		voicestreams_worker_process(vs);
+		// Files written by the stream's voice worker are flushed by the worker.
+		if (vs->worker != NULL) {
+			if (voicestreams_file_flush_if_needed(vs, VOICESTREAMS_FILE_TYPE_AMBE))
+				unflushed = 1;
+			continue;
+		}
+#endif
+		for (type = 0; type < VOICESTREAMS_FILE_TYPE_COUNT; type++) {
+			if (voicestreams_file_flush_if_needed(vs, type))
+				unflushed = 1;
+		}
+	}
+	// Checking again later if there's no traffic, so buffered recording data gets to disk.
+	if (unflushed)
+		daemon_poll_setmaxtimeout(1000);
+
+	voicestreams_governor_process();
+	daemon_latency_mark(DAEMON_LATENCY_STAGE_VOICESTREAMS);
+}
+
 void voicestreams_init(void) {
 	char **streamnames = config_voicestreams_get_streamnames();
 	char **streamnames_i = streamnames;
 	voicestream_t *new_vs;
+	uint8_t i;
 #ifdef AMBEDECODEVOICE
 	char mbeversion[25];
 #endif
 
 	console_log("voicestreams init:\n");
+	voicestreams_dsp_init();
 	if (streamnames == NULL) {
 		console_log("no voice streams defined in config file.\n");
 		return;
@@ -173,10 +343,13 @@ void voicestreams_init(void) {
 		new_vs->savetorawambefile = config_voicestreams_get_savetorawambefile(new_vs->name);
 		new_vs->savedecodedtorawfile = config_voicestreams_get_savedecodedtorawfile(new_vs->name);
 		new_vs->savedecodedtomp3file = config_voicestreams_get_savedecodedtomp3file(new_vs->name);
+		new_vs->savecallindex = config_voicestreams_get_savecallindex(new_vs->name);
 		new_vs->minmp3bitrate = config_voicestreams_get_minmp3bitrate(new_vs->name);
 		new_vs->mp3bitrate = config_voicestreams_get_mp3bitrate(new_vs->name);
 		new_vs->mp3quality = config_voicestreams_get_mp3quality(new_vs->name);
 		new_vs->mp3vbr = config_voicestreams_get_mp3vbr(new_vs->name);
+		// Rounding down to whole decoded frames.
+		new_vs->mp3chunkinms = max(VOICESTREAMS_MP3_MIN_CHUNK_IN_MS, min(VOICESTREAMS_MP3_MAX_CHUNK_IN_MS, config_voicestreams_get_mp3chunkinms(new_vs->name)))/20*20;
 		new_vs->timeslot = config_voicestreams_get_timeslot(new_vs->name);
 		new_vs->decodequality = config_voicestreams_get_decodequality(new_vs->name);
 		new_vs->playrawfileatcallstart = config_voicestreams_get_playrawfileatcallstart(new_vs->name);
@@ -184,8 +357,13 @@ void voicestreams_init(void) {
 		new_vs->playrawfileatcallend = config_voicestreams_get_playrawfileatcallend(new_vs->name);
 		new_vs->rawfileatcallendgain = config_voicestreams_get_rawfileatcallendgain(new_vs->name);
 		new_vs->rmsminsamplevalue = config_voicestreams_get_rmsminsamplevalue(new_vs->name);
+		new_vs->mixermaxsources = max(1, min(VOICESTREAMS_MIXER_MAX_SOURCES, config_voicestreams_get_mixermaxsources(new_vs->name)));
+		new_vs->priority = config_voicestreams_get_priority(new_vs->name);
 
-		new_vs->rms_vol = new_vs->avg_rms_vol = VOICESTREAMS_INVALID_RMS_VALUE;
+		for (i = 0; i < VOICESTREAMS_MIXER_MAX_SOURCES; i++) {
+			new_vs->sources[i].rms_vol = new_vs->sources[i].avg_rms_vol = VOICESTREAMS_INVALID_RMS_VALUE;
+			new_vs->sources[i].published_rms_vol = new_vs->sources[i].published_avg_rms_vol = VOICESTREAMS_INVALID_RMS_VALUE;
+		}
 
 #if defined(AMBEDECODEVOICE) && defined(MP3ENCODEVOICE)
 		voicestreams_mp3_init(new_vs);
@@ -198,21 +376,36 @@ void voicestreams_init(void) {
 	}
 	config_voicestreams_free_streamnames(streamnames);
 
+	voicestreams_governor_init(voicestreams);
+
 #ifdef AMBEDECODEVOICE
 	mbe_printVersion(mbeversion);
 	console_log("voicestreams: using mbelib v%s for voice decoding\n", mbeversion);
+
+	voicestreams_worker_init(voicestreams);
 #endif
 }
 
 void voicestreams_deinit(void) {
 	voicestream_t *next_vs;
+	voicestreams_format_t format;
+	uint8_t i;
 
 	console_log("voicestreams: deinit\n");
 
+#ifdef AMBEDECODEVOICE
+	voicestreams_worker_deinit();
+#endif
+
 	while (voicestreams != NULL) {
 #ifdef MP3ENCODEVOICE
 		voicestreams_mp3_deinit(voicestreams);
 #endif
+		voicestreams_file_close(voicestreams);
+		for (format = 0; format < VOICESTREAMS_FORMAT_COUNT; format++) {
+			for (i = 0; i < VOICESTREAMS_LISTENER_FRAMES_COUNT; i++)
+				voicestreams_shared_frame_unref(voicestreams->listener_frames[format][i]);
+		}
 
 		free(voicestreams->name);
 		free(voicestreams->repeaterhosts);
@@ -19,9 +19,13 @@
 #define VOICESTREAMS_H_
 
 #include <libs/base/types.h>
+#include <libs/base/dmr.h>
 #include <libs/dmrpacket/dmrpacket-types.h>
 
 #include <netinet/ip.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/types.h>
 #ifdef AMBEDECODEVOICE
 #include <mbelib.h>
 #ifdef MP3ENCODEVOICE
@@ -32,19 +36,175 @@
 #define VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT	160
 #define VOICESTREAMS_INVALID_RMS_VALUE					127
 
+// Formats of the audio sent to the listeners. HTTP listeners always get MP3,
+// websocket listeners can change the format with the changeformat command.
+#define VOICESTREAMS_FORMAT_MP3							0
+#define VOICESTREAMS_FORMAT_PCM16						1 // 8kHz signed 16 bit little endian samples.
+#define VOICESTREAMS_FORMAT_ULAW						2 // 8kHz G.711 mu-law samples.
+#define VOICESTREAMS_FORMAT_ALAW						3 // 8kHz G.711 A-law samples.
+#define VOICESTREAMS_FORMAT_COUNT						4
+typedef uint8_t voicestreams_format_t;
+
+// Processing stages of received voice. Only the stages which have consumers are run.
+#define VOICESTREAMS_STAGE_DECODE						(1 << 0) // For RMS volume, decoded recordings and encoding.
+#define VOICESTREAMS_STAGE_MP3							(1 << 1) // For MP3 listeners and MP3 recordings.
+#define VOICESTREAMS_STAGE_PCM16						(1 << 2) // For PCM listeners, these frames are sent out every 20ms.
+#define VOICESTREAMS_STAGE_ULAW							(1 << 3)
+#define VOICESTREAMS_STAGE_ALAW							(1 << 4)
+#define VOICESTREAMS_STAGE_PCM							(VOICESTREAMS_STAGE_PCM16 | VOICESTREAMS_STAGE_ULAW | VOICESTREAMS_STAGE_ALAW)
+// The stage which encodes the given format.
+#define VOICESTREAMS_STAGE_FOR_FORMAT(format)			(1 << ((format)+1))
+typedef uint8_t voicestreams_stages_t;
+
+// Calls of different repeaters on the same stream are decoded separately and mixed
+// together. This is the upper limit of the mixermaxsources stream config option.
+#define VOICESTREAMS_MIXER_MAX_SOURCES					8
+// Decoded frames of a source waiting to be mixed, 16 frames are 320ms.
+#define VOICESTREAMS_MIXER_SOURCE_FRAMES_COUNT			16 // Must be a power of 2.
+
+// Recording files of a voice stream. Each type is written by only one thread.
+#define VOICESTREAMS_FILE_TYPE_AMBE						0 // Written by the main thread.
+#define VOICESTREAMS_FILE_TYPE_DECODED_RAW				1 // Written by the stream's voice worker.
+#define VOICESTREAMS_FILE_TYPE_MP3						2 // Written by the stream's voice worker.
+#define VOICESTREAMS_FILE_TYPE_COUNT					3
+// Buffered data of the recording files is flushed at call end, and also at least this often.
+#define VOICESTREAMS_FILE_FLUSH_INTERVAL_IN_SEC			5
+typedef uint8_t voicestreams_file_type_t;
+
+typedef struct {
+	FILE *f;
+	char filename[255];
+	time_t rotate_at; // The file is reopened with a new name at the next local midnight.
+	time_t last_flush_at;
+	flag_t unflushed; // Set if written data can still be in the file's buffer.
+	off_t size; // Offset of the next write, used for indexing calls.
+} voicestreams_file_t;
+
+// Position of a call's start in a recording file.
+typedef struct {
+	off_t offset;
+	time_t rotate_at; // Of the file at call start, if it changes, the call continues in a new file.
+} voicestreams_file_pos_t;
+
+// Details of a call which get written to the recordings' index files.
+typedef struct {
+	time_t started_at;
+	dmr_id_t src_id;
+	dmr_id_t dst_id;
+	dmr_id_t repeater_id;
+	dmr_call_type_t call_type;
+	dmr_timeslot_t timeslot;
+} voicestreams_call_t;
+
+
+// A repeater's call which is mixed into the stream.
+typedef struct {
+	// Only accessed by the main thread.
+	struct repeater_st *repeater; // Kept after the call has ended, so its RMS volume can be read.
+	flag_t active;
+	flag_t rms_needed; // Set at call start if the call's RMS volume will be used.
+	voicestreams_call_t call;
+	voicestreams_file_pos_t ambe_file_pos;
+	// Copies of rms_vol and avg_rms_vol below. If the stream has a voice worker, they are passed back by the
+	// worker, and the number of ended calls whose RMS volume hasn't been passed back yet is counted.
+	int8_t published_rms_vol;
+	int8_t published_avg_rms_vol;
+	uint8_t call_end_rms_vols_pending;
+
+	// Only accessed by the thread which decodes the stream.
+	flag_t decoding;
+	// Copied at call start, as the main thread can reuse the source for a new call before the decoder finishes the old one.
+	voicestreams_call_t decoded_call;
+	voicestreams_file_pos_t decoded_file_pos[VOICESTREAMS_FILE_TYPE_COUNT];
+#ifdef AMBEDECODEVOICE
+	mbe_parms cur_mp;
+	mbe_parms prev_mp;
+	mbe_parms prev_mp_enhanced;
+	float frames[VOICESTREAMS_MIXER_SOURCE_FRAMES_COUNT][VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT];
+	uint32_t frames_head;
+	uint32_t frames_tail;
+#endif
+	// Sum of squares of the samples above rmsminsamplevalue, accumulated for every decoded frame.
+	float rms_vol_sum;
+	uint16_t rms_vol_elements;
+	uint16_t rms_vol_samples_count;
+	// Calculated by the thread which decodes the stream.
+	int8_t rms_vol;
+	int8_t avg_rms_vol;
+} voicestreams_source_t;
+
+// A decoded frame encoded to PCM16, mu-law or A-law.
+typedef struct {
+	uint8_t bytes[VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT*sizeof(int16_t)];
+	uint16_t bytes_size;
+} voicestreams_pcm_frame_t;
+
+// Limits of the mp3chunkinms stream config option. Browsers can't decode MP3 frames
+// encoded from too small PCM chunks, the upper limit keeps encoded chunks below 64k.
+#define VOICESTREAMS_MP3_MIN_CHUNK_IN_MS				160
+#define VOICESTREAMS_MP3_MAX_CHUNK_IN_MS				5000
 #ifdef MP3ENCODEVOICE
- // 8000 samples per sec., 1.25*8000 + 7200
-#define VOICESTREAMS_MP3_FRAME_BUFFER_SIZE				17200
-// We have to choose a value here which the MP3 encoder can encode. If the number
-// of frames are too small, the MP3 encoder won't be able to encode them.
-#define VOICESTREAMS_MP3_SILENT_FRAME_SAMPLES_NUM		1280
-#define VOICESTREAMS_MP3_SILENT_FRAME_LENGTH_IN_MS		(uint16_t)((VOICESTREAMS_MP3_SILENT_FRAME_SAMPLES_NUM/8000.0)*1000.0)
+// Worst case size of the MP3 data encoded from the given number of samples, 1.25*samples + 7200.
+#define VOICESTREAMS_MP3_ENCODED_BUF_SIZE(samples)		((samples)*5/4+7200)
 typedef struct {
-	uint8_t bytes[VOICESTREAMS_MP3_FRAME_BUFFER_SIZE];
+	uint8_t *bytes; // Points to the stream's encoded data buffer.
 	uint16_t bytes_size;
+	uint64_t received_at_usec; // Arrival of the first voice packet of the chunk if it's measured, 0 otherwise.
 } voicestreams_mp3_frame_t;
 #endif
 
+// Encoded frames passed from a voice worker thread to the main thread. PCM listeners
+// get a frame for every 20ms of voice, so this holds about 5 seconds for them.
+#define VOICESTREAMS_WORKER_FRAME_QUEUE_SIZE			256 // Must be a power of 2.
+
+// Encoded audio data which is shared between all HTTP and websocket listeners of a stream.
+// Space for the websocket frame header is reserved before the data, so it can be sent out
+// without copying. The size of the reserved space is checked against libwebsockets at compile time.
+#define VOICESTREAMS_SHARED_FRAME_PRE_PADDING			32
+#define VOICESTREAMS_SHARED_FRAME_POST_PADDING			16
+#define VOICESTREAMS_SHARED_FRAME_BYTES(frame)			((frame)->buf+VOICESTREAMS_SHARED_FRAME_PRE_PADDING)
+typedef struct {
+	uint16_t refcount;
+	uint16_t bytes_size;
+	voicestreams_format_t format;
+	uint64_t received_at_usec; // For measuring the latency of MP3 frames, 0 if it's not measured.
+	uint8_t buf[];
+} voicestreams_shared_frame_t;
+
+// This many latest shared frames of each format are kept for the listeners. A listener which
+// falls behind more than this skips the frames it missed.
+#define VOICESTREAMS_LISTENER_FRAMES_COUNT				64 // Must be a power of 2.
+
+#ifdef AMBEDECODEVOICE
+// Jobs for the stream's voice worker thread. 256 voice packets are 15 seconds of audio.
+#define VOICESTREAMS_JOB_QUEUE_SIZE						256 // Must be a power of 2.
+#define VOICESTREAMS_JOB_TYPE_VOICE						0
+#define VOICESTREAMS_JOB_TYPE_CALL_START				1
+#define VOICESTREAMS_JOB_TYPE_CALL_END					2
+#define VOICESTREAMS_JOB_TYPE_FLUSH_FILES				3 // Flushes the recording files written by the worker.
+typedef uint8_t voicestreams_job_type_t;
+
+typedef struct {
+	voicestreams_job_type_t type;
+	voicestreams_stages_t stages;
+	uint8_t source; // Index in the stream's sources array.
+	dmrpacket_payload_voice_bytes_t voice_bytes;
+	uint64_t queued_at_usec; // Set if the stream's MP3 encoding is measured.
+} voicestreams_job_t;
+
+// Call start and end jobs which don't fit into the job queue are kept by the main thread until they fit.
+#define VOICESTREAMS_JOB_BACKLOG_SIZE					16
+
+// RMS volumes calculated by a voice worker thread, passed to the main thread.
+#define VOICESTREAMS_WORKER_RMS_VOL_QUEUE_SIZE			64 // Must be a power of 2.
+typedef struct {
+	uint8_t source; // Index in the stream's sources array.
+	int8_t rms_vol;
+	int8_t avg_rms_vol;
+	flag_t call_ended;
+} voicestreams_rms_vol_result_t;
+#endif
+
 typedef struct voicestream_st {
 	char *name;
 	flag_t enabled;
@@ -54,10 +214,12 @@ typedef struct voicestream_st {
 	flag_t savetorawambefile;
 	flag_t savedecodedtorawfile;
 	flag_t savedecodedtomp3file;
+	flag_t savecallindex;
 	uint8_t minmp3bitrate;
 	uint8_t mp3bitrate;
 	uint8_t mp3quality;
 	flag_t mp3vbr;
+	uint16_t mp3chunkinms;
 	flag_t timeslot;
 	uint8_t decodequality;
 	char *playrawfileatcallstart;
@@ -65,41 +227,118 @@ typedef struct voicestream_st {
 	char *playrawfileatcallend;
 	float rawfileatcallendgain;
 	float rmsminsamplevalue;
+	uint8_t mixermaxsources;
+	uint8_t priority; // Streams with lower priority are shed first by the load governor.
 
-	float rms_vol_buf[VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT*25]; // 0.5 sec. buffer
-	uint16_t rms_vol_buf_pos;
-	int8_t rms_vol;
-	int8_t avg_rms_vol;
+	// Sources are only accessed by the main thread, except their fields noted otherwise.
+	voicestreams_source_t sources[VOICESTREAMS_MIXER_MAX_SOURCES];
+	uint8_t active_sources_count;
+	voicestreams_source_t *ambe_recording_source; // Raw AMBE frames can't be mixed, only one source is recorded.
+	uint32_t mixer_dropped_calls;
 
-#ifdef AMBEDECODEVOICE
-	mbe_parms cur_mp;
-	mbe_parms prev_mp;
-	mbe_parms prev_mp_enhanced;
+	// Set by the load governor on the main thread.
+	flag_t shed; // The stream is not decoded and encoded because of high load.
+	uint8_t active_decodequality; // Read by the thread which decodes the stream.
+
+	// Consumers of the stream, these are only accessed by the main thread.
+	uint16_t listeners_count[VOICESTREAMS_FORMAT_COUNT];
+	voicestreams_stages_t requested_stages; // The stages requested with the last voice packet.
+	// The stages run on the last voice packet, only accessed by the thread which decodes the stream.
+	voicestreams_stages_t active_stages;
 
+	// Mixer state and statistics, only written by the thread which decodes the stream.
+	uint8_t decoding_sources_count;
+	uint32_t mixer_mixes; // Mixed frames with more than one source.
+	uint32_t mixer_late_frames; // Mixed frames with missing frames of a source.
+	uint64_t mixer_mix_nsec_sum;
+	uint32_t mixer_mix_nsec_max;
+
+#ifdef AMBEDECODEVOICE
 #ifdef MP3ENCODEVOICE
 	lame_global_flags *mp3_flags;
-	voicestreams_mp3_frame_t silent_mp3_frame;
-	// Raw bytes are stored here. These will get encoded to mp3 frames.
-	// Must be a multiple of VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT.
-	// Note that browsers can't decode MP3 frames encoded from too small PCM chunks.
-	// That's why we multiply the default AMBE frame samples count.
-	float mp3_buf[VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT*50];
+	// Sent to idle HTTP listeners every mp3chunkinms, only accessed by the main thread.
+	voicestreams_shared_frame_t *silent_mp3_frame;
+	// Decoded samples are collected here, and they get encoded to MP3 when mp3chunkinms worth of samples
+	// are collected. The size is a multiple of VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT.
+	float *mp3_buf;
+	uint16_t mp3_buf_size; // In samples.
 	uint16_t mp3_buf_pos;
+	uint8_t *mp3_encoded_buf;
+	uint16_t mp3_encoded_buf_size;
+
+	// Encoder measurement, enabled by the streammp3measurestart command.
+	flag_t mp3_measuring; // Set by the main thread.
+	flag_t mp3_measure_reset_requested; // Set by the main thread, cleared by the thread which encodes the stream.
+	uint64_t mp3_queued_at_usec; // Of the voice job being processed, 0 if the stream is decoded on the main thread.
+	uint64_t mp3_buf_received_at_usec; // Of the first voice packet in mp3_buf.
+	// Written by the thread which encodes the stream.
+	uint64_t mp3_encode_cpu_nsec;
+	uint64_t mp3_encoded_samples;
+	uint32_t mp3_encodes;
+	// Latency between receiving a chunk's first voice packet and passing the chunk to the listeners,
+	// only accessed by the main thread.
+	uint64_t mp3_latency_usec_sum;
+	uint32_t mp3_latency_usec_max;
+	uint32_t mp3_latency_count;
 #endif
+
+	// Single producer (worker), single consumer (main thread) queue.
+	voicestreams_shared_frame_t *worker_frames[VOICESTREAMS_WORKER_FRAME_QUEUE_SIZE];
+	uint32_t worker_frames_head; // Written only by the worker thread.
+	uint32_t worker_frames_tail; // Written only by the main thread.
+	uint32_t worker_frames_dropped;
+
+	// The worker thread which decodes this stream, NULL if decoding is done on the main thread.
+	// Decoder and encoder state above is only accessed by this thread.
+	struct voicestreams_worker_st *worker;
+	// Single producer (main thread), single consumer (worker) queue.
+	voicestreams_job_t jobs[VOICESTREAMS_JOB_QUEUE_SIZE];
+	uint32_t jobs_head; // Written only by the main thread.
+	uint32_t jobs_tail; // Written only by the worker thread.
+	uint32_t jobs_max_depth;
+	uint32_t jobs_dropped;
+	// Only accessed by the main thread.
+	voicestreams_job_t jobs_backlog[VOICESTREAMS_JOB_BACKLOG_SIZE];
+	uint8_t jobs_backlog_first;
+	uint8_t jobs_backlog_count;
+	time_t worker_files_flush_at; // Only accessed by the main thread, 0 if the worker's files don't need flushing.
+	// Single producer (worker), single consumer (main thread) queue.
+	voicestreams_rms_vol_result_t worker_rms_vols[VOICESTREAMS_WORKER_RMS_VOL_QUEUE_SIZE];
+	uint32_t worker_rms_vols_head; // Written only by the worker thread.
+	uint32_t worker_rms_vols_tail; // Written only by the main thread.
 #endif
 
-	struct repeater_t *currently_streaming_repeater;
+	voicestreams_file_t files[VOICESTREAMS_FILE_TYPE_COUNT];
+
+	// Rings of the latest frames of each format sent to the listeners, only accessed by the main thread.
+	// Listeners keep the sequence number of the next frame they have to send.
+	voicestreams_shared_frame_t *listener_frames[VOICESTREAMS_FORMAT_COUNT][VOICESTREAMS_LISTENER_FRAMES_COUNT];
+	uint32_t listener_frames_head[VOICESTREAMS_FORMAT_COUNT]; // Sequence number of the next frame.
 
 	struct voicestream_st *next;
 } voicestream_t;
 
+voicestreams_shared_frame_t *voicestreams_shared_frame_new(voicestreams_format_t format, uint8_t *bytes, uint16_t bytes_size);
+voicestreams_shared_frame_t *voicestreams_shared_frame_ref(voicestreams_shared_frame_t *frame);
+void voicestreams_shared_frame_unref(voicestreams_shared_frame_t *frame);
+
 char *voicestreams_get_stream_filename(voicestream_t *voicestream, char *extension);
+char *voicestreams_get_stream_filename_for_date_r(voicestream_t *voicestream, char *date, char *extension, char *fn, size_t fn_size);
+char *voicestreams_get_stream_filename_r(voicestream_t *voicestream, char *extension, char *fn, size_t fn_size);
 
 voicestream_t *voicestreams_get_stream_for_repeater(struct in_addr *ip, int timeslot);
 voicestream_t *voicestreams_get_stream_by_name(char *name);
 
+char *voicestreams_get_format_name(voicestreams_format_t format);
+voicestreams_format_t voicestreams_get_format_by_name(char *name);
+
+void voicestreams_get_rms_vol(voicestream_t *voicestream, struct repeater_st *repeater, int8_t *rms_vol, int8_t *avg_rms_vol);
+void voicestreams_reset_rms_vol(voicestream_t *voicestream, struct repeater_st *repeater);
+flag_t voicestreams_is_rms_vol_pending(voicestream_t *voicestream, struct repeater_st *repeater);
+
 void voicestreams_printlist(void);
 
+void voicestreams_process(void);
 void voicestreams_init(void);
 void voicestreams_deinit(void);
 
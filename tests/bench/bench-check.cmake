@@ -0,0 +1,59 @@
+# Runs BENCH with the given PCAPS (a ;-separated list), and checks that the JSON file written to
+# OUTPUT is valid and has a result with at least one operation for every benchmark.
+cmake_minimum_required(VERSION 3.19)
+
+# Coders which are run with both clean and error injected inputs.
+set(coders bptc_196_96 golay_20_8 quadres_16_7 rs_12_9 trellis vbptc_16_11 dmrpacket_decode_chain)
+# Benchmarks which are only run with clean inputs.
+set(clean_only rs_12_9_checksum crc16_ccitt crc16_ccitt_bytes crc9_bytes crc32_bytes base_bytestobits)
+
+file(REMOVE ${OUTPUT})
+execute_process(COMMAND ${BENCH} -t 1 -o ${OUTPUT} ${PCAPS} RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+	message(FATAL_ERROR "running ${BENCH} failed")
+endif()
+
+file(READ ${OUTPUT} json)
+string(JSON packets ERROR_VARIABLE error GET "${json}" packets)
+if(error)
+	message(FATAL_ERROR "${OUTPUT} is not valid: ${error}")
+endif()
+if(packets EQUAL 0)
+	message(FATAL_ERROR "${OUTPUT}: no packets were loaded from the pcap files")
+endif()
+foreach(key version min_time_ms seed)
+	string(JSON value ERROR_VARIABLE error GET "${json}" ${key})
+	if(error)
+		message(FATAL_ERROR "${OUTPUT}: ${key} is missing")
+	endif()
+endforeach()
+
+string(JSON results_count ERROR_VARIABLE error LENGTH "${json}" results)
+if(error)
+	message(FATAL_ERROR "${OUTPUT}: results are missing")
+endif()
+set(found)
+math(EXPR last "${results_count}-1")
+foreach(i RANGE ${last})
+	string(JSON name GET "${json}" results ${i} name)
+	string(JSON input GET "${json}" results ${i} input)
+	string(JSON ops GET "${json}" results ${i} ops)
+	string(JSON ns_per_op GET "${json}" results ${i} ns_per_op)
+	if(ops EQUAL 0 OR NOT ns_per_op MATCHES "^[0-9]+(\\.[0-9]+)?$")
+		message(FATAL_ERROR "${OUTPUT}: invalid result for ${name} (${input} input)")
+	endif()
+	list(APPEND found "${name}/${input}")
+endforeach()
+
+set(expected)
+foreach(name ${coders})
+	list(APPEND expected "${name}/clean" "${name}/errors")
+endforeach()
+foreach(name ${clean_only})
+	list(APPEND expected "${name}/clean")
+endforeach()
+foreach(key ${expected})
+	if(NOT key IN_LIST found)
+		message(FATAL_ERROR "${OUTPUT}: result for ${key} is missing")
+	endif()
+endforeach()
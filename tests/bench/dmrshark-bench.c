@@ -0,0 +1,541 @@
+// Measures the speed of the coders in libs/coding, the dmrpacket decode chain and
+// base_bytestobits() with inputs taken from the given pcap files. Every coder is run
+// with the clean inputs and with inputs which have a single bit/byte error injected.
+// Results are printed and also written as JSON to the file given with -o (dmrshark-bench.json
+// by default), so they can be compared between releases.
+// Usage: dmrshark-bench [-t min. ms per benchmark] [-s random seed] [-o json file] [pcap files...]
+
+#include <dmrshark/defaults.h>
+
+#include <libs/coding/coding.h>
+#include <libs/coding/bptc-196-96.h>
+#include <libs/coding/golay-20-8.h>
+#include <libs/coding/quadres-16-7.h>
+#include <libs/coding/rs-12-9.h>
+#include <libs/coding/trellis.h>
+#include <libs/coding/vbptc-16-11.h>
+#include <libs/coding/crc.h>
+#include <libs/dmrpacket/dmrpacket.h>
+#include <libs/dmrpacket/dmrpacket-sync.h>
+#include <libs/dmrpacket/dmrpacket-slot-type.h>
+#include <libs/dmrpacket/dmrpacket-emb.h>
+#include <libs/dmrpacket/dmrpacket-lc.h>
+#include <libs/dmrpacket/dmrpacket-csbk.h>
+#include <libs/dmrpacket/dmrpacket-data.h>
+#include <libs/dmrpacket/dmrpacket-data-header.h>
+#include <libs/comm/ipscpacket.h>
+#include <libs/base/base.h>
+#include <libs/daemon/console.h>
+
+#include <pcap/pcap.h>
+#include <netinet/if_ether.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#define BENCH_MAX_INPUTS		8192
+#define BENCH_MAX_RESULTS		64
+
+typedef void (*bench_op_t)(uint32_t input_nr);
+
+typedef struct {
+	char *name;
+	char *input;
+	uint32_t inputs_count;
+	uint64_t ops;
+	uint64_t elapsed_ns;
+} bench_result_t;
+
+typedef struct {
+	uint32_t count;
+	ipscpacket_t packets[BENCH_MAX_INPUTS];
+} bench_packets_t;
+
+// Inputs for the different coders. Index 0 contains the clean inputs, index 1 the ones with errors.
+static bench_packets_t bench_packets[2];
+static dmrpacket_payload_info_bits_t bench_bptc_inputs[2][BENCH_MAX_INPUTS];
+static uint32_t bench_bptc_inputs_count = 0;
+static dmrpacket_slot_type_bits_t bench_golay_inputs[2][BENCH_MAX_INPUTS];
+static uint32_t bench_golay_inputs_count = 0;
+static dmrpacket_emb_bits_t bench_quadres_inputs[2][BENCH_MAX_INPUTS];
+static uint32_t bench_quadres_inputs_count = 0;
+static rs_12_9_codeword_t bench_rs_inputs[2][BENCH_MAX_INPUTS];
+static uint32_t bench_rs_inputs_count = 0;
+static dmrpacket_payload_info_bits_t bench_trellis_inputs[2][BENCH_MAX_INPUTS];
+static uint32_t bench_trellis_inputs_count = 0;
+static flag_t bench_vbptc_inputs[2][BENCH_MAX_INPUTS][sizeof(dmrpacket_emb_signalling_lc_fragment_bits_t)*4];
+static uint32_t bench_vbptc_inputs_count = 0;
+
+static bench_result_t bench_results[BENCH_MAX_RESULTS];
+static uint8_t bench_results_count = 0;
+static uint8_t bench_variant = 0;
+static uint64_t bench_min_time_ns = 200000000;
+static volatile uint32_t bench_sink = 0;
+
+static uint64_t bench_get_time_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000+ts.tv_nsec;
+}
+
+static void bench_flip_random_bit(flag_t *bits, uint16_t from_bit, uint16_t to_bit) {
+	uint16_t bit = from_bit+rand() % (to_bit-from_bit);
+
+	bits[bit] = !bits[bit];
+}
+
+static void bench_run(char *name, bench_op_t op, uint32_t inputs_count) {
+	bench_result_t *result;
+	uint64_t start;
+	uint64_t elapsed = 0;
+	uint64_t ops = 0;
+	uint32_t i;
+
+	if (inputs_count == 0 || bench_results_count == BENCH_MAX_RESULTS)
+		return;
+
+	// Warming up the caches.
+	for (i = 0; i < inputs_count; i++)
+		op(i);
+
+	start = bench_get_time_ns();
+	do {
+		for (i = 0; i < inputs_count; i++)
+			op(i);
+		ops += inputs_count;
+		elapsed = bench_get_time_ns()-start;
+	} while (elapsed < bench_min_time_ns);
+
+	result = &bench_results[bench_results_count++];
+	result->name = name;
+	result->input = (bench_variant == 0 ? "clean" : "errors");
+	result->inputs_count = inputs_count;
+	result->ops = ops;
+	result->elapsed_ns = elapsed;
+
+	printf("%-24s %-6s %10.1f ns/op %12.0f ops/s\n", result->name, result->input,
+		(double)elapsed/ops, ops*1000000000.0/elapsed);
+}
+
+static void bench_op_bptc_196_96(uint32_t input_nr) {
+	dmrpacket_payload_info_bits_t info_bits;
+	bptc_196_96_data_bits_t data_bits;
+
+	// Repairing is done in place, so we work on a copy of the input.
+	memcpy(&info_bits, &bench_bptc_inputs[bench_variant][input_nr], sizeof(dmrpacket_payload_info_bits_t));
+	if (bptc_196_96_check_and_repair(info_bits.bits))
+		bench_sink += bptc_196_96_extractdata_r(info_bits.bits, &data_bits)->bits[0];
+}
+
+static void bench_op_golay_20_8(uint32_t input_nr) {
+	dmrpacket_slot_type_bits_t slot_type_bits;
+
+	memcpy(&slot_type_bits, &bench_golay_inputs[bench_variant][input_nr], sizeof(dmrpacket_slot_type_bits_t));
+	bench_sink += golay_20_8_check_and_repair(slot_type_bits.bits);
+}
+
+static void bench_op_quadres_16_7(uint32_t input_nr) {
+	bench_sink += quadres_16_7_check((quadres_16_7_codeword_t *)bench_quadres_inputs[bench_variant][input_nr].bits);
+}
+
+static void bench_op_rs_12_9(uint32_t input_nr) {
+	rs_12_9_codeword_t codeword;
+	rs_12_9_poly_t syndrome;
+	uint8_t errors_found = 0;
+
+	memcpy(&codeword, &bench_rs_inputs[bench_variant][input_nr], sizeof(rs_12_9_codeword_t));
+	rs_12_9_calc_syndrome(&codeword, &syndrome);
+	bench_sink += rs_12_9_correct_errors(&codeword, &syndrome, &errors_found);
+}
+
+static void bench_op_rs_12_9_checksum(uint32_t input_nr) {
+	rs_12_9_checksum_t checksum;
+
+	bench_sink += rs_12_9_calc_checksum_r(&bench_rs_inputs[bench_variant][input_nr], &checksum)->bytes[0];
+}
+
+static void bench_op_trellis(uint32_t input_nr) {
+	trellis_dibits_t dibits;
+	trellis_dibits_t deinterleaved_dibits;
+	trellis_constellationpoints_t constellationpoints;
+	trellis_tribits_t tribits;
+	dmrpacket_data_binary_t binary;
+	uint16_t path_metric;
+
+	trellis_extract_dibits_r(&bench_trellis_inputs[bench_variant][input_nr], &dibits);
+	trellis_deinterleave_dibits_r(&dibits, &deinterleaved_dibits);
+	trellis_getconstellationpoints_r(&deinterleaved_dibits, &constellationpoints);
+	if (trellis_extract_tribits_r(&constellationpoints, &path_metric, &tribits) != NULL)
+		bench_sink += trellis_extract_binary_r(&tribits, &binary)->bits[0]+path_metric;
+}
+
+static void bench_op_vbptc_16_11(uint32_t input_nr) {
+	vbptc_16_11_t vbptc;
+	dmrpacket_emb_signalling_lc_bits_t emb_signalling_lc_bits;
+	uint8_t i;
+
+	vbptc_16_11_init(&vbptc, 8);
+	for (i = 0; i < 4; i++) {
+		vbptc_16_11_add_burst(&vbptc, &bench_vbptc_inputs[bench_variant][input_nr][i*sizeof(dmrpacket_emb_signalling_lc_fragment_bits_t)],
+			sizeof(dmrpacket_emb_signalling_lc_fragment_bits_t));
+	}
+	if (vbptc_16_11_check_and_repair(&vbptc)) {
+		vbptc_16_11_get_data_bits(&vbptc, (flag_t *)&emb_signalling_lc_bits, sizeof(dmrpacket_emb_signalling_lc_bits_t));
+		bench_sink += emb_signalling_lc_bits.bits[0];
+	}
+}
+
+static void bench_op_crc16_ccitt(uint32_t input_nr) {
+	uint16_t crc = 0;
+	uint8_t i;
+
+	for (i = 0; i < sizeof(ipscpacket_payload_t)-1; i++)
+		crc_calc_crc16_ccitt(&crc, bench_packets[0].packets[input_nr].payload.bytes[i]);
+	crc_calc_crc16_ccitt_finish(&crc);
+	bench_sink += crc;
+}
+
+static void bench_op_crc16_ccitt_bytes(uint32_t input_nr) {
+	uint16_t crc = 0;
+
+	crc_calc_crc16_ccitt_bytes(&crc, bench_packets[0].packets[input_nr].payload.bytes, sizeof(ipscpacket_payload_t)-1);
+	crc_calc_crc16_ccitt_finish(&crc);
+	bench_sink += crc;
+}
+
+static void bench_op_crc9_bytes(uint32_t input_nr) {
+	uint16_t crc = 0;
+
+	crc_calc_crc9_bytes(&crc, bench_packets[0].packets[input_nr].payload.bytes, sizeof(ipscpacket_payload_t)-1);
+	crc_calc_crc9_finish(&crc, 8);
+	bench_sink += crc;
+}
+
+static void bench_op_crc32_bytes(uint32_t input_nr) {
+	uint32_t crc = 0;
+
+	crc_calc_crc32_bytes(&crc, bench_packets[0].packets[input_nr].payload.bytes, sizeof(ipscpacket_payload_t)-1);
+	crc_calc_crc32_finish(&crc);
+	bench_sink += crc;
+}
+
+static void bench_op_base_bytestobits(uint32_t input_nr) {
+	dmrpacket_payload_bits_t payload_bits;
+
+	base_bytestobits(bench_packets[0].packets[input_nr].payload.bytes, sizeof(ipscpacket_payload_t)-1, payload_bits.bits, sizeof(dmrpacket_payload_bits_t));
+	bench_sink += payload_bits.bits[0];
+}
+
+// Does the same decoding steps on the packet as dmr-handle.c does for the given slot type.
+static void bench_op_dmrpacket_decode_chain(uint32_t input_nr) {
+	ipscpacket_t *ipscpacket = &bench_packets[bench_variant].packets[input_nr];
+	dmrpacket_sync_bits_t sync_bits;
+	dmrpacket_slot_type_bits_t slot_type_bits;
+	dmrpacket_slot_type_t slot_type;
+	dmrpacket_emb_bits_t emb_bits;
+	dmrpacket_emb_t emb;
+	dmrpacket_payload_voice_bits_t voice_bits;
+	dmrpacket_payload_info_bits_t info_bits;
+	bptc_196_96_data_bits_t data_bits;
+	dmrpacket_lc_t lc;
+	dmrpacket_csbk_t csbk;
+	dmrpacket_data_header_t data_header;
+	trellis_dibits_t dibits;
+	trellis_dibits_t deinterleaved_dibits;
+	trellis_constellationpoints_t constellationpoints;
+	trellis_tribits_t tribits;
+	dmrpacket_data_binary_t binary;
+	dmrpacket_data_block_bytes_t data_block_bytes;
+	dmrpacket_data_block_t data_block;
+
+	bench_sink += dmrpacket_sync_get_sync_pattern_type(dmrpacket_sync_extract_bits_r(&ipscpacket->payload_bits, &sync_bits));
+
+	switch (ipscpacket->slot_type) {
+		case IPSCPACKET_SLOT_TYPE_VOICE_DATA_A:
+		case IPSCPACKET_SLOT_TYPE_VOICE_DATA_B:
+		case IPSCPACKET_SLOT_TYPE_VOICE_DATA_C:
+		case IPSCPACKET_SLOT_TYPE_VOICE_DATA_D:
+		case IPSCPACKET_SLOT_TYPE_VOICE_DATA_E:
+		case IPSCPACKET_SLOT_TYPE_VOICE_DATA_F:
+			dmrpacket_extract_voice_bits_r(&ipscpacket->payload_bits, &voice_bits);
+			if (ipscpacket->slot_type != IPSCPACKET_SLOT_TYPE_VOICE_DATA_A && dmrpacket_emb_decode_r(dmrpacket_emb_extract_from_sync_r(&sync_bits, &emb_bits), &emb) != NULL)
+				bench_sink += emb.lcss;
+			return;
+		default:
+			break;
+	}
+
+	if (dmrpacket_slot_type_decode_r(dmrpacket_slot_type_extract_bits_r(&ipscpacket->payload_bits, &slot_type_bits), &slot_type) != NULL)
+		bench_sink += slot_type.data_type;
+
+	switch (ipscpacket->slot_type) {
+		case IPSCPACKET_SLOT_TYPE_VOICE_LC_HEADER:
+			if (dmrpacket_lc_decode_voice_lc_header_r(dmrpacket_data_extract_and_repair_bptc_data_r(&ipscpacket->payload_bits, &data_bits), &lc) != NULL)
+				bench_sink += lc.dst_id;
+			break;
+		case IPSCPACKET_SLOT_TYPE_TERMINATOR_WITH_LC:
+			if (dmrpacket_lc_decode_terminator_with_lc_r(dmrpacket_data_extract_and_repair_bptc_data_r(&ipscpacket->payload_bits, &data_bits), &lc) != NULL)
+				bench_sink += lc.dst_id;
+			break;
+		case IPSCPACKET_SLOT_TYPE_CSBK:
+			if (dmrpacket_csbk_decode_r(dmrpacket_data_extract_and_repair_bptc_data_r(&ipscpacket->payload_bits, &data_bits), &csbk) != NULL)
+				bench_sink += csbk.dst_id;
+			break;
+		case IPSCPACKET_SLOT_TYPE_DATA_HEADER:
+			if (dmrpacket_data_header_decode_r(dmrpacket_data_extract_and_repair_bptc_data_r(&ipscpacket->payload_bits, &data_bits), 0, &data_header) != NULL)
+				bench_sink += data_header.common.dst_llid;
+			break;
+		case IPSCPACKET_SLOT_TYPE_RATE_12_DATA:
+			if (dmrpacket_data_decode_block_r(dmrpacket_data_convert_payload_bptc_data_bits_to_block_bytes_r(
+				dmrpacket_data_extract_and_repair_bptc_data_r(&ipscpacket->payload_bits, &data_bits), &data_block_bytes), DMRPACKET_DATA_TYPE_RATE_12_DATA, 0, &data_block) != NULL)
+					bench_sink += data_block.data_length;
+			break;
+		case IPSCPACKET_SLOT_TYPE_RATE_34_DATA:
+			dmrpacket_extract_info_bits_r(&ipscpacket->payload_bits, &info_bits);
+			trellis_extract_dibits_r(&info_bits, &dibits);
+			trellis_deinterleave_dibits_r(&dibits, &deinterleaved_dibits);
+			trellis_getconstellationpoints_r(&deinterleaved_dibits, &constellationpoints);
+			if (trellis_extract_tribits_r(&constellationpoints, NULL, &tribits) == NULL)
+				break;
+			trellis_extract_binary_r(&tribits, &binary);
+			if (dmrpacket_data_decode_block_r(dmrpacket_data_convert_binary_to_block_bytes_r(&binary, &data_block_bytes), DMRPACKET_DATA_TYPE_RATE_34_DATA, 0, &data_block) != NULL)
+				bench_sink += data_block.data_length;
+			break;
+		default:
+			break;
+	}
+}
+
+static uint8_t *bench_get_ip_packet_from_pcap_packet(uint8_t *packet, uint32_t *packet_length, int datalink) {
+	uint16_t header_length;
+	uint16_t eth_type;
+
+	switch (datalink) {
+		case DLT_EN10MB: header_length = 14; break;
+		case DLT_LINUX_SLL: header_length = 16; break;
+		default: return packet;
+	}
+	if (*packet_length < header_length)
+		return NULL;
+
+	eth_type = packet[header_length-2] << 8 | packet[header_length-1];
+	if (eth_type != ETHERTYPE_IP)
+		return NULL;
+
+	*packet_length -= header_length;
+	return packet+header_length;
+}
+
+static flag_t bench_load_pcap(char *filename) {
+	char errbuf[PCAP_ERRBUF_SIZE];
+	pcap_t *pcap;
+	struct pcap_pkthdr pkthdr;
+	uint8_t *packet;
+	uint32_t packet_length;
+	struct ip *ip_packet;
+	struct udphdr *udp_packet;
+
+	pcap = pcap_open_offline(filename, errbuf);
+	if (pcap == NULL) {
+		printf("can't open pcap file %s: %s\n", filename, errbuf);
+		return 0;
+	}
+
+	while ((packet = (uint8_t *)pcap_next(pcap, &pkthdr)) != NULL && bench_packets[0].count < BENCH_MAX_INPUTS) {
+		packet_length = pkthdr.caplen;
+		packet = bench_get_ip_packet_from_pcap_packet(packet, &packet_length, pcap_datalink(pcap));
+		if (packet == NULL || packet_length < sizeof(struct ip))
+			continue;
+
+		ip_packet = (struct ip *)packet;
+		if (ip_packet->ip_p != IPPROTO_UDP || packet_length < ip_packet->ip_hl*4+sizeof(struct udphdr))
+			continue;
+
+		udp_packet = (struct udphdr *)(packet+ip_packet->ip_hl*4);
+		if (packet_length < ip_packet->ip_hl*4+ntohs(udp_packet->len))
+			continue;
+
+		if (ipscpacket_decode(ip_packet, udp_packet, &bench_packets[0].packets[bench_packets[0].count], 0))
+			bench_packets[0].count++;
+	}
+	pcap_close(pcap);
+	return 1;
+}
+
+// Collects the inputs for the coders from the loaded IPSC packets.
+static void bench_collect_inputs(void) {
+	ipscpacket_t *ipscpacket;
+	dmrpacket_sync_bits_t sync_bits;
+	dmrpacket_payload_info_bits_t info_bits;
+	bptc_196_96_data_bits_t data_bits;
+	dmrpacket_lc_t lc;
+	dmrpacket_emb_signalling_lc_bits_t emb_signalling_lc_bits;
+	dmrpacket_emb_signalling_lc_bits_t interleaved_emb_signalling_lc_bits;
+	vbptc_16_11_t vbptc;
+	uint32_t i;
+
+	for (i = 0; i < bench_packets[0].count; i++) {
+		ipscpacket = &bench_packets[0].packets[i];
+
+		switch (ipscpacket->slot_type) {
+			case IPSCPACKET_SLOT_TYPE_VOICE_DATA_B:
+			case IPSCPACKET_SLOT_TYPE_VOICE_DATA_C:
+			case IPSCPACKET_SLOT_TYPE_VOICE_DATA_D:
+			case IPSCPACKET_SLOT_TYPE_VOICE_DATA_E:
+			case IPSCPACKET_SLOT_TYPE_VOICE_DATA_F:
+				dmrpacket_sync_extract_bits_r(&ipscpacket->payload_bits, &sync_bits);
+				dmrpacket_emb_extract_from_sync_r(&sync_bits, &bench_quadres_inputs[0][bench_quadres_inputs_count++]);
+				break;
+			case IPSCPACKET_SLOT_TYPE_VOICE_LC_HEADER:
+			case IPSCPACKET_SLOT_TYPE_TERMINATOR_WITH_LC:
+			case IPSCPACKET_SLOT_TYPE_CSBK:
+			case IPSCPACKET_SLOT_TYPE_DATA_HEADER:
+			case IPSCPACKET_SLOT_TYPE_RATE_12_DATA:
+				dmrpacket_slot_type_extract_bits_r(&ipscpacket->payload_bits, &bench_golay_inputs[0][bench_golay_inputs_count++]);
+				dmrpacket_extract_info_bits_r(&ipscpacket->payload_bits, &info_bits);
+				dmrpacket_data_bptc_deinterleave_r(&info_bits, &bench_bptc_inputs[0][bench_bptc_inputs_count]);
+
+				// Reed-Solomon (12,9) codewords are taken from the data part of the BPTC(196,96) coded bursts,
+				// with the checksum recalculated, so the clean inputs contain valid codewords.
+				memcpy(&info_bits, &bench_bptc_inputs[0][bench_bptc_inputs_count++], sizeof(dmrpacket_payload_info_bits_t));
+				if (!bptc_196_96_check_and_repair(info_bits.bits))
+					break;
+				bptc_196_96_extractdata_r(info_bits.bits, &data_bits);
+				base_bitstobytes(data_bits.bits, RS_12_9_DATASIZE*8, bench_rs_inputs[0][bench_rs_inputs_count].data, RS_12_9_DATASIZE);
+				memcpy(bench_rs_inputs[0][bench_rs_inputs_count].data+RS_12_9_DATASIZE,
+					rs_12_9_calc_checksum(&bench_rs_inputs[0][bench_rs_inputs_count])->bytes, RS_12_9_CHECKSUMSIZE);
+				bench_rs_inputs_count++;
+
+				// VBPTC(16,11) inputs are the embedded signalling LCs constructed the same way as
+				// repeaters_start_voice_call() does it, for the calls of the voice LC headers.
+				if (ipscpacket->slot_type != IPSCPACKET_SLOT_TYPE_VOICE_LC_HEADER || dmrpacket_lc_decode_voice_lc_header_r(&data_bits, &lc) == NULL)
+					break;
+				dmrpacket_lc_construct_emb_signalling_lc_r(lc.call_type, lc.dst_id, lc.src_id, &emb_signalling_lc_bits);
+				dmrpacket_emb_signalling_lc_interleave_r(&emb_signalling_lc_bits, &interleaved_emb_signalling_lc_bits);
+				vbptc_16_11_init(&vbptc, 8);
+				vbptc_16_11_construct(&vbptc, interleaved_emb_signalling_lc_bits.bits, sizeof(dmrpacket_emb_signalling_lc_bits_t));
+				vbptc_16_11_get_interleaved_bits(&vbptc, 0, bench_vbptc_inputs[0][bench_vbptc_inputs_count++], sizeof(bench_vbptc_inputs[0][0]));
+				break;
+			case IPSCPACKET_SLOT_TYPE_RATE_34_DATA:
+				dmrpacket_slot_type_extract_bits_r(&ipscpacket->payload_bits, &bench_golay_inputs[0][bench_golay_inputs_count++]);
+				dmrpacket_extract_info_bits_r(&ipscpacket->payload_bits, &bench_trellis_inputs[0][bench_trellis_inputs_count++]);
+				break;
+			default:
+				break;
+		}
+	}
+
+	// Creating the error injected inputs.
+	memcpy(&bench_packets[1], &bench_packets[0], sizeof(bench_packets_t));
+	for (i = 0; i < bench_packets[1].count; i++)
+		bench_flip_random_bit(bench_packets[1].packets[i].payload_bits.bits, 0, sizeof(dmrpacket_payload_bits_t));
+	memcpy(bench_bptc_inputs[1], bench_bptc_inputs[0], sizeof(bench_bptc_inputs[0]));
+	for (i = 0; i < bench_bptc_inputs_count; i++)
+		bench_flip_random_bit(bench_bptc_inputs[1][i].bits, 1, 196); // Bit 0 is not used.
+	memcpy(bench_golay_inputs[1], bench_golay_inputs[0], sizeof(bench_golay_inputs[0]));
+	for (i = 0; i < bench_golay_inputs_count; i++)
+		bench_flip_random_bit(bench_golay_inputs[1][i].bits, 0, sizeof(dmrpacket_slot_type_bits_t));
+	memcpy(bench_quadres_inputs[1], bench_quadres_inputs[0], sizeof(bench_quadres_inputs[0]));
+	for (i = 0; i < bench_quadres_inputs_count; i++)
+		bench_flip_random_bit(bench_quadres_inputs[1][i].bits, 0, sizeof(dmrpacket_emb_bits_t));
+	memcpy(bench_rs_inputs[1], bench_rs_inputs[0], sizeof(bench_rs_inputs[0]));
+	for (i = 0; i < bench_rs_inputs_count; i++)
+		bench_rs_inputs[1][i].data[rand() % (RS_12_9_DATASIZE+RS_12_9_CHECKSUMSIZE)] ^= 1+rand() % 255;
+	memcpy(bench_trellis_inputs[1], bench_trellis_inputs[0], sizeof(bench_trellis_inputs[0]));
+	for (i = 0; i < bench_trellis_inputs_count; i++)
+		bench_flip_random_bit(bench_trellis_inputs[1][i].bits, 0, sizeof(dmrpacket_payload_info_bits_t));
+	memcpy(bench_vbptc_inputs[1], bench_vbptc_inputs[0], sizeof(bench_vbptc_inputs[0]));
+	for (i = 0; i < bench_vbptc_inputs_count; i++)
+		bench_flip_random_bit(bench_vbptc_inputs[1][i], 0, sizeof(bench_vbptc_inputs[1][i]));
+}
+
+static void bench_write_json(FILE *f, unsigned int seed) {
+	bench_result_t *result;
+	uint8_t i;
+
+	fprintf(f, "{\n");
+	fprintf(f, "\t\"version\": \"%u.%u.%u\",\n", VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH);
+	fprintf(f, "\t\"min_time_ms\": %llu,\n", (unsigned long long)bench_min_time_ns/1000000);
+	fprintf(f, "\t\"seed\": %u,\n", seed);
+	fprintf(f, "\t\"packets\": %u,\n", bench_packets[0].count);
+	fprintf(f, "\t\"results\": [\n");
+	for (i = 0; i < bench_results_count; i++) {
+		result = &bench_results[i];
+		fprintf(f, "\t\t{ \"name\": \"%s\", \"input\": \"%s\", \"inputs\": %u, \"ops\": %llu, \"ns_per_op\": %.2f, \"ops_per_sec\": %.0f }%s\n",
+			result->name, result->input, result->inputs_count, (unsigned long long)result->ops, (double)result->elapsed_ns/result->ops,
+			result->ops*1000000000.0/result->elapsed_ns, (i < bench_results_count-1 ? "," : ""));
+	}
+	fprintf(f, "\t]\n");
+	fprintf(f, "}\n");
+}
+
+int main(int argc, char *argv[]) {
+	loglevel_t loglevel = { .raw = 0 };
+	unsigned int seed = 1;
+	char *json_filename = "dmrshark-bench.json";
+	FILE *json_file;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:s:o:h")) != -1) {
+		switch (opt) {
+			case 't': bench_min_time_ns = strtoull(optarg, NULL, 10)*1000000; break;
+			case 's': seed = strtoul(optarg, NULL, 10); break;
+			case 'o': json_filename = optarg; break;
+			default:
+				printf("usage: %s [-t min. ms per benchmark] [-s random seed] [-o json file] [pcap files...]\n", argv[0]);
+				return 1;
+		}
+	}
+	if (optind >= argc) {
+		printf("usage: %s [-t min. ms per benchmark] [-s random seed] [-o json file] [pcap files...]\n", argv[0]);
+		return 1;
+	}
+
+	// We don't want the coders to log anything during the measurements.
+	console_set_loglevel(&loglevel);
+	coding_init();
+	srand(seed);
+
+	for (; optind < argc; optind++) {
+		if (!bench_load_pcap(argv[optind]))
+			return 1;
+	}
+	if (bench_packets[0].count == 0) {
+		printf("no ipsc packets found in the given pcap files\n");
+		return 1;
+	}
+	bench_collect_inputs();
+
+	for (bench_variant = 0; bench_variant < 2; bench_variant++) {
+		bench_run("bptc_196_96", bench_op_bptc_196_96, bench_bptc_inputs_count);
+		bench_run("golay_20_8", bench_op_golay_20_8, bench_golay_inputs_count);
+		bench_run("quadres_16_7", bench_op_quadres_16_7, bench_quadres_inputs_count);
+		bench_run("rs_12_9", bench_op_rs_12_9, bench_rs_inputs_count);
+		bench_run("trellis", bench_op_trellis, bench_trellis_inputs_count);
+		bench_run("vbptc_16_11", bench_op_vbptc_16_11, bench_vbptc_inputs_count);
+		bench_run("dmrpacket_decode_chain", bench_op_dmrpacket_decode_chain, bench_packets[bench_variant].count);
+	}
+
+	// These don't depend on the input data being valid.
+	bench_variant = 0;
+	bench_run("rs_12_9_checksum", bench_op_rs_12_9_checksum, bench_rs_inputs_count);
+	bench_run("crc16_ccitt", bench_op_crc16_ccitt, bench_packets[0].count);
+	bench_run("crc16_ccitt_bytes", bench_op_crc16_ccitt_bytes, bench_packets[0].count);
+	bench_run("crc9_bytes", bench_op_crc9_bytes, bench_packets[0].count);
+	bench_run("crc32_bytes", bench_op_crc32_bytes, bench_packets[0].count);
+	bench_run("base_bytestobits", bench_op_base_bytestobits, bench_packets[0].count);
+
+	json_file = fopen(json_filename, "w");
+	if (json_file == NULL) {
+		printf("can't open %s for writing\n", json_filename);
+		return 1;
+	}
+	bench_write_json(json_file, seed);
+	fclose(json_file);
+	printf("results written to %s\n", json_filename);
+
+	return 0;
+}
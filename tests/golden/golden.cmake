@@ -0,0 +1,30 @@
+# Replays PCAP with dmrshark's replay bench, writes the decoded events to OUTPUT and compares
+# them with GOLDEN. If the DMRSHARK_UPDATE_GOLDEN environment variable is set, GOLDEN is
+# overwritten with the new events instead, for example:
+#   DMRSHARK_UPDATE_GOLDEN=1 ctest -R golden
+
+# The config is always generated from the defaults, so local changes can't affect the results.
+file(REMOVE ${CONFIG})
+
+execute_process(COMMAND ${DMRSHARK} -c ${CONFIG} --replay-bench ${PCAP} --replay-events ${OUTPUT}
+	RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+	message(FATAL_ERROR "replaying ${PCAP} failed")
+endif()
+
+if(DEFINED ENV{DMRSHARK_UPDATE_GOLDEN})
+	configure_file(${OUTPUT} ${GOLDEN} COPYONLY)
+	message(STATUS "updated ${GOLDEN}")
+	return()
+endif()
+
+if(NOT EXISTS ${GOLDEN})
+	message(FATAL_ERROR "golden file ${GOLDEN} is missing, create it with DMRSHARK_UPDATE_GOLDEN=1")
+endif()
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${OUTPUT} ${GOLDEN}
+	RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+	execute_process(COMMAND diff -u ${GOLDEN} ${OUTPUT})
+	message(FATAL_ERROR "decoded events of ${PCAP} differ from ${GOLDEN}")
+endif()
@@ -0,0 +1,368 @@
+// Runs the reentrant (_r) decode/encode chains concurrently on multiple threads, and compares
+// every result with the one calculated by a single thread before the threads were started.
+// Covered chains: the trellis, BPTC(196,96) and Reed-Solomon (12,9) coders, the dmrpacket
+// decode and encode chains of data and voice bursts, and if dmrshark is built with
+// AMBEDECODEVOICE (and MP3ENCODEVOICE), AMBE voice decoding (and MP3 encoding) with a
+// voicestream for every thread.
+// Build with -DCMAKE_C_FLAGS=-fsanitize=thread to run it under ThreadSanitizer.
+// Usage: test-reentrant [threads] [iterations]
+
+#include <dmrshark/defaults.h>
+
+#include <libs/coding/coding.h>
+#include <libs/coding/trellis.h>
+#include <libs/coding/bptc-196-96.h>
+#include <libs/coding/rs-12-9.h>
+#include <libs/dmrpacket/dmrpacket.h>
+#include <libs/dmrpacket/dmrpacket-sync.h>
+#include <libs/dmrpacket/dmrpacket-slot-type.h>
+#include <libs/dmrpacket/dmrpacket-emb.h>
+#include <libs/dmrpacket/dmrpacket-lc.h>
+#include <libs/dmrpacket/dmrpacket-csbk.h>
+#include <libs/dmrpacket/dmrpacket-data.h>
+#include <libs/voicestreams/voicestreams-decode.h>
+#include <libs/voicestreams/voicestreams-mp3.h>
+#include <libs/daemon/console.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INPUTS_COUNT			512
+#define MAX_THREADS				64
+// Voice bursts are decoded in order with the decoder state of the thread, so only a part of
+// the inputs is used for them to keep the test fast.
+#define VOICE_INPUTS_COUNT		64
+#define MP3_OUTPUT_MAX_SIZE		65536
+
+typedef struct {
+	dmrpacket_data_binary_t binary;
+	bptc_196_96_data_bits_t data_bits;
+	rs_12_9_codeword_t codeword;
+
+	dmr_call_type_t call_type;
+	dmr_id_t dst_id;
+	dmr_id_t src_id;
+	dmr_emb_lcss_t lcss;
+	dmrpacket_payload_bits_t data_burst; // Voice LC header, terminator with LC or CSBK.
+	dmrpacket_payload_bits_t voice_burst;
+} input_t;
+
+typedef struct {
+	dmrpacket_data_binary_t binary;
+	uint16_t path_metric;
+	bptc_196_96_data_bits_t data_bits;
+	rs_12_9_checksum_t checksum;
+
+	dmrpacket_slot_type_t slot_type;
+	bptc_196_96_data_bits_t burst_data_bits;
+	dmrpacket_lc_t lc;
+	dmrpacket_csbk_t csbk;
+	dmrpacket_payload_info_bits_t reconstructed_info_bits;
+	dmrpacket_emb_t emb;
+	dmrpacket_emb_signalling_lc_fragment_bits_t emb_signalling_lc_fragment_bits;
+	dmrpacket_lc_t emb_signalling_lc;
+	dmrpacket_payload_voice_bits_t voice_bits;
+} output_t;
+
+static input_t inputs[INPUTS_COUNT];
+static output_t expected_outputs[INPUTS_COUNT];
+static int iterations = 20;
+static int mismatches = 0;
+
+#ifdef AMBEDECODEVOICE
+static voicestream_t voicestreams[MAX_THREADS];
+static voicestreams_decoded_frame_t expected_decoded_frames[VOICE_INPUTS_COUNT*3];
+#ifdef MP3ENCODEVOICE
+static voicestream_t reference_voicestream;
+static uint8_t expected_mp3_output[MP3_OUTPUT_MAX_SIZE];
+static uint32_t expected_mp3_output_size;
+#endif
+#endif
+
+static void process(input_t *input, output_t *output) {
+	trellis_tribits_t tribits;
+	trellis_constellationpoints_t constellationpoints;
+	trellis_dibits_t dibits;
+	trellis_dibits_t interleaved_dibits;
+	dmrpacket_payload_info_bits_t info_bits;
+	dmrpacket_slot_type_bits_t slot_type_bits;
+	dmrpacket_sync_bits_t sync_bits;
+	dmrpacket_emb_bits_t emb_bits;
+	dmrpacket_emb_signalling_lc_bits_t emb_signalling_lc_bits;
+	dmrpacket_emb_signalling_lc_bits_t interleaved_emb_signalling_lc_bits;
+	bptc_196_96_data_bits_t data_bits;
+
+	memset(output, 0, sizeof(output_t));
+
+	// Rate 3/4 data: encoding, then decoding the result.
+	trellis_construct_tribits_r(&input->binary, &tribits);
+	trellis_construct_constellationpoints_r(&tribits, &constellationpoints);
+	trellis_construct_deinterleaved_dibits_r(&constellationpoints, &dibits);
+	trellis_interleave_dibits_r(&dibits, &interleaved_dibits);
+	trellis_construct_payload_info_bits_r(&interleaved_dibits, &info_bits);
+
+	trellis_extract_dibits_r(&info_bits, &interleaved_dibits);
+	trellis_deinterleave_dibits_r(&interleaved_dibits, &dibits);
+	trellis_getconstellationpoints_r(&dibits, &constellationpoints);
+	if (trellis_extract_tribits_r(&constellationpoints, &output->path_metric, &tribits) != NULL)
+		trellis_extract_binary_r(&tribits, &output->binary);
+
+	// BPTC(196,96) encoding and decoding.
+	bptc_196_96_generate_r(&input->data_bits, &info_bits);
+	if (bptc_196_96_check_and_repair(info_bits.bits))
+		bptc_196_96_extractdata_r(info_bits.bits, &output->data_bits);
+
+	rs_12_9_calc_checksum_r(&input->codeword, &output->checksum);
+
+	// Decoding the data burst, then encoding the decoded LC or CSBK again.
+	dmrpacket_slot_type_decode_r(dmrpacket_slot_type_extract_bits_r(&input->data_burst, &slot_type_bits), &output->slot_type);
+	dmrpacket_data_extract_and_repair_bptc_data_r(&input->data_burst, &output->burst_data_bits);
+	switch (output->slot_type.data_type) {
+		case DMRPACKET_DATA_TYPE_VOICE_LC_HEADER:
+			dmrpacket_lc_decode_voice_lc_header_r(&output->burst_data_bits, &output->lc);
+			dmrpacket_lc_construct_voice_lc_header_r(output->lc.call_type, output->lc.dst_id, output->lc.src_id, &data_bits);
+			break;
+		case DMRPACKET_DATA_TYPE_TERMINATOR_WITH_LC:
+			dmrpacket_lc_decode_terminator_with_lc_r(&output->burst_data_bits, &output->lc);
+			dmrpacket_lc_construct_terminator_with_lc_r(output->lc.call_type, output->lc.dst_id, output->lc.src_id, &data_bits);
+			break;
+		case DMRPACKET_DATA_TYPE_CSBK:
+			dmrpacket_csbk_decode_r(&output->burst_data_bits, &output->csbk);
+			dmrpacket_csbk_construct_r(&output->csbk, &data_bits);
+			break;
+		default:
+			return;
+	}
+	dmrpacket_data_bptc_interleave_r(bptc_196_96_generate_r(&data_bits, &info_bits), &output->reconstructed_info_bits);
+
+	// Decoding the voice burst's EMB and voice bits.
+	dmrpacket_sync_extract_bits_r(&input->voice_burst, &sync_bits);
+	dmrpacket_emb_decode_r(dmrpacket_emb_extract_from_sync_r(&sync_bits, &emb_bits), &output->emb);
+	dmrpacket_emb_signalling_lc_fragment_extract_from_sync_r(&sync_bits, &output->emb_signalling_lc_fragment_bits);
+	dmrpacket_extract_voice_bits_r(&input->voice_burst, &output->voice_bits);
+
+	// Embedded signalling LC encoding and decoding.
+	dmrpacket_lc_construct_emb_signalling_lc_r(input->call_type, input->dst_id, input->src_id, &emb_signalling_lc_bits);
+	dmrpacket_emb_signalling_lc_interleave_r(&emb_signalling_lc_bits, &interleaved_emb_signalling_lc_bits);
+	dmrpacket_emb_signalling_lc_deinterleave_r(&interleaved_emb_signalling_lc_bits, &emb_signalling_lc_bits);
+	dmrpacket_lc_decode_emb_signalling_lc_r(&emb_signalling_lc_bits, &output->emb_signalling_lc);
+}
+
+#ifdef AMBEDECODEVOICE
+// Decodes the AMBE frames of the voice bursts in order, and calls the callback with every decoded frame.
+static void process_voice(voicestream_t *voicestream, void (*callback)(voicestream_t *voicestream, uint16_t frame_nr, voicestreams_decoded_frame_t *decoded_frame)) {
+	voicestreams_decoded_frame_t decoded_frame;
+	uint8_t j;
+	int i;
+
+	voicestreams_decode_ambe_init(&voicestream->sources[0]);
+	for (i = 0; i < VOICE_INPUTS_COUNT; i++) {
+		for (j = 0; j < 3; j++) {
+			voicestreams_decode_ambe_frame_r(&expected_outputs[i].voice_bits.ambe_frames.frames[j], voicestream, &voicestream->sources[0], &decoded_frame);
+			callback(voicestream, i*3+j, &decoded_frame);
+		}
+	}
+}
+
+static void store_decoded_frame(voicestream_t *voicestream, uint16_t frame_nr, voicestreams_decoded_frame_t *decoded_frame) {
+	memcpy(&expected_decoded_frames[frame_nr], decoded_frame, sizeof(voicestreams_decoded_frame_t));
+}
+
+static void check_decoded_frame(voicestream_t *voicestream, uint16_t frame_nr, voicestreams_decoded_frame_t *decoded_frame) {
+	if (memcmp(decoded_frame, &expected_decoded_frames[frame_nr], sizeof(voicestreams_decoded_frame_t)) != 0)
+		__sync_fetch_and_add(&mismatches, 1);
+}
+
+#ifdef MP3ENCODEVOICE
+static void init_mp3_encoder(voicestream_t *voicestream) {
+	voicestream->mp3bitrate = 64;
+	voicestream->minmp3bitrate = 32;
+	voicestream->mp3quality = 2;
+	voicestream->mp3chunkinms = VOICESTREAMS_MP3_MIN_CHUNK_IN_MS;
+	voicestreams_mp3_init(voicestream);
+}
+
+// Encodes the expected decoded frames with the stream's encoder, and returns the size of the MP3 data.
+static uint32_t process_mp3(voicestream_t *voicestream, uint8_t *output) {
+	voicestreams_mp3_frame_t mp3frame;
+	uint32_t output_size = 0;
+	int i;
+
+	for (i = 0; i <= VOICE_INPUTS_COUNT*3; i++) {
+		if (i < VOICE_INPUTS_COUNT*3) {
+			if (voicestreams_mp3_encode_r(voicestream, &expected_decoded_frames[i], &mp3frame) == NULL)
+				continue;
+		} else
+			voicestreams_mp3_encode_flush(voicestream, &mp3frame);
+
+		if (output_size+mp3frame.bytes_size > MP3_OUTPUT_MAX_SIZE)
+			break;
+		memcpy(output+output_size, mp3frame.bytes, mp3frame.bytes_size);
+		output_size += mp3frame.bytes_size;
+	}
+	return output_size;
+}
+#endif
+#endif
+
+static void *thread_main(void *arg) {
+	int thread_nr = (int)(long)arg;
+	output_t output;
+	int i, j;
+#if defined(AMBEDECODEVOICE) && defined(MP3ENCODEVOICE)
+	uint8_t *mp3_output;
+	uint32_t mp3_output_size;
+
+	// The encoder state changes with every encoded frame, so the MP3 data is only checked once.
+	mp3_output = (uint8_t *)malloc(MP3_OUTPUT_MAX_SIZE);
+	if (mp3_output != NULL) {
+		mp3_output_size = process_mp3(&voicestreams[thread_nr], mp3_output);
+		if (mp3_output_size != expected_mp3_output_size || memcmp(mp3_output, expected_mp3_output, mp3_output_size) != 0)
+			__sync_fetch_and_add(&mismatches, 1);
+		free(mp3_output);
+	}
+#endif
+
+	for (i = 0; i < iterations; i++) {
+		for (j = (thread_nr+i) % INPUTS_COUNT; j < INPUTS_COUNT; j++) {
+			process(&inputs[j], &output);
+			if (memcmp(&output, &expected_outputs[j], sizeof(output_t)) != 0)
+				__sync_fetch_and_add(&mismatches, 1);
+		}
+#ifdef AMBEDECODEVOICE
+		process_voice(&voicestreams[thread_nr], check_decoded_frame);
+#endif
+	}
+	return NULL;
+}
+
+static void construct_bursts(input_t *input, int input_nr) {
+	dmrpacket_csbk_t csbk;
+	dmrpacket_emb_signalling_lc_fragment_bits_t emb_signalling_lc_fragment_bits;
+	dmrpacket_payload_voice_bits_t voice_bits;
+	dmrpacket_data_type_t data_type;
+	bptc_196_96_data_bits_t *data_bits;
+	int i;
+
+	memset(&input->data_burst, 0, sizeof(dmrpacket_payload_bits_t));
+	switch (input_nr % 3) {
+		case 0:
+			data_type = DMRPACKET_DATA_TYPE_VOICE_LC_HEADER;
+			data_bits = dmrpacket_lc_construct_voice_lc_header(input->call_type, input->dst_id, input->src_id);
+			break;
+		case 1:
+			data_type = DMRPACKET_DATA_TYPE_TERMINATOR_WITH_LC;
+			data_bits = dmrpacket_lc_construct_terminator_with_lc(input->call_type, input->dst_id, input->src_id);
+			break;
+		default:
+			memset(&csbk, 0, sizeof(dmrpacket_csbk_t));
+			csbk.last_block = 1;
+			csbk.csbko = DMRPACKET_CSBKO_PREAMBLE;
+			csbk.data.preamble.data_follows = 1;
+			csbk.data.preamble.dst_is_group = (input->call_type == DMR_CALL_TYPE_GROUP);
+			csbk.data.preamble.csbk_blocks_to_follow = rand() & 0xff;
+			csbk.dst_id = input->dst_id;
+			csbk.src_id = input->src_id;
+			data_type = DMRPACKET_DATA_TYPE_CSBK;
+			data_bits = dmrpacket_csbk_construct(&csbk);
+			break;
+	}
+	dmrpacket_insert_info_bits(&input->data_burst, dmrpacket_data_bptc_interleave(bptc_196_96_generate(data_bits)));
+	dmrpacket_slot_type_insert_bits(&input->data_burst, dmrpacket_slot_type_construct_bits(1, data_type));
+	dmrpacket_sync_insert_bits(&input->data_burst, dmrpacket_sync_construct_bits(DMRPACKET_SYNC_PATTERN_TYPE_BS_SOURCED_DATA));
+
+	memset(&input->voice_burst, 0, sizeof(dmrpacket_payload_bits_t));
+	for (i = 0; i < sizeof(voice_bits.raw.bits); i++)
+		voice_bits.raw.bits[i] = rand() & 1;
+	for (i = 0; i < sizeof(emb_signalling_lc_fragment_bits.bits); i++)
+		emb_signalling_lc_fragment_bits.bits[i] = rand() & 1;
+	dmrpacket_insert_voice_bits(&input->voice_burst, &voice_bits);
+	dmrpacket_emb_insert_bits(&input->voice_burst, dmrpacket_emb_construct_bits(input->lcss));
+	dmrpacket_lc_insert_emb_signalling_lc_fragment_bits(&input->voice_burst, &emb_signalling_lc_fragment_bits);
+}
+
+int main(int argc, char *argv[]) {
+	loglevel_t loglevel = { .raw = 0 };
+	pthread_t threads[MAX_THREADS];
+	int threads_count = 4;
+	int i, j;
+
+	if (argc > 1)
+		threads_count = atoi(argv[1]);
+	if (argc > 2)
+		iterations = atoi(argv[2]);
+	if (threads_count < 1 || threads_count > MAX_THREADS || iterations < 1) {
+		printf("usage: %s [threads] [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	// The coders log to the console, we don't need it here.
+	console_set_loglevel(&loglevel);
+	coding_init();
+
+	srand(1);
+	for (i = 0; i < INPUTS_COUNT; i++) {
+		// The 48 tribits carry 144 data bits, the tail constellation point is added by the encoder.
+		for (j = 0; j < 48*3; j++)
+			inputs[i].binary.bits[j] = rand() & 1;
+		for (j = 0; j < sizeof(inputs[i].data_bits.bits); j++)
+			inputs[i].data_bits.bits[j] = rand() & 1;
+		for (j = 0; j < RS_12_9_DATASIZE; j++)
+			inputs[i].codeword.data[j] = rand() & 0xff;
+
+		inputs[i].call_type = (rand() & 1 ? DMR_CALL_TYPE_GROUP : DMR_CALL_TYPE_PRIVATE);
+		inputs[i].dst_id = rand() & 0xffffff;
+		inputs[i].src_id = rand() & 0xffffff;
+		inputs[i].lcss = rand() & 0x03;
+		construct_bursts(&inputs[i], i);
+
+		process(&inputs[i], &expected_outputs[i]);
+		if (memcmp(&expected_outputs[i].binary, &inputs[i].binary, sizeof(dmrpacket_data_binary_t)) != 0 ||
+			memcmp(&expected_outputs[i].data_bits, &inputs[i].data_bits, sizeof(bptc_196_96_data_bits_t)) != 0) {
+				printf("input #%u: encode/decode roundtrip failed\n", i);
+				return 1;
+		}
+		if (memcmp(&expected_outputs[i].reconstructed_info_bits, dmrpacket_extract_info_bits(&inputs[i].data_burst), sizeof(dmrpacket_payload_info_bits_t)) != 0 ||
+			expected_outputs[i].emb.lcss != inputs[i].lcss || expected_outputs[i].emb_signalling_lc.dst_id != inputs[i].dst_id ||
+			expected_outputs[i].emb_signalling_lc.src_id != inputs[i].src_id) {
+				printf("input #%u: dmrpacket decode/encode roundtrip failed\n", i);
+				return 1;
+		}
+	}
+
+#ifdef AMBEDECODEVOICE
+	for (i = 0; i < threads_count; i++) {
+		voicestreams[i].name = "reentrant";
+		voicestreams[i].decodequality = voicestreams[i].active_decodequality = 3;
+#ifdef MP3ENCODEVOICE
+		init_mp3_encoder(&voicestreams[i]);
+#endif
+	}
+	process_voice(&voicestreams[0], store_decoded_frame);
+#ifdef MP3ENCODEVOICE
+	reference_voicestream.name = "reference";
+	init_mp3_encoder(&reference_voicestream);
+	expected_mp3_output_size = process_mp3(&reference_voicestream, expected_mp3_output);
+	voicestreams_mp3_deinit(&reference_voicestream);
+#endif
+#endif
+
+	for (i = 0; i < threads_count; i++) {
+		if (pthread_create(&threads[i], NULL, thread_main, (void *)(long)i) != 0) {
+			printf("can't create thread\n");
+			return 1;
+		}
+	}
+	for (i = 0; i < threads_count; i++)
+		pthread_join(threads[i], NULL);
+
+#if defined(AMBEDECODEVOICE) && defined(MP3ENCODEVOICE)
+	for (i = 0; i < threads_count; i++)
+		voicestreams_mp3_deinit(&voicestreams[i]);
+#endif
+
+	printf("%u threads, %u iterations, %u mismatches\n", threads_count, iterations, mismatches);
+	return (mismatches > 0);
+}
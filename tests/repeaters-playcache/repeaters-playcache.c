@@ -0,0 +1,167 @@
+// Plays generated AMBE files with repeaters_play_ambe_file(), which sends the IPSC payloads cached
+// by repeaters-playcache.c, and compares the queued packets (including their sequence numbers) and
+// the slot's TX state with the ones queued by repeaters_start_voice_call(), repeaters_play_ambe_data()
+// and repeaters_end_voice_call(). Every file is played twice, so cache hits are checked too, and there
+// are more call parameter combinations than cache entries, so entries get replaced.
+// Usage: test-repeaters-playcache [config file] [ambe file]
+
+#include <libs/comm/repeaters.h>
+#include <libs/config/config.h>
+#include <libs/coding/coding.h>
+#include <libs/daemon/console.h>
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MASTER_IP		"10.0.0.1"
+#define REPEATER_IP		"10.0.0.2"
+#define DST_ID			2160
+#define SRC_ID			2161234
+
+static const uint32_t frames_counts[] = { 0, 1, 5, 6, 7, 100 };
+
+static flag_t write_config(char *filename) {
+	FILE *f = fopen(filename, "w");
+
+	if (f == NULL) {
+		printf("can't open %s for writing\n", filename);
+		return 0;
+	}
+	fprintf(f, "[main]\nmasteripaddr=%s\n", MASTER_IP);
+	fclose(f);
+	return 1;
+}
+
+// Every file gets different frames, so a stale cache entry would show up as a mismatch.
+static flag_t write_ambe_file(char *filename, dmrpacket_payload_voice_bytes_t *frames, uint32_t frames_count) {
+	FILE *f = fopen(filename, "w");
+	uint32_t i;
+	uint8_t j;
+
+	if (f == NULL) {
+		printf("can't open %s for writing\n", filename);
+		return 0;
+	}
+	for (i = 0; i < frames_count; i++) {
+		for (j = 0; j < sizeof(dmrpacket_payload_voice_bytes_t); j++)
+			frames[i].bytes[j] = (frames_count*31+i*7+j*13) & 0xff;
+	}
+	if (frames_count > 0 && fwrite(frames, sizeof(dmrpacket_payload_voice_bytes_t), frames_count, f) != frames_count) {
+		printf("can't write %s\n", filename);
+		fclose(f);
+		return 0;
+	}
+	fclose(f);
+	return 1;
+}
+
+static void free_packet_buffer(repeater_t *repeater, dmr_timeslot_t ts) {
+	ipscrawpacketbuf_t *next_entry;
+
+	while (repeater->slot[ts].ipsc_tx_rawpacketbuf != NULL) {
+		next_entry = repeater->slot[ts].ipsc_tx_rawpacketbuf->next;
+		free(repeater->slot[ts].ipsc_tx_rawpacketbuf);
+		repeater->slot[ts].ipsc_tx_rawpacketbuf = next_entry;
+	}
+}
+
+// Returns the number of mismatches between the packets queued to the reference and the tested repeater.
+static int compare(repeater_t *ref_repeater, repeater_t *repeater, dmr_timeslot_t ts, uint32_t frames_count, char *desc) {
+	ipscrawpacketbuf_t *ref_entry = ref_repeater->slot[ts].ipsc_tx_rawpacketbuf;
+	ipscrawpacketbuf_t *entry = repeater->slot[ts].ipsc_tx_rawpacketbuf;
+	ipscpacket_payload_raw_t *payload_raw;
+	uint32_t packets_count = 0;
+	int mismatches = 0;
+
+	while (ref_entry != NULL && entry != NULL) {
+		payload_raw = (ipscpacket_payload_raw_t *)(entry->ipscpacket_raw.bytes+20+8);
+		if (payload_raw->seq != (packets_count & 0xff)) {
+			printf("%s: packet %u has seqnum %u\n", desc, packets_count, payload_raw->seq);
+			mismatches++;
+		}
+		if (memcmp(&ref_entry->ipscpacket_raw, &entry->ipscpacket_raw, sizeof(ipscpacket_raw_t)) != 0 || ref_entry->nowait != entry->nowait) {
+			printf("%s: packet %u differs\n", desc, packets_count);
+			mismatches++;
+		}
+		ref_entry = ref_entry->next;
+		entry = entry->next;
+		packets_count++;
+	}
+	if (ref_entry != NULL || entry != NULL || packets_count != frames_count+4) {
+		printf("%s: packet count mismatch\n", desc);
+		mismatches++;
+	}
+	if (ref_repeater->slot[ts].ipsc_tx_seqnum != repeater->slot[ts].ipsc_tx_seqnum ||
+		ref_repeater->slot[ts].ipsc_tx_voice_frame_num != repeater->slot[ts].ipsc_tx_voice_frame_num) {
+			printf("%s: slot tx state differs\n", desc);
+			mismatches++;
+	}
+	return mismatches;
+}
+
+int main(int argc, char *argv[]) {
+	static dmrpacket_payload_voice_bytes_t frames[100];
+	loglevel_t loglevel = { .raw = 0 };
+	char *config_filename = "repeaters-playcache.cfg";
+	char *ambe_filename = "repeaters-playcache.ambe";
+	repeater_t *ref_repeater;
+	repeater_t *repeater;
+	dmr_timeslot_t ts;
+	dmr_call_type_t calltype;
+	char desc[100];
+	int mismatches = 0;
+	uint32_t i;
+	uint32_t j;
+	uint8_t play;
+
+	if (argc > 1)
+		config_filename = argv[1];
+	if (argc > 2)
+		ambe_filename = argv[2];
+
+	if (!write_config(config_filename))
+		return 1;
+
+	console_set_loglevel(&loglevel);
+	config_init(config_filename);
+	coding_init();
+
+	ref_repeater = (repeater_t *)calloc(1, sizeof(repeater_t));
+	repeater = (repeater_t *)calloc(1, sizeof(repeater_t));
+	if (ref_repeater == NULL || repeater == NULL)
+		return 1;
+	inet_aton(REPEATER_IP, &ref_repeater->ipaddr);
+	inet_aton(REPEATER_IP, &repeater->ipaddr);
+
+	for (i = 0; i < sizeof(frames_counts)/sizeof(frames_counts[0]); i++) {
+		if (!write_ambe_file(ambe_filename, frames, frames_counts[i]))
+			return 1;
+
+		for (ts = 0; ts < 2; ts++) {
+			for (calltype = DMR_CALL_TYPE_PRIVATE; calltype <= DMR_CALL_TYPE_GROUP; calltype++) {
+				repeaters_start_voice_call(ref_repeater, ts, calltype, DST_ID, SRC_ID);
+				for (j = 0; j < frames_counts[i]; j++)
+					repeaters_play_ambe_data(&frames[j], ref_repeater, ts, calltype, DST_ID, SRC_ID);
+				repeaters_end_voice_call(ref_repeater, ts, calltype, DST_ID, SRC_ID);
+
+				for (play = 0; play < 2; play++) {
+					repeaters_play_ambe_file(ambe_filename, repeater, ts, calltype, DST_ID, SRC_ID);
+					snprintf(desc, sizeof(desc), "%u frames ts%u calltype %u play %u", frames_counts[i], ts+1, calltype, play+1);
+					mismatches += compare(ref_repeater, repeater, ts, frames_counts[i], desc);
+					free_packet_buffer(repeater, ts);
+				}
+				free_packet_buffer(ref_repeater, ts);
+			}
+		}
+	}
+
+	repeaters_deinit();
+	free(ref_repeater);
+	free(repeater);
+	config_deinit();
+
+	printf("mismatches: %d\n", mismatches);
+	return (mismatches > 0);
+}
@@ -0,0 +1,157 @@
+// Compares the table driven Reed-Solomon (12,9) syndrome calculation with the previous
+// implementation, which did a log/antilog lookup with zero checks for every multiplication.
+// Usage: test-rs-12-9-bench [iterations]
+
+#include <libs/coding/rs-12-9.h>
+#include <libs/daemon/console.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CODEWORDS_COUNT 1024
+
+static uint8_t ref_exp_table[256];
+static uint8_t ref_log_table[256];
+
+// The Reed-Solomon coder logs to the console, we don't need it here.
+loglevel_t console_get_loglevel(void) {
+	loglevel_t loglevel = { .raw = 0 };
+	return loglevel;
+}
+
+void console_log(const char *format, ...) {
+}
+
+// Generates the same tables as in rs-12-9.c with the primitive polynomial x^8+x^4+x^3+x^2+1.
+static void ref_init(void) {
+	uint16_t i;
+	uint16_t x = 1;
+
+	for (i = 0; i < 255; i++) {
+		ref_exp_table[i] = x;
+		ref_log_table[x] = i;
+		x <<= 1;
+		if (x & 0x100)
+			x ^= 0x11d;
+	}
+	ref_exp_table[255] = ref_exp_table[0];
+}
+
+static uint8_t ref_galois_multiplication(uint8_t a, uint8_t b) {
+	if (a == 0 || b == 0)
+		return 0;
+
+	return ref_exp_table[(ref_log_table[a] + ref_log_table[b]) % 255];
+}
+
+static void ref_calc_syndrome(rs_12_9_codeword_t *codeword, rs_12_9_poly_t *syndrome) {
+	uint8_t i, j;
+
+	syndrome->data[0] = syndrome->data[1] = syndrome->data[2] = 0;
+
+	for (j = 0; j < 3;  j++) {
+		for (i = 0; i < sizeof(rs_12_9_codeword_t); i++)
+			syndrome->data[j] = codeword->data[i] ^ ref_galois_multiplication(ref_exp_table[j+1], syndrome->data[j]);
+	}
+}
+
+static flag_t ref_check_syndrome(rs_12_9_poly_t *syndrome) {
+	uint8_t i;
+
+	for (i = 0; i < 3; i++) {
+		if (syndrome->data[i] != 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+static double get_time_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1e9+ts.tv_nsec;
+}
+
+static void generate_codewords(rs_12_9_codeword_t *codewords, flag_t add_errors) {
+	rs_12_9_checksum_t *checksum;
+	uint16_t i;
+	uint8_t j;
+
+	for (i = 0; i < CODEWORDS_COUNT; i++) {
+		for (j = 0; j < RS_12_9_DATASIZE; j++)
+			codewords[i].data[j] = rand();
+		checksum = rs_12_9_calc_checksum(&codewords[i]);
+		memcpy(codewords[i].data+RS_12_9_DATASIZE, checksum->bytes, RS_12_9_CHECKSUMSIZE);
+
+		if (add_errors)
+			codewords[i].data[rand() % sizeof(rs_12_9_codeword_t)] ^= 1+rand() % 255;
+	}
+}
+
+static int bench(char *name, rs_12_9_codeword_t *codewords, unsigned long iterations) {
+	rs_12_9_poly_t ref_syndrome;
+	rs_12_9_poly_t syndrome;
+	rs_12_9_codeword_t corrected;
+	uint8_t errors_found;
+	double start, ref_ns, ns, correct_ns;
+	unsigned long i;
+	volatile flag_t sink = 0;
+	int mismatches = 0;
+
+	for (i = 0; i < CODEWORDS_COUNT; i++) {
+		ref_calc_syndrome(&codewords[i], &ref_syndrome);
+		rs_12_9_calc_syndrome(&codewords[i], &syndrome);
+		if (memcmp(ref_syndrome.data, syndrome.data, 3) != 0 || ref_check_syndrome(&ref_syndrome) != rs_12_9_check_syndrome(&syndrome))
+			mismatches++;
+	}
+
+	start = get_time_ns();
+	for (i = 0; i < iterations; i++) {
+		ref_calc_syndrome(&codewords[i % CODEWORDS_COUNT], &ref_syndrome);
+		sink ^= ref_check_syndrome(&ref_syndrome);
+	}
+	ref_ns = (get_time_ns()-start)/iterations;
+
+	start = get_time_ns();
+	for (i = 0; i < iterations; i++) {
+		rs_12_9_calc_syndrome(&codewords[i % CODEWORDS_COUNT], &syndrome);
+		sink ^= rs_12_9_check_syndrome(&syndrome);
+	}
+	ns = (get_time_ns()-start)/iterations;
+
+	start = get_time_ns();
+	for (i = 0; i < iterations; i++) {
+		memcpy(&corrected, &codewords[i % CODEWORDS_COUNT], sizeof(rs_12_9_codeword_t));
+		rs_12_9_calc_syndrome(&corrected, &syndrome);
+		sink ^= rs_12_9_correct_errors(&corrected, &syndrome, &errors_found);
+	}
+	correct_ns = (get_time_ns()-start)/iterations;
+
+	printf("%s codewords: syndrome previous %.1f ns/op, table driven %.1f ns/op (%.1fx), syndrome+correct %.1f ns/op, %u mismatches\n",
+		name, ref_ns, ns, ref_ns/ns, correct_ns, mismatches);
+
+	return mismatches;
+}
+
+int main(int argc, char *argv[]) {
+	static rs_12_9_codeword_t codewords[CODEWORDS_COUNT];
+	unsigned long iterations = 1000000;
+	int mismatches = 0;
+
+	if (argc > 1)
+		iterations = strtoul(argv[1], NULL, 10);
+
+	srand(1);
+	ref_init();
+	rs_12_9_init();
+
+	generate_codewords(codewords, 0);
+	mismatches += bench("clean", codewords, iterations);
+	generate_codewords(codewords, 1);
+	mismatches += bench("single byte error", codewords, iterations);
+
+	return (mismatches > 0);
+}
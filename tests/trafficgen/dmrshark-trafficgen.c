@@ -0,0 +1,562 @@
+// Generates synthetic IPSC traffic of the given number of virtual repeaters using the packet
+// constructors of libs/comm/ipscpacket.c: voice calls (voice LC headers, voice superframes with
+// embedded signalling LC, terminators) and SMS data sessions (CSBK preambles, IPSC sync, data header,
+// data blocks) on both timeslots of every repeater. Packets are written to a pcap file (with the given
+// start time as the base of the timestamps), or injected to the given network interface at the
+// original packet rate multiplied by the given speed (0 means as fast as possible).
+// The same random seed and arguments always generate the same traffic.
+// Usage: dmrshark-trafficgen [-r repeaters] [-c max. simultaneous calls] [-d duration in sec] [-s random seed]
+//                            [-t start time] [-p data session percent] [-a ambe file] [-m master ip]
+//                            [-o pcap file] [-i interface] [-x speed]
+
+#include <dmrshark/defaults.h>
+
+#include <libs/coding/coding.h>
+#include <libs/coding/vbptc-16-11.h>
+#include <libs/dmrpacket/dmrpacket-lc.h>
+#include <libs/dmrpacket/dmrpacket-emb.h>
+#include <libs/dmrpacket/dmrpacket-csbk.h>
+#include <libs/dmrpacket/dmrpacket-data.h>
+#include <libs/dmrpacket/dmrpacket-data-header.h>
+#include <libs/comm/ipscpacket.h>
+#include <libs/base/base.h>
+#include <libs/daemon/console.h>
+
+#include <pcap/pcap.h>
+#include <netinet/if_ether.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+// A DMR burst takes 60ms on one timeslot.
+#define TRAFFICGEN_BURST_INTERVAL_US		60000
+#define TRAFFICGEN_MIN_IDLE_US				1000000
+#define TRAFFICGEN_MAX_IDLE_US				15000000
+#define TRAFFICGEN_MIN_CALL_US				2000000
+#define TRAFFICGEN_MAX_CALL_US				20000000
+// If the simultaneous call limit is reached, the slot retries starting a call after this time.
+#define TRAFFICGEN_CALL_RETRY_US			1000000
+#define TRAFFICGEN_PRIVATE_CALL_PERCENT		10
+#define TRAFFICGEN_CSBK_PREAMBLES			20
+#define TRAFFICGEN_MAX_REPEATERS			(250*256)
+
+typedef enum {
+	TRAFFICGEN_SLOT_STATE_IDLE,
+	TRAFFICGEN_SLOT_STATE_VOICE_LC_HEADER,
+	TRAFFICGEN_SLOT_STATE_VOICE,
+	TRAFFICGEN_SLOT_STATE_VOICE_TERMINATOR,
+	TRAFFICGEN_SLOT_STATE_DATA
+} trafficgen_slot_state_t;
+
+typedef struct {
+	struct in_addr ipaddr;
+	uint8_t ethaddr[ETH_ALEN];
+} trafficgen_repeater_t;
+
+typedef struct {
+	trafficgen_repeater_t *repeater;
+	dmr_timeslot_t ts;
+	trafficgen_slot_state_t state;
+	uint64_t next_packet_at_us;
+
+	dmr_call_type_t calltype;
+	dmr_id_t dst_id;
+	dmr_id_t src_id;
+	uint8_t seqnum;
+	uint8_t voice_frame_num;
+	uint32_t packets_left;
+	uint32_t ambe_pos;
+	vbptc_16_11_t emb_sig_lc_vbptc_storage;
+
+	ipscpacket_payload_raw_t *data_payloads;
+	uint16_t data_payloads_count;
+	uint16_t data_payloads_sent;
+} trafficgen_slot_t;
+
+static trafficgen_repeater_t *trafficgen_repeaters = NULL;
+static trafficgen_slot_t *trafficgen_slots = NULL;
+// Min-heap of the slots ordered by their next packet's time.
+static trafficgen_slot_t **trafficgen_heap = NULL;
+static uint32_t trafficgen_heap_size = 0;
+
+static struct in_addr trafficgen_master_ipaddr;
+static uint8_t trafficgen_master_ethaddr[ETH_ALEN];
+static dmrpacket_payload_voice_bytes_t *trafficgen_ambe = NULL;
+static uint32_t trafficgen_ambe_count = 0;
+static uint32_t trafficgen_max_calls = 0;
+static uint8_t trafficgen_data_percent = 10;
+
+static uint32_t trafficgen_active_calls = 0;
+static uint32_t trafficgen_peak_active_calls = 0;
+static uint32_t trafficgen_delayed_calls = 0;
+static uint32_t trafficgen_voice_calls = 0;
+static uint32_t trafficgen_data_sessions = 0;
+static uint64_t trafficgen_packets = 0;
+static uint64_t trafficgen_csbks = 0;
+static uint64_t trafficgen_bytes = 0;
+
+static const dmr_id_t trafficgen_talkgroups[] = { 1, 2, 9, 91, 216, 2161, 2162, 2163, 2164, 9990 };
+
+static pcap_t *trafficgen_pcap = NULL;
+static pcap_dumper_t *trafficgen_pcap_dumper = NULL;
+static time_t trafficgen_start_time = 1451606400; // 2016-01-01 00:00:00 UTC
+static double trafficgen_speed = 1;
+static struct timespec trafficgen_inject_start;
+// State of the xorshift32 generator. It's used instead of rand(), so the same seed generates the
+// same traffic with every C library.
+static uint32_t trafficgen_rand_state = 1;
+
+static void trafficgen_srand(uint32_t seed) {
+	// Xorshift never leaves the all zero state.
+	trafficgen_rand_state = (seed == 0 ? 0x9e3779b9 : seed);
+}
+
+static uint32_t trafficgen_rand(void) {
+	uint32_t x = trafficgen_rand_state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	trafficgen_rand_state = x;
+	return x;
+}
+
+static uint32_t trafficgen_rand_range(uint32_t min, uint32_t max) {
+	return min + (uint32_t)(((uint64_t)trafficgen_rand() * (max-min+1)) >> 32);
+}
+
+static void trafficgen_heap_push(trafficgen_slot_t *slot) {
+	uint32_t i = trafficgen_heap_size++;
+	uint32_t parent;
+
+	while (i > 0) {
+		parent = (i-1)/2;
+		if (trafficgen_heap[parent]->next_packet_at_us <= slot->next_packet_at_us)
+			break;
+		trafficgen_heap[i] = trafficgen_heap[parent];
+		i = parent;
+	}
+	trafficgen_heap[i] = slot;
+}
+
+static trafficgen_slot_t *trafficgen_heap_pop(void) {
+	trafficgen_slot_t *top = trafficgen_heap[0];
+	trafficgen_slot_t *last = trafficgen_heap[--trafficgen_heap_size];
+	uint32_t i = 0;
+	uint32_t child;
+
+	while ((child = i*2+1) < trafficgen_heap_size) {
+		if (child+1 < trafficgen_heap_size && trafficgen_heap[child+1]->next_packet_at_us < trafficgen_heap[child]->next_packet_at_us)
+			child++;
+		if (last->next_packet_at_us <= trafficgen_heap[child]->next_packet_at_us)
+			break;
+		trafficgen_heap[i] = trafficgen_heap[child];
+		i = child;
+	}
+	if (trafficgen_heap_size > 0)
+		trafficgen_heap[i] = last;
+	return top;
+}
+
+static flag_t trafficgen_output(trafficgen_slot_t *slot, ipscpacket_payload_raw_t *ipscpacket_payload_raw) {
+	uint8_t frame[sizeof(struct ether_header)+sizeof(ipscpacket_raw_t)];
+	struct ether_header *eth_header = (struct ether_header *)frame;
+	ipscpacket_raw_t *ipscpacket_raw;
+	struct pcap_pkthdr pkthdr;
+	struct timespec now;
+	int64_t wait_us;
+
+	ipscpacket_raw = ipscpacket_construct_raw_packet_from_addr(&slot->repeater->ipaddr, &trafficgen_master_ipaddr, ipscpacket_payload_raw);
+	if (ipscpacket_raw == NULL)
+		return 0;
+
+	memcpy(eth_header->ether_dhost, trafficgen_master_ethaddr, ETH_ALEN);
+	memcpy(eth_header->ether_shost, slot->repeater->ethaddr, ETH_ALEN);
+	eth_header->ether_type = htons(ETHERTYPE_IP);
+	memcpy(frame+sizeof(struct ether_header), ipscpacket_raw->bytes, sizeof(ipscpacket_raw_t));
+
+	if (trafficgen_pcap_dumper != NULL) {
+		pkthdr.ts.tv_sec = trafficgen_start_time + slot->next_packet_at_us/1000000;
+		pkthdr.ts.tv_usec = slot->next_packet_at_us % 1000000;
+		pkthdr.caplen = pkthdr.len = sizeof(frame);
+		pcap_dump((u_char *)trafficgen_pcap_dumper, &pkthdr, frame);
+	} else {
+		if (trafficgen_speed > 0) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			wait_us = (int64_t)(slot->next_packet_at_us/trafficgen_speed) -
+				((now.tv_sec-trafficgen_inject_start.tv_sec)*1000000 + (now.tv_nsec-trafficgen_inject_start.tv_nsec)/1000);
+			if (wait_us > 0)
+				usleep(wait_us);
+		}
+		if (pcap_inject(trafficgen_pcap, frame, sizeof(frame)) != sizeof(frame)) {
+			printf("can't inject packet: %s\n", pcap_geterr(trafficgen_pcap));
+			return 0;
+		}
+	}
+
+	trafficgen_packets++;
+	trafficgen_bytes += sizeof(frame);
+	return 1;
+}
+
+static void trafficgen_pick_ids(trafficgen_slot_t *slot) {
+	if (trafficgen_rand_range(0, 99) < TRAFFICGEN_PRIVATE_CALL_PERCENT) {
+		slot->calltype = DMR_CALL_TYPE_PRIVATE;
+		slot->dst_id = trafficgen_rand_range(2160000, 2169999);
+	} else {
+		slot->calltype = DMR_CALL_TYPE_GROUP;
+		slot->dst_id = trafficgen_talkgroups[trafficgen_rand_range(0, sizeof(trafficgen_talkgroups)/sizeof(trafficgen_talkgroups[0])-1)];
+	}
+	// Every slot has it's own source ID, so the same ID can't be active on two repeaters at the same time.
+	slot->src_id = 2160000 + (slot-trafficgen_slots);
+}
+
+static void trafficgen_start_voice_call(trafficgen_slot_t *slot) {
+	dmrpacket_emb_signalling_lc_bits_t *emb_signalling_lc_bits;
+
+	trafficgen_pick_ids(slot);
+	slot->seqnum = 0;
+	slot->voice_frame_num = 2;
+	slot->packets_left = 3;
+	if (trafficgen_ambe_count > 0)
+		slot->ambe_pos = trafficgen_rand_range(0, trafficgen_ambe_count-1);
+	vbptc_16_11_init(&slot->emb_sig_lc_vbptc_storage, 8);
+	emb_signalling_lc_bits = dmrpacket_emb_signalling_lc_interleave(dmrpacket_lc_construct_emb_signalling_lc(slot->calltype, slot->dst_id, slot->src_id));
+	vbptc_16_11_construct(&slot->emb_sig_lc_vbptc_storage, emb_signalling_lc_bits->bits, sizeof(dmrpacket_emb_signalling_lc_bits_t));
+	slot->state = TRAFFICGEN_SLOT_STATE_VOICE_LC_HEADER;
+
+	trafficgen_voice_calls++;
+	trafficgen_active_calls++;
+	if (trafficgen_active_calls > trafficgen_peak_active_calls)
+		trafficgen_peak_active_calls = trafficgen_active_calls;
+}
+
+static void trafficgen_add_data_payload(trafficgen_slot_t *slot, uint8_t seqnum, ipscpacket_slot_type_t slot_type, ipscpacket_payload_t *payload) {
+	ipscpacket_payload_raw_t *ipscpacket_payload_raw;
+
+	ipscpacket_payload_raw = ipscpacket_construct_raw_payload(seqnum, slot->ts, slot_type, slot->calltype, slot->dst_id, slot->src_id, payload);
+	if (ipscpacket_payload_raw != NULL)
+		memcpy(&slot->data_payloads[slot->data_payloads_count++], ipscpacket_payload_raw, sizeof(ipscpacket_payload_raw_t));
+}
+
+// Constructs the same packet sequence as dmr_data_send_sms() and repeaters_send_data_packet().
+static flag_t trafficgen_start_data_session(trafficgen_slot_t *slot) {
+	dmrpacket_data_packet_t data_packet;
+	dmrpacket_data_block_t *data_blocks;
+	dmrpacket_csbk_t csbk;
+	char msg[64];
+	char *utf16le_msg;
+	uint16_t utf16le_msg_length;
+	flag_t confirmed;
+	uint16_t i;
+
+	trafficgen_pick_ids(slot);
+	confirmed = (slot->calltype == DMR_CALL_TYPE_PRIVATE);
+	snprintf(msg, sizeof(msg), "dmrshark-trafficgen sms #%u from %u", trafficgen_data_sessions, slot->src_id);
+
+	utf16le_msg = dmrpacket_data_convertmsg((uint8_t *)msg, strlen(msg), &utf16le_msg_length, DMRPACKET_DATA_HEADER_DD_FORMAT_UTF8, DMRPACKET_DATA_HEADER_DD_FORMAT_UTF16LE, 2);
+	if (utf16le_msg == NULL)
+		return 0;
+	data_packet.data_type = (confirmed ? DMRPACKET_DATA_TYPE_RATE_34_DATA : DMRPACKET_DATA_TYPE_RATE_12_DATA);
+	dmrpacket_data_construct_fragment((uint8_t *)utf16le_msg, utf16le_msg_length, data_packet.data_type, confirmed, &data_packet.fragment);
+	free(utf16le_msg);
+
+	data_packet.header.common.dst_is_a_group = (slot->calltype == DMR_CALL_TYPE_GROUP);
+	data_packet.header.common.response_requested = confirmed;
+	data_packet.header.common.dst_llid = slot->dst_id;
+	data_packet.header.common.src_llid = slot->src_id;
+	data_packet.header.common.data_packet_format = DMRPACKET_DATA_HEADER_DPF_SHORT_DATA_DEFINED;
+	data_packet.header.common.service_access_point = DMRPACKET_DATA_HEADER_SAP_SHORT_DATA;
+	data_packet.header.short_data_defined.appended_blocks = data_packet.fragment.data_blocks_needed;
+	data_packet.header.short_data_defined.dd_format = DMRPACKET_DATA_HEADER_DD_FORMAT_UTF16LE;
+	data_packet.header.short_data_defined.resync = 1;
+	data_packet.header.short_data_defined.full_message = 1;
+	data_packet.header.short_data_defined.bit_padding = (dmrpacket_data_get_block_size(data_packet.data_type, confirmed)*data_packet.fragment.data_blocks_needed-data_packet.fragment.bytes_stored-4)*8;
+
+	data_blocks = dmrpacket_data_construct_data_blocks(&data_packet.fragment, data_packet.data_type, confirmed);
+	if (data_blocks == NULL)
+		return 0;
+
+	slot->data_payloads = (ipscpacket_payload_raw_t *)malloc(sizeof(ipscpacket_payload_raw_t)*(TRAFFICGEN_CSBK_PREAMBLES+2+data_packet.fragment.data_blocks_needed));
+	if (slot->data_payloads == NULL) {
+		free(data_blocks);
+		return 0;
+	}
+	slot->data_payloads_count = slot->data_payloads_sent = 0;
+	slot->seqnum = 0;
+
+	csbk.last_block = 1;
+	csbk.csbko = DMRPACKET_CSBKO_PREAMBLE;
+	csbk.data.preamble.data_follows = 1;
+	csbk.data.preamble.dst_is_group = data_packet.header.common.dst_is_a_group;
+	csbk.data.preamble.csbk_blocks_to_follow = TRAFFICGEN_CSBK_PREAMBLES+data_packet.fragment.data_blocks_needed+1; // +1 - header
+	csbk.dst_id = slot->dst_id;
+	csbk.src_id = slot->src_id;
+	for (i = 0; i < TRAFFICGEN_CSBK_PREAMBLES; i++) {
+		csbk.data.preamble.csbk_blocks_to_follow--;
+		trafficgen_add_data_payload(slot, slot->seqnum++, IPSCPACKET_SLOT_TYPE_CSBK, ipscpacket_construct_payload_csbk(&csbk));
+	}
+	trafficgen_add_data_payload(slot, 0, IPSCPACKET_SLOT_TYPE_IPSC_SYNC, ipscpacket_construct_payload_ipsc_sync(slot->ts, slot->dst_id, slot->src_id));
+	trafficgen_add_data_payload(slot, slot->seqnum++, IPSCPACKET_SLOT_TYPE_DATA_HEADER, ipscpacket_construct_payload_data_header(&data_packet.header));
+	for (i = 0; i < data_packet.fragment.data_blocks_needed; i++) {
+		trafficgen_add_data_payload(slot, slot->seqnum++, ipscpacket_get_slot_type_for_data_type(data_packet.data_type),
+			(data_packet.data_type == DMRPACKET_DATA_TYPE_RATE_34_DATA ? ipscpacket_construct_payload_data_block_rate_34(&data_blocks[i]) : ipscpacket_construct_payload_data_block_rate_12(&data_blocks[i])));
+	}
+	free(data_blocks);
+
+	slot->state = TRAFFICGEN_SLOT_STATE_DATA;
+	trafficgen_data_sessions++;
+	return 1;
+}
+
+static void trafficgen_go_idle(trafficgen_slot_t *slot) {
+	slot->state = TRAFFICGEN_SLOT_STATE_IDLE;
+	slot->next_packet_at_us += trafficgen_rand_range(TRAFFICGEN_MIN_IDLE_US, TRAFFICGEN_MAX_IDLE_US);
+}
+
+static void trafficgen_send_voice_frame(trafficgen_slot_t *slot) {
+	static const ipscpacket_slot_type_t slot_types[] = { IPSCPACKET_SLOT_TYPE_VOICE_DATA_A, IPSCPACKET_SLOT_TYPE_VOICE_DATA_B,
+		IPSCPACKET_SLOT_TYPE_VOICE_DATA_C, IPSCPACKET_SLOT_TYPE_VOICE_DATA_D, IPSCPACKET_SLOT_TYPE_VOICE_DATA_E, IPSCPACKET_SLOT_TYPE_VOICE_DATA_F };
+	dmrpacket_payload_voice_bytes_t voice_bytes;
+	dmrpacket_payload_voice_bits_t voice_bits;
+	ipscpacket_slot_type_t slot_type = slot_types[slot->voice_frame_num];
+	uint8_t i;
+
+	if (trafficgen_ambe_count > 0) {
+		memcpy(&voice_bytes, &trafficgen_ambe[slot->ambe_pos++], sizeof(dmrpacket_payload_voice_bytes_t));
+		if (slot->ambe_pos >= trafficgen_ambe_count)
+			slot->ambe_pos = 0;
+	} else {
+		for (i = 0; i < sizeof(dmrpacket_payload_voice_bytes_t); i++)
+			voice_bytes.bytes[i] = trafficgen_rand() & 0xff;
+	}
+	base_bytestobits(voice_bytes.bytes, sizeof(dmrpacket_payload_voice_bytes_t), voice_bits.raw.bits, sizeof(dmrpacket_payload_voice_bits_t));
+
+	trafficgen_output(slot, ipscpacket_construct_raw_payload(slot->seqnum++, slot->ts, slot_type, slot->calltype, slot->dst_id, slot->src_id,
+		ipscpacket_construct_payload_voice_frame(slot_type, &voice_bits, &slot->emb_sig_lc_vbptc_storage)));
+
+	slot->voice_frame_num++;
+	if (slot->voice_frame_num > 5)
+		slot->voice_frame_num = 0;
+}
+
+// Sends the next packet of the given slot, or starts a new session if it's idle.
+static flag_t trafficgen_process_slot(trafficgen_slot_t *slot) {
+	ipscpacket_payload_raw_t *ipscpacket_payload_raw;
+
+	switch (slot->state) {
+		case TRAFFICGEN_SLOT_STATE_IDLE:
+			if (trafficgen_rand_range(0, 99) < trafficgen_data_percent) {
+				if (!trafficgen_start_data_session(slot))
+					return 0;
+			} else if (trafficgen_max_calls > 0 && trafficgen_active_calls >= trafficgen_max_calls) {
+				trafficgen_delayed_calls++;
+				slot->next_packet_at_us += TRAFFICGEN_CALL_RETRY_US;
+			} else
+				trafficgen_start_voice_call(slot);
+			return 1; // The first packet is sent when the slot gets processed next time.
+		case TRAFFICGEN_SLOT_STATE_VOICE_LC_HEADER:
+			ipscpacket_payload_raw = ipscpacket_construct_raw_payload(slot->seqnum++, slot->ts, IPSCPACKET_SLOT_TYPE_VOICE_LC_HEADER, slot->calltype, slot->dst_id, slot->src_id,
+				ipscpacket_construct_payload_voice_lc_header(slot->calltype, slot->dst_id, slot->src_id));
+			if (!trafficgen_output(slot, ipscpacket_payload_raw))
+				return 0;
+			if (--slot->packets_left == 0) {
+				slot->state = TRAFFICGEN_SLOT_STATE_VOICE;
+				slot->packets_left = trafficgen_rand_range(TRAFFICGEN_MIN_CALL_US, TRAFFICGEN_MAX_CALL_US)/TRAFFICGEN_BURST_INTERVAL_US;
+			}
+			break;
+		case TRAFFICGEN_SLOT_STATE_VOICE:
+			trafficgen_send_voice_frame(slot);
+			if (--slot->packets_left == 0)
+				slot->state = TRAFFICGEN_SLOT_STATE_VOICE_TERMINATOR;
+			break;
+		case TRAFFICGEN_SLOT_STATE_VOICE_TERMINATOR:
+			ipscpacket_payload_raw = ipscpacket_construct_raw_payload(slot->seqnum++, slot->ts, IPSCPACKET_SLOT_TYPE_TERMINATOR_WITH_LC, slot->calltype, slot->dst_id, slot->src_id,
+				ipscpacket_construct_payload_terminator_with_lc(slot->calltype, slot->dst_id, slot->src_id));
+			if (!trafficgen_output(slot, ipscpacket_payload_raw))
+				return 0;
+			vbptc_16_11_clear(&slot->emb_sig_lc_vbptc_storage);
+			trafficgen_active_calls--;
+			trafficgen_go_idle(slot);
+			return 1;
+		case TRAFFICGEN_SLOT_STATE_DATA:
+			if (slot->data_payloads[slot->data_payloads_sent].slot_type == IPSCPACKET_SLOT_TYPE_CSBK)
+				trafficgen_csbks++;
+			if (!trafficgen_output(slot, &slot->data_payloads[slot->data_payloads_sent++]))
+				return 0;
+			if (slot->data_payloads_sent == slot->data_payloads_count) {
+				free(slot->data_payloads);
+				slot->data_payloads = NULL;
+				trafficgen_go_idle(slot);
+				return 1;
+			}
+			break;
+	}
+	slot->next_packet_at_us += TRAFFICGEN_BURST_INTERVAL_US;
+	return 1;
+}
+
+static flag_t trafficgen_load_ambe(char *filename) {
+	FILE *f;
+	long size;
+
+	f = fopen(filename, "r");
+	if (f == NULL) {
+		printf("can't open %s\n", filename);
+		return 0;
+	}
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	trafficgen_ambe_count = size/sizeof(dmrpacket_payload_voice_bytes_t);
+	if (trafficgen_ambe_count == 0) {
+		printf("%s contains no ambe frames\n", filename);
+		fclose(f);
+		return 0;
+	}
+	trafficgen_ambe = (dmrpacket_payload_voice_bytes_t *)malloc(trafficgen_ambe_count*sizeof(dmrpacket_payload_voice_bytes_t));
+	if (trafficgen_ambe == NULL || fread(trafficgen_ambe, sizeof(dmrpacket_payload_voice_bytes_t), trafficgen_ambe_count, f) != trafficgen_ambe_count) {
+		printf("can't read %s\n", filename);
+		fclose(f);
+		return 0;
+	}
+	fclose(f);
+	return 1;
+}
+
+static void trafficgen_print_usage(char *argv0) {
+	printf("usage: %s [-r repeaters] [-c max. simultaneous calls] [-d duration in sec] [-s random seed]\n", argv0);
+	printf("       [-t start time] [-p data session percent] [-a ambe file] [-m master ip]\n");
+	printf("       [-o pcap file] [-i interface] [-x speed]\n");
+}
+
+int main(int argc, char *argv[]) {
+	loglevel_t loglevel = { .raw = 0 };
+	unsigned int seed = 1;
+	uint32_t repeaters_count = 10;
+	uint64_t duration_us = 60*1000000ULL;
+	char *pcap_filename = NULL;
+	char *ifname = NULL;
+	char *ambe_filename = NULL;
+	char *master_ip = "10.0.0.1";
+	char pcap_errbuf[PCAP_ERRBUF_SIZE] = {0,};
+	struct timespec started_at;
+	struct timespec finished_at;
+	double elapsed;
+	trafficgen_slot_t *slot;
+	flag_t result = 1;
+	uint32_t i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "r:c:d:s:t:p:a:m:o:i:x:h")) != -1) {
+		switch (opt) {
+			case 'r': repeaters_count = strtoul(optarg, NULL, 10); break;
+			case 'c': trafficgen_max_calls = strtoul(optarg, NULL, 10); break;
+			case 'd': duration_us = strtoull(optarg, NULL, 10)*1000000; break;
+			case 's': seed = strtoul(optarg, NULL, 10); break;
+			case 't': trafficgen_start_time = strtoull(optarg, NULL, 10); break;
+			case 'p': trafficgen_data_percent = strtoul(optarg, NULL, 10); break;
+			case 'a': ambe_filename = optarg; break;
+			case 'm': master_ip = optarg; break;
+			case 'o': pcap_filename = optarg; break;
+			case 'i': ifname = optarg; break;
+			case 'x': trafficgen_speed = strtod(optarg, NULL); break;
+			default:
+				trafficgen_print_usage(argv[0]);
+				return 1;
+		}
+	}
+	if (repeaters_count == 0 || repeaters_count > TRAFFICGEN_MAX_REPEATERS || trafficgen_data_percent > 100 || trafficgen_speed < 0 ||
+		(pcap_filename == NULL && ifname == NULL) || (pcap_filename != NULL && ifname != NULL)) {
+			trafficgen_print_usage(argv[0]);
+			return 1;
+	}
+	if (inet_aton(master_ip, &trafficgen_master_ipaddr) == 0) {
+		printf("invalid master ip address: %s\n", master_ip);
+		return 1;
+	}
+	if (ambe_filename != NULL && !trafficgen_load_ambe(ambe_filename))
+		return 1;
+
+	// We don't want the coders to log anything.
+	console_set_loglevel(&loglevel);
+	coding_init();
+	trafficgen_srand(seed);
+
+	if (pcap_filename != NULL) {
+		trafficgen_pcap = pcap_open_dead(DLT_EN10MB, 65535);
+		trafficgen_pcap_dumper = pcap_dump_open(trafficgen_pcap, pcap_filename);
+		if (trafficgen_pcap_dumper == NULL) {
+			printf("can't open %s for writing: %s\n", pcap_filename, pcap_geterr(trafficgen_pcap));
+			return 1;
+		}
+	} else {
+		trafficgen_pcap = pcap_open_live(ifname, 65535, 0, 0, pcap_errbuf);
+		if (trafficgen_pcap == NULL) {
+			printf("can't open interface %s: %s\n", ifname, pcap_errbuf);
+			return 1;
+		}
+	}
+
+	trafficgen_repeaters = (trafficgen_repeater_t *)calloc(repeaters_count, sizeof(trafficgen_repeater_t));
+	trafficgen_slots = (trafficgen_slot_t *)calloc(repeaters_count*2, sizeof(trafficgen_slot_t));
+	trafficgen_heap = (trafficgen_slot_t **)calloc(repeaters_count*2, sizeof(trafficgen_slot_t *));
+	if (trafficgen_repeaters == NULL || trafficgen_slots == NULL || trafficgen_heap == NULL) {
+		printf("can't allocate memory for %u repeaters\n", repeaters_count);
+		return 1;
+	}
+
+	// Locally administered MAC addresses are derived from the IP addresses.
+	trafficgen_master_ethaddr[0] = 0x02;
+	memcpy(&trafficgen_master_ethaddr[2], &trafficgen_master_ipaddr, sizeof(struct in_addr));
+	for (i = 0; i < repeaters_count; i++) {
+		trafficgen_repeaters[i].ipaddr.s_addr = htonl((10 << 24) | (1 << 16) | ((i/250) << 8) | (i%250+1));
+		trafficgen_repeaters[i].ethaddr[0] = 0x02;
+		memcpy(&trafficgen_repeaters[i].ethaddr[2], &trafficgen_repeaters[i].ipaddr, sizeof(struct in_addr));
+
+		trafficgen_slots[i*2].repeater = trafficgen_slots[i*2+1].repeater = &trafficgen_repeaters[i];
+		trafficgen_slots[i*2].ts = 0;
+		trafficgen_slots[i*2+1].ts = 1;
+	}
+	// Slots start their first session at a random time, so the calls don't start at the same time.
+	for (i = 0; i < repeaters_count*2; i++) {
+		trafficgen_slots[i].next_packet_at_us = trafficgen_rand_range(0, TRAFFICGEN_MAX_IDLE_US);
+		trafficgen_heap_push(&trafficgen_slots[i]);
+	}
+
+	printf("generating %.0f seconds of traffic of %u repeaters to %s\n", duration_us/1000000.0, repeaters_count, (pcap_filename != NULL ? pcap_filename : ifname));
+	clock_gettime(CLOCK_MONOTONIC, &started_at);
+	trafficgen_inject_start = started_at;
+
+	while (trafficgen_heap[0]->next_packet_at_us < duration_us) {
+		slot = trafficgen_heap_pop();
+		if (!trafficgen_process_slot(slot)) {
+			result = 0;
+			break;
+		}
+		trafficgen_heap_push(slot);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &finished_at);
+	elapsed = (finished_at.tv_sec-started_at.tv_sec) + (finished_at.tv_nsec-started_at.tv_nsec)/1000000000.0;
+
+	printf("  packets: %llu (%llu bytes, %.0f packets/sec simulated, %.0f packets/sec generated)\n", (unsigned long long)trafficgen_packets,
+		(unsigned long long)trafficgen_bytes, trafficgen_packets/(duration_us/1000000.0), (elapsed > 0 ? trafficgen_packets/elapsed : 0));
+	printf("  voice calls: %u (peak simultaneous: %u, delayed by the limit: %u)\n", trafficgen_voice_calls, trafficgen_peak_active_calls, trafficgen_delayed_calls);
+	printf("  data sessions: %u (%llu csbks)\n", trafficgen_data_sessions, (unsigned long long)trafficgen_csbks);
+
+	for (i = 0; i < repeaters_count*2; i++)
+		free(trafficgen_slots[i].data_payloads);
+	free(trafficgen_heap);
+	free(trafficgen_slots);
+	free(trafficgen_repeaters);
+	free(trafficgen_ambe);
+	if (trafficgen_pcap_dumper != NULL)
+		pcap_dump_close(trafficgen_pcap_dumper);
+	pcap_close(trafficgen_pcap);
+
+	return !result;
+}
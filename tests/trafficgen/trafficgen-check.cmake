@@ -0,0 +1,32 @@
+# Generates traffic with TRAFFICGEN twice with the same seed and checks that the pcap files are
+# identical, and that the first one has EXPECTED_PACKETS packets and EXPECTED_SHA256 hash.
+
+foreach(run 1 2)
+	file(REMOVE ${OUTPUT}.${run})
+	execute_process(COMMAND ${TRAFFICGEN} -r 5 -d 30 -s 1 -o ${OUTPUT}.${run}
+		RESULT_VARIABLE result OUTPUT_VARIABLE output)
+	if(NOT result EQUAL 0)
+		message(FATAL_ERROR "running ${TRAFFICGEN} failed")
+	endif()
+	if(run EQUAL 1)
+		set(first_output "${output}")
+	endif()
+endforeach()
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${OUTPUT}.1 ${OUTPUT}.2
+	RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+	message(FATAL_ERROR "the same seed generated different traffic")
+endif()
+
+if(NOT first_output MATCHES "packets: ([0-9]+) ")
+	message(FATAL_ERROR "the generated packet count is missing from the output:\n${first_output}")
+endif()
+if(NOT CMAKE_MATCH_1 EQUAL EXPECTED_PACKETS)
+	message(FATAL_ERROR "generated ${CMAKE_MATCH_1} packets instead of ${EXPECTED_PACKETS}")
+endif()
+
+file(SHA256 ${OUTPUT}.1 hash)
+if(NOT hash STREQUAL EXPECTED_SHA256)
+	message(FATAL_ERROR "the generated pcap's hash is ${hash} instead of ${EXPECTED_SHA256}")
+endif()
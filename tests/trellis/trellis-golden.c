@@ -0,0 +1,273 @@
+// Decodes all rate 3/4 data blocks found in the given pcap files, re-encodes them
+// and compares the results with the given golden file. Every block is also decoded
+// with 1, 2 and TRELLIS_GOLDEN_UNCORRECTABLE_ERRORS injected bit errors, and the
+// results are compared with the error free decoding. The errors are injected into
+// constellation points which are spread evenly in the trellis, so 1 and 2 bit errors
+// must be corrected with a path metric equal to the number of injected errors.
+// Usage: test-trellis-golden [golden file] [pcap files...]
+// If the golden file is "-", the results are only printed.
+
+#include <libs/coding/trellis.h>
+#include <libs/daemon/console.h>
+
+#include <pcap/pcap.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <libgen.h>
+
+#define IPSC_SLOT_TYPE_RATE_34_DATA		0x6666
+#define IPSC_PAYLOAD_OFFSET				26
+#define IPSC_PAYLOAD_SIZE				34
+
+#define TRELLIS_GOLDEN_UNCORRECTABLE_ERRORS	24
+
+static uint8_t injected_errors_counts[] = { 1, 2, TRELLIS_GOLDEN_UNCORRECTABLE_ERRORS };
+
+// The trellis coder logs to the console, we don't need it here.
+loglevel_t console_get_loglevel(void) {
+	loglevel_t loglevel = { .raw = 0 };
+	return loglevel;
+}
+
+void console_log(const char *format, ...) {
+}
+
+static void bytestobits(uint8_t *bytes, uint16_t bytes_length, flag_t *bits) {
+	uint16_t i;
+
+	for (i = 0; i < bytes_length*8; i++)
+		bits[i] = (bytes[i/8] >> (7-i%8)) & 1;
+}
+
+static uint8_t *get_ipsc_payload(const uint8_t *packet, uint32_t packet_length, int datalink) {
+	uint16_t udp_length;
+	uint8_t ip_header_length;
+
+	switch (datalink) {
+		case DLT_EN10MB: packet += 14; packet_length -= 14; break;
+		case DLT_LINUX_SLL: packet += 16; packet_length -= 16; break;
+		default: break;
+	}
+
+	if (packet_length < 20 || (packet[0] >> 4) != 4 || packet[9] != 17) // Not an IPv4 UDP packet.
+		return NULL;
+
+	ip_header_length = (packet[0] & 0x0f)*4;
+	if (packet_length < ip_header_length+8)
+		return NULL;
+
+	udp_length = (packet[ip_header_length+4] << 8 | packet[ip_header_length+5])-8;
+	if ((udp_length != 72 && udp_length != 103) || packet_length < ip_header_length+8+udp_length)
+		return NULL;
+
+	return (uint8_t *)packet+ip_header_length+8;
+}
+
+static void get_info_bits(uint8_t *ipsc_payload, dmrpacket_payload_info_bits_t *info_bits) {
+	uint8_t payload[IPSC_PAYLOAD_SIZE];
+	flag_t payload_bits[(IPSC_PAYLOAD_SIZE-1)*8];
+	uint8_t i;
+
+	// Swapping the payload bytes, see ipscpacket_decode().
+	for (i = 0; i < IPSC_PAYLOAD_SIZE; i += 2) {
+		payload[i] = ipsc_payload[IPSC_PAYLOAD_OFFSET+i+1];
+		payload[i+1] = ipsc_payload[IPSC_PAYLOAD_OFFSET+i];
+	}
+	bytestobits(payload, IPSC_PAYLOAD_SIZE-1, payload_bits);
+
+	memcpy(info_bits->bits, payload_bits, 98);
+	memcpy(info_bits->bits+98, payload_bits+98+10+48+10, 98);
+}
+
+static int decode(dmrpacket_payload_info_bits_t *info_bits, dmrpacket_data_binary_t *binary, uint16_t *path_metric) {
+	trellis_tribits_t *tribits;
+
+	tribits = trellis_extract_tribits(trellis_getconstellationpoints(trellis_deinterleave_dibits(trellis_extract_dibits(info_bits))), path_metric);
+	if (tribits == NULL)
+		return 0;
+
+	memcpy(binary, trellis_extract_binary(tribits), sizeof(dmrpacket_data_binary_t));
+	return 1;
+}
+
+static int print_data(char *result, uint16_t result_size, dmrpacket_data_binary_t *binary) {
+	int pos = 0;
+	uint8_t i;
+
+	for (i = 0; i < 144; i += 8) {
+		pos += snprintf(result+pos, result_size-pos, "%.2x", binary->bits[i] << 7 | binary->bits[i+1] << 6 | binary->bits[i+2] << 5 | binary->bits[i+3] << 4 |
+			binary->bits[i+4] << 3 | binary->bits[i+5] << 2 | binary->bits[i+6] << 1 | binary->bits[i+7]);
+	}
+	return pos;
+}
+
+static int process_block(char *result, uint16_t result_size, dmrpacket_payload_info_bits_t *info_bits, dmrpacket_data_binary_t *binary) {
+	dmrpacket_payload_info_bits_t *reconstructed_info_bits;
+	uint16_t path_metric;
+	int pos;
+
+	if (!decode(info_bits, binary, &path_metric))
+		return 0;
+
+	pos = snprintf(result, result_size, "metric %u data ", path_metric);
+	pos += print_data(result+pos, result_size-pos, binary);
+
+	reconstructed_info_bits = trellis_construct_payload_info_bits(trellis_interleave_dibits(trellis_construct_deinterleaved_dibits(
+		trellis_construct_constellationpoints(trellis_construct_tribits(binary)))));
+	snprintf(result+pos, result_size-pos, " reencode %s", (memcmp(reconstructed_info_bits, info_bits, sizeof(dmrpacket_payload_info_bits_t)) == 0 ? "ok" : "differs"));
+
+	return 1;
+}
+
+// Returns the position of the given deinterleaved dibit in the interleaved dibits.
+static uint8_t get_interleaved_dibit_index(uint8_t deinterleaved_index) {
+	trellis_dibits_t dibits;
+	trellis_dibits_t *interleaved_dibits;
+	uint8_t i;
+
+	memset(dibits.dibits, 1, sizeof(dibits.dibits));
+	dibits.dibits[deinterleaved_index] = -3;
+	interleaved_dibits = trellis_interleave_dibits(&dibits);
+	for (i = 0; i < 98; i++) {
+		if (interleaved_dibits->dibits[i] == -3)
+			break;
+	}
+	return i;
+}
+
+// Flips one bit in errors_count constellation points spread evenly over the block, and
+// decodes the result. Returns 0 if the decoding failed, -1 if a correctable error count
+// was not corrected properly.
+static int process_block_with_errors(char *result, uint16_t result_size, dmrpacket_payload_info_bits_t *info_bits,
+	uint16_t block_nr, uint8_t errors_count, dmrpacket_data_binary_t *expected_binary) {
+
+	dmrpacket_payload_info_bits_t corrupted_info_bits;
+	dmrpacket_data_binary_t binary;
+	uint16_t path_metric;
+	flag_t corrected;
+	uint8_t constellationpoint;
+	uint8_t i;
+	int pos;
+
+	memcpy(&corrupted_info_bits, info_bits, sizeof(dmrpacket_payload_info_bits_t));
+	for (i = 0; i < errors_count; i++) {
+		constellationpoint = (block_nr+i*48/errors_count) % 48;
+		// Flipping the first or the second bit of the constellation point's first dibit.
+		corrupted_info_bits.bits[get_interleaved_dibit_index(constellationpoint*2)*2+(block_nr+i)%2] ^= 1;
+	}
+
+	if (!decode(&corrupted_info_bits, &binary, &path_metric))
+		return 0;
+
+	corrected = (memcmp(&binary, expected_binary, sizeof(dmrpacket_data_binary_t)) == 0);
+	pos = snprintf(result, result_size, "errors %u metric %u data ", errors_count, path_metric);
+	pos += print_data(result+pos, result_size-pos, &binary);
+	snprintf(result+pos, result_size-pos, " %s", (corrected ? "corrected" : "not corrected"));
+
+	if (errors_count < TRELLIS_GOLDEN_UNCORRECTABLE_ERRORS && (!corrected || path_metric != errors_count))
+		return -1;
+	return 1;
+}
+
+static int check_result(FILE *golden, char *result) {
+	char golden_line[256];
+
+	if (golden == NULL) {
+		printf("%s\n", result);
+		return 0;
+	}
+
+	if (fgets(golden_line, sizeof(golden_line), golden) == NULL)
+		golden_line[0] = 0;
+	golden_line[strcspn(golden_line, "\n")] = 0;
+	if (strcmp(golden_line, result) != 0) {
+		printf("mismatch:\n  expected: %s\n  got:      %s\n", golden_line, result);
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	FILE *golden = NULL;
+	char golden_line[256];
+	char result[256];
+	uint16_t result_length;
+	char errbuf[PCAP_ERRBUF_SIZE];
+	pcap_t *pcap;
+	struct pcap_pkthdr pkthdr;
+	const uint8_t *packet;
+	uint8_t *ipsc_payload;
+	dmrpacket_payload_info_bits_t info_bits;
+	dmrpacket_data_binary_t binary;
+	uint16_t block_nr;
+	int errors = 0;
+	int blocks = 0;
+	int i;
+	int j;
+	int res;
+
+	if (argc < 3) {
+		printf("usage: %s [golden file] [pcap files...]\n", argv[0]);
+		return 1;
+	}
+
+	if (strcmp(argv[1], "-") != 0) {
+		golden = fopen(argv[1], "r");
+		if (golden == NULL) {
+			printf("can't open golden file %s\n", argv[1]);
+			return 1;
+		}
+	}
+
+	for (i = 2; i < argc; i++) {
+		pcap = pcap_open_offline(argv[i], errbuf);
+		if (pcap == NULL) {
+			printf("can't open pcap file %s: %s\n", argv[i], errbuf);
+			return 1;
+		}
+
+		block_nr = 0;
+		while ((packet = pcap_next(pcap, &pkthdr)) != NULL) {
+			ipsc_payload = get_ipsc_payload(packet, pkthdr.caplen, pcap_datalink(pcap));
+			if (ipsc_payload == NULL || (ipsc_payload[18] | ipsc_payload[19] << 8) != IPSC_SLOT_TYPE_RATE_34_DATA)
+				continue;
+
+			get_info_bits(ipsc_payload, &info_bits);
+			blocks++;
+
+			result_length = snprintf(result, sizeof(result), "%s #%u ", basename(argv[i]), block_nr);
+			if (!process_block(result+result_length, sizeof(result)-result_length, &info_bits, &binary)) {
+				strncat(result, "decode failed", sizeof(result)-result_length-1);
+				errors += check_result(golden, result);
+				block_nr++;
+				continue;
+			}
+			errors += check_result(golden, result);
+
+			for (j = 0; j < sizeof(injected_errors_counts); j++) {
+				res = process_block_with_errors(result+result_length, sizeof(result)-result_length, &info_bits, block_nr, injected_errors_counts[j], &binary);
+				if (res == 0)
+					strncat(result, "decode failed", sizeof(result)-result_length-1);
+				errors += check_result(golden, result);
+				if (res < 0) {
+					printf("%s: %u bit errors were not corrected properly\n", result, injected_errors_counts[j]);
+					errors++;
+				}
+			}
+			block_nr++;
+		}
+		pcap_close(pcap);
+	}
+
+	if (golden) {
+		if (fgets(golden_line, sizeof(golden_line), golden) != NULL) {
+			printf("golden file has more entries than the decoded blocks\n");
+			errors++;
+		}
+		fclose(golden);
+		printf("%u blocks checked, %u mismatches\n", blocks, errors);
+	}
+
+	return (errors > 0);
+}
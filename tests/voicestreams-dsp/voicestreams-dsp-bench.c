@@ -0,0 +1,160 @@
+// Compares the vectorized gain, clipping, mixing and RMS sum of squares kernels of every instruction
+// set supported by the CPU with the previous per-sample implementation, and measures their speed.
+// Usage: test-voicestreams-dsp-bench [iterations]
+
+#include <libs/voicestreams/voicestreams-dsp.h>
+#include <libs/voicestreams/voicestreams.h>
+#include <libs/daemon/console.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define FRAMES_COUNT		25
+#define RMS_MIN_SAMPLE_VALUE	0.0001f
+
+// The voicestreams lib logs to the console, we don't need it here.
+loglevel_t console_get_loglevel(void) {
+	loglevel_t loglevel = { .raw = 0 };
+	return loglevel;
+}
+
+void console_log(const char *format, ...) {
+}
+
+static void ref_apply_gain(float *samples) {
+	uint8_t i;
+
+	for (i = 0; i < VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT; i++) {
+		samples[i] *= 15.0;
+
+		// Clipping
+		if (samples[i] > 1.0f)
+			samples[i] = 1.0f;
+		else if (samples[i] < -1.0f)
+			samples[i] = -1.0f;
+	}
+}
+
+static float ref_sum_of_squares(float *samples, uint16_t count, uint16_t *elements) {
+	uint16_t i;
+	float sum = 0;
+
+	for (i = 0; i < count; i++) {
+		if (fabsf(samples[i]) > RMS_MIN_SAMPLE_VALUE) {
+			sum += samples[i]*samples[i];
+			(*elements)++;
+		}
+	}
+	return sum;
+}
+
+static double get_time_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1e9+ts.tv_nsec;
+}
+
+// Generates mbelib-like output with silent parts, so both the clipping and the RMS threshold is hit.
+static void generate_samples(float *samples, uint16_t count) {
+	uint16_t i;
+
+	for (i = 0; i < count; i++) {
+		if ((i/VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT) % 5 == 4)
+			samples[i] = 0;
+		else
+			samples[i] = (rand() % 65535)-32767;
+	}
+}
+
+static int bench(voicestreams_dsp_isa_t isa, float *input, unsigned long iterations) {
+	static float ref_samples[VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT*FRAMES_COUNT];
+	static float samples[VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT*FRAMES_COUNT];
+	uint16_t ref_elements = 0;
+	uint16_t elements = 0;
+	float ref_sum = 0;
+	float sum = 0;
+	double start, ref_ns, ns;
+	unsigned long i;
+	uint16_t j;
+	volatile float sink = 0;
+	int mismatches = 0;
+
+	memcpy(ref_samples, input, sizeof(ref_samples));
+	memcpy(samples, input, sizeof(samples));
+	for (j = 0; j < FRAMES_COUNT; j++) {
+		// Previous implementation: divide, then gain and clip, then copying to the 0.5 sec. RMS buffer.
+		for (i = 0; i < VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT; i++)
+			ref_samples[j*VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT+i] /= 32767.0;
+		ref_apply_gain(&ref_samples[j*VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT]);
+
+		voicestreams_dsp_scale(&samples[j*VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT], VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT, 1.0f/32767.0f);
+		voicestreams_dsp_scale_and_clip(&samples[j*VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT], VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT, 15.0f);
+		sum += voicestreams_dsp_sum_of_squares_above(&samples[j*VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT], VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT, RMS_MIN_SAMPLE_VALUE, &elements);
+	}
+	ref_sum = ref_sum_of_squares(ref_samples, VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT*FRAMES_COUNT, &ref_elements);
+
+	// Multiplying with the reciprocal instead of dividing may differ in the last bit.
+	for (i = 0; i < VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT*FRAMES_COUNT; i++) {
+		if (fabsf(ref_samples[i]-samples[i]) > 1e-6f)
+			mismatches++;
+	}
+	if (ref_elements != elements || fabsf(ref_sum-sum) > ref_sum*1e-4f)
+		mismatches++;
+
+	// Mixing two frames.
+	voicestreams_dsp_add(samples, &samples[VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT], VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT);
+	for (i = 0; i < VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT; i++) {
+		if (fabsf(ref_samples[i]+ref_samples[VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT+i]-samples[i]) > 2e-6f)
+			mismatches++;
+	}
+
+	start = get_time_ns();
+	for (i = 0; i < iterations; i++) {
+		j = i % FRAMES_COUNT;
+		ref_apply_gain(&ref_samples[j*VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT]);
+		ref_elements = 0;
+		sink += ref_sum_of_squares(&ref_samples[j*VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT], VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT, &ref_elements);
+	}
+	ref_ns = (get_time_ns()-start)/iterations;
+
+	start = get_time_ns();
+	for (i = 0; i < iterations; i++) {
+		j = i % FRAMES_COUNT;
+		voicestreams_dsp_scale_and_clip(&samples[j*VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT], VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT, 15.0f);
+		elements = 0;
+		sink += voicestreams_dsp_sum_of_squares_above(&samples[j*VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT], VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT, RMS_MIN_SAMPLE_VALUE, &elements);
+	}
+	ns = (get_time_ns()-start)/iterations;
+
+	printf("%s: gain+clip+rms per frame previous %.1f ns, %s %.1f ns (%.1fx), %u mismatches\n",
+		voicestreams_dsp_get_readable_isa(isa), ref_ns, voicestreams_dsp_get_readable_isa(isa), ns, ref_ns/ns, mismatches);
+
+	return mismatches;
+}
+
+int main(int argc, char *argv[]) {
+	static float input[VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT*FRAMES_COUNT];
+	unsigned long iterations = 1000000;
+	voicestreams_dsp_isa_t isa;
+	int mismatches = 0;
+
+	if (argc > 1)
+		iterations = strtoul(argv[1], NULL, 10);
+
+	srand(1);
+	generate_samples(input, VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT*FRAMES_COUNT);
+
+	for (isa = VOICESTREAMS_DSP_ISA_SCALAR; isa < VOICESTREAMS_DSP_ISA_COUNT; isa++) {
+		if (!voicestreams_dsp_set_isa(isa)) {
+			printf("%s: not supported by the cpu\n", voicestreams_dsp_get_readable_isa(isa));
+			continue;
+		}
+		mismatches += bench(isa, input, iterations);
+	}
+
+	return (mismatches > 0);
+}
@@ -0,0 +1,141 @@
+// Checks the PCM16, G.711 mu-law and A-law encoding of voicestreams-pcm.c against the code values
+// of the G.711 reference implementation (Sun's g711.c), including the clipping of out of range float
+// samples, the mu-law clip level, the segment boundaries, and the codes of the smallest positive and
+// negative samples.
+// Usage: test-voicestreams-pcm
+
+#include <libs/voicestreams/voicestreams-pcm.h>
+#include <libs/daemon/console.h>
+
+#include <stdio.h>
+#include <string.h>
+
+// Float sample which is converted to the given 16 bit sample.
+#define SAMPLE(pcm)		((pcm)/32767.0f)
+
+typedef struct {
+	float sample;
+	int16_t pcm;
+	uint8_t ulaw;
+	uint8_t alaw;
+} testcase_t;
+
+static const testcase_t testcases[] = {
+	{ SAMPLE(0), 0, 0xff, 0xd5 },
+	{ SAMPLE(1), 1, 0xff, 0xd5 },
+	{ SAMPLE(-1), -1, 0x7e, 0x55 },
+	{ SAMPLE(3), 3, 0xff, 0xd5 },
+	{ SAMPLE(-3), -3, 0x7e, 0x55 },
+	{ SAMPLE(4), 4, 0xfe, 0xd5 },
+	{ SAMPLE(-4), -4, 0x7e, 0x55 },
+	{ SAMPLE(8), 8, 0xfe, 0xd5 },
+	{ SAMPLE(-8), -8, 0x7e, 0x55 },
+	{ SAMPLE(9), 9, 0xfe, 0xd5 },
+	{ SAMPLE(-9), -9, 0x7d, 0x55 },
+	{ SAMPLE(63), 63, 0xf7, 0xd6 },
+	{ SAMPLE(-63), -63, 0x77, 0x56 },
+	{ SAMPLE(64), 64, 0xf7, 0xd1 },
+	{ SAMPLE(-64), -64, 0x77, 0x56 },
+	{ SAMPLE(255), 255, 0xe7, 0xda },
+	{ SAMPLE(-255), -255, 0x67, 0x5a },
+	{ SAMPLE(256), 256, 0xe7, 0xc5 },
+	{ SAMPLE(-256), -256, 0x67, 0x5a },
+	{ SAMPLE(1000), 1000, 0xce, 0xfa },
+	{ SAMPLE(-1000), -1000, 0x4e, 0x7a },
+	{ SAMPLE(4095), 4095, 0xaf, 0x9a },
+	{ SAMPLE(-4096), -4096, 0x2f, 0x1a },
+	{ SAMPLE(8158), 8158, 0x9f, 0x8a },
+	{ SAMPLE(-8159), -8159, 0x1f, 0x0a },
+	{ SAMPLE(16383), 16383, 0x8f, 0xba },
+	{ SAMPLE(-16384), -16384, 0x0f, 0x3a },
+	{ SAMPLE(30000), 30000, 0x82, 0xa8 },
+	{ SAMPLE(-30000), -30000, 0x02, 0x28 },
+	// Samples above the mu-law clip level.
+	{ SAMPLE(32123), 32123, 0x80, 0xaa },
+	{ SAMPLE(-32124), -32124, 0x00, 0x2a },
+	{ SAMPLE(32636), 32636, 0x80, 0xaa },
+	{ SAMPLE(-32637), -32637, 0x00, 0x2a },
+	{ SAMPLE(32767), 32767, 0x80, 0xaa },
+	{ SAMPLE(-32767), -32767, 0x00, 0x2a },
+	// Float samples out of the -1..1 range are clipped.
+	{ 1.0f, 32767, 0x80, 0xaa },
+	{ 1.5f, 32767, 0x80, 0xaa },
+	{ -1.0f, -32767, 0x00, 0x2a },
+	{ -1.5f, -32767, 0x00, 0x2a }
+};
+
+#define TESTCASES_COUNT		(sizeof(testcases)/sizeof(testcases[0]))
+
+// The voicestreams lib logs to the console, we don't need it here.
+loglevel_t console_get_loglevel(void) {
+	loglevel_t loglevel = { .raw = 0 };
+	return loglevel;
+}
+
+void console_log(const char *format, ...) {
+}
+
+// Encodes all test cases in one frame (repeating them to fill the frame) with the given format.
+static voicestreams_pcm_frame_t *encode(voicestreams_format_t format, voicestreams_pcm_frame_t *pcmframe) {
+	voicestreams_decoded_frame_t decoded_frame;
+	uint16_t i;
+
+	for (i = 0; i < VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT; i++)
+		decoded_frame.samples[i] = testcases[i % TESTCASES_COUNT].sample;
+
+	memset(pcmframe, 0, sizeof(voicestreams_pcm_frame_t));
+	return voicestreams_pcm_encode_r(format, &decoded_frame, pcmframe);
+}
+
+int main(int argc, char *argv[]) {
+	voicestreams_pcm_frame_t pcmframe;
+	const testcase_t *testcase;
+	int16_t pcm;
+	int mismatches = 0;
+	uint16_t i;
+
+	if (encode(VOICESTREAMS_FORMAT_PCM16, &pcmframe) == NULL || pcmframe.bytes_size != VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT*2) {
+		printf("pcm16: encoding failed\n");
+		return 1;
+	}
+	for (i = 0; i < VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT; i++) {
+		testcase = &testcases[i % TESTCASES_COUNT];
+		pcm = (int16_t)(pcmframe.bytes[i*2] | (pcmframe.bytes[i*2+1] << 8));
+		if (pcm != testcase->pcm) {
+			printf("pcm16: sample %f encoded to %d instead of %d\n", testcase->sample, pcm, testcase->pcm);
+			mismatches++;
+		}
+	}
+
+	if (encode(VOICESTREAMS_FORMAT_ULAW, &pcmframe) == NULL || pcmframe.bytes_size != VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT) {
+		printf("ulaw: encoding failed\n");
+		return 1;
+	}
+	for (i = 0; i < VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT; i++) {
+		testcase = &testcases[i % TESTCASES_COUNT];
+		if (pcmframe.bytes[i] != testcase->ulaw) {
+			printf("ulaw: sample %d encoded to 0x%.2x instead of 0x%.2x\n", testcase->pcm, pcmframe.bytes[i], testcase->ulaw);
+			mismatches++;
+		}
+	}
+
+	if (encode(VOICESTREAMS_FORMAT_ALAW, &pcmframe) == NULL || pcmframe.bytes_size != VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT) {
+		printf("alaw: encoding failed\n");
+		return 1;
+	}
+	for (i = 0; i < VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT; i++) {
+		testcase = &testcases[i % TESTCASES_COUNT];
+		if (pcmframe.bytes[i] != testcase->alaw) {
+			printf("alaw: sample %d encoded to 0x%.2x instead of 0x%.2x\n", testcase->pcm, pcmframe.bytes[i], testcase->alaw);
+			mismatches++;
+		}
+	}
+
+	if (encode(VOICESTREAMS_FORMAT_MP3, &pcmframe) != NULL) {
+		printf("mp3: encoding should fail\n");
+		mismatches++;
+	}
+
+	printf("%u samples checked, mismatches: %d\n", VOICESTREAMS_DECODED_AMBE_FRAME_SAMPLES_COUNT, mismatches);
+	return (mismatches > 0);
+}